@@ -1,6 +1,8 @@
 #pragma once
 #include "Helper.h"
 
+// One primary command buffer per frame, each allocated from its own transient pool so a frame can be
+// reset and re-recorded as a whole without touching the others
 class CommandBuffer
 {
 public:
@@ -9,8 +11,10 @@ public:
 
 	void Finalize();
 
-	void Init(VkDevice device, uint32_t swapCount, VkCommandPool commandPool);
+	void Init(VkDevice device, uint32_t frameCount, uint32_t queueFamilyIndex);
 
+	// The GPU must be done with the previous submission of this frame
+	void Reset(uint32_t index);
 	void Begin(uint32_t index);
 	void End(uint32_t index);
 
@@ -18,7 +22,6 @@ public:
 
 private:
 	VkDevice m_Device;
-	VkCommandPool m_CommandPool;
+	std::vector<VkCommandPool> m_CommandPools;
 	std::vector<VkCommandBuffer> m_CommandBuffers;
 };
-
@@ -0,0 +1,84 @@
+#pragma once
+#include "Helper.h"
+#include "GraphicSystem.h"
+
+// std140 mirror of DeferredUniformBufferObject in Shader/tiled_lighting.comp
+struct DeferredUniform
+{
+	glm::mat4 invViewProjMtx;
+	glm::vec4 cameraPos;
+	glm::vec4 projParams; // x : P00, y : P11, z : P22, w : P32 of the projection, view depth = w / (depth + z)
+};
+
+// Tiled deferred path. Opaque and masked objects write their material into the G-buffer with Shader/gbuffer.frag,
+// Shader/tiled_lighting.comp then culls the frame's lights per 16x16 tile and shades every pixel once, however many
+// surfaces were drawn over it. The lit, tone mapped image is copied onto the swapchain by a fullscreen triangle and
+// blended objects are drawn forward on top, testing against the G-buffer pass's depth.
+// The G-buffer and the lit image are shared by all frames in flight like the depth buffer, the passes are ordered on the queue.
+// They are sampled by the compute pass, so none of them can be a transient attachment
+class DeferredRenderer
+{
+public:
+	DeferredRenderer();
+	~DeferredRenderer();
+
+	// False when a shader is missing, nothing is kept then
+	bool Init(GraphicSystem* pGraphicSystem);
+	void Finalize();
+
+	// Between FrameContext::BeginFrame and Submit, after LightManager::UpdateUniform
+	void Update(uint32_t frameIndex);
+
+	// Begins GraphicSystem::GetGBufferRenderPass on the G-buffer framebuffer, set 0 (lights) has to be bound for the draws
+	void BeginGBufferPass(VkCommandBuffer commandBuffer, VkSubpassContents contents);
+	// After the G-buffer pass, outside of a render pass. Depth is sampled in between and handed back in
+	// DEPTH_STENCIL_ATTACHMENT_OPTIMAL for the composite pass
+	void RecordLighting(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+	// First draw inside GraphicSystem::GetCompositeRenderPass, covers every pixel
+	void RecordComposite(VkCommandBuffer commandBuffer);
+
+	VkFramebuffer GetGBufferFramebuffer()
+	{
+		return m_GBufferFramebuffer;
+	}
+
+private:
+	bool CreateTargets();
+	void CreateDescriptors();
+	bool CreatePipelines();
+
+	GraphicSystem* m_pGraphicSystem = nullptr;
+	VkDevice m_Device = VK_NULL_HANDLE;
+	VkExtent2D m_Extent = {};
+
+	VkShaderModule m_LightingShaderModule = VK_NULL_HANDLE;
+	VkShaderModule m_CompositeVertexShaderModule = VK_NULL_HANDLE;
+	VkShaderModule m_CompositeFragmentShaderModule = VK_NULL_HANDLE;
+	// Not used here, Models build the G-buffer pipelines from it. Acquired so the path is refused when it is missing
+	VkShaderModule m_GBufferShaderModule = VK_NULL_HANDLE;
+
+	// In GBufferAttachment order
+	std::vector<VkImage> m_GBufferImages;
+	std::vector<MemoryAllocation> m_GBufferImageMemories;
+	std::vector<VkImageView> m_GBufferImageViews;
+	VkFramebuffer m_GBufferFramebuffer = VK_NULL_HANDLE;
+	VkImage m_LitImage = VK_NULL_HANDLE;
+	MemoryAllocation m_LitImageMemory;
+	VkImageView m_LitImageView = VK_NULL_HANDLE;
+	// Only texelFetch reads through it
+	VkSampler m_Sampler = VK_NULL_HANDLE;
+
+	UniformSlot m_UniformSlot;
+	DeferredUniform m_UniformData;
+
+	VkDescriptorSetLayout m_LightingDescriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorSetLayout m_CompositeDescriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool m_DescriptorPool = VK_NULL_HANDLE;
+	// One per frame, each points at that frame's uniform copy
+	std::vector<VkDescriptorSet> m_LightingDescriptorSets;
+	VkDescriptorSet m_CompositeDescriptorSet = VK_NULL_HANDLE;
+	VkPipelineLayout m_LightingPipelineLayout = VK_NULL_HANDLE;
+	VkPipelineLayout m_CompositePipelineLayout = VK_NULL_HANDLE;
+	VkPipeline m_LightingPipeline = VK_NULL_HANDLE;
+	VkPipeline m_CompositePipeline = VK_NULL_HANDLE;
+};
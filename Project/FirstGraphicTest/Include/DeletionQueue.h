@@ -0,0 +1,56 @@
+#pragma once
+#include "Helper.h"
+#include "MemoryAllocator.h"
+#include "GpuTimeline.h"
+
+#include <deque>
+#include <functional>
+
+// Destroys Vulkan objects once the graphics timeline passes the last submission that may still use them,
+// so a Model can be unloaded mid-session without idling the device.
+// An object is tagged with the value of the latest graphics submission at the time it is handed over. It must no longer
+// be referenced by command buffers recorded after that, i.e. hand objects over outside of recording.
+class DeletionQueue
+{
+public:
+	DeletionQueue();
+	~DeletionQueue();
+
+	void Init(VkDevice device, MemoryAllocator* pAllocator, GpuTimeline* pTimeline);
+	// Waits for the GPU and destroys everything still pending
+	void Finalize();
+
+	void DestroyBuffer(VkBuffer buffer, MemoryAllocation* pMemory);
+	void DestroyImage(VkImage image, MemoryAllocation* pMemory);
+	void DestroyImageView(VkImageView imageView);
+	void DestroySampler(VkSampler sampler);
+	void DestroyDescriptorPool(VkDescriptorPool descriptorPool);
+	void DestroyPipeline(VkPipeline pipeline);
+	void DestroyFramebuffer(VkFramebuffer framebuffer);
+	// Anything else the GPU may still read, e.g. a GeometryPool range that must not be handed out again yet
+	void Defer(std::function<void()>&& release);
+
+	// Destroys everything whose value has completed, call once per frame
+	void Collect();
+
+	size_t GetPendingCount()
+	{
+		return m_Pending.size();
+	}
+
+private:
+	struct Entry
+	{
+		uint64_t timelineValue;
+		std::function<void()> destroy;
+	};
+
+	void Push(std::function<void()>&& destroy);
+
+	VkDevice m_Device = VK_NULL_HANDLE;
+	MemoryAllocator* m_pAllocator = nullptr;
+	GpuTimeline* m_pTimeline = nullptr;
+
+	// Values are taken from a monotonic counter, the front is always the oldest
+	std::deque<Entry> m_Pending;
+};
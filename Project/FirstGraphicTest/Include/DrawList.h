@@ -0,0 +1,78 @@
+#pragma once
+#include "Helper.h"
+
+class RenderObject;
+
+struct DrawItem
+{
+	uint64_t sortKey;
+	RenderObject* pRenderObject;
+};
+
+// Rebuilt every frame from whatever is visible, then recorded into that frame's command buffer.
+// Nothing outlives the frame, so objects can be added, removed or hidden between frames.
+// Sort orders the items by a 64 bit key, most significant bits first:
+//   opaque / mask : pass 2 | pipeline 14 | material 16 | view depth 32, front to back
+//   blend         : pass 2 | view depth 32, back to front | pipeline 14 | material 16
+// Record skips binds the previous item already made, so the fewer state changes the sort leaves, the fewer binds.
+// With the depth pre-pass every item is recorded twice: first depth only, then shaded with an EQUAL depth test.
+// Deferred, Record fills the G-buffer and skips blended items, RecordBlended shades them afterwards
+class DrawList
+{
+public:
+	DrawList();
+	~DrawList();
+
+	void Clear();
+	void Add(RenderObject* pRenderObject);
+	// Keeps the items whose flag is non-zero, in their current order
+	void Compact(const std::vector<uint8_t>& isKept);
+	// After culling, Update of the objects has to have run for the frame
+	void Sort(const glm::mat4& viewMtx);
+
+	// Stays set across Clear
+	void SetDepthPrepass(bool isDepthPrepass)
+	{
+		m_IsDepthPrepass = isDepthPrepass;
+	}
+	bool IsDepthPrepass()
+	{
+		return m_IsDepthPrepass;
+	}
+	// Stays set across Clear, takes precedence over the depth pre-pass
+	void SetDeferred(bool isDeferred)
+	{
+		m_IsDeferred = isDeferred;
+	}
+	bool IsDeferred()
+	{
+		return m_IsDeferred;
+	}
+
+	void Record(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+	// Records [begin, end) of GetRecordCount(), safe to call from several threads on disjoint ranges.
+	// The pre-pass draws come first, ranges executed in order keep every depth draw ahead of every shaded one
+	void Record(VkCommandBuffer commandBuffer, uint32_t frameIndex, size_t begin, size_t end);
+	size_t GetRecordCount()
+	{
+		return (m_IsDepthPrepass && !m_IsDeferred) ? m_DrawItems.size() * 2 : m_DrawItems.size();
+	}
+	// Deferred only, inside a render pass on the swapchain after the lit G-buffer was composited
+	void RecordBlended(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+	size_t GetDrawCount()
+	{
+		return m_DrawItems.size();
+	}
+	RenderObject* GetRenderObject(size_t index)
+	{
+		return m_DrawItems[index].pRenderObject;
+	}
+
+private:
+	std::vector<DrawItem> m_DrawItems;
+	// Radix sort ping-pong buffer, kept so sorting does not allocate after the first frame
+	std::vector<DrawItem> m_SortItems;
+	bool m_IsDepthPrepass = false;
+	bool m_IsDeferred = false;
+};
@@ -0,0 +1,63 @@
+#pragma once
+#include "Helper.h"
+#include "GpuTimeline.h"
+
+// Paces the CPU against the GPU with a fixed number of frames in flight, keyed on the graphics timeline value each
+// frame slot and swapchain image was last submitted with.
+// Everything that is written per frame (uniform arena region, command buffers) is indexed by GetFrameIndex(),
+// swapchain images by the index returned from AcquireImage, the two no longer have to match
+class FrameContext
+{
+public:
+	FrameContext();
+	~FrameContext();
+
+	void Init(VkDevice device, GpuTimeline* pTimeline, uint32_t frameCount, uint32_t imageCount);
+	void Finalize();
+
+	// Blocks until the GPU is done with the last use of this frame slot, afterwards its resources may be rewritten
+	uint32_t BeginFrame();
+
+	// Swapchain path, the submit then waits for the image to become available
+	VkResult AcquireImage(VkSwapchainKHR swapChain, uint32_t* pImageIndex);
+	// Headless path, the caller picks the image
+	void UseImage(uint32_t imageIndex);
+
+	// Returns the graphics timeline value of the frame
+	uint64_t Submit(VkCommandBuffer commandBuffer);
+	VkResult Present(VkQueue queue, VkSwapchainKHR swapChain);
+	void EndFrame();
+
+	uint32_t GetFrameIndex()
+	{
+		return m_FrameIndex;
+	}
+	uint32_t GetImageIndex()
+	{
+		return m_ImageIndex;
+	}
+	uint32_t GetFrameCount()
+	{
+		return m_FrameCount;
+	}
+
+private:
+	void WaitForImage(uint32_t imageIndex);
+
+	VkDevice m_Device = VK_NULL_HANDLE;
+	GpuTimeline* m_pTimeline = nullptr;
+	uint32_t m_FrameCount = 0;
+	uint32_t m_FrameIndex = 0;
+	uint32_t m_ImageIndex = 0;
+	bool m_IsImageAcquired = false;
+
+	// Per frame slot
+	std::vector<VkSemaphore> m_ImageAvailableSemaphores;
+	// Timeline value of the last submission of the slot, 0 if none
+	std::vector<uint64_t> m_FrameValues;
+
+	// Per swapchain image. Present may still wait on the semaphore after the frame slot is recycled, so it cannot be per frame
+	std::vector<VkSemaphore> m_RenderFinishedSemaphores;
+	// Timeline value of the frame that last rendered to the image, 0 if none
+	std::vector<uint64_t> m_ImageValues;
+};
@@ -0,0 +1,41 @@
+#pragma once
+#include "Helper.h"
+#include "DrawList.h"
+
+struct FrustumCullStats
+{
+	uint32_t testedCount = 0;
+	uint32_t culledCount = 0;
+	float cullTimeMs = 0.0f;
+};
+
+// Removes the draw list items whose world bounds lie completely outside the view frustum.
+// Bounds are copied into structure-of-arrays form and tested four boxes at a time against all six planes with SSE
+class FrustumCuller
+{
+public:
+	FrustumCuller();
+	~FrustumCuller();
+
+	void Cull(const glm::mat4& viewProjMtx, DrawList* pDrawList);
+
+	// Of the last Cull call
+	FrustumCullStats GetStats()
+	{
+		return m_Stats;
+	}
+
+private:
+	void TestBounds(const glm::vec4* pPlanes, size_t count);
+
+	// One entry per draw item, padded to a multiple of 4 so the kernel has no scalar tail
+	std::vector<float> m_MinX;
+	std::vector<float> m_MinY;
+	std::vector<float> m_MinZ;
+	std::vector<float> m_MaxX;
+	std::vector<float> m_MaxY;
+	std::vector<float> m_MaxZ;
+	std::vector<uint8_t> m_IsVisible;
+
+	FrustumCullStats m_Stats;
+};
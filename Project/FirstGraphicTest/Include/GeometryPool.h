@@ -0,0 +1,112 @@
+#pragma once
+#include "Helper.h"
+#include "MemoryAllocator.h"
+#include "DeletionQueue.h"
+
+#include <map>
+
+const uint32_t InvalidGeometryBlock = UINT32_MAX;
+// One position and one uv per vertex of a depth vertex range
+const VkDeviceSize DepthVertexSize = sizeof(glm::vec3) + sizeof(glm::vec2);
+
+struct GeometryRange
+{
+	uint32_t block = InvalidGeometryBlock;
+	VkDeviceSize offset = 0;	// bytes into the block's buffer
+	VkDeviceSize size = 0;
+};
+
+// Vertex and index data of every RenderObject, sub-allocated out of a few large device-local buffers.
+// A draw binds its block once and picks its geometry with vertexOffset / firstIndex, so objects sharing a block
+// need no rebinding and can be batched into indirect draws.
+// Vertex ranges are whole Vertex records, index ranges 4 byte aligned so firstIndex is exact for every index type.
+// Depth vertex ranges repeat the position and uv of a vertex range for the depth pre-pass, which would otherwise fetch
+// whole Vertex records for 12 bytes of them. A depth block stores the positions of all its vertices packed, then the uvs,
+// so both streams bind the same buffer and a single vertexOffset selects the range in each.
+// Blocks live until Finalize, only the ranges inside them are recycled
+class GeometryPool
+{
+public:
+	GeometryPool();
+	~GeometryPool();
+
+	void Init(VkDevice device, MemoryAllocator* pAllocator, DeletionQueue* pDeletionQueue, VkDeviceSize blockSize);
+	void Finalize();
+
+	// A request larger than the block size gets a block of its own
+	void AllocateVertices(VkDeviceSize vertexCount, GeometryRange* pRange);
+	void AllocateIndices(VkDeviceSize dataSize, GeometryRange* pRange);
+	void AllocateDepthVertices(VkDeviceSize vertexCount, GeometryRange* pRange);
+	// The range is reused once the draws recorded so far have completed, same rules as the DeletionQueue
+	void FreeVertices(GeometryRange* pRange);
+	void FreeIndices(GeometryRange* pRange);
+	void FreeDepthVertices(GeometryRange* pRange);
+
+	VkBuffer GetVertexBuffer(uint32_t block)
+	{
+		return m_VertexHeap.blocks[block].buffer;
+	}
+	VkBuffer GetIndexBuffer(uint32_t block)
+	{
+		return m_IndexHeap.blocks[block].buffer;
+	}
+	int32_t GetVertexOffset(const GeometryRange& range)
+	{
+		return static_cast<int32_t>(range.offset / sizeof(Vertex));
+	}
+	VkBuffer GetDepthVertexBuffer(uint32_t block)
+	{
+		return m_DepthVertexHeap.blocks[block].buffer;
+	}
+	int32_t GetDepthVertexOffset(const GeometryRange& range)
+	{
+		return static_cast<int32_t>(range.offset / DepthVertexSize);
+	}
+	// Byte offsets of the two streams of a depth block, the positions start at 0
+	VkDeviceSize GetDepthUvStreamOffset(uint32_t block)
+	{
+		return m_DepthVertexHeap.blocks[block].size / DepthVertexSize * sizeof(glm::vec3);
+	}
+	VkDeviceSize GetDepthPositionOffset(const GeometryRange& range)
+	{
+		return GetDepthVertexOffset(range) * sizeof(glm::vec3);
+	}
+	VkDeviceSize GetDepthUvOffset(const GeometryRange& range)
+	{
+		return GetDepthUvStreamOffset(range.block) + GetDepthVertexOffset(range) * sizeof(glm::vec2);
+	}
+	void PrintStats();
+
+private:
+	struct Block
+	{
+		VkBuffer buffer;
+		MemoryAllocation memory;
+		VkDeviceSize size;
+		// offset -> size, adjacent ranges are merged on release
+		std::map<VkDeviceSize, VkDeviceSize> freeRanges;
+	};
+
+	struct Heap
+	{
+		std::vector<Block> blocks;
+		VkBufferUsageFlags usage = 0;
+		VkDeviceSize granularity = 1;
+		VkDeviceSize usedBytes = 0;
+		uint32_t rangeCount = 0;
+	};
+
+	void Allocate(Heap& heap, VkDeviceSize size, GeometryRange* pRange);
+	void Free(Heap& heap, GeometryRange* pRange);
+	void Release(Heap& heap, const GeometryRange& range);
+	void DestroyHeap(Heap& heap);
+
+	VkDevice m_Device = VK_NULL_HANDLE;
+	MemoryAllocator* m_pAllocator = nullptr;
+	DeletionQueue* m_pDeletionQueue = nullptr;
+	VkDeviceSize m_BlockSize = 0;
+
+	Heap m_VertexHeap;
+	Heap m_IndexHeap;
+	Heap m_DepthVertexHeap;
+};
@@ -0,0 +1,213 @@
+#pragma once
+#include "Helper.h"
+#include "GraphicSystem.h"
+#include "HiZBuffer.h"
+
+#include <unordered_map>
+
+class RenderObject;
+class Texture;
+
+enum GpuTextureSlot
+{
+	GPU_TEXTURE_SLOT_DIFFUSE = 0,
+	GPU_TEXTURE_SLOT_NORMAL = 1,
+	GPU_TEXTURE_SLOT_METALLICROUGHNESS = 2,
+	GPU_TEXTURE_SLOT_EMISSIVE = 3,
+	GPU_TEXTURE_SLOT_OCCLUSION = 4,
+	GPU_TEXTURE_SLOT_DFG = 5,
+	GPU_TEXTURE_SLOT_IBL = 6,	// index into the cube array
+	GPU_TEXTURE_SLOT_COUNT = 7,
+};
+
+// std430 mirror of FrameData in Shader/gpu_scene.glsl, at the start of every frame region of the scene buffer
+struct GpuFrameData
+{
+	glm::mat4 viewMtx;
+	glm::mat4 projMtx;
+	glm::vec4 cameraPos;
+	glm::vec4 frustumPlanes[6];
+	// Opaque instances and buckets only, the cull shader never sees the blended ones
+	uint32_t instanceCount;
+	uint32_t bucketCount;
+	uint32_t depthWidth;
+	uint32_t depthHeight;
+};
+
+// std430 mirror of InstanceData in Shader/gpu_scene.glsl
+struct GpuInstanceData
+{
+	glm::mat4 modelMtx;
+	glm::vec4 localBoundsMin;
+	glm::vec4 localBoundsMax;
+	glm::vec4 baseColorFactor;
+	glm::vec4 metallicRoughness;
+	glm::vec4 blendMode;
+	glm::vec4 emissiveFactor;
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	uint32_t bucket;
+	uint32_t firstCommand;
+	uint32_t isVisible;
+	uint32_t reserved[2];
+	uint32_t textureIndices[8];
+};
+
+// The draws of a frame. Without occlusion culling only the early phase exists and it tests the frustum alone
+enum GpuCullPhase
+{
+	GPU_CULL_PHASE_EARLY = 0,	// instances that passed the occlusion test last frame
+	GPU_CULL_PHASE_LATE = 1,	// instances the Hi-Z pyramid of the early phase's depth newly shows
+};
+
+struct GpuSceneStats
+{
+	uint32_t instanceCount = 0;
+	uint32_t bucketCount = 0;
+	uint32_t textureCount = 0;
+	uint32_t cubeTextureCount = 0;
+	VkDeviceSize vertexBytes = 0;
+	VkDeviceSize indexBytes = 0;
+	// Instance records copied into the frame region by the last Update
+	uint32_t writtenInstanceCount = 0;
+	// Counters of the cull passes the last time this frame slot was used, read back by Update
+	uint32_t drawnCount = 0;
+	uint32_t lateDrawnCount = 0;
+	uint32_t frustumCulledCount = 0;
+	// Inside the frustum but behind the Hi-Z depth, some of these were still drawn by the early phase
+	uint32_t occlusionCulledCount = 0;
+	// Of the current frame, culled and sorted on the CPU by Update. Included in drawnCount and frustumCulledCount
+	uint32_t blendedDrawnCount = 0;
+};
+
+// GPU-driven path over a fixed set of RenderObjects. Their geometry is drawn straight out of the GeometryPool blocks,
+// transforms and material factors go to a per-frame storage buffer and every material texture into two descriptor arrays,
+// so a single descriptor set serves all objects. Each frame a compute pass frustum-culls the instances and appends
+// VkDrawIndexedIndirectCommands per pipeline bucket, then one vkCmdDrawIndexedIndirectCount per bucket draws them.
+// Recording cost follows the number of distinct pipelines instead of the number of objects.
+// Blended objects get buckets of their own after the opaque ones but stay out of the compute pass: Update frustum-culls them
+// on the CPU and sorts them back to front, RecordBlended draws them one by one once all opaque draws of the frame are done.
+// With occlusion culling a frame has two phases: the early one redraws what was visible last frame, a Hi-Z pyramid is built
+// from that depth, and the late one tests every instance against it, draws what became visible and keeps the result for the
+// next frame. Objects coming into view are drawn the same frame, so nothing pops in late.
+// The RenderObjects stay owned by their Models and must outlive the scene
+class GpuScene
+{
+public:
+	GpuScene();
+	~GpuScene();
+
+	// False when the device lacks the features, a shader is missing or a limit is exceeded; nothing is kept then
+	bool Init(GraphicSystem* pGraphicSystem, const std::vector<RenderObject*>& renderObjects, bool isOcclusionCulled);
+	void Finalize();
+
+	// object indexes the vector given to Init. Changes reach each frame region the next time that region is updated
+	void SetObjectTransform(uint32_t object, const glm::mat4& modelMtx);
+	void SetObjectVisible(uint32_t object, bool isVisible);
+
+	// Between FrameContext::BeginFrame and Submit: writes the camera and the instances changed since the slot's last use
+	void Update(uint32_t frameIndex);
+	// Outside of a render pass, before the pass that calls RecordDraw for the same phase. The late phase follows the
+	// early phase's render pass, which has to store depth, and builds the Hi-Z pyramid first
+	void RecordCull(VkCommandBuffer commandBuffer, uint32_t frameIndex, GpuCullPhase phase);
+	// Inside the render pass, set 0 (lights) has to be bound already. Opaque and mask buckets only
+	void RecordDraw(VkCommandBuffer commandBuffer, uint32_t frameIndex, GpuCullPhase phase);
+	// Inside the render pass of the frame's last phase, after its RecordDraw
+	void RecordBlended(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+	bool IsOcclusionCulled()
+	{
+		return m_IsOcclusionCulled;
+	}
+
+	GpuSceneStats GetStats()
+	{
+		return m_Stats;
+	}
+	void PrintStats();
+	void PrintCullStats();
+
+private:
+	// Objects with the same pipeline, index type and GeometryPool blocks share a bucket and one indirect draw
+	struct Bucket
+	{
+		GraphicsPipelineDesc pipelineDesc;
+		VkPipeline pipeline;
+		VkIndexType indexType;
+		VkBuffer vertexBuffer;
+		VkBuffer indexBuffer;
+		uint32_t firstCommand;
+		uint32_t commandCount;
+	};
+
+	void CreateInstances(const std::vector<RenderObject*>& renderObjects);
+	void CreateFrameRegions();
+	void CreateDescriptors();
+	bool CreatePipelines();
+	uint32_t AddTexture(Texture* pTexture, bool isCube);
+	void MarkInstanceDirty(uint32_t instance);
+	void GetDynamicOffsets(uint32_t frameIndex, uint32_t* pOffsets);
+
+	GraphicSystem* m_pGraphicSystem = nullptr;
+	VkDevice m_Device = VK_NULL_HANDLE;
+	uint32_t m_FrameCount = 0;
+	VkDeviceSize m_StorageAlignment = 0;
+	bool m_IsOcclusionCulled = false;
+
+	VkShaderModule m_VertexShaderModule = VK_NULL_HANDLE;
+	VkShaderModule m_FragmentShaderModule = VK_NULL_HANDLE;
+	VkShaderModule m_CullShaderModule = VK_NULL_HANDLE;
+
+	// Per frame regions: GpuFrameData + instances, draw commands of both phases, draw counts of both phases + the culled counters
+	VkBuffer m_SceneBuffer = VK_NULL_HANDLE;
+	MemoryAllocation m_SceneBufferMemory;
+	VkDeviceSize m_SceneRegionSize = 0;
+	VkBuffer m_DrawCommandBuffer = VK_NULL_HANDLE;
+	MemoryAllocation m_DrawCommandBufferMemory;
+	VkDeviceSize m_DrawCommandRegionSize = 0;
+	// Host visible so the counts of a completed frame can be read back for stats
+	VkBuffer m_DrawCountBuffer = VK_NULL_HANDLE;
+	MemoryAllocation m_DrawCountBufferMemory;
+	VkDeviceSize m_DrawCountRegionSize = 0;
+	// One flag per instance, written by the late phase and read by the next frame's early phase
+	VkBuffer m_VisibilityBuffer = VK_NULL_HANDLE;
+	MemoryAllocation m_VisibilityBufferMemory;
+
+	// Allocated even without occlusion culling, the cull shader references it in every phase
+	HiZBuffer m_HiZBuffer;
+
+	// Blended instances visible this frame, back to front
+	struct BlendedDraw
+	{
+		float depth;
+		uint32_t instance;
+	};
+
+	std::vector<GpuInstanceData> m_Instances;
+	// Sorted by bucket, m_ObjectInstances maps an object of Init's vector to its instance
+	std::vector<uint32_t> m_ObjectInstances;
+	std::vector<Bucket> m_Buckets;
+	// The blended buckets and their instances follow these, the compute pass only sees the opaque ones
+	uint32_t m_OpaqueInstanceCount = 0;
+	uint32_t m_OpaqueBucketCount = 0;
+	std::vector<BlendedDraw> m_BlendedDraws;
+	// Frame regions that still miss the instance's latest data
+	std::vector<uint32_t> m_InstanceDirtyFrames;
+	std::vector<uint32_t> m_DirtyInstances;
+
+	std::vector<VkDescriptorImageInfo> m_Textures;
+	std::vector<VkDescriptorImageInfo> m_CubeTextures;
+	std::unordered_map<VkImageView, uint32_t> m_TextureIndices;
+
+	VkDescriptorSetLayout m_DescriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool m_DescriptorPool = VK_NULL_HANDLE;
+	VkDescriptorSet m_DescriptorSet = VK_NULL_HANDLE;
+	VkPipelineLayout m_PipelineLayout = VK_NULL_HANDLE;
+	VkPipelineLayout m_CullPipelineLayout = VK_NULL_HANDLE;
+	// Frustum only or the early phase, depending on m_IsOcclusionCulled
+	VkPipeline m_CullPipeline = VK_NULL_HANDLE;
+	VkPipeline m_LateCullPipeline = VK_NULL_HANDLE;
+
+	GpuSceneStats m_Stats;
+};
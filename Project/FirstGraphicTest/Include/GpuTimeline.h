@@ -0,0 +1,55 @@
+#pragma once
+#include "Helper.h"
+
+// One timeline semaphore per queue, every submission through it signals the next value.
+// "The GPU is done with X" becomes "GetCompletedValue() >= the value of the submission that last used X", which is
+// what frame pacing, staging reuse and resource retirement all key on. Values start at 1, 0 is always complete.
+// Swapchain acquire/present still need binary semaphores, they are passed through AddWait/AddSignal.
+class GpuTimeline
+{
+public:
+	GpuTimeline();
+	~GpuTimeline();
+
+	void Init(VkDevice device, VkQueue queue);
+	void Finalize();
+
+	// Applied to the next Submit only. A wait on another timeline waits for value, for a binary semaphore value is ignored
+	void AddWait(VkSemaphore semaphore, uint64_t value, VkPipelineStageFlags stageMask);
+	void AddSignal(VkSemaphore binarySemaphore);
+
+	// Returns the value signaled once the command buffers and every earlier submission of this queue have completed.
+	// When vkQueueSubmit fails the command buffers never run and the last submitted value is returned instead
+	uint64_t Submit(uint32_t commandBufferCount, const VkCommandBuffer* pCommandBuffers);
+	// Ends, submits and waits for a one-off command buffer allocated from commandPool, then frees it
+	void EndSingleTimeCommands(VkCommandBuffer commandBuffer, VkCommandPool commandPool);
+
+	// Values past GetSubmittedValue() are clamped to it, nothing could ever signal them
+	void Wait(uint64_t value);
+	bool IsComplete(uint64_t value);
+	uint64_t GetCompletedValue();
+
+	uint64_t GetSubmittedValue()
+	{
+		return m_SubmittedValue;
+	}
+	VkSemaphore GetSemaphore()
+	{
+		return m_Semaphore;
+	}
+
+private:
+	VkDevice m_Device = VK_NULL_HANDLE;
+	VkQueue m_Queue = VK_NULL_HANDLE;
+	VkSemaphore m_Semaphore = VK_NULL_HANDLE;
+
+	uint64_t m_SubmittedValue = 0;
+	// Last value read back from the semaphore, only ever grows
+	uint64_t m_CompletedValue = 0;
+
+	std::vector<VkSemaphore> m_WaitSemaphores;
+	std::vector<uint64_t> m_WaitValues;
+	std::vector<VkPipelineStageFlags> m_WaitStages;
+	std::vector<VkSemaphore> m_SignalSemaphores;
+	std::vector<uint64_t> m_SignalValues;
+};
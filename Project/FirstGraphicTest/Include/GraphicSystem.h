@@ -1,5 +1,14 @@
 #pragma once
 #include "Helper.h"
+#include "MemoryAllocator.h"
+#include "StagingRing.h"
+#include "GpuTimeline.h"
+#include "DeletionQueue.h"
+#include "PipelineCache.h"
+#include "PipelineLibrary.h"
+#include "ShaderModuleCache.h"
+#include "UniformArena.h"
+#include "GeometryPool.h"
 
 struct Camera
 {
@@ -8,6 +17,40 @@ struct Camera
 	glm::vec3 cameraUp;
 	glm::mat4 viewMtx;
 	glm::mat4 projMtx;
+	// The planes projMtx was built with, light clustering slices the depth between them
+	float nearPlane = 0.1f;
+	float farPlane = 10000.0f;
+};
+
+// G-buffer of the deferred path, written by Shader/gbuffer.frag and lit by Shader/tiled_lighting.comp
+enum GBufferAttachment
+{
+	GBUFFER_BASECOLOR = 0,	// rgb : base color
+	GBUFFER_NORMAL = 1,		// rgb : world space normal * 0.5 + 0.5
+	GBUFFER_MATERIAL = 2,	// r : metallic, g : perceptual roughness, b : occlusion
+	GBUFFER_EMISSIVE = 3,	// rgb : emissive plus the ambient and IBL light, everything not from a punctual light
+	GBUFFER_ATTACHMENT_COUNT = 4,
+};
+
+static const VkFormat GBufferFormats[GBUFFER_ATTACHMENT_COUNT] =
+{
+	VK_FORMAT_R8G8B8A8_SRGB,
+	VK_FORMAT_A2B10G10R10_UNORM_PACK32,
+	VK_FORMAT_R8G8B8A8_UNORM,
+	VK_FORMAT_R16G16B16A16_SFLOAT,
+};
+
+struct GraphicSystemConfig
+{
+	VkDeviceSize stagingRingSize = 64 * 1024 * 1024;
+	// Empty disables loading and saving, the cache then only lives for one run
+	std::string pipelineCachePath = "pipeline_cache.bin";
+	// Frames the CPU may record ahead of the GPU, every per-frame resource is allocated this many times
+	uint32_t framesInFlight = 2;
+	// Uniform space per frame in flight, shared by every RenderObject
+	VkDeviceSize uniformArenaFrameSize = 4 * 1024 * 1024;
+	// Size of each vertex and index buffer geometry is sub-allocated from, a new block is added once one is full
+	VkDeviceSize geometryBlockSize = 64 * 1024 * 1024;
 };
 
 class GraphicSystem
@@ -16,7 +59,18 @@ public:
 	GraphicSystem();
 	~GraphicSystem();
 	void Finalize();
-	void InitGraphicsSystem(GLFWwindow* pWindow);
+	void InitGraphicsSystem(GLFWwindow* pWindow, const GraphicSystemConfig& config = GraphicSystemConfig());
+	void InitHeadlessGraphicsSystem(int width, int height, const GraphicSystemConfig& config = GraphicSystemConfig());
+
+	bool IsHeadless()
+	{
+		return m_IsHeadless;
+	}
+	// Multi-draw indirect count and non-uniform texture array indexing are enabled on the device
+	bool IsGpuDrivenSupported()
+	{
+		return m_IsGpuDrivenSupported;
+	}
 
 	VkDevice GetDevice()
 	{
@@ -26,6 +80,48 @@ public:
 	{
 		return m_PhysicalDevice;
 	}
+	MemoryAllocator* GetMemoryAllocator()
+	{
+		return &m_MemoryAllocator;
+	}
+	// Signaled by every graphics queue submission, frames and graphics-side uploads are keyed on its values
+	GpuTimeline* GetGraphicsTimeline()
+	{
+		return &m_GraphicsTimeline;
+	}
+	// Signaled by every transfer queue submission, the staging ring recycles on its values
+	GpuTimeline* GetTransferTimeline()
+	{
+		return &m_TransferTimeline;
+	}
+	DeletionQueue* GetDeletionQueue()
+	{
+		return &m_DeletionQueue;
+	}
+	StagingRing* GetStagingRing()
+	{
+		return &m_StagingRing;
+	}
+	PipelineCache* GetPipelineCache()
+	{
+		return &m_PipelineCache;
+	}
+	PipelineLibrary* GetPipelineLibrary()
+	{
+		return &m_PipelineLibrary;
+	}
+	ShaderModuleCache* GetShaderModuleCache()
+	{
+		return &m_ShaderModuleCache;
+	}
+	UniformArena* GetUniformArena()
+	{
+		return &m_UniformArena;
+	}
+	GeometryPool* GetGeometryPool()
+	{
+		return &m_GeometryPool;
+	}
 	VkFormat GetSwapChainFormat()
 	{
 		return m_SwapChainFormat;
@@ -38,6 +134,23 @@ public:
 	{
 		return m_Queues;
 	}
+	uint32_t GetGraphicsQueueFamilyIndex()
+	{
+		return m_GraphicsQueueFamilyIndex;
+	}
+	// Falls back to the graphics queue when the device has no transfer-only family
+	VkQueue GetTransferQueue()
+	{
+		return m_Queues[2];
+	}
+	uint32_t GetTransferQueueFamilyIndex()
+	{
+		return m_TransferQueueFamilyIndex;
+	}
+	bool HasDedicatedTransferQueue()
+	{
+		return m_TransferQueueFamilyIndex != m_GraphicsQueueFamilyIndex;
+	}
 
 	VkSwapchainKHR GetSwapChain()
 	{
@@ -56,20 +169,49 @@ public:
 	{
 		return m_SwapChainCount;
 	}
+	uint32_t GetFramesInFlight()
+	{
+		return m_FramesInFlight;
+	}
 	VkRenderPass GetRenderPass()
 	{
 		return m_RenderPass;
 	}
+	// Same attachments as GetRenderPass but loaded instead of cleared, for a second pass in the same frame
+	VkRenderPass GetLoadRenderPass()
+	{
+		return m_LoadRenderPass;
+	}
+	// Color cleared but depth loaded, for a pass that covers every pixel itself on top of depth written earlier in the frame.
+	// Compatible with GetRenderPass as well
+	VkRenderPass GetCompositeRenderPass()
+	{
+		return m_CompositeRenderPass;
+	}
+	// G-buffer attachments in GBufferAttachment order, then the depth buffer. Left in SHADER_READ_ONLY_OPTIMAL and
+	// DEPTH_STENCIL_ATTACHMENT_OPTIMAL, the framebuffer belongs to the deferred renderer
+	VkRenderPass GetGBufferRenderPass()
+	{
+		return m_GBufferRenderPass;
+	}
 	VkCommandPool GetCommandPool()
 	{
 		return m_CommandPool;
 	}
+	VkCommandPool GetTransferCommandPool()
+	{
+		return m_TransferCommandPool;
+	}
 
 	std::vector<VkFramebuffer>& GetSwapChainFrameBuffers()
 	{
 		return m_SwapChainFrameBuffers;
 	}
 
+	VkImage GetDepthImage()
+	{
+		return m_DepthImage;
+	}
 	VkImageView GetDepthImageView()
 	{
 		return m_DepthImageView;
@@ -86,28 +228,51 @@ public:
 	}
 
 private:
+	void InitRenderTargets(VkImageLayout colorFinalLayout);
+
+	bool m_IsHeadless = false;
+	bool m_IsGpuDrivenSupported = false;
 	VkFormat m_SwapChainFormat;
 	VkInstance m_Instance = VK_NULL_HANDLE;
 	VkPhysicalDevice m_PhysicalDevice = VK_NULL_HANDLE;
 	VkDevice m_Device = VK_NULL_HANDLE;
+	MemoryAllocator m_MemoryAllocator;
+	GpuTimeline m_GraphicsTimeline;
+	GpuTimeline m_TransferTimeline;
+	DeletionQueue m_DeletionQueue;
+	StagingRing m_StagingRing;
+	PipelineCache m_PipelineCache;
+	PipelineLibrary m_PipelineLibrary;
+	ShaderModuleCache m_ShaderModuleCache;
+	UniformArena m_UniformArena;
+	GeometryPool m_GeometryPool;
 	std::vector<VkQueue> m_Queues;
-	VkSwapchainKHR m_SwapChain;
+	uint32_t m_GraphicsQueueFamilyIndex = 0;
+	uint32_t m_TransferQueueFamilyIndex = 0;
+	VkSwapchainKHR m_SwapChain = VK_NULL_HANDLE;
 	VkExtent2D m_SwapChainExtent;
-	VkSurfaceKHR m_Surface;
+	VkSurfaceKHR m_Surface = VK_NULL_HANDLE;
 	VkRenderPass m_RenderPass;
+	VkRenderPass m_LoadRenderPass;
+	VkRenderPass m_CompositeRenderPass;
+	VkRenderPass m_GBufferRenderPass;
 	VkCommandPool m_CommandPool;
+	VkCommandPool m_TransferCommandPool;
 
 	std::vector<VkImage> m_SwapChainImages;
 	std::vector<VkImageView> m_SwapChainImageViews;
 	std::vector<VkFramebuffer> m_SwapChainFrameBuffers;
+	// Headless only: backing memory of the offscreen images in m_SwapChainImages
+	std::vector<MemoryAllocation> m_OffscreenImageMemories;
 
 	VkImage m_DepthImage;
-	VkDeviceMemory m_DepthImageMemory;
+	MemoryAllocation m_DepthImageMemory;
 	VkImageView m_DepthImageView;
 
 	int m_ScreenWidth;
 	int m_ScreenHeight;
 	uint32_t m_SwapChainCount;
+	uint32_t m_FramesInFlight = 2;
 
 	Camera m_Camera;
 };
@@ -1,5 +1,7 @@
 #pragma once
+#ifdef _WIN32
 #define VK_USE_PLATFORM_WIN32_KHR
+#endif
 #include <vulkan/vulkan.h>
 
 #define GLM_FORCE_RADIANS
@@ -16,8 +18,10 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#ifdef _WIN32
 #define GLFW_EXPOSE_NATIVE_WIN32
 #include <GLFW/glfw3native.h>
+#endif
 
 #include <cstring>
 #include <array>
@@ -30,7 +34,12 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#ifdef _WIN32
 #include <io.h>
+#else
+#include <unistd.h>
+#define _access access
+#endif
 
 #include <cstdint>
 #include <algorithm>
@@ -88,6 +97,113 @@ struct Vertex
 	}
 };
 
+// Depth pre-pass input, the GeometryPool's packed position stream on binding 0 and uv stream on binding 1.
+// Locations match Vertex, only alpha-masked materials fetch the uv
+struct DepthVertex
+{
+	static std::vector<VkVertexInputBindingDescription> GetBindingDescriptions(bool isUvRead)
+	{
+		std::vector<VkVertexInputBindingDescription> bindingDescriptions(isUvRead ? 2 : 1);
+
+		bindingDescriptions[0].binding = 0;
+		bindingDescriptions[0].stride = sizeof(glm::vec3);
+		bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		if (isUvRead)
+		{
+			bindingDescriptions[1].binding = 1;
+			bindingDescriptions[1].stride = sizeof(glm::vec2);
+			bindingDescriptions[1].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		}
+		return bindingDescriptions;
+	}
+
+	static std::vector<VkVertexInputAttributeDescription> GetAttributeDescriptions(bool isUvRead)
+	{
+		std::vector<VkVertexInputAttributeDescription> attributeDescriptions(isUvRead ? 2 : 1);
+
+		attributeDescriptions[0].binding = 0;
+		attributeDescriptions[0].location = 0;
+		attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+		attributeDescriptions[0].offset = 0;
+		if (isUvRead)
+		{
+			attributeDescriptions[1].binding = 1;
+			attributeDescriptions[1].location = 3;
+			attributeDescriptions[1].format = VK_FORMAT_R32G32_SFLOAT;
+			attributeDescriptions[1].offset = 0;
+		}
+		return attributeDescriptions;
+	}
+};
+
+struct BoundingBox
+{
+	glm::vec3 min = glm::vec3(0.0f);
+	glm::vec3 max = glm::vec3(0.0f);
+};
+
+// Smallest axis aligned box around the transformed box, each output axis takes the larger/smaller of the two products
+static BoundingBox TransformBoundingBox(const BoundingBox& box, const glm::mat4& mtx)
+{
+	BoundingBox result;
+	result.min = glm::vec3(mtx[3]);
+	result.max = glm::vec3(mtx[3]);
+	for (int column = 0; column < 3; column++)
+	{
+		glm::vec3 a = glm::vec3(mtx[column]) * box.min[column];
+		glm::vec3 b = glm::vec3(mtx[column]) * box.max[column];
+		result.min += glm::min(a, b);
+		result.max += glm::max(a, b);
+	}
+	return result;
+}
+
+// Gribb/Hartmann, planes point inwards. Depth is [0,1] so near is the third row alone.
+// The planes are not normalized, only the sign of the distance is meaningful
+static void ExtractFrustumPlanes(const glm::mat4& mtx, glm::vec4* pPlanes)
+{
+	glm::vec4 row0 = glm::vec4(mtx[0][0], mtx[1][0], mtx[2][0], mtx[3][0]);
+	glm::vec4 row1 = glm::vec4(mtx[0][1], mtx[1][1], mtx[2][1], mtx[3][1]);
+	glm::vec4 row2 = glm::vec4(mtx[0][2], mtx[1][2], mtx[2][2], mtx[3][2]);
+	glm::vec4 row3 = glm::vec4(mtx[0][3], mtx[1][3], mtx[2][3], mtx[3][3]);
+	pPlanes[0] = row3 + row0;
+	pPlanes[1] = row3 - row0;
+	pPlanes[2] = row3 + row1;
+	pPlanes[3] = row3 - row1;
+	pPlanes[4] = row2;
+	pPlanes[5] = row3 - row2;
+}
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+static VkDeviceSize GetIndexSize(VkIndexType indexType)
+{
+	switch (indexType)
+	{
+	case VK_INDEX_TYPE_UINT8_EXT:
+		return 1;
+	case VK_INDEX_TYPE_UINT32:
+		return 4;
+	default:
+		return 2;
+	}
+}
+
+// FNV-1a, pass a previous result as hash to chain several ranges
+static uint64_t HashBytes(const void* pData, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+	const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= pBytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
 static uint32_t FindMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties)
 {
 	VkPhysicalDeviceMemoryProperties memProps;
@@ -201,13 +317,13 @@ static void CreateShaderStage(VkPipelineShaderStageCreateInfo* pCreateInfo, VkSh
 
 static void CreateVertexInputState(
 	VkPipelineVertexInputStateCreateInfo* pCreateInfo,
-	VkVertexInputBindingDescription* pBindingDescription,
+	std::vector<VkVertexInputBindingDescription>* pBindingDescriptions,
 	std::vector<VkVertexInputAttributeDescription>* pAttributeDescriptions)
 {
 	pCreateInfo->sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	pCreateInfo->vertexBindingDescriptionCount = 1;
+	pCreateInfo->vertexBindingDescriptionCount = static_cast<uint32_t>(pBindingDescriptions->size());
 	pCreateInfo->vertexAttributeDescriptionCount = static_cast<uint32_t>(pAttributeDescriptions->size());
-	pCreateInfo->pVertexBindingDescriptions = pBindingDescription;
+	pCreateInfo->pVertexBindingDescriptions = pBindingDescriptions->data();
 	pCreateInfo->pVertexAttributeDescriptions = pAttributeDescriptions->data();
 }
 
@@ -273,7 +389,7 @@ static void CreateColorBlendAttachmentState(VkPipelineColorBlendAttachmentState*
 		VK_COLOR_COMPONENT_G_BIT |
 		VK_COLOR_COMPONENT_B_BIT |
 		VK_COLOR_COMPONENT_A_BIT;
-	pColorBlendAttachment->blendEnable = VK_TRUE;
+	pColorBlendAttachment->blendEnable = VK_FALSE;
 	pColorBlendAttachment->srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
 	pColorBlendAttachment->dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
 	pColorBlendAttachment->colorBlendOp = VK_BLEND_OP_ADD;
@@ -345,115 +461,6 @@ static VkCommandBuffer BeginSingleTimeCommands(VkDevice device, VkCommandPool co
 	return commandBuffer;
 }
 
-static void EndSingleTimeCommands(VkCommandBuffer commandBuffer, VkDevice device, VkCommandPool commandPool, VkQueue queue)
-{
-	vkEndCommandBuffer(commandBuffer);
-
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
-
-	vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(queue);
-
-	vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
-}
-
-static void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDevice device, VkCommandPool commandPool, VkQueue queue)
-{
-	VkCommandBuffer commandBuffer = BeginSingleTimeCommands(device, commandPool);
-
-	VkBufferCopy copyRagion = {};
-	copyRagion.srcOffset = 0;
-	copyRagion.dstOffset = 0;
-	copyRagion.size = size;
-	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRagion);
-
-	EndSingleTimeCommands(commandBuffer, device, commandPool, queue);
-}
-
-static void CreateBuffer(
-	VkBuffer* pBuffer,
-	VkDeviceMemory* pBufferMemory,
-	VkDeviceSize size,
-	VkBufferUsageFlags usageFlags,
-	VkMemoryPropertyFlags propertyFlags,
-	VkDevice device,
-	VkPhysicalDevice physicalDevice)
-{
-	VkBufferCreateInfo bufferInfo = {};
-	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferInfo.size = size;
-	bufferInfo.usage = usageFlags;
-	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-	VkResult result = vkCreateBuffer(device, &bufferInfo, nullptr, pBuffer);
-
-	VkMemoryRequirements memRequirments;
-	vkGetBufferMemoryRequirements(device, *pBuffer, &memRequirments);
-
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirments.size;
-	allocInfo.memoryTypeIndex = FindMemoryType(physicalDevice, memRequirments.memoryTypeBits, propertyFlags);
-
-	result = vkAllocateMemory(device, &allocInfo, nullptr, pBufferMemory);
-
-	result = vkBindBufferMemory(device, *pBuffer, *pBufferMemory, 0);
-}
-
-static void CreateImage(
-	VkImage* pImage, 
-	VkDeviceMemory* pImageMemory, 
-	VkDevice device, 
-	VkPhysicalDevice physicalDevice, 
-	uint32_t width,
-	uint32_t height, 
-	uint32_t layers,
-	uint32_t mipLevels,
-	VkImageType imageType,
-	VkFormat format, 
-	VkImageTiling tiling,
-	VkImageUsageFlags usageFlags,
-	VkMemoryPropertyFlags propertyFlags)
-{
-	VkImageCreateInfo imageInfo = {};
-	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-	imageInfo.imageType = imageType;
-	imageInfo.extent.width = width;
-	imageInfo.extent.height = height;
-	imageInfo.extent.depth = 1;
-	imageInfo.mipLevels = mipLevels;
-	imageInfo.arrayLayers = layers;
-
-	imageInfo.format = format;
-	imageInfo.tiling = tiling;//VK_IMAGE_TILING_LINEAR //VK_IMAGE_TILING_OPTIMAL
-	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	imageInfo.usage = usageFlags;
-	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-	imageInfo.flags = 0;
-	if (layers == 6)
-	{
-		imageInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
-	}
-
-	vkCreateImage(device, &imageInfo, nullptr, pImage);
-
-	VkMemoryRequirements memRequirments;
-	vkGetImageMemoryRequirements(device, *pImage, &memRequirments);
-
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirments.size;
-	allocInfo.memoryTypeIndex = FindMemoryType(physicalDevice, memRequirments.memoryTypeBits, propertyFlags);
-
-	VkResult result = vkAllocateMemory(device, &allocInfo, nullptr, pImageMemory);
-
-	result = vkBindImageMemory(device, *pImage, *pImageMemory, 0);
-}
-
 static bool CreateImageView(VkImageView* pImageView, VkImage image, VkImageViewType viewType, VkDevice device, uint32_t layers, uint32_t mipLevels, VkFormat format, VkImageAspectFlags aspectFlags)
 {
 	VkImageViewCreateInfo viewInfo = {};
@@ -479,94 +486,3 @@ static bool CreateImageView(VkImageView* pImageView, VkImage image, VkImageViewT
 
 	return true;
 }
-
-static void TransitionImageLayout(VkImage image, VkFormat format, uint32_t layers, uint32_t mipLevels, VkImageLayout oldLayout, VkImageLayout newLayout, VkDevice device, VkCommandPool commandPool, VkQueue queue)
-{
-	VkCommandBuffer commandBuffer = BeginSingleTimeCommands(device, commandPool);
-
-
-	VkImageMemoryBarrier barrier = {};
-	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	barrier.oldLayout = oldLayout;
-	barrier.newLayout = newLayout;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.image = image;
-	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.levelCount = mipLevels;
-	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.layerCount = layers;
-
-	VkPipelineStageFlags srcStage;
-	VkPipelineStageFlags dstStage;
-
-	if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-		srcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		dstStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-	}
-	else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-		srcStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		dstStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-	}
-	else
-	{
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = 0;
-	}
-
-	vkCmdPipelineBarrier(
-		commandBuffer,
-		srcStage, dstStage,
-		0,
-		0, nullptr,
-		0, nullptr,
-		1, &barrier
-	);
-
-	EndSingleTimeCommands(commandBuffer, device, commandPool, queue);
-}
-
-static void CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layers, uint32_t mipLevels, uint32_t bitDepth, VkDevice device, VkCommandPool commandPool, VkQueue queue)
-{
-	VkCommandBuffer commandBuffer = BeginSingleTimeCommands(device, commandPool);
-
-	uint32_t offset = 0;
-	std::vector<VkBufferImageCopy> bufferCopyRegions = {};
-	for (uint32_t face = 0; face < layers; face++) {
-		for (uint32_t level = 0; level < mipLevels; level++) {
-			VkBufferImageCopy bufferCopyRegion = {};
-			bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			bufferCopyRegion.imageSubresource.mipLevel = level;
-			bufferCopyRegion.imageSubresource.baseArrayLayer = face;
-			bufferCopyRegion.imageSubresource.layerCount = 1;
-			bufferCopyRegion.imageExtent.width = width >> level;
-			bufferCopyRegion.imageExtent.height = height >> level;
-			bufferCopyRegion.imageExtent.depth = 1;
-			bufferCopyRegion.bufferOffset = offset;
-			bufferCopyRegion.imageOffset = { 0,0,0 };
-
-			bufferCopyRegions.push_back(bufferCopyRegion);
-
-			
-			// Increase offset into staging buffer for next level / face
-			offset += (width >> level) * (height >> level) * (bitDepth / 8);
-		}
-	}
-
-	vkCmdCopyBufferToImage(
-		commandBuffer, 
-		buffer, 
-		image, 
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
-		static_cast<uint32_t>(bufferCopyRegions.size()), 
-		bufferCopyRegions.data());
-	
-	EndSingleTimeCommands(commandBuffer, device, commandPool, queue);
-}
\ No newline at end of file
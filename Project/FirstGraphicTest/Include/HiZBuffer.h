@@ -0,0 +1,54 @@
+#pragma once
+#include "Helper.h"
+#include "GraphicSystem.h"
+
+// Max depth pyramid of the GraphicSystem depth buffer for occlusion tests. Level 0 is half the depth resolution rounded up
+// and every further level halves again down to 1x1, so texel t of level k holds the farthest depth of the pixels t << (k + 1)
+// up to ((t + 1) << (k + 1)) - 1. Built by Shader/hiz.comp one level per dispatch, the pyramid stays in VK_IMAGE_LAYOUT_GENERAL
+class HiZBuffer
+{
+public:
+	HiZBuffer();
+	~HiZBuffer();
+
+	bool Init(GraphicSystem* pGraphicSystem);
+	void Finalize();
+
+	// After a render pass that stored depth. The depth image is sampled in between and handed back in DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+	// the pyramid is readable by compute shaders afterwards
+	void RecordBuild(VkCommandBuffer commandBuffer);
+
+	// All levels, for texelFetch
+	VkImageView GetImageView()
+	{
+		return m_ImageView;
+	}
+	VkSampler GetSampler()
+	{
+		return m_Sampler;
+	}
+	uint32_t GetLevelCount()
+	{
+		return m_LevelCount;
+	}
+
+private:
+	GraphicSystem* m_pGraphicSystem = nullptr;
+	VkDevice m_Device = VK_NULL_HANDLE;
+	VkExtent2D m_Extent = {};
+	uint32_t m_LevelCount = 0;
+
+	VkImage m_Image = VK_NULL_HANDLE;
+	MemoryAllocation m_ImageMemory;
+	VkImageView m_ImageView = VK_NULL_HANDLE;
+	std::vector<VkImageView> m_LevelViews;
+	VkSampler m_Sampler = VK_NULL_HANDLE;
+
+	VkShaderModule m_ShaderModule = VK_NULL_HANDLE;
+	VkDescriptorSetLayout m_DescriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool m_DescriptorPool = VK_NULL_HANDLE;
+	// Set i reads level i - 1, or the depth buffer for level 0, and writes level i
+	std::vector<VkDescriptorSet> m_DescriptorSets;
+	VkPipelineLayout m_PipelineLayout = VK_NULL_HANDLE;
+	VkPipeline m_Pipeline = VK_NULL_HANDLE;
+};
@@ -1,7 +1,57 @@
 #pragma once
 #include "Helper.h"
+#include "UniformArena.h"
+#include "MemoryAllocator.h"
 
 class Light;
+class GraphicSystem;
+class SceneBvh;
+struct Camera;
+
+struct LightInfo
+{
+	glm::vec4 LightPos; // xyz: lightPos
+	glm::vec4 LightDir; // xyz: lightDir
+	glm::vec4 lightColor = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f); // xyz: color, w : intensity
+	glm::vec4 lightInfo = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);// x: range, y: innerAngleCos, z: outerAngleCos w: lightType
+};
+
+static const int MaxLightCount = 4096;
+
+// Froxel grid over the view frustum: screen tiles times exponential depth slices
+static const uint32_t LightClusterCountX = 16;
+static const uint32_t LightClusterCountY = 9;
+static const uint32_t LightClusterCountZ = 24;
+static const uint32_t LightClusterCount = LightClusterCountX * LightClusterCountY * LightClusterCountZ;
+// 128 lights per cluster on average, the lists of the last clusters are cut short past it
+static const uint32_t MaxLightIndexCount = LightClusterCount * 128;
+
+// std140 mirror of LightClusterUniformBufferObject in Shader/lights.glsl
+struct LightClusterUniform
+{
+	glm::mat4 viewMtx;
+	glm::vec4 clusterScale = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f); // x, y : tile size in pixels, z : depth slice scale, w : depth slice bias
+	glm::uvec4 clusterGrid = glm::uvec4(LightClusterCountX, LightClusterCountY, LightClusterCountZ, 0); // w : global light count
+	glm::uvec4 lightCount = glm::uvec4(0); // x : lights in the light buffer, global ones included
+};
+
+struct LightClusterStats
+{
+	uint32_t lightCount = 0;
+	// Directional lights and lights without a range, evaluated by every fragment
+	uint32_t globalLightCount = 0;
+	// Ranged lights entirely outside the view frustum
+	uint32_t culledLightCount = 0;
+	// Ranged lights in view whose sphere touches no object of the scene BVH
+	uint32_t unlitLightCount = 0;
+	// Light / object pairs found through the scene BVH
+	uint32_t litObjectCount = 0;
+	uint32_t indexCount = 0;
+	uint32_t maxClusterLightCount = 0;
+	// Cluster entries that did not fit MaxLightIndexCount
+	uint32_t droppedIndexCount = 0;
+	float assignTimeMs = 0.0f;
+};
 
 class LightManager
 {
@@ -13,6 +63,46 @@ private:
 
 	std::vector<Light*> lightList;
 
+	// Froxels a ranged light touches, inclusive
+	struct LightClusterBounds
+	{
+		uint32_t light;
+		glm::uvec3 minCluster;
+		glm::uvec3 maxCluster;
+	};
+
+	void FillLightInfo(Light* pLight, LightInfo* pInfo);
+	bool ComputeClusterBounds(Light* pLight, const Camera& camera, LightClusterBounds* pBounds);
+
+	// Gathered once per frame and bound as descriptor set 0, which every pipeline shares: the cluster parameters in the
+	// uniform arena, the lights, the per-cluster ranges and the light index lists in a per-frame region of a storage buffer
+	GraphicSystem* m_pGraphicSystem = nullptr;
+	VkDevice m_Device = VK_NULL_HANDLE;
+	UniformArena* m_pUniformArena = nullptr;
+	UniformSlot m_UniformSlot;
+	LightClusterUniform m_ClusterData;
+
+	VkBuffer m_LightBuffer = VK_NULL_HANDLE;
+	MemoryAllocation m_LightBufferMemory;
+	VkDeviceSize m_LightRegionSize = 0;
+	VkDeviceSize m_ClusterOffset = 0;
+	VkDeviceSize m_IndexOffset = 0;
+
+	// Built on the CPU each frame and copied into the frame region, kept so assignment does not allocate
+	std::vector<LightClusterBounds> m_ClusterBounds;
+	std::vector<glm::uvec2> m_ClusterRanges; // x : first index, y : count
+	std::vector<uint32_t> m_ClusterFill;
+	std::vector<uint32_t> m_LightIndices;
+	LightClusterStats m_Stats;
+
+	SceneBvh* m_pSceneBvh = nullptr;
+	std::vector<uint32_t> m_LitObjects;
+
+	VkDescriptorSetLayout m_DescriptorSetLayout = VK_NULL_HANDLE;
+	VkPipelineLayout m_PipelineLayout = VK_NULL_HANDLE;
+	VkDescriptorPool m_DescriptorPool = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSet> m_DescriptorSets;
+
 public:
 	void Finalize();
 	static LightManager& GetInstance()
@@ -27,5 +117,30 @@ public:
 	Light* GetLight(int index);
 
 	int GetLightCount();
+
+	void InitUniform(GraphicSystem* pGraphicSystem);
+	// Call once per frame after the light transforms and the camera are final, assigns the lights to the clusters
+	void UpdateUniform(uint32_t frameIndex);
+	// Ranged lights are then assigned to the objects within their range first and dropped when there are none.
+	// The BVH has to be refit before UpdateUniform, nullptr or an empty BVH keeps every light in view
+	void SetSceneBvh(SceneBvh* pSceneBvh)
+	{
+		m_pSceneBvh = pSceneBvh;
+	}
+
+	// Layout of set 0, pipeline layouts of all scene pipelines start with it
+	VkDescriptorSetLayout GetDescriptorSetLayout()
+	{
+		return m_DescriptorSetLayout;
+	}
+	// Stays bound across pipeline changes since every pipeline layout has the same set 0.
+	// Compute pipelines that include Shader/lights.glsl bind it at VK_PIPELINE_BIND_POINT_COMPUTE themselves
+	void Bind(VkCommandBuffer commandBuffer, uint32_t frameIndex, VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS);
+
+	LightClusterStats GetStats()
+	{
+		return m_Stats;
+	}
+	void PrintStats();
 };
 
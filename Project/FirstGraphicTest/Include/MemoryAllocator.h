@@ -0,0 +1,209 @@
+#pragma once
+#include "Helper.h"
+
+#include <mutex>
+
+enum MemoryAllocationStrategy
+{
+	MEMORY_STRATEGY_FREE_LIST = 0,	// general purpose, best-fit over a sorted free range list
+	MEMORY_STRATEGY_LINEAR = 1,		// bump allocation, a block is recycled once all of its allocations are freed
+};
+
+enum MemoryResourceType
+{
+	MEMORY_RESOURCE_LINEAR = 0,		// buffers and linear-tiling images
+	MEMORY_RESOURCE_OPTIMAL = 1,	// optimal-tiling images
+};
+
+struct MemoryBlock;
+
+struct MemoryAllocation
+{
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	void* pMappedData = nullptr;
+	uint32_t memoryTypeIndex = 0;
+
+	// Range actually taken from the block, alignment padding included. pBlock is nullptr for dedicated allocations
+	MemoryBlock* pBlock = nullptr;
+	VkDeviceSize blockOffset = 0;
+	VkDeviceSize blockSize = 0;
+};
+
+struct MemoryAllocatorStats
+{
+	uint32_t blockCount = 0;
+	uint32_t dedicatedAllocationCount = 0;
+	uint32_t allocationCount = 0;
+	VkDeviceSize reservedBytes = 0;			// sum of all vkAllocateMemory sizes
+	VkDeviceSize usedBytes = 0;				// sum of requested allocation sizes
+	VkDeviceSize alignmentWasteBytes = 0;	// padding inserted to satisfy alignment
+	VkDeviceSize freeBytes = 0;
+	VkDeviceSize largestFreeRange = 0;
+	uint32_t freeRangeCount = 0;
+
+	// 0 : all free memory is one contiguous range, close to 1 : free memory is scattered in small holes
+	float GetFragmentation() const
+	{
+		if (freeBytes == 0)
+		{
+			return 0.0f;
+		}
+		return 1.0f - static_cast<float>(largestFreeRange) / static_cast<float>(freeBytes);
+	}
+
+	void Add(const MemoryAllocatorStats& other)
+	{
+		blockCount += other.blockCount;
+		dedicatedAllocationCount += other.dedicatedAllocationCount;
+		allocationCount += other.allocationCount;
+		reservedBytes += other.reservedBytes;
+		usedBytes += other.usedBytes;
+		alignmentWasteBytes += other.alignmentWasteBytes;
+		freeBytes += other.freeBytes;
+		largestFreeRange = std::max(largestFreeRange, other.largestFreeRange);
+		freeRangeCount += other.freeRangeCount;
+	}
+};
+
+struct MemoryBlock
+{
+	struct Range
+	{
+		VkDeviceSize offset;
+		VkDeviceSize size;
+	};
+
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize size = 0;
+	void* pMappedData = nullptr;
+	uint32_t memoryTypeIndex = 0;
+	MemoryResourceType resourceType = MEMORY_RESOURCE_LINEAR;
+	MemoryAllocationStrategy strategy = MEMORY_STRATEGY_FREE_LIST;
+
+	std::vector<Range> freeRanges;	// MEMORY_STRATEGY_FREE_LIST, sorted by offset and never adjacent
+	VkDeviceSize linearOffset = 0;	// MEMORY_STRATEGY_LINEAR
+
+	uint32_t allocationCount = 0;
+	VkDeviceSize usedBytes = 0;
+	VkDeviceSize alignmentWasteBytes = 0;
+};
+
+// Sub-allocates VkDeviceMemory blocks per memory type so resources do not each pay for a vkAllocateMemory.
+// Host visible blocks stay mapped for their whole lifetime, MemoryAllocation::pMappedData points at the allocation.
+class MemoryAllocator
+{
+public:
+	MemoryAllocator();
+	~MemoryAllocator();
+
+	void Init(VkDevice device, VkPhysicalDevice physicalDevice);
+	void Finalize();
+
+	bool Allocate(
+		MemoryAllocation* pAllocation,
+		const VkMemoryRequirements& requirements,
+		VkMemoryPropertyFlags propertyFlags,
+		MemoryResourceType resourceType,
+		MemoryAllocationStrategy strategy);
+	void Free(MemoryAllocation* pAllocation);
+
+	MemoryAllocatorStats GetStats(uint32_t memoryTypeIndex);
+	MemoryAllocatorStats GetTotalStats();
+	void PrintStats();
+
+private:
+	MemoryBlock* CreateBlock(uint32_t memoryTypeIndex, VkDeviceSize size, MemoryResourceType resourceType, MemoryAllocationStrategy strategy);
+	void DestroyBlock(MemoryBlock* pBlock);
+	bool AllocateFromBlock(MemoryBlock* pBlock, VkDeviceSize size, VkDeviceSize alignment, MemoryAllocation* pAllocation);
+	VkDeviceSize GetBlockSize(uint32_t memoryTypeIndex);
+
+	VkDevice m_Device = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties m_MemoryProperties;
+	VkDeviceSize m_BufferImageGranularity = 1;
+
+	std::vector<MemoryBlock*> m_Blocks;
+
+	struct DedicatedStats
+	{
+		uint32_t count = 0;
+		VkDeviceSize bytes = 0;
+	};
+	std::vector<DedicatedStats> m_DedicatedStats;
+
+	std::mutex m_Mutex;
+};
+
+static void CreateBuffer(
+	VkBuffer* pBuffer,
+	MemoryAllocation* pAllocation,
+	VkDeviceSize size,
+	VkBufferUsageFlags usageFlags,
+	VkMemoryPropertyFlags propertyFlags,
+	VkDevice device,
+	MemoryAllocator* pAllocator,
+	MemoryAllocationStrategy strategy = MEMORY_STRATEGY_FREE_LIST)
+{
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = usageFlags;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VkResult result = vkCreateBuffer(device, &bufferInfo, nullptr, pBuffer);
+
+	VkMemoryRequirements memRequirments;
+	vkGetBufferMemoryRequirements(device, *pBuffer, &memRequirments);
+
+	pAllocator->Allocate(pAllocation, memRequirments, propertyFlags, MEMORY_RESOURCE_LINEAR, strategy);
+
+	result = vkBindBufferMemory(device, *pBuffer, pAllocation->memory, pAllocation->offset);
+}
+
+static void CreateImage(
+	VkImage* pImage,
+	MemoryAllocation* pAllocation,
+	VkDevice device,
+	MemoryAllocator* pAllocator,
+	uint32_t width,
+	uint32_t height,
+	uint32_t layers,
+	uint32_t mipLevels,
+	VkImageType imageType,
+	VkFormat format,
+	VkImageTiling tiling,
+	VkImageUsageFlags usageFlags,
+	VkMemoryPropertyFlags propertyFlags)
+{
+	VkImageCreateInfo imageInfo = {};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = imageType;
+	imageInfo.extent.width = width;
+	imageInfo.extent.height = height;
+	imageInfo.extent.depth = 1;
+	imageInfo.mipLevels = mipLevels;
+	imageInfo.arrayLayers = layers;
+
+	imageInfo.format = format;
+	imageInfo.tiling = tiling;//VK_IMAGE_TILING_LINEAR //VK_IMAGE_TILING_OPTIMAL
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageInfo.usage = usageFlags;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.flags = 0;
+	if (layers == 6)
+	{
+		imageInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+	}
+
+	vkCreateImage(device, &imageInfo, nullptr, pImage);
+
+	VkMemoryRequirements memRequirments;
+	vkGetImageMemoryRequirements(device, *pImage, &memRequirments);
+
+	MemoryResourceType resourceType = tiling == VK_IMAGE_TILING_OPTIMAL ? MEMORY_RESOURCE_OPTIMAL : MEMORY_RESOURCE_LINEAR;
+	pAllocator->Allocate(pAllocation, memRequirments, propertyFlags, resourceType, MEMORY_STRATEGY_FREE_LIST);
+
+	VkResult result = vkBindImageMemory(device, *pImage, pAllocation->memory, pAllocation->offset);
+}
@@ -2,6 +2,7 @@
 #include <string>
 #include "RenderObject.h"
 #include "Light.h"
+#include "DrawList.h"
 
 typedef std::vector<RenderObject*> Mesh;
 
@@ -15,13 +16,23 @@ public:
 	void CreateModel(std::string textureName, const void* pVertexData, size_t vertexCount, const void* pIndexData, size_t indexCount, GraphicSystem* pGraphicSystem);
 	void CreateModel(std::string fileName, std::string textureRoot, GraphicSystem* pGraphicSystem);
 	
-	void Draw(VkCommandBuffer commandBuffer, uint32_t index);
+	// Adds every RenderObject of a visible model, called each frame while building the frame's draw list
+	void GatherDrawItems(DrawList* pDrawList);
 
 	void Update(uint32_t index);
 
+	// Appends every RenderObject of the model, the order stays fixed for the model's lifetime
+	void GetRenderObjects(std::vector<RenderObject*>* pRenderObjects);
+	// Set by SetTranslate/SetRotate/SetScale, cleared by the next Update once the objects' bounds follow
+	bool IsTransformChanged()
+	{
+		return m_IsTransformChanged;
+	}
+
 	void SetTranslate(glm::vec3 translateVec)
 	{
 		m_Translate = translateVec;
+		m_IsTransformChanged = true;
 		//m_Transform.modelMtx = glm::translate(glm::mat4(1.0f), glm::vec3(0, m_Offset, 0));
 		//m_Transform.modelMtx = glm::rotate(m_Transform.modelMtx, /*time * */glm::radians(0.0f), glm::vec3(1.0f, 0.0f, 0.0f)); //glm::mat4(1.0);
 	}
@@ -29,16 +40,33 @@ public:
 	{
 		//m_Transform.modelMtx = glm::rotate(m_Transform.modelMtx, /*time * */glm::radians(0.0f), glm::vec3(1.0f, 0.0f, 0.0f)); //glm::mat4(1.0);
 		m_Rotate = rotateQuat;
+		m_IsTransformChanged = true;
 	}
 	void SetScale(glm::vec3 scale)
 	{
 		m_Scale = scale;
+		m_IsTransformChanged = true;
+	}
+	void SetVisible(bool isVisible)
+	{
+		m_IsVisible = isVisible;
+	}
+	bool IsVisible()
+	{
+		return m_IsVisible;
 	}
 
 private:
 	VkDevice m_Device;
+	ShaderModuleCache* m_pShaderModuleCache;
 	VkShaderModule m_VsShaderModule;
 	VkShaderModule m_FsShaderModule;
+	// Depth pre-pass, VK_NULL_HANDLE when the shaders were not compiled
+	VkShaderModule m_DepthVsShaderModule;
+	VkShaderModule m_DepthMaskVsShaderModule;
+	VkShaderModule m_DepthFsShaderModule;
+	// Deferred path, VK_NULL_HANDLE when the shader was not compiled
+	VkShaderModule m_GBufferFsShaderModule;
 	std::vector<Mesh> meshes;
 	std::vector<Light*> lights;
 
@@ -46,6 +74,8 @@ private:
 	glm::vec3 m_Scale;
 	glm::quat m_Rotate;
 	glm::mat4 m_WorldTransform;
+	bool m_IsVisible;
+	bool m_IsTransformChanged;
 
 };
 
@@ -0,0 +1,63 @@
+#pragma once
+#include "Helper.h"
+#include "DrawList.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Splits a DrawList into one chunk per worker thread. Each chunk is recorded into a secondary command buffer from
+// that thread's own pool for the frame, and the primary then runs them all with a single vkCmdExecuteCommands
+class ParallelRecorder
+{
+public:
+	ParallelRecorder();
+	~ParallelRecorder();
+
+	void Init(VkDevice device, uint32_t queueFamilyIndex, uint32_t frameCount, uint32_t threadCount);
+	void Finalize();
+
+	// The render pass must be begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS. beginCommands runs at the start of
+	// every secondary, bindings made in the primary are not inherited. Same contract as CommandBuffer::Reset for the frame
+	void Record(
+		VkCommandBuffer primaryCommandBuffer,
+		uint32_t frameIndex,
+		VkRenderPass renderPass,
+		VkFramebuffer framebuffer,
+		DrawList* pDrawList,
+		const std::function<void(VkCommandBuffer)>& beginCommands);
+
+	uint32_t GetThreadCount()
+	{
+		return m_ThreadCount;
+	}
+
+private:
+	void WorkerMain(uint32_t threadIndex);
+	void RecordChunk(uint32_t threadIndex);
+
+	VkDevice m_Device = VK_NULL_HANDLE;
+	uint32_t m_ThreadCount = 0;
+
+	// [frameIndex * m_ThreadCount + threadIndex]
+	std::vector<VkCommandPool> m_CommandPools;
+	std::vector<VkCommandBuffer> m_CommandBuffers;
+
+	std::vector<std::thread> m_Threads;
+	std::mutex m_Mutex;
+	std::condition_variable m_StartCondition;
+	std::condition_variable m_DoneCondition;
+	uint64_t m_Generation = 0;
+	uint32_t m_PendingCount = 0;
+	bool m_IsExiting = false;
+
+	// Current job, written before m_Generation is bumped and read-only while workers run
+	uint32_t m_FrameIndex = 0;
+	VkRenderPass m_RenderPass = VK_NULL_HANDLE;
+	VkFramebuffer m_Framebuffer = VK_NULL_HANDLE;
+	DrawList* m_pDrawList = nullptr;
+	const std::function<void(VkCommandBuffer)>* m_pBeginCommands = nullptr;
+	size_t m_ChunkSize = 0;
+	uint32_t m_ChunkCount = 0;
+};
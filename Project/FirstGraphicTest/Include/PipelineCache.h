@@ -0,0 +1,58 @@
+#pragma once
+#include "Helper.h"
+
+#include <mutex>
+
+// Written in front of the vkGetPipelineCacheData blob so a cache from another GPU or driver is never fed back
+struct PipelineCacheFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t dataSize;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+};
+
+struct PipelineCacheStats
+{
+	bool isLoadedFromDisk = false;
+	size_t loadedBytes = 0;
+	uint32_t pipelineCount = 0;
+	double totalCreateMs = 0.0;
+	double maxCreateMs = 0.0;
+};
+
+class PipelineCache
+{
+public:
+	PipelineCache();
+	~PipelineCache();
+
+	// An empty path keeps the cache in memory only
+	void Init(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& path);
+	void Finalize();
+
+	VkResult CreateGraphicsPipeline(const VkGraphicsPipelineCreateInfo* pCreateInfo, VkPipeline* pPipeline);
+	VkResult CreateComputePipeline(const VkComputePipelineCreateInfo* pCreateInfo, VkPipeline* pPipeline);
+
+	VkPipelineCache GetPipelineCache()
+	{
+		return m_PipelineCache;
+	}
+	PipelineCacheStats GetStats();
+	void PrintStats();
+
+private:
+	bool Load(std::vector<char>& cacheData);
+	void Save();
+
+	VkDevice m_Device = VK_NULL_HANDLE;
+	VkPhysicalDeviceProperties m_DeviceProperties;
+	VkPipelineCache m_PipelineCache = VK_NULL_HANDLE;
+	std::string m_Path;
+
+	PipelineCacheStats m_Stats;
+	std::mutex m_StatsMutex;
+};
@@ -0,0 +1,128 @@
+#pragma once
+#include "Helper.h"
+#include "PipelineCache.h"
+
+#include <unordered_map>
+
+enum VertexLayout
+{
+	VERTEX_LAYOUT_FULL = 0,			// interleaved Vertex records
+	VERTEX_LAYOUT_DEPTH = 1,		// DepthVertex, positions only
+	VERTEX_LAYOUT_DEPTH_MASKED = 2,	// DepthVertex, positions and uvs
+};
+
+// Everything a graphics pipeline of this renderer can differ in. Hashed and compared as raw bytes,
+// keep the members sized so that the struct has no padding
+struct GraphicsPipelineDesc
+{
+	VkShaderModule vertexShaderModule = VK_NULL_HANDLE;
+	// VK_NULL_HANDLE builds a vertex-only pipeline, e.g. for a depth pre-pass with colorWriteMask 0
+	VkShaderModule fragmentShaderModule = VK_NULL_HANDLE;
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	// ShaderModuleCache content hashes, a handle value may be reused by a different module once the old one is destroyed
+	uint64_t vertexShaderHash = 0;
+	uint64_t fragmentShaderHash = 0;
+	uint32_t subpass = 0;
+
+	// specialization constants 0 and 1 of both stages
+	uint32_t vertexAttributeFlags = 0;
+	uint32_t textureAttributeFlags = 0;
+
+	uint32_t cullMode = VK_CULL_MODE_BACK_BIT;
+	uint32_t frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	// Only for BLENDMODE_BLEND materials, opaque ones would pay for the read-modify-write
+	uint32_t isBlendEnabled = VK_FALSE;
+	uint32_t isDepthTestEnabled = VK_TRUE;
+	uint32_t isDepthWriteEnabled = VK_TRUE;
+	uint32_t depthCompareOp = VK_COMPARE_OP_LESS;
+
+	uint32_t viewportWidth = 0;
+	uint32_t viewportHeight = 0;
+	uint32_t colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	// Every color attachment of the subpass gets the same blend state and write mask, e.g. the G-buffer pass
+	uint32_t colorAttachmentCount = 1;
+	uint32_t vertexLayout = VERTEX_LAYOUT_FULL;
+};
+
+// Same rules as GraphicsPipelineDesc: compared as raw bytes, no padding
+struct ComputePipelineDesc
+{
+	VkShaderModule shaderModule = VK_NULL_HANDLE;
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	uint64_t shaderHash = 0;
+	// specialization constant 0
+	uint32_t specialization = 0;
+	uint32_t reserved = 0;
+};
+
+struct PipelineLibraryStats
+{
+	uint32_t pipelineRequestCount = 0;
+	uint32_t pipelineCount = 0;
+	uint32_t pipelineLayoutCount = 0;
+	uint32_t descriptorSetLayoutCount = 0;
+	uint32_t hashCollisionCount = 0;
+};
+
+// Owns every descriptor set layout, pipeline layout and pipeline handed out, users never destroy them.
+// Identical requests return the same handle, so the number of pipelines follows the number of distinct states
+// in the scene instead of the number of primitives
+class PipelineLibrary
+{
+public:
+	PipelineLibrary();
+	~PipelineLibrary();
+
+	void Init(VkDevice device, PipelineCache* pPipelineCache);
+	void Finalize();
+
+	VkDescriptorSetLayout GetDescriptorSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+	VkPipelineLayout GetPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts);
+	// pPipelineId receives a small number unique to the pipeline, e.g. for draw sort keys
+	VkPipeline GetGraphicsPipeline(const GraphicsPipelineDesc& desc, uint32_t* pPipelineId = nullptr);
+	VkPipeline GetComputePipeline(const ComputePipelineDesc& desc);
+
+	PipelineLibraryStats GetStats()
+	{
+		return m_Stats;
+	}
+	void PrintStats();
+
+private:
+	struct DescriptorSetLayoutEntry
+	{
+		std::vector<VkDescriptorSetLayoutBinding> bindings;
+		VkDescriptorSetLayout layout;
+	};
+	struct PipelineLayoutEntry
+	{
+		std::vector<VkDescriptorSetLayout> setLayouts;
+		VkPipelineLayout layout;
+	};
+	struct PipelineEntry
+	{
+		GraphicsPipelineDesc desc;
+		VkPipeline pipeline;
+		uint32_t id;
+	};
+	struct ComputePipelineEntry
+	{
+		ComputePipelineDesc desc;
+		VkPipeline pipeline;
+	};
+
+	VkPipeline CreateGraphicsPipeline(const GraphicsPipelineDesc& desc);
+	VkPipeline CreateComputePipeline(const ComputePipelineDesc& desc);
+
+	VkDevice m_Device = VK_NULL_HANDLE;
+	PipelineCache* m_pPipelineCache = nullptr;
+
+	// A bucket only holds more than one entry on a real 64 bit hash collision
+	std::unordered_map<uint64_t, std::vector<DescriptorSetLayoutEntry>> m_DescriptorSetLayouts;
+	std::unordered_map<uint64_t, std::vector<PipelineLayoutEntry>> m_PipelineLayouts;
+	std::unordered_map<uint64_t, std::vector<PipelineEntry>> m_Pipelines;
+	std::unordered_map<uint64_t, std::vector<ComputePipelineEntry>> m_ComputePipelines;
+
+	PipelineLibraryStats m_Stats;
+};
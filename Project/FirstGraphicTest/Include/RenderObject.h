@@ -1,7 +1,6 @@
 #pragma once
 #include "Helper.h"
 #include "VertexBuffer.h"
-#include "UniformBuffer.h"
 #include "Texture.h"
 
 #include "GraphicSystem.h"
@@ -19,18 +18,29 @@ struct UniformData
 	glm::vec4 emissiveFactor = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
 };
 
-struct LightInfo
+// glTF alpha modes, same values as the BLENDMODE_ defines of the fragment shaders
+enum BlendMode
 {
-	glm::vec4 LightPos; // xyz: lightPos
-	glm::vec4 LightDir; // xyz: lightDir
-	glm::vec4 lightColor = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f); // xyz: color, w : intensity
-	glm::vec4 lightInfo = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);// x: range, y: innerAngleCos, z: outerAngleCos w: lightType
+	BLENDMODE_OPAQUE = 0,
+	BLENDMODE_MASK = 1,
+	BLENDMODE_BLEND = 2,
 };
 
-struct LightInfosUniform
+enum DrawPass
 {
-	LightInfo lightInfos[16];
-	glm::vec4 lightCount = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
+	DRAW_PASS_COLOR = 0,		// depth test LESS with depth writes, no pre-pass ran
+	DRAW_PASS_DEPTH = 1,		// depth only, skipped by BLENDMODE_BLEND objects
+	DRAW_PASS_COLOR_EQUAL = 2,	// after DRAW_PASS_DEPTH, shades only the surface the pre-pass kept
+	DRAW_PASS_GBUFFER = 3,		// GraphicSystem::GetGBufferRenderPass, skipped by BLENDMODE_BLEND objects
+};
+
+// State left bound by the previous Draw into the same command buffer, start every command buffer with a fresh one
+struct DrawBindState
+{
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkBuffer vertexBuffer = VK_NULL_HANDLE;
+	VkBuffer indexBuffer = VK_NULL_HANDLE;
+	VkIndexType indexType = VK_INDEX_TYPE_MAX_ENUM;
 };
 
 class RenderObject
@@ -41,6 +51,7 @@ public:
 	void Finalize();
 
 	void SetGraphicSystem(GraphicSystem* pGraphicSystem);
+	void SetUploadBatch(UploadBatch* pUploadBatch);
 
 	void SetGeometry(const void* pVertexData, size_t vertexCount, const void* pIndexData, size_t indexCount, int indexStride, uint32_t vertexAttributeFlags);
 	
@@ -67,24 +78,99 @@ public:
 
 	void SetVertexShaderModule(VkShaderModule shaderModule);
 	void SetFragmentShaderModule(VkShaderModule shaderModule);
+	// Optional, without them the object has no depth pre-pass and keeps testing LESS in DRAW_PASS_COLOR_EQUAL
+	void SetDepthShaderModules(VkShaderModule vertexShaderModule, VkShaderModule maskVertexShaderModule, VkShaderModule maskFragmentShaderModule);
+	// Optional, without it the object is not drawn by the deferred path
+	void SetGBufferShaderModule(VkShaderModule fragmentShaderModule);
 
 	void Init();
 
 	void Update(uint32_t index);
-	VkBuffer* GetVertexBuffer()
+	// Shared GeometryPool blocks, the object's geometry starts at GetVertexOffset / GetFirstIndex
+	VkBuffer GetVertexBuffer()
 	{
 		return m_VertexBuffer.GetVertexBuffer();
 	}
-	VkBuffer* GetIndexBuffer()
+	VkBuffer GetIndexBuffer()
 	{
 		return m_VertexBuffer.GetIndexBuffer();
 	}
-	UniformBuffer* GetUniformBuffer()
+	int32_t GetVertexOffset()
+	{
+		return m_VertexBuffer.GetVertexOffset();
+	}
+	uint32_t GetFirstIndex()
+	{
+		return m_VertexBuffer.GetFirstIndex();
+	}
+	const GeometryRange& GetVertexRange()
+	{
+		return m_VertexBuffer.GetVertexRange();
+	}
+	const GeometryRange& GetIndexRange()
+	{
+		return m_VertexBuffer.GetIndexRange();
+	}
+	VkIndexType GetIndexType()
+	{
+		return m_VertexBuffer.GetIndexType();
+	}
+	size_t GetVertexCount()
+	{
+		return m_VertexCount;
+	}
+	size_t GetIndexCount()
+	{
+		return m_IndexCount;
+	}
+	// Updated by Update() from the current world and model transforms
+	const BoundingBox& GetWorldBounds()
+	{
+		return m_WorldBounds;
+	}
+	const BoundingBox& GetLocalBounds()
+	{
+		return m_LocalBounds;
+	}
+	const glm::mat4& GetModelMatrix()
+	{
+		return m_UniformData.modelMtx;
+	}
+	// Material factors live next to the transforms in the uniform data
+	const UniformData& GetUniformData()
+	{
+		return m_UniformData;
+	}
+	uint32_t GetVertexAttributeFlags()
+	{
+		return m_VertexAttributeFlags;
+	}
+	uint32_t GetTextureAttributeFlags()
+	{
+		return m_TextureAttributeFlags;
+	}
+	bool IsDoubleSided()
+	{
+		return m_IsDoubleSided;
+	}
+	BlendMode GetBlendMode()
+	{
+		return static_cast<BlendMode>(static_cast<uint32_t>(m_UniformData.blendMode.x));
+	}
+	// Set by Init. Objects built from the same texture files share a material id, different ones may collide
+	uint32_t GetPipelineId()
+	{
+		return m_PipelineId;
+	}
+	uint32_t GetMaterialId()
 	{
-		return &m_UniformBuffer;
+		return m_MaterialId;
 	}
+	// nullptr when the material has no texture in that slot. DFG_TEX and IBL_TEX name their slots even when the flag is not set
+	Texture* GetTexture(TextureAttributeFlag slot);
 
-	void Draw(VkCommandBuffer commandBuffer, uint32_t index);
+	// Skips the pipeline and geometry binds pBindState already holds, then updates it
+	void Draw(VkCommandBuffer commandBuffer, uint32_t index, DrawBindState* pBindState, DrawPass pass);
 
 
 	std::vector<VkDescriptorSet>& GetDescriptorSets()
@@ -118,25 +204,24 @@ public:
 private:
 
 	GraphicSystem* m_pGraphicSystem;
+	UploadBatch* m_pUploadBatch;
 	VkDevice m_Device;
 	VkPhysicalDevice m_PhysicalDevice;
 
 	VertexBuffer m_VertexBuffer;
 
-	UniformBuffer m_UniformBuffer;
-	//UniformBuffer m_LightInfo;
-	//UniformBuffer m_MaterialInfo;
-	UniformBuffer m_LightInfoBuffer;
-
 
 	struct TextureDescriptor
 	{
 		bool isInitialized = false;
 		Texture texture; 
+		// TextureManager data the image was created from, the same for every object using that image file
+		const void* pSourceData = nullptr;
 		uint32_t bindingPoint;
 		VkDescriptorSetLayoutBinding textureBinding;
 		void Init(
 			GraphicSystem* pGraphicSystem,
+			UploadBatch* pUploadBatch,
 			int width,
 			int height,
 			int layers,
@@ -148,6 +233,7 @@ private:
 			uint32_t binding)
 		{
 			isInitialized = true;
+			pSourceData = pTexData;
 
 			VkFormat texFormat = format;
 			if (bitDepth == 64)
@@ -165,7 +251,7 @@ private:
 				imageType = VK_IMAGE_TYPE_2D;
 				imageViewType = VK_IMAGE_VIEW_TYPE_CUBE;
 			}
-			texture.Init(pGraphicSystem, width, height, layers, mipLevels, imageType, imageViewType, texFormat, pTexData, texDataSize);
+			texture.Init(pGraphicSystem, pUploadBatch, width, height, layers, mipLevels, imageType, imageViewType, texFormat, pTexData, texDataSize);
 			bindingPoint = binding;
 			CreateDescriptorSetLayoutBinding(&textureBinding, bindingPoint, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, pGraphicSystem->GetDevice());
 		}
@@ -186,7 +272,7 @@ private:
 	struct UniformDescriptor
 	{
 		bool isInitialized = false;
-		UniformBuffer uniformBuffer;
+		UniformSlot slot;
 		uint32_t bindingPoint;
 		VkDescriptorSetLayoutBinding uniformBinding;
 		void Init(
@@ -194,31 +280,36 @@ private:
 		{
 			isInitialized = true;
 			bindingPoint = binding;//VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT
-			CreateDescriptorSetLayoutBinding(&uniformBinding, bindingPoint, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, shaderStage, pGraphicSystem->GetDevice());
+			CreateDescriptorSetLayoutBinding(&uniformBinding, bindingPoint, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, shaderStage, pGraphicSystem->GetDevice());
 		}
-		void Bind(std::vector<VkDescriptorSet>& descriptorSets)
+		void Bind(VkDevice device, std::vector<VkDescriptorSet>& descriptorSets, UniformArena* pUniformArena)
 		{
-			//texture.Bind(descriptorSets, bindingPoint);
-		}
-		void Finalize()
-		{
-			if (isInitialized == true)
+			VkDescriptorBufferInfo bufferInfo = pUniformArena->GetDescriptorBufferInfo(slot);
+			for (VkDescriptorSet descriptorSet : descriptorSets)
 			{
-				uniformBuffer.Finalize();
+				VkWriteDescriptorSet descriptorWrite = {};
+				descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				descriptorWrite.dstSet = descriptorSet;
+				descriptorWrite.dstBinding = bindingPoint;
+				descriptorWrite.dstArrayElement = 0;
+				descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+				descriptorWrite.descriptorCount = 1;
+				descriptorWrite.pBufferInfo = &bufferInfo;
+				vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
 			}
 		}
 	};
 	UniformDescriptor m_UniformBufferDescriptor;
-	UniformDescriptor m_LightInfosDescriptor;
 
-	VkSpecializationInfo specializationInfo;
-	VkSpecializationMapEntry specializationMapEntry;
-	VkSpecializationMapEntry specializationMapEntry2;
 	uint32_t m_VertexAttributeFlags;
 	uint32_t m_TextureAttributeFlags;
 
 	VkShaderModule m_VertexShaderModule;
 	VkShaderModule m_FragmentShaderModule;
+	VkShaderModule m_DepthVertexShaderModule;
+	VkShaderModule m_DepthMaskVertexShaderModule;
+	VkShaderModule m_DepthFragmentShaderModule;
+	VkShaderModule m_GBufferFragmentShaderModule;
 
 	VkDescriptorSetLayout m_DescriptorSetLayout;
 
@@ -229,14 +320,21 @@ private:
 
 	VkPipelineLayout m_PipelineLayout;
 	VkPipeline m_Pipeline;
+	// VK_NULL_HANDLE when the object takes no part in the depth pre-pass
+	VkPipeline m_DepthPipeline;
+	VkPipeline m_EqualPipeline;
+	// VK_NULL_HANDLE for blended objects, they are shaded forward on top of the lit G-buffer
+	VkPipeline m_GBufferPipeline;
+	uint32_t m_PipelineId;
+	uint32_t m_MaterialId;
 
 	UniformData m_UniformData;
 	glm::mat4 m_WorldMtx;
 	glm::mat4 m_ModelMtx;
+	BoundingBox m_LocalBounds;
+	BoundingBox m_WorldBounds;
 
-	BOOL m_IsDoubleSided;
-
-	LightInfosUniform m_LightInfosData;
+	bool m_IsDoubleSided;
 
 	size_t m_VertexCount;
 	size_t m_IndexCount;
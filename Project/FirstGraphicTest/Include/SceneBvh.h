@@ -0,0 +1,91 @@
+#pragma once
+#include "Helper.h"
+
+#include <atomic>
+
+struct SceneBvhStats
+{
+	uint32_t primitiveCount = 0;
+	uint32_t nodeCount = 0;
+	uint32_t leafCount = 0;
+	uint32_t maxDepth = 0;
+	float buildTimeMs = 0.0f;
+	float refitTimeMs = 0.0f;
+	// Of the last query
+	uint32_t visitedNodeCount = 0;
+};
+
+// Bounding volume hierarchy over opaque primitive indices, in practice the RenderObjects of the scene.
+// Built top down with binned SAH splits, subtrees above a size threshold are built on their own thread.
+// Moving primitives only refits the boxes on the path to the root; rebuild once the tree quality has degraded
+// noticeably, e.g. after objects travelled far from where they were at build time.
+class SceneBvh
+{
+public:
+	SceneBvh();
+	~SceneBvh();
+
+	// threadCount 1 builds and refits on the calling thread only
+	void Init(uint32_t threadCount);
+	void Finalize();
+
+	void Build(const std::vector<BoundingBox>& primitiveBounds);
+
+	// Marks the primitive's leaf for the next Refit
+	void SetPrimitiveBounds(uint32_t primitive, const BoundingBox& bounds);
+	void Refit();
+
+	// Appends every primitive whose box is not completely outside one of the six planes
+	void CullFrustum(const glm::mat4& viewProjMtx, std::vector<uint32_t>* pPrimitives);
+	// Closest primitive box hit along the ray within maxDistance, false if none
+	bool RayCast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, uint32_t* pPrimitive, float* pDistance);
+	// Appends every primitive whose box touches the sphere, e.g. the objects within a light's range
+	void QuerySphere(const glm::vec3& center, float radius, std::vector<uint32_t>* pPrimitives);
+
+	uint32_t GetPrimitiveCount()
+	{
+		return static_cast<uint32_t>(m_PrimitiveBounds.size());
+	}
+	SceneBvhStats GetStats()
+	{
+		return m_Stats;
+	}
+	void PrintStats();
+
+private:
+	// Interior nodes have primitiveCount 0 and their children at first and first + 1,
+	// leaves own m_PrimitiveIndices[first, first + primitiveCount)
+	struct Node
+	{
+		BoundingBox bounds;
+		uint32_t first;
+		uint32_t primitiveCount;
+		uint32_t parent;
+	};
+
+	void BuildNode(uint32_t nodeIndex, uint32_t begin, uint32_t end, uint32_t depth, const std::vector<glm::vec3>& centroids);
+	void MakeLeaf(uint32_t nodeIndex, uint32_t begin, uint32_t end);
+	void RefitNode(uint32_t nodeIndex, uint32_t depth);
+	void UpdateNodeBounds(uint32_t nodeIndex);
+	void AppendSubtree(uint32_t nodeIndex, std::vector<uint32_t>* pPrimitives);
+
+	uint32_t m_ThreadCount = 1;
+	// Subtrees below this depth are never split off to another thread, keeps the thread count near m_ThreadCount
+	uint32_t m_MaxParallelDepth = 0;
+
+	std::vector<Node> m_Nodes;
+	// Children are taken in pairs while building, possibly from several threads
+	std::atomic<uint32_t> m_NodeCount;
+	std::atomic<uint32_t> m_MaxDepth;
+
+	std::vector<BoundingBox> m_PrimitiveBounds;
+	std::vector<uint32_t> m_PrimitiveIndices;
+	std::vector<uint32_t> m_PrimitiveLeaves;
+
+	std::vector<uint32_t> m_DirtyLeaves;
+	std::vector<uint8_t> m_IsNodeDirty;
+
+	std::vector<uint32_t> m_TraversalStack;
+
+	SceneBvhStats m_Stats;
+};
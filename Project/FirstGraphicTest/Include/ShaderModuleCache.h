@@ -0,0 +1,57 @@
+#pragma once
+#include "Helper.h"
+
+#include <unordered_map>
+
+struct ShaderModuleCacheStats
+{
+	uint32_t acquireCount = 0;
+	uint32_t moduleCreateCount = 0;
+	uint32_t liveModuleCount = 0;
+	uint32_t validationFailureCount = 0;
+};
+
+// Loads each SPIR-V file once and hands the same VkShaderModule to every user.
+// Modules are keyed by path and content hash, so a file changed on disk gets a new module while the old one stays
+// alive for whoever still holds it. Acquire and Release must be balanced, the module is destroyed with its last reference
+class ShaderModuleCache
+{
+public:
+	ShaderModuleCache();
+	~ShaderModuleCache();
+
+	void Init(VkDevice device);
+	void Finalize();
+
+	// VK_NULL_HANDLE when the file is missing or is not SPIR-V
+	VkShaderModule Acquire(const std::string& path);
+	void Release(VkShaderModule shaderModule);
+
+	// Stable across runs and module re-creation, unlike the handle. 0 for unknown modules
+	uint64_t GetContentHash(VkShaderModule shaderModule);
+
+	ShaderModuleCacheStats GetStats()
+	{
+		return m_Stats;
+	}
+	void PrintStats();
+
+private:
+	struct Entry
+	{
+		std::string path;
+		uint64_t contentHash;
+		VkShaderModule shaderModule;
+		uint32_t refCount;
+	};
+
+	bool Validate(const std::vector<char>& code, const std::string& path);
+
+	VkDevice m_Device = VK_NULL_HANDLE;
+
+	std::unordered_map<VkShaderModule, Entry> m_Entries;
+	// path + content hash -> module
+	std::map<std::pair<std::string, uint64_t>, VkShaderModule> m_Modules;
+
+	ShaderModuleCacheStats m_Stats;
+};
@@ -0,0 +1,66 @@
+#pragma once
+#include "Helper.h"
+#include "MemoryAllocator.h"
+#include "GpuTimeline.h"
+
+#include <deque>
+
+struct StagingRegion
+{
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	void* pMappedData = nullptr;
+};
+
+// One persistently mapped host-visible buffer handed out front to back.
+// Regions allocated between two Submit calls belong to the timeline value given to Submit and are reused
+// only once the timeline has reached it.
+class StagingRing
+{
+public:
+	StagingRing();
+	~StagingRing();
+
+	void Init(VkDevice device, MemoryAllocator* pAllocator, GpuTimeline* pTimeline, VkDeviceSize size);
+	void Finalize();
+
+	// Fails when the request is larger than the ring or only regions of the still open submission are in the way
+	bool Allocate(VkDeviceSize size, VkDeviceSize alignment, StagingRegion* pRegion);
+
+	// Closes the open submission, timelineValue is what the submission that reads its regions signals
+	void Submit(uint64_t timelineValue);
+
+	VkDeviceSize GetSize()
+	{
+		return m_Size;
+	}
+	bool HasOpenRegions()
+	{
+		return m_OpenStart != m_Head;
+	}
+
+private:
+	struct Submission
+	{
+		uint64_t timelineValue;
+		VkDeviceSize end;
+	};
+
+	void Retire(const Submission& submission);
+	bool WaitForOldest();
+
+	VkDevice m_Device = VK_NULL_HANDLE;
+	MemoryAllocator* m_pAllocator = nullptr;
+	GpuTimeline* m_pTimeline = nullptr;
+
+	VkBuffer m_Buffer = VK_NULL_HANDLE;
+	MemoryAllocation m_Memory;
+	VkDeviceSize m_Size = 0;
+
+	// [m_Tail, m_Head) is in use, wrapping around the end of the buffer. m_Head == m_Tail means empty
+	VkDeviceSize m_Head = 0;
+	VkDeviceSize m_Tail = 0;
+	VkDeviceSize m_OpenStart = 0;
+
+	std::deque<Submission> m_InFlight;
+};
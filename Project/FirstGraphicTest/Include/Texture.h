@@ -1,6 +1,7 @@
 #pragma once
 #include "Helper.h"
 #include "GraphicSystem.h"
+#include "UploadBatch.h"
 
 enum TextureAttributeFlag
 {
@@ -24,6 +25,7 @@ public:
 
 	void Init(
 		GraphicSystem* pGraphicSystem,
+		UploadBatch* pUploadBatch,
 		int width,
 		int height,
 		int layers,
@@ -40,13 +42,28 @@ public:
 	{
 		return m_DescriptorWrites[index];
 	}
+	VkImageView GetImageView()
+	{
+		return m_TextureImageView;
+	}
+	VkSampler GetSampler()
+	{
+		return m_Sampler;
+	}
+	VkImageViewType GetViewType()
+	{
+		return m_ViewType;
+	}
 
 private:
 	VkDevice m_Device;
+	MemoryAllocator* m_pMemoryAllocator;
+	DeletionQueue* m_pDeletionQueue;
 
 	VkImage m_TextureImage;
 	VkImageView m_TextureImageView;
-	VkDeviceMemory m_TextureImageMemory;
+	VkImageViewType m_ViewType;
+	MemoryAllocation m_TextureImageMemory;
 	VkSampler m_Sampler;
 
 	std::vector<VkDescriptorImageInfo> m_ImageInfos;
@@ -0,0 +1,72 @@
+#pragma once
+#include "Helper.h"
+#include "MemoryAllocator.h"
+
+struct UniformSlot
+{
+	VkDeviceSize offset = 0;	// inside one frame region
+	VkDeviceSize size = 0;
+};
+
+// One persistently mapped uniform buffer split into a region per frame. A slot is the same range in every region,
+// so descriptors are written once against the whole buffer and the frame is picked with a dynamic offset at bind time.
+// Writing frame N while the GPU reads frame N-1 is safe as long as frame N's previous use has completed
+class UniformArena
+{
+public:
+	UniformArena();
+	~UniformArena();
+
+	void Init(VkDevice device, VkPhysicalDevice physicalDevice, MemoryAllocator* pAllocator, uint32_t frameCount, VkDeviceSize frameSize);
+	void Finalize();
+
+	// Slots live as long as the arena. Fails once the frame region is full
+	bool AllocateSlot(VkDeviceSize size, UniformSlot* pSlot);
+
+	void Write(const UniformSlot& slot, uint32_t frameIndex, const void* pData, size_t dataSize)
+	{
+		std::memcpy(GetMappedData(slot, frameIndex), pData, dataSize);
+	}
+	void* GetMappedData(const UniformSlot& slot, uint32_t frameIndex)
+	{
+		return static_cast<uint8_t*>(m_Memory.pMappedData) + GetDynamicOffset(slot, frameIndex);
+	}
+	uint32_t GetDynamicOffset(const UniformSlot& slot, uint32_t frameIndex)
+	{
+		return static_cast<uint32_t>(frameIndex * m_FrameSize + slot.offset);
+	}
+
+	// Buffer info for a VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC descriptor of this slot
+	VkDescriptorBufferInfo GetDescriptorBufferInfo(const UniformSlot& slot)
+	{
+		VkDescriptorBufferInfo bufferInfo = {};
+		bufferInfo.buffer = m_Buffer;
+		bufferInfo.offset = 0;
+		bufferInfo.range = slot.size;
+		return bufferInfo;
+	}
+
+	VkBuffer GetBuffer()
+	{
+		return m_Buffer;
+	}
+	uint32_t GetFrameCount()
+	{
+		return m_FrameCount;
+	}
+	void PrintStats();
+
+private:
+	VkDevice m_Device = VK_NULL_HANDLE;
+	MemoryAllocator* m_pAllocator = nullptr;
+
+	VkBuffer m_Buffer = VK_NULL_HANDLE;
+	MemoryAllocation m_Memory;
+
+	VkDeviceSize m_Alignment = 0;
+	VkDeviceSize m_FrameSize = 0;
+	uint32_t m_FrameCount = 0;
+
+	VkDeviceSize m_Head = 0;
+	uint32_t m_SlotCount = 0;
+};
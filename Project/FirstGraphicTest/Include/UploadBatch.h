@@ -0,0 +1,93 @@
+#pragma once
+#include "Helper.h"
+#include "MemoryAllocator.h"
+#include "StagingRing.h"
+
+class GraphicSystem;
+
+// Records staging copies and layout transitions for many resources and submits them together.
+// Staging data lives in the GraphicSystem staging ring, only uploads larger than the ring get a buffer of their own.
+// Copies run on the transfer queue and signal its timeline. With a dedicated transfer family every submission releases
+// its resources to the graphics family, End() submits all matching acquires at once on the graphics queue, waiting on
+// the transfer timeline value of the last copy.
+// Nothing blocks, End() included, unless the ring runs full, in which case the oldest submission is waited on.
+// Command buffers and dedicated staging buffers still in flight at End() are retired through the GraphicSystem DeletionQueue.
+class UploadBatch
+{
+public:
+	UploadBatch();
+	~UploadBatch();
+
+	void Begin(GraphicSystem* pGraphicSystem);
+	void End();
+
+	// Only [dstOffset, dstOffset + dataSize) is released to the graphics family, the rest of the buffer may be in use
+	void UploadBuffer(VkBuffer dstBuffer, const void* pData, size_t dataSize, VkDeviceSize dstOffset = 0);
+	void UploadImage(
+		VkImage dstImage,
+		const void* pData,
+		size_t dataSize,
+		uint32_t width,
+		uint32_t height,
+		uint32_t layers,
+		uint32_t mipLevels,
+		uint32_t bitDepth);
+
+	uint32_t GetSubmitCount()
+	{
+		return m_SubmitCount;
+	}
+
+private:
+	struct StagingBuffer
+	{
+		VkBuffer buffer;
+		MemoryAllocation memory;
+	};
+
+	struct BufferCopy
+	{
+		VkBuffer srcBuffer;
+		VkBuffer dstBuffer;
+		VkBufferCopy region;
+	};
+
+	struct ImageCopy
+	{
+		VkBuffer srcBuffer;
+		VkImage dstImage;
+		std::vector<VkBufferImageCopy> regions;
+	};
+
+	struct Submission
+	{
+		VkCommandBuffer commandBuffer;
+		uint64_t timelineValue;
+		std::vector<StagingBuffer> dedicatedStagingBuffers;
+	};
+
+	void Stage(const void* pData, size_t dataSize, VkBuffer* pBuffer, VkDeviceSize* pOffset);
+	void Submit();
+	// Only once the transfer timeline has reached the submission's value
+	void Retire(Submission& submission);
+
+	GraphicSystem* m_pGraphicSystem = nullptr;
+	VkDevice m_Device = VK_NULL_HANDLE;
+	MemoryAllocator* m_pMemoryAllocator = nullptr;
+	StagingRing* m_pStagingRing = nullptr;
+	GpuTimeline* m_pTransferTimeline = nullptr;
+	GpuTimeline* m_pGraphicsTimeline = nullptr;
+
+	// Commands of the batch being recorded, emitted as one barrier / copies / one barrier on Submit
+	std::vector<StagingBuffer> m_DedicatedStagingBuffers;
+	std::vector<BufferCopy> m_BufferCopies;
+	std::vector<ImageCopy> m_ImageCopies;
+	std::vector<VkImageMemoryBarrier> m_PreCopyBarriers;
+	std::vector<VkImageMemoryBarrier> m_PostCopyBarriers;
+
+	std::vector<Submission> m_Submissions;
+	// Acquire halves of the ownership transfers of every submission, recorded into one command buffer by End()
+	std::vector<VkBufferMemoryBarrier> m_AcquireBufferBarriers;
+	std::vector<VkImageMemoryBarrier> m_AcquireImageBarriers;
+	uint32_t m_SubmitCount = 0;
+};
@@ -1,6 +1,7 @@
 #pragma once
 #include "Helper.h"
 #include "GraphicSystem.h"
+#include "UploadBatch.h"
 
 enum VertexAttributeFlag
 {
@@ -10,6 +11,8 @@ enum VertexAttributeFlag
 	TEXCOORD = 1 << 3,
 };
 
+// Vertex and index ranges of one primitive inside the GraphicSystem's GeometryPool. Draws bind the pool blocks
+// and select the primitive with GetVertexOffset / GetFirstIndex, the depth pre-pass with GetDepthVertexOffset
 class VertexBuffer
 {
 public:
@@ -18,29 +21,55 @@ public:
 
 	void Finalize();
 
-	void CreateVertexBuffer(GraphicSystem* pGraphicSystem, const void* pData, size_t dataSize);
-	void CreateIndexBuffer(GraphicSystem* pGraphicSystem, const void* pData, size_t dataSize, VkIndexType indexType);
+	void CreateVertexBuffer(GraphicSystem* pGraphicSystem, UploadBatch* pUploadBatch, const void* pData, size_t dataSize);
+	void CreateIndexBuffer(GraphicSystem* pGraphicSystem, UploadBatch* pUploadBatch, const void* pData, size_t dataSize, VkIndexType indexType);
 
-	VkBuffer* GetVertexBuffer()
+	VkBuffer GetVertexBuffer()
 	{
-		return &m_VertexBuffer;
+		return m_pGeometryPool->GetVertexBuffer(m_VertexRange.block);
 	}
-	VkBuffer* GetIndexBuffer()
+	VkBuffer GetIndexBuffer()
 	{
-		return &m_IndexBuffer;
+		return m_pGeometryPool->GetIndexBuffer(m_IndexRange.block);
+	}
+	int32_t GetVertexOffset()
+	{
+		return m_pGeometryPool->GetVertexOffset(m_VertexRange);
+	}
+	VkBuffer GetDepthVertexBuffer()
+	{
+		return m_pGeometryPool->GetDepthVertexBuffer(m_DepthVertexRange.block);
+	}
+	VkDeviceSize GetDepthUvStreamOffset()
+	{
+		return m_pGeometryPool->GetDepthUvStreamOffset(m_DepthVertexRange.block);
+	}
+	int32_t GetDepthVertexOffset()
+	{
+		return m_pGeometryPool->GetDepthVertexOffset(m_DepthVertexRange);
+	}
+	uint32_t GetFirstIndex()
+	{
+		return static_cast<uint32_t>(m_IndexRange.offset / GetIndexSize(m_IndexType));
+	}
+	const GeometryRange& GetVertexRange()
+	{
+		return m_VertexRange;
+	}
+	const GeometryRange& GetIndexRange()
+	{
+		return m_IndexRange;
 	}
 	VkIndexType GetIndexType()
 	{
 		return m_IndexType;
 	}
 private:
-	VkBuffer m_VertexBuffer;
-	VkDeviceMemory m_VertexBufferMemory;
-
-	VkBuffer m_IndexBuffer;
-	VkDeviceMemory m_IndexBufferMemory;
+	GeometryRange m_VertexRange;
+	GeometryRange m_IndexRange;
+	GeometryRange m_DepthVertexRange;
 
 	VkIndexType m_IndexType;
 
-	VkDevice m_Device;
+	GeometryPool* m_pGeometryPool;
 };
\ No newline at end of file
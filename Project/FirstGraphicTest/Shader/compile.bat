@@ -1,3 +1,14 @@
 C:\VulkanSDK\1.2.131.2\Bin32\glslc.exe shader.vert -o vs.spv
 C:\VulkanSDK\1.2.131.2\Bin32\glslc.exe shader.frag -o fs.spv
+C:\VulkanSDK\1.2.131.2\Bin32\glslc.exe indirect.vert -o indirect_vs.spv
+C:\VulkanSDK\1.2.131.2\Bin32\glslc.exe indirect.frag -o indirect_fs.spv
+C:\VulkanSDK\1.2.131.2\Bin32\glslc.exe cull.comp -o cull_cs.spv
+C:\VulkanSDK\1.2.131.2\Bin32\glslc.exe hiz.comp -o hiz_cs.spv
+C:\VulkanSDK\1.2.131.2\Bin32\glslc.exe depth.vert -o depth_vs.spv
+C:\VulkanSDK\1.2.131.2\Bin32\glslc.exe depth_mask.vert -o depth_mask_vs.spv
+C:\VulkanSDK\1.2.131.2\Bin32\glslc.exe depth.frag -o depth_fs.spv
+C:\VulkanSDK\1.2.131.2\Bin32\glslc.exe gbuffer.frag -o gbuffer_fs.spv
+C:\VulkanSDK\1.2.131.2\Bin32\glslc.exe tiled_lighting.comp -o tiled_lighting_cs.spv
+C:\VulkanSDK\1.2.131.2\Bin32\glslc.exe composite.vert -o composite_vs.spv
+C:\VulkanSDK\1.2.131.2\Bin32\glslc.exe composite.frag -o composite_fs.spv
 pause
\ No newline at end of file
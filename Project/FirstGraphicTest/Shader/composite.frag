@@ -0,0 +1,12 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Copies the tone mapped output of Shader/tiled_lighting.comp to the swapchain, the image matches the framebuffer size
+layout(set = 0, binding = 0) uniform sampler2D litSampler;
+
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+    outColor = vec4(texelFetch(litSampler, ivec2(gl_FragCoord.xy), 0).rgb, 1.0);
+}
@@ -0,0 +1,27 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Depth pre-pass of BLENDMODE_MASK materials, opaque ones have no fragment stage at all
+layout(location = 0) in vec2 fragTexCoord;
+
+layout(set = 1, binding = 0) uniform UniformBufferObject
+{
+		mat4 modelMtx;
+		mat4 viewMtx;
+		mat4 projMtx;
+		vec4 cameraPos;
+		vec4 baseColorFactor;
+		vec4 metallicRoughness;
+		vec4 blendMode; // x : blendMode, y : alphaCutOff
+		vec4 emissiveFactor;
+} ubo;
+
+layout(set = 1, binding = 2) uniform sampler2D diffuseSampler;
+
+void main()
+{
+    if(texture(diffuseSampler, fragTexCoord).a < ubo.blendMode.y)
+    {
+        discard;
+    }
+}
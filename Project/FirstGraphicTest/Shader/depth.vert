@@ -0,0 +1,21 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Depth pre-pass of opaque materials, reads the GeometryPool's packed position stream and nothing else.
+// depth_mask.vert is the same with the uv for the alpha test
+layout(location = 0) in vec3 inPos;
+
+layout(set = 1, binding = 0) uniform UniformBufferObject
+{
+		mat4 modelMtx;
+		mat4 viewMtx;
+		mat4 projMtx;
+} ubo;
+
+// Same expression as shader.vert, the main pass tests the depth written here with EQUAL
+invariant gl_Position;
+
+void main()
+{
+    gl_Position = ubo.projMtx * ubo.viewMtx * ubo.modelMtx * vec4(inPos, 1.0);
+}
@@ -0,0 +1,24 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Depth pre-pass of BLENDMODE_MASK materials, the packed uv stream follows the positions for depth.frag's alpha test
+layout(location = 0) in vec3 inPos;
+layout(location = 3) in vec2 inUv;
+
+layout(location = 0) out vec2 fragTexCoord;
+
+layout(set = 1, binding = 0) uniform UniformBufferObject
+{
+		mat4 modelMtx;
+		mat4 viewMtx;
+		mat4 projMtx;
+} ubo;
+
+// Same expression as shader.vert, the main pass tests the depth written here with EQUAL
+invariant gl_Position;
+
+void main()
+{
+    gl_Position = ubo.projMtx * ubo.viewMtx * ubo.modelMtx * vec4(inPos, 1.0);
+	fragTexCoord = inUv;
+}
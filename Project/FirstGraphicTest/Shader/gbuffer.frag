@@ -0,0 +1,180 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : enable
+
+#define BLENDMODE_OPAQUE 0
+#define BLENDMODE_MASK 1
+#define BLENDMODE_BLEND 2
+
+#define POSION 1
+#define NORMAL 1 << 1
+#define TANGENT 1 << 2
+#define TEXCOORD 1 << 3
+
+#define DIFFUSE_TEX 1
+#define NORMAL_TEX 1 << 1
+#define METALLICROUGHNESS_TEX 1 << 2
+#define EMISSIVE_TEX 1 << 3
+#define OCCLUSION_TEX 1 << 4
+#define OCCLUSION_IN_METALLICROUGHNESS_TEX 1 << 5
+#define DFG_TEX 1 << 8
+#define IBL_TEX 1 << 9
+layout(constant_id = 0) const int VTX_STATE = POSION | NORMAL | TANGENT | TEXCOORD;
+layout(constant_id = 1) const int TEXTURE_STATE = 
+    DIFFUSE_TEX | 
+    NORMAL_TEX | 
+    METALLICROUGHNESS_TEX | 
+    EMISSIVE_TEX | 
+    OCCLUSION_TEX | 
+    OCCLUSION_IN_METALLICROUGHNESS_TEX | 
+    DFG_TEX |
+    IBL_TEX;
+
+layout(location = 0) in vec2 fragTexCoord;
+layout(location = 1) in vec3 fragNormal;
+layout(location = 2) in vec3 fragTangent;
+layout(location = 3) in vec3 fragBinormal;
+layout(location = 4) in vec4 fragPos;
+
+#include "brdf.glsl"
+
+// Deferred path: writes the material at the surface for Shader/tiled_lighting.comp, GBufferAttachment in GraphicSystem.h.
+// Never used by BLENDMODE_BLEND materials, they are shaded forward after the lighting pass
+layout(set = 1, binding = 0) uniform UniformBufferObject
+{
+		mat4 modelMtx;
+		mat4 viewMtx;
+		mat4 projMtx;
+		vec4 cameraPos;
+		vec4 baseColorFactor;
+		vec4 metallicRoughness; // y : roughness, z : metallic
+		vec4 blendMode; // x : blendMode, y : alphaCutOff
+		vec4 emissiveFactor;
+} ubo;
+
+layout(set = 1, binding = 2) uniform sampler2D diffuseSampler;
+layout(set = 1, binding = 3) uniform sampler2D normalSampler;
+layout(set = 1, binding = 4) uniform sampler2D MetallicRoughnessSampler;
+layout(set = 1, binding = 5) uniform sampler2D EmissiveSampler;
+layout(set = 1, binding = 6) uniform sampler2D OcclusionSampler;
+layout(set = 1, binding = 9) uniform sampler2D DfgSampler;
+layout(set = 1, binding = 10) uniform samplerCube IBLSampler;
+
+layout(location = 0) out vec4 outBaseColor;
+layout(location = 1) out vec4 outNormal;
+layout(location = 2) out vec4 outMaterial;
+layout(location = 3) out vec4 outEmissive;
+
+vec3 PrefilteredDFG_LUT(float lod, float NoV) {
+    // coord = sqrt(linear_roughness), which is the mapping used by cmgen.
+    return textureLod(DfgSampler, vec2(NoV, lod), 0.0).rgb;
+}
+
+void main()
+{
+    vec4 diffuseTex = texture(diffuseSampler, fragTexCoord);
+    if(ubo.blendMode.x == BLENDMODE_MASK && diffuseTex.a < ubo.blendMode.y)
+    {
+        discard;
+    }
+
+    vec3 t = fragTangent;
+    vec3 b = fragBinormal;
+
+    if((VTX_STATE & TANGENT) != TANGENT)
+	{
+        vec3 pos_dx = dFdx(fragPos.xyz);
+        vec3 pos_dy = dFdy(fragPos.xyz);
+        vec3 tex_dx = dFdx(vec3(fragTexCoord, 0.0));
+        vec3 tex_dy = dFdy(vec3(fragTexCoord, 0.0));
+        t = (tex_dy.t * pos_dx - tex_dx.t * pos_dy) / (tex_dx.s * tex_dy.t - tex_dy.s * tex_dx.t);
+
+        vec3 ng = normalize(fragNormal);
+
+        t = normalize(t - ng * dot(ng, t));
+        b = normalize(-cross(ng, t));
+    }
+
+	mat3 TBN = mat3(t, b, fragNormal);
+
+    vec3 normal = fragNormal;
+    if((TEXTURE_STATE & NORMAL_TEX) == NORMAL_TEX)
+    {
+        vec4 normalTex = texture(normalSampler, fragTexCoord);
+
+        vec3 sampledNormal = 2.0f * normalTex.xyz - 1.0f - 0.00392f;
+        sampledNormal.y *= -1.0;
+
+	    normal = TBN * sampledNormal;
+    }
+	
+	normal = normalize(normal);
+
+    //============================================================
+    vec3 baseColor = ubo.baseColorFactor.rgb * diffuseTex.xyz;
+    float matMetallic = ubo.metallicRoughness.x;
+    float matRoughness = ubo.metallicRoughness.y;
+    vec3 matEmissiveFactor = ubo.emissiveFactor.xyz;
+    float matReflectance = 1.0f;
+
+    float occlusion = 1.0f;
+
+    float perceptualRoughness = matRoughness;
+    float roughness = matRoughness * matRoughness;
+    float metallic = matMetallic;
+    if((TEXTURE_STATE & METALLICROUGHNESS_TEX) == METALLICROUGHNESS_TEX)
+    {
+        vec4 metallicRoughnessTex = texture(MetallicRoughnessSampler, fragTexCoord);
+        perceptualRoughness = matRoughness * metallicRoughnessTex.y;
+        roughness = perceptualRoughness * perceptualRoughness;
+
+        metallic = matMetallic * metallicRoughnessTex.z;
+        
+        if((TEXTURE_STATE & OCCLUSION_IN_METALLICROUGHNESS_TEX) == OCCLUSION_IN_METALLICROUGHNESS_TEX)
+        {
+            occlusion = metallicRoughnessTex.x;
+        }
+    }
+    if((TEXTURE_STATE & OCCLUSION_TEX) == OCCLUSION_TEX)
+    {
+        occlusion = texture(OcclusionSampler, fragTexCoord).x;
+    }
+
+    vec3 emissive = matEmissiveFactor;
+    if((TEXTURE_STATE & EMISSIVE_TEX) == EMISSIVE_TEX)
+    {
+        emissive = emissive * texture(EmissiveSampler, fragTexCoord).xyz;
+    }
+
+    //====================================================================
+    // Light that does not depend on the punctual lights is resolved here, same terms as shader.frag
+
+    float reflectance = computeDielectricF0(matReflectance);
+
+    vec3 diffuseColor = computeDiffuseColor(baseColor, metallic);
+    vec3 specularColor = baseColor.rgb * metallic;
+
+    vec3 toViewDir = normalize(ubo.cameraPos.xyz - fragPos.xyz);
+    float NoV = clampNoV(dot(toViewDir, normal));
+
+    vec3 dfg = PrefilteredDFG_LUT(roughness, NoV);
+
+    vec3 iblColor = vec3(0);
+    if((TEXTURE_STATE & IBL_TEX) == IBL_TEX)
+    {
+        vec3 viewReflect = reflect(-toViewDir, normal);
+        const int MipCount = 10;
+        float lod = clamp(MipCount * roughness,  0.0, MipCount);
+
+        iblColor = textureLod(IBLSampler, viewReflect, lod).xyz;
+    }
+
+    vec3 ambient = (specularColor * dfg.xxx + dfg.yyy) * iblColor;
+    ambient += diffuseColor * 0.1f * occlusion;
+    ambient += emissive;
+
+    outBaseColor = vec4(baseColor, 1.0f);
+    outNormal = vec4(normal * 0.5f + 0.5f, 1.0f);
+    outMaterial = vec4(metallic, perceptualRoughness, occlusion, 1.0f);
+    outEmissive = vec4(ambient, 1.0f);
+}
@@ -0,0 +1,53 @@
+// Scene storage buffer of the GPU-driven path, mirrors GpuFrameData and GpuInstanceData in GpuScene.h (std430).
+// Define SCENE_SET before including, compute binds the scene at set 0 and graphics at set 1
+
+#ifndef GPU_SCENE_GLSL
+#define GPU_SCENE_GLSL
+
+#define TEXTURE_SLOT_DIFFUSE 0
+#define TEXTURE_SLOT_NORMAL 1
+#define TEXTURE_SLOT_METALLICROUGHNESS 2
+#define TEXTURE_SLOT_EMISSIVE 3
+#define TEXTURE_SLOT_OCCLUSION 4
+#define TEXTURE_SLOT_DFG 5
+#define TEXTURE_SLOT_IBL 6 // index into the cube array
+
+struct FrameData
+{
+    mat4 viewMtx;
+    mat4 projMtx;
+    vec4 cameraPos;
+    vec4 frustumPlanes[6];
+    uint instanceCount;
+    uint bucketCount;
+    uint depthWidth; // depth buffer the Hi-Z pyramid is built from
+    uint depthHeight;
+};
+
+struct InstanceData
+{
+    mat4 modelMtx;
+    vec4 localBoundsMin;
+    vec4 localBoundsMax;
+    vec4 baseColorFactor;
+    vec4 metallicRoughness; // y : roughness, z : metallic
+    vec4 blendMode; // x : blendMode, y : alphaCutOff
+    vec4 emissiveFactor;
+    uint indexCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint bucket;
+    uint firstCommand; // of the bucket's range in the draw command buffer
+    uint isVisible;
+    uint reserved0;
+    uint reserved1;
+    uint textureIndices[8];
+};
+
+layout(std430, set = SCENE_SET, binding = 0) readonly buffer SceneBuffer
+{
+    FrameData frame;
+    InstanceData instances[];
+} scene;
+
+#endif
@@ -0,0 +1,236 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_nonuniform_qualifier : enable
+
+#define BLENDMODE_OPAQUE 0
+#define BLENDMODE_MASK 1
+#define BLENDMODE_BLEND 2
+
+#define POSION 1
+#define NORMAL 1 << 1
+#define TANGENT 1 << 2
+#define TEXCOORD 1 << 3
+
+#define DIFFUSE_TEX 1
+#define NORMAL_TEX 1 << 1
+#define METALLICROUGHNESS_TEX 1 << 2
+#define EMISSIVE_TEX 1 << 3
+#define OCCLUSION_TEX 1 << 4
+#define OCCLUSION_IN_METALLICROUGHNESS_TEX 1 << 5
+#define DFG_TEX 1 << 8
+#define IBL_TEX 1 << 9
+layout(constant_id = 0) const int VTX_STATE = POSION | NORMAL | TANGENT | TEXCOORD;
+layout(constant_id = 1) const int TEXTURE_STATE = 
+    DIFFUSE_TEX | 
+    NORMAL_TEX | 
+    METALLICROUGHNESS_TEX | 
+    EMISSIVE_TEX | 
+    OCCLUSION_TEX | 
+    OCCLUSION_IN_METALLICROUGHNESS_TEX | 
+    DFG_TEX |
+    IBL_TEX;
+
+layout(location = 0) in vec2 fragTexCoord;
+layout(location = 1) in vec3 fragNormal;
+layout(location = 2) in vec3 fragTangent;
+layout(location = 3) in vec3 fragBinormal;
+layout(location = 4) in vec4 fragPos;
+layout(location = 5) flat in uint fragInstance;
+
+#include "brdf.glsl"
+
+#define SCENE_SET 1
+#include "gpu_scene.glsl"
+
+// Set 0 is bound once per frame and shared by every draw
+#include "lights.glsl"
+
+// Every material texture of the scene, instances hold indices into them
+layout(set = 1, binding = 3) uniform sampler2D textures[];
+layout(set = 1, binding = 4) uniform samplerCube cubeTextures[];
+
+layout(location = 0) out vec4 outColor;
+
+// Neighbouring fragments may belong to different draws of one indirect call, hence nonuniformEXT
+vec4 SampleTexture(uint slot, vec2 uv)
+{
+    uint index = scene.instances[fragInstance].textureIndices[slot];
+    return texture(textures[nonuniformEXT(index)], uv);
+}
+
+vec3 PrefilteredDFG_LUT(float lod, float NoV) {
+    // coord = sqrt(linear_roughness), which is the mapping used by cmgen.
+    uint index = scene.instances[fragInstance].textureIndices[TEXTURE_SLOT_DFG];
+    return textureLod(textures[nonuniformEXT(index)], vec2(NoV, lod), 0.0).rgb;
+}
+
+void main()
+{
+    InstanceData instance = scene.instances[fragInstance];
+
+    vec3 t = fragTangent;
+    vec3 b = fragBinormal;
+
+    if((VTX_STATE & TANGENT) != TANGENT)
+	{
+        vec3 pos_dx = dFdx(fragPos.xyz);
+        vec3 pos_dy = dFdy(fragPos.xyz);
+        vec3 tex_dx = dFdx(vec3(fragTexCoord, 0.0));
+        vec3 tex_dy = dFdy(vec3(fragTexCoord, 0.0));
+        t = (tex_dy.t * pos_dx - tex_dx.t * pos_dy) / (tex_dx.s * tex_dy.t - tex_dy.s * tex_dx.t);
+
+        vec3 ng = normalize(fragNormal);
+
+        t = normalize(t - ng * dot(ng, t));
+        b = normalize(-cross(ng, t));
+    }
+    
+	//vec3 binormal = cross(fragTangent, fragNormal);
+	//binormal = normalize(binormal);
+	mat3 TBN = mat3(t, b, fragNormal);
+
+
+    vec3 normal = fragNormal;
+    if((TEXTURE_STATE & NORMAL_TEX) == NORMAL_TEX)
+    {
+        vec4 normalTex = SampleTexture(TEXTURE_SLOT_NORMAL, fragTexCoord);
+
+        vec3 sampledNormal = 2.0f * normalTex.xyz - 1.0f - 0.00392f;
+        sampledNormal.y *= -1.0;
+        //sampledNormal.x *= -1.0;
+
+	    normal = TBN * sampledNormal;
+    }
+	
+	normal = normalize(normal);
+
+    //============================================================
+	vec4 diffuseTex = SampleTexture(TEXTURE_SLOT_DIFFUSE, fragTexCoord);
+
+    vec3 baseColor = instance.baseColorFactor.rgb * diffuseTex.xyz;
+    float matMetallic = instance.metallicRoughness.x;
+    float matRoughness = instance.metallicRoughness.y;
+    vec3 matEmissiveFactor = instance.emissiveFactor.xyz;
+    float matReflectance = 1.0f;
+
+    float blendMode = instance.blendMode.x;
+    float alphaMaskValue = instance.blendMode.y;
+
+    float occlusion = 1.0f;
+
+    float perceptualRoughness = matRoughness;
+    float roughness = matRoughness * matRoughness;
+    float metallic = matMetallic;
+    if((TEXTURE_STATE & METALLICROUGHNESS_TEX) == METALLICROUGHNESS_TEX)
+    {
+        vec4 metallicRoughnessTex = SampleTexture(TEXTURE_SLOT_METALLICROUGHNESS, fragTexCoord);
+        perceptualRoughness = matRoughness * metallicRoughnessTex.y;
+        roughness = perceptualRoughness * perceptualRoughness;
+
+        metallic = matMetallic * metallicRoughnessTex.z;
+        
+        if((TEXTURE_STATE & OCCLUSION_IN_METALLICROUGHNESS_TEX) == OCCLUSION_IN_METALLICROUGHNESS_TEX)
+        {
+            occlusion = metallicRoughnessTex.x;
+        }
+    }
+    if((TEXTURE_STATE & OCCLUSION_TEX) == OCCLUSION_TEX)
+    {
+        occlusion = SampleTexture(TEXTURE_SLOT_OCCLUSION, fragTexCoord).x;
+    }
+
+    vec3 emissive = matEmissiveFactor;
+    if((TEXTURE_STATE & EMISSIVE_TEX) == EMISSIVE_TEX)
+    {
+        emissive = emissive * SampleTexture(TEXTURE_SLOT_EMISSIVE, fragTexCoord).xyz;
+    }
+
+
+
+    float reflectance = computeDielectricF0(matReflectance);
+
+    vec3 diffuseColor = computeDiffuseColor(baseColor, metallic);
+    vec3 specularColor = baseColor.rgb * metallic;
+
+    vec3 toViewDir = normalize(scene.frame.cameraPos.xyz - fragPos.xyz);
+    float NoV = clampNoV(dot(toViewDir, normal));
+    vec3 f0 = computeF0(baseColor, metallic, reflectance);
+
+    //====================================================================
+
+    vec3 dfg = PrefilteredDFG_LUT(roughness, NoV);
+    vec3 energyCompensation = 1.0 + f0 * (1.0 / dfg.y - 1.0);
+    
+    //==========================================================================
+
+    vec3 iblColor = vec3(0);
+    if((TEXTURE_STATE & IBL_TEX) == IBL_TEX)
+    {
+        vec3 viewReflect = reflect(-toViewDir, normal);
+        vec3 E = vec3(1.0f);//specularDFG(pixel);
+        E = mix(dfg.xxx, dfg.yyy, f0);
+        const int MipCount = 10;
+        //float lod = 9 * perceptualRoughness * (2.0 - perceptualRoughness);
+        float lod = clamp(MipCount * roughness,  0.0, MipCount);
+
+        iblColor = textureLod(cubeTextures[nonuniformEXT(scene.instances[fragInstance].textureIndices[TEXTURE_SLOT_IBL])], viewReflect, lod).xyz;
+        //iblColor = E * iblColor;
+        //iblColor = (dfg.x + dfg.y) * iblColor;
+
+    }
+
+    //====================================================================
+
+    vec3 lightResult = EvaluateLights(
+        gl_FragCoord.xy,
+        fragPos.xyz, 
+        toViewDir, 
+        normal, 
+        f0,
+        diffuseColor, 
+        roughness, 
+        NoV, 
+        occlusion);
+
+    
+    vec3 Fa = diffuseColor * 0.1f * occlusion;
+
+    //lightResult +=diffuseColor * iblColor;
+    //lightResult += specularColor * mix(dfg.xxx, dfg.yyy, f0) * iblColor;
+    lightResult += (specularColor * dfg.xxx + dfg.yyy) * iblColor;
+
+    lightResult += Fa;
+    lightResult += emissive;
+
+    lightResult = toneMapUncharted2Impl(lightResult);
+
+	//outColor = vec4(Fd, diffuseTex.a);      
+    //return;
+    if(blendMode == BLENDMODE_BLEND)
+    {
+        // Blended by the pipeline, blend buckets are drawn after the opaque ones
+	    outColor = vec4(lightResult, instance.baseColorFactor.a * diffuseTex.a);
+    }
+    else if(blendMode == BLENDMODE_MASK )
+    {
+        if(diffuseTex.a < alphaMaskValue)
+        {
+            discard;
+        }
+        else
+        {
+            outColor = vec4(lightResult, 1.0f);
+        }
+    }
+    else
+    {
+	    outColor = vec4(lightResult, 1.0f);
+    }
+
+	//outColor = vec4(specularColor, diffuseTex.a);
+	//outColor = vec4(vec3(occlusion), diffuseTex.a);
+	//outColor = vec4(vec3(fragTexCoord.x, fragTexCoord.y, 0.0), diffuseTex.a);
+    //outColor = gl_FragCoord;
+    //outColor.a = 1;
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : enable
+
+#define POSION 1
+#define NORMAL 1 << 1
+#define TANGENT 1 << 2
+#define TEXCOORD 1 << 3
+layout(constant_id = 0) const int VTX_STATE = (POSION | NORMAL | TANGENT | TEXCOORD);
+
+layout(location = 0) in vec3 inPos;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in vec4 inTangent;
+layout(location = 3) in vec2 inUv;
+
+layout(location = 0) out vec2 fragTexCoord;
+layout(location = 1) out vec3 fragNormal;
+layout(location = 2) out vec3 fragTangent;
+layout(location = 3) out vec3 fragBinormal;
+layout(location = 4) out vec4 fragPos;
+layout(location = 5) flat out uint fragInstance;
+
+#define SCENE_SET 1
+#include "gpu_scene.glsl"
+
+void main()
+{
+	// firstInstance of every indirect command is the instance index, see cull.comp
+	fragInstance = gl_InstanceIndex;
+	mat4 modelMtx = scene.instances[gl_InstanceIndex].modelMtx;
+
+    gl_Position = scene.frame.projMtx * scene.frame.viewMtx * modelMtx * vec4(inPos, 1.0);
+	fragTexCoord = inUv;
+
+	fragPos = modelMtx * vec4(inPos, 1.0);
+
+	vec4 normal = modelMtx * vec4(inNormal, 0.0);
+	fragNormal = normalize(normal.xyz);
+
+  	//vec3 tangent = -vec3(abs(inNormal.y) + abs(inNormal.z), abs(inNormal.x), 0);
+  	//vec3 binormal = cross(tangent, inNormal);
+  	//fragTangent = normalize(modelMtx * vec4(cross(inNormal, binormal), 0.0)).xyz;
+  	//fragBinormal = normalize(modelMtx * vec4(binormal, 0.0)).xyz;
+
+	if((VTX_STATE & TANGENT) == TANGENT)
+	{
+		//HAS TANGENT
+		vec4 tangent = modelMtx * vec4(inTangent.xyz, 0.0);
+		fragTangent = normalize(tangent.xyz);
+
+		vec3 binormal = cross(fragTangent, fragNormal) * inTangent.w;
+		//vec3 binormal = cross(inTangent.xyz, inNormal.xyz);
+		fragBinormal = normalize(binormal);//(modelMtx * vec4(binormal, 0.0)).xyz;
+	}
+
+} 
\ No newline at end of file
@@ -0,0 +1,73 @@
+// Clustered lights of LightManager, mirrors LightClusterUniform in LightManager.h.
+// Graphics pipelines see them at set 0, define LIGHT_SET before including to place them elsewhere
+
+#ifndef LIGHTS_GLSL
+#define LIGHTS_GLSL
+
+#include "brdf.glsl"
+
+#ifndef LIGHT_SET
+#define LIGHT_SET 0
+#endif
+
+layout(set = LIGHT_SET, binding = 0) uniform LightClusterUniformBufferObject
+{
+    mat4 viewMtx;
+    vec4 clusterScale; // x, y : tile size in pixels, z : depth slice scale, w : depth slice bias
+    uvec4 clusterGrid; // xyz : clusters per axis, w : global light count
+    uvec4 lightCount; // x : lights in the light buffer, global ones included
+} lightClusterUbo;
+
+// Global lights first, then the ranged lights the clusters index
+layout(std430, set = LIGHT_SET, binding = 1) readonly buffer LightBuffer
+{
+    LightInfo lightInfos[];
+};
+
+layout(std430, set = LIGHT_SET, binding = 2) readonly buffer LightClusterBuffer
+{
+    uvec2 lightClusters[]; // x : first index, y : count
+};
+
+layout(std430, set = LIGHT_SET, binding = 3) readonly buffer LightIndexBuffer
+{
+    uint lightIndices[];
+};
+
+uint GetLightCluster(vec2 fragCoord, vec3 worldPos)
+{
+    uvec3 grid = lightClusterUbo.clusterGrid.xyz;
+    float viewDepth = max(-(lightClusterUbo.viewMtx * vec4(worldPos, 1.0)).z, 1e-4);
+    uvec3 cluster;
+    cluster.xy = min(uvec2(fragCoord / lightClusterUbo.clusterScale.xy), grid.xy - 1);
+    cluster.z = uint(clamp(log(viewDepth) * lightClusterUbo.clusterScale.z + lightClusterUbo.clusterScale.w, 0.0, float(grid.z - 1)));
+    return (cluster.z * grid.y + cluster.y) * grid.x + cluster.x;
+}
+
+// Every global light plus the lights of the fragment's cluster, the cost does not grow with the scene's light count
+vec3 EvaluateLights(
+    vec2 fragCoord,
+    vec3 worldPos,
+    vec3 toViewDir,
+    vec3 normal,
+    vec3 f0,
+    vec3 diffuseColor,
+    float roughness,
+    float NoV,
+    float occlusion)
+{
+    vec3 lightResult = vec3(0);
+    for(uint i = 0; i < lightClusterUbo.clusterGrid.w; i++)
+    {
+        lightResult += EvaluateLight(lightInfos[i], worldPos, toViewDir, normal, f0, diffuseColor, roughness, NoV, occlusion);
+    }
+
+    uvec2 cluster = lightClusters[GetLightCluster(fragCoord, worldPos)];
+    for(uint i = 0; i < cluster.y; i++)
+    {
+        lightResult += EvaluateLight(lightInfos[lightIndices[cluster.x + i]], worldPos, toViewDir, normal, f0, diffuseColor, roughness, NoV, occlusion);
+    }
+    return lightResult;
+}
+
+#endif
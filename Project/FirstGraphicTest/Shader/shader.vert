@@ -18,13 +18,16 @@ layout(location = 2) out vec3 fragTangent;
 layout(location = 3) out vec3 fragBinormal;
 layout(location = 4) out vec4 fragPos;
 
-layout(binding = 0) uniform UniformBufferObject
+layout(set = 1, binding = 0) uniform UniformBufferObject
 {
 		mat4 modelMtx;
 		mat4 viewMtx;
 		mat4 projMtx;
 } ubo;
 
+// Matches depth.vert bit for bit, the pre-pass depth is tested with EQUAL
+invariant gl_Position;
+
 void main()
 {
     gl_Position = ubo.projMtx * ubo.viewMtx * ubo.modelMtx * vec4(inPos, 1.0);
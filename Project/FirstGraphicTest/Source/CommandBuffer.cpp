@@ -13,32 +13,49 @@ CommandBuffer::~CommandBuffer()
 
 void CommandBuffer::Finalize()
 {
-	for (VkCommandBuffer commandBuffer : m_CommandBuffers)
+	// Destroying a pool frees the command buffers allocated from it
+	for (VkCommandPool commandPool : m_CommandPools)
 	{
-		vkFreeCommandBuffers(m_Device, m_CommandPool, 1, &commandBuffer);
+		vkDestroyCommandPool(m_Device, commandPool, nullptr);
 	}
+	m_CommandPools.clear();
+	m_CommandBuffers.clear();
 }
 
-void CommandBuffer::Init(VkDevice device, uint32_t swapCount, VkCommandPool commandPool)
+void CommandBuffer::Init(VkDevice device, uint32_t frameCount, uint32_t queueFamilyIndex)
 {
 	m_Device = device;
-	m_CommandPool = commandPool;
-	m_CommandBuffers.resize(swapCount);
+	m_CommandPools.resize(frameCount);
+	m_CommandBuffers.resize(frameCount);
 
-	VkCommandBufferAllocateInfo allocCmdBufInfo = {};
-	allocCmdBufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocCmdBufInfo.commandPool = commandPool;
-	allocCmdBufInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocCmdBufInfo.commandBufferCount = static_cast<uint32_t>(m_CommandBuffers.size());
+	for (uint32_t i = 0; i < frameCount; i++)
+	{
+		VkCommandPoolCreateInfo cmdPoolCreateInfo = {};
+		cmdPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		cmdPoolCreateInfo.queueFamilyIndex = queueFamilyIndex;
+		cmdPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		vkCreateCommandPool(m_Device, &cmdPoolCreateInfo, nullptr, &m_CommandPools[i]);
+
+		VkCommandBufferAllocateInfo allocCmdBufInfo = {};
+		allocCmdBufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocCmdBufInfo.commandPool = m_CommandPools[i];
+		allocCmdBufInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocCmdBufInfo.commandBufferCount = 1;
+
+		vkAllocateCommandBuffers(m_Device, &allocCmdBufInfo, &m_CommandBuffers[i]);
+	}
+}
 
-	vkAllocateCommandBuffers(m_Device, &allocCmdBufInfo, m_CommandBuffers.data());
+void CommandBuffer::Reset(uint32_t index)
+{
+	vkResetCommandPool(m_Device, m_CommandPools[index], 0);
 }
 
 void CommandBuffer::Begin(uint32_t index)
 {
 	VkCommandBufferBeginInfo beginInfo = {};
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = 0;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 	beginInfo.pInheritanceInfo = nullptr;
 
 	vkBeginCommandBuffer(m_CommandBuffers[index], &beginInfo);
@@ -0,0 +1,405 @@
+#include "DeferredRenderer.h"
+#include "LightManager.h"
+
+namespace
+{
+	// local_size of Shader/tiled_lighting.comp
+	const uint32_t TileSize = 16;
+
+	// Depth plus every G-buffer attachment, sampled by the lighting pass
+	const uint32_t LightingSamplerCount = GBUFFER_ATTACHMENT_COUNT + 1;
+}
+
+DeferredRenderer::DeferredRenderer()
+{
+}
+
+DeferredRenderer::~DeferredRenderer()
+{
+}
+
+bool DeferredRenderer::Init(GraphicSystem* pGraphicSystem)
+{
+	m_pGraphicSystem = pGraphicSystem;
+	m_Device = pGraphicSystem->GetDevice();
+	m_Extent = pGraphicSystem->GetSwapChainExtent();
+
+	ShaderModuleCache* pShaderModuleCache = pGraphicSystem->GetShaderModuleCache();
+	m_LightingShaderModule = pShaderModuleCache->Acquire("Shader/tiled_lighting_cs.spv");
+	m_CompositeVertexShaderModule = pShaderModuleCache->Acquire("Shader/composite_vs.spv");
+	m_CompositeFragmentShaderModule = pShaderModuleCache->Acquire("Shader/composite_fs.spv");
+	m_GBufferShaderModule = pShaderModuleCache->Acquire("Shader/gbuffer_fs.spv");
+	if (m_LightingShaderModule == VK_NULL_HANDLE || m_CompositeVertexShaderModule == VK_NULL_HANDLE || m_CompositeFragmentShaderModule == VK_NULL_HANDLE ||
+		m_GBufferShaderModule == VK_NULL_HANDLE)
+	{
+		printf("### ERROR ### DeferredRenderer : deferred shaders are missing, run Shader/compile.bat\n");
+		Finalize();
+		return false;
+	}
+
+	if (!CreateTargets())
+	{
+		printf("### ERROR ### DeferredRenderer : G-buffer creation failed\n");
+		Finalize();
+		return false;
+	}
+	CreateDescriptors();
+	if (!CreatePipelines())
+	{
+		printf("### ERROR ### DeferredRenderer : pipeline creation failed\n");
+		Finalize();
+		return false;
+	}
+
+	return true;
+}
+
+bool DeferredRenderer::CreateTargets()
+{
+	MemoryAllocator* pAllocator = m_pGraphicSystem->GetMemoryAllocator();
+	m_GBufferImages.resize(GBUFFER_ATTACHMENT_COUNT, VK_NULL_HANDLE);
+	m_GBufferImageMemories.resize(GBUFFER_ATTACHMENT_COUNT);
+	m_GBufferImageViews.resize(GBUFFER_ATTACHMENT_COUNT, VK_NULL_HANDLE);
+	for (uint32_t i = 0; i < GBUFFER_ATTACHMENT_COUNT; i++)
+	{
+		CreateImage(
+			&m_GBufferImages[i],
+			&m_GBufferImageMemories[i],
+			m_Device,
+			pAllocator,
+			m_Extent.width,
+			m_Extent.height,
+			1,
+			1,
+			VK_IMAGE_TYPE_2D,
+			GBufferFormats[i],
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		if (!CreateImageView(&m_GBufferImageViews[i], m_GBufferImages[i], VK_IMAGE_VIEW_TYPE_2D, m_Device, 1, 1, GBufferFormats[i], VK_IMAGE_ASPECT_COLOR_BIT))
+		{
+			return false;
+		}
+	}
+
+	CreateImage(
+		&m_LitImage,
+		&m_LitImageMemory,
+		m_Device,
+		pAllocator,
+		m_Extent.width,
+		m_Extent.height,
+		1,
+		1,
+		VK_IMAGE_TYPE_2D,
+		VK_FORMAT_R16G16B16A16_SFLOAT,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	if (!CreateImageView(&m_LitImageView, m_LitImage, VK_IMAGE_VIEW_TYPE_2D, m_Device, 1, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT))
+	{
+		return false;
+	}
+
+	std::vector<VkImageView> attachments = m_GBufferImageViews;
+	attachments.push_back(m_pGraphicSystem->GetDepthImageView());
+
+	VkFramebufferCreateInfo framebufferInfo = {};
+	framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	framebufferInfo.renderPass = m_pGraphicSystem->GetGBufferRenderPass();
+	framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	framebufferInfo.pAttachments = attachments.data();
+	framebufferInfo.width = m_Extent.width;
+	framebufferInfo.height = m_Extent.height;
+	framebufferInfo.layers = 1;
+	if (vkCreateFramebuffer(m_Device, &framebufferInfo, nullptr, &m_GBufferFramebuffer) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.maxAnisotropy = 1;
+	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+	samplerInfo.minLod = 0;
+	samplerInfo.maxLod = 0;
+	return vkCreateSampler(m_Device, &samplerInfo, nullptr, &m_Sampler) == VK_SUCCESS;
+}
+
+void DeferredRenderer::CreateDescriptors()
+{
+	UniformArena* pUniformArena = m_pGraphicSystem->GetUniformArena();
+	pUniformArena->AllocateSlot(sizeof(DeferredUniform), &m_UniformSlot);
+	uint32_t frameCount = pUniformArena->GetFrameCount();
+
+	std::vector<VkDescriptorSetLayoutBinding> lightingBindings(LightingSamplerCount + 2);
+	CreateDescriptorSetLayoutBinding(&lightingBindings[0], 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, m_Device);
+	for (uint32_t binding = 1; binding <= LightingSamplerCount; binding++)
+	{
+		CreateDescriptorSetLayoutBinding(&lightingBindings[binding], binding, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, m_Device);
+	}
+	CreateDescriptorSetLayoutBinding(&lightingBindings[LightingSamplerCount + 1], LightingSamplerCount + 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, m_Device);
+	std::vector<VkDescriptorSetLayoutBinding> compositeBindings(1);
+	CreateDescriptorSetLayoutBinding(&compositeBindings[0], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, m_Device);
+	PipelineLibrary* pPipelineLibrary = m_pGraphicSystem->GetPipelineLibrary();
+	m_LightingDescriptorSetLayout = pPipelineLibrary->GetDescriptorSetLayout(lightingBindings);
+	m_CompositeDescriptorSetLayout = pPipelineLibrary->GetDescriptorSetLayout(compositeBindings);
+
+	VkDescriptorPoolSize uniformPoolSize = {};
+	VkDescriptorPoolSize samplerPoolSize = {};
+	VkDescriptorPoolSize storagePoolSize = {};
+	CreateDescriptorPoolSize(&uniformPoolSize, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, frameCount);
+	CreateDescriptorPoolSize(&samplerPoolSize, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, LightingSamplerCount * frameCount + 1);
+	CreateDescriptorPoolSize(&storagePoolSize, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, frameCount);
+	std::vector<VkDescriptorPoolSize> poolSizes = { uniformPoolSize, samplerPoolSize, storagePoolSize };
+	CreateDescriptorPool(&m_DescriptorPool, m_Device, poolSizes, frameCount + 1);
+
+	std::vector<VkDescriptorSetLayout> layouts(frameCount, m_LightingDescriptorSetLayout);
+	m_LightingDescriptorSets.resize(frameCount);
+	VkDescriptorSetAllocateInfo allocateInfo = {};
+	CreateDescriptorSet(m_LightingDescriptorSets, &allocateInfo, m_DescriptorPool, layouts, m_Device);
+
+	std::vector<VkDescriptorSetLayout> compositeLayouts = { m_CompositeDescriptorSetLayout };
+	std::vector<VkDescriptorSet> compositeSets(1);
+	VkDescriptorSetAllocateInfo compositeAllocateInfo = {};
+	CreateDescriptorSet(compositeSets, &compositeAllocateInfo, m_DescriptorPool, compositeLayouts, m_Device);
+	m_CompositeDescriptorSet = compositeSets[0];
+
+	// Depth is read between the passes in SHADER_READ_ONLY_OPTIMAL, the render pass leaves the G-buffer in it
+	VkDescriptorImageInfo samplerInfos[LightingSamplerCount] = {};
+	samplerInfos[0].sampler = m_Sampler;
+	samplerInfos[0].imageView = m_pGraphicSystem->GetDepthImageView();
+	samplerInfos[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	for (uint32_t i = 0; i < GBUFFER_ATTACHMENT_COUNT; i++)
+	{
+		samplerInfos[i + 1].sampler = m_Sampler;
+		samplerInfos[i + 1].imageView = m_GBufferImageViews[i];
+		samplerInfos[i + 1].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	}
+	VkDescriptorImageInfo litStorageInfo = {};
+	litStorageInfo.imageView = m_LitImageView;
+	litStorageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	for (uint32_t i = 0; i < frameCount; i++)
+	{
+		VkDescriptorBufferInfo bufferInfo = pUniformArena->GetDescriptorBufferInfo(m_UniformSlot);
+		bufferInfo.offset = pUniformArena->GetDynamicOffset(m_UniformSlot, i);
+
+		VkWriteDescriptorSet writes[3] = {};
+		writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[0].dstSet = m_LightingDescriptorSets[i];
+		writes[0].dstBinding = 0;
+		writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		writes[0].descriptorCount = 1;
+		writes[0].pBufferInfo = &bufferInfo;
+		writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[1].dstSet = m_LightingDescriptorSets[i];
+		writes[1].dstBinding = 1;
+		writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writes[1].descriptorCount = LightingSamplerCount;
+		writes[1].pImageInfo = samplerInfos;
+		writes[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[2].dstSet = m_LightingDescriptorSets[i];
+		writes[2].dstBinding = LightingSamplerCount + 1;
+		writes[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		writes[2].descriptorCount = 1;
+		writes[2].pImageInfo = &litStorageInfo;
+		vkUpdateDescriptorSets(m_Device, 3, writes, 0, nullptr);
+	}
+
+	VkDescriptorImageInfo litSamplerInfo = {};
+	litSamplerInfo.sampler = m_Sampler;
+	litSamplerInfo.imageView = m_LitImageView;
+	litSamplerInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkWriteDescriptorSet compositeWrite = {};
+	compositeWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	compositeWrite.dstSet = m_CompositeDescriptorSet;
+	compositeWrite.dstBinding = 0;
+	compositeWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	compositeWrite.descriptorCount = 1;
+	compositeWrite.pImageInfo = &litSamplerInfo;
+	vkUpdateDescriptorSets(m_Device, 1, &compositeWrite, 0, nullptr);
+}
+
+bool DeferredRenderer::CreatePipelines()
+{
+	PipelineLibrary* pPipelineLibrary = m_pGraphicSystem->GetPipelineLibrary();
+	ShaderModuleCache* pShaderModuleCache = m_pGraphicSystem->GetShaderModuleCache();
+	m_LightingPipelineLayout = pPipelineLibrary->GetPipelineLayout({ LightManager::GetInstance().GetDescriptorSetLayout(), m_LightingDescriptorSetLayout });
+	m_CompositePipelineLayout = pPipelineLibrary->GetPipelineLayout({ m_CompositeDescriptorSetLayout });
+
+	ComputePipelineDesc lightingDesc;
+	lightingDesc.shaderModule = m_LightingShaderModule;
+	lightingDesc.pipelineLayout = m_LightingPipelineLayout;
+	lightingDesc.shaderHash = pShaderModuleCache->GetContentHash(m_LightingShaderModule);
+	m_LightingPipeline = pPipelineLibrary->GetComputePipeline(lightingDesc);
+
+	// Compatible with the composite pass, the triangle overwrites color and leaves depth to the blended draws after it
+	GraphicsPipelineDesc compositeDesc;
+	compositeDesc.vertexShaderModule = m_CompositeVertexShaderModule;
+	compositeDesc.fragmentShaderModule = m_CompositeFragmentShaderModule;
+	compositeDesc.pipelineLayout = m_CompositePipelineLayout;
+	compositeDesc.renderPass = m_pGraphicSystem->GetCompositeRenderPass();
+	compositeDesc.vertexShaderHash = pShaderModuleCache->GetContentHash(m_CompositeVertexShaderModule);
+	compositeDesc.fragmentShaderHash = pShaderModuleCache->GetContentHash(m_CompositeFragmentShaderModule);
+	compositeDesc.cullMode = VK_CULL_MODE_NONE;
+	compositeDesc.isDepthTestEnabled = VK_FALSE;
+	compositeDesc.isDepthWriteEnabled = VK_FALSE;
+	compositeDesc.viewportWidth = m_Extent.width;
+	compositeDesc.viewportHeight = m_Extent.height;
+	m_CompositePipeline = pPipelineLibrary->GetGraphicsPipeline(compositeDesc);
+
+	return m_LightingPipeline != VK_NULL_HANDLE && m_CompositePipeline != VK_NULL_HANDLE;
+}
+
+void DeferredRenderer::Finalize()
+{
+	if (m_pGraphicSystem == nullptr)
+	{
+		return;
+	}
+
+	DeletionQueue* pDeletionQueue = m_pGraphicSystem->GetDeletionQueue();
+	if (m_DescriptorPool != VK_NULL_HANDLE)
+	{
+		pDeletionQueue->DestroyDescriptorPool(m_DescriptorPool);
+		m_DescriptorPool = VK_NULL_HANDLE;
+	}
+	m_LightingDescriptorSets.clear();
+	m_CompositeDescriptorSet = VK_NULL_HANDLE;
+	if (m_Sampler != VK_NULL_HANDLE)
+	{
+		pDeletionQueue->DestroySampler(m_Sampler);
+		m_Sampler = VK_NULL_HANDLE;
+	}
+	if (m_GBufferFramebuffer != VK_NULL_HANDLE)
+	{
+		pDeletionQueue->DestroyFramebuffer(m_GBufferFramebuffer);
+		m_GBufferFramebuffer = VK_NULL_HANDLE;
+	}
+	for (size_t i = 0; i < m_GBufferImages.size(); i++)
+	{
+		pDeletionQueue->DestroyImageView(m_GBufferImageViews[i]);
+		if (m_GBufferImages[i] != VK_NULL_HANDLE)
+		{
+			pDeletionQueue->DestroyImage(m_GBufferImages[i], &m_GBufferImageMemories[i]);
+		}
+	}
+	m_GBufferImageViews.clear();
+	m_GBufferImages.clear();
+	m_GBufferImageMemories.clear();
+	if (m_LitImageView != VK_NULL_HANDLE)
+	{
+		pDeletionQueue->DestroyImageView(m_LitImageView);
+		m_LitImageView = VK_NULL_HANDLE;
+	}
+	if (m_LitImage != VK_NULL_HANDLE)
+	{
+		pDeletionQueue->DestroyImage(m_LitImage, &m_LitImageMemory);
+		m_LitImage = VK_NULL_HANDLE;
+	}
+
+	ShaderModuleCache* pShaderModuleCache = m_pGraphicSystem->GetShaderModuleCache();
+	pShaderModuleCache->Release(m_LightingShaderModule);
+	pShaderModuleCache->Release(m_CompositeVertexShaderModule);
+	pShaderModuleCache->Release(m_CompositeFragmentShaderModule);
+	pShaderModuleCache->Release(m_GBufferShaderModule);
+	m_LightingShaderModule = VK_NULL_HANDLE;
+	m_CompositeVertexShaderModule = VK_NULL_HANDLE;
+	m_CompositeFragmentShaderModule = VK_NULL_HANDLE;
+	m_GBufferShaderModule = VK_NULL_HANDLE;
+
+	// Layouts and pipelines belong to the PipelineLibrary
+	m_LightingDescriptorSetLayout = VK_NULL_HANDLE;
+	m_CompositeDescriptorSetLayout = VK_NULL_HANDLE;
+	m_LightingPipelineLayout = VK_NULL_HANDLE;
+	m_CompositePipelineLayout = VK_NULL_HANDLE;
+	m_LightingPipeline = VK_NULL_HANDLE;
+	m_CompositePipeline = VK_NULL_HANDLE;
+	m_pGraphicSystem = nullptr;
+}
+
+void DeferredRenderer::Update(uint32_t frameIndex)
+{
+	const Camera& camera = m_pGraphicSystem->GetCamera();
+	m_UniformData.invViewProjMtx = glm::inverse(camera.projMtx * camera.viewMtx);
+	m_UniformData.cameraPos = glm::vec4(camera.cameraPos, 1.0f);
+	m_UniformData.projParams = glm::vec4(camera.projMtx[0][0], camera.projMtx[1][1], camera.projMtx[2][2], camera.projMtx[3][2]);
+	m_pGraphicSystem->GetUniformArena()->Write(m_UniformSlot, frameIndex, &m_UniformData, sizeof(DeferredUniform));
+}
+
+void DeferredRenderer::BeginGBufferPass(VkCommandBuffer commandBuffer, VkSubpassContents contents)
+{
+	VkClearValue clearValues[GBUFFER_ATTACHMENT_COUNT + 1] = {};
+	clearValues[GBUFFER_ATTACHMENT_COUNT].depthStencil = { 1.0f, 0 };
+
+	VkRenderPassBeginInfo renderPassBeginInfo = {};
+	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassBeginInfo.renderPass = m_pGraphicSystem->GetGBufferRenderPass();
+	renderPassBeginInfo.framebuffer = m_GBufferFramebuffer;
+	renderPassBeginInfo.renderArea.offset = { 0, 0 };
+	renderPassBeginInfo.renderArea.extent = m_Extent;
+	renderPassBeginInfo.clearValueCount = GBUFFER_ATTACHMENT_COUNT + 1;
+	renderPassBeginInfo.pClearValues = clearValues;
+
+	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, contents);
+}
+
+void DeferredRenderer::RecordLighting(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+	// The G-buffer pass's depth becomes readable. The lit image is rewritten whole, the last read of it was the
+	// previous frame's composite draw
+	VkImageMemoryBarrier barriers[2] = {};
+	barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].image = m_pGraphicSystem->GetDepthImage();
+	barriers[0].subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+	barriers[1].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[1].srcAccessMask = 0;
+	barriers[1].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[1].image = m_LitImage;
+	barriers[1].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, nullptr, 0, nullptr, 2, barriers);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_LightingPipeline);
+	LightManager::GetInstance().Bind(commandBuffer, frameIndex, VK_PIPELINE_BIND_POINT_COMPUTE);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_LightingPipelineLayout, 1, 1, &m_LightingDescriptorSets[frameIndex], 0, nullptr);
+	vkCmdDispatch(commandBuffer, (m_Extent.width + TileSize - 1) / TileSize, (m_Extent.height + TileSize - 1) / TileSize, 1);
+
+	// Lit image to the composite draw, depth back to the blended draws' depth test
+	barriers[0].srcAccessMask = 0;
+	barriers[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	barriers[1].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		0, 0, nullptr, 0, nullptr, 2, barriers);
+}
+
+void DeferredRenderer::RecordComposite(VkCommandBuffer commandBuffer)
+{
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_CompositePipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_CompositePipelineLayout, 0, 1, &m_CompositeDescriptorSet, 0, nullptr);
+	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+}
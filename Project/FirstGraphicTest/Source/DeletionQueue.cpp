@@ -0,0 +1,131 @@
+#include "DeletionQueue.h"
+
+DeletionQueue::DeletionQueue()
+{
+}
+
+DeletionQueue::~DeletionQueue()
+{
+}
+
+void DeletionQueue::Init(VkDevice device, MemoryAllocator* pAllocator, GpuTimeline* pTimeline)
+{
+	m_Device = device;
+	m_pAllocator = pAllocator;
+	m_pTimeline = pTimeline;
+}
+
+void DeletionQueue::Finalize()
+{
+	if (!m_Pending.empty())
+	{
+		m_pTimeline->Wait(m_Pending.back().timelineValue);
+	}
+	Collect();
+}
+
+void DeletionQueue::DestroyBuffer(VkBuffer buffer, MemoryAllocation* pMemory)
+{
+	if (buffer == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	VkDevice device = m_Device;
+	MemoryAllocator* pAllocator = m_pAllocator;
+	MemoryAllocation memory = *pMemory;
+	*pMemory = MemoryAllocation();
+	Push([device, pAllocator, buffer, memory]() mutable
+	{
+		vkDestroyBuffer(device, buffer, nullptr);
+		pAllocator->Free(&memory);
+	});
+}
+
+void DeletionQueue::DestroyImage(VkImage image, MemoryAllocation* pMemory)
+{
+	if (image == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	VkDevice device = m_Device;
+	MemoryAllocator* pAllocator = m_pAllocator;
+	MemoryAllocation memory = *pMemory;
+	*pMemory = MemoryAllocation();
+	Push([device, pAllocator, image, memory]() mutable
+	{
+		vkDestroyImage(device, image, nullptr);
+		pAllocator->Free(&memory);
+	});
+}
+
+void DeletionQueue::DestroyImageView(VkImageView imageView)
+{
+	if (imageView == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	VkDevice device = m_Device;
+	Push([device, imageView]() { vkDestroyImageView(device, imageView, nullptr); });
+}
+
+void DeletionQueue::DestroySampler(VkSampler sampler)
+{
+	if (sampler == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	VkDevice device = m_Device;
+	Push([device, sampler]() { vkDestroySampler(device, sampler, nullptr); });
+}
+
+void DeletionQueue::DestroyDescriptorPool(VkDescriptorPool descriptorPool)
+{
+	if (descriptorPool == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	VkDevice device = m_Device;
+	Push([device, descriptorPool]() { vkDestroyDescriptorPool(device, descriptorPool, nullptr); });
+}
+
+void DeletionQueue::DestroyPipeline(VkPipeline pipeline)
+{
+	if (pipeline == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	VkDevice device = m_Device;
+	Push([device, pipeline]() { vkDestroyPipeline(device, pipeline, nullptr); });
+}
+
+void DeletionQueue::DestroyFramebuffer(VkFramebuffer framebuffer)
+{
+	if (framebuffer == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	VkDevice device = m_Device;
+	Push([device, framebuffer]() { vkDestroyFramebuffer(device, framebuffer, nullptr); });
+}
+
+void DeletionQueue::Defer(std::function<void()>&& release)
+{
+	Push(std::move(release));
+}
+
+void DeletionQueue::Collect()
+{
+	while (!m_Pending.empty() && m_pTimeline->IsComplete(m_Pending.front().timelineValue))
+	{
+		m_Pending.front().destroy();
+		m_Pending.pop_front();
+	}
+}
+
+void DeletionQueue::Push(std::function<void()>&& destroy)
+{
+	Entry entry;
+	entry.timelineValue = m_pTimeline->GetSubmittedValue();
+	entry.destroy = std::move(destroy);
+	m_Pending.push_back(std::move(entry));
+}
@@ -0,0 +1,157 @@
+#include "DrawList.h"
+#include "RenderObject.h"
+
+namespace
+{
+	const uint32_t PipelineIdBits = 14;
+	const uint32_t MaterialIdBits = 16;
+
+	// IEEE bits of a non-negative float order like the float itself
+	uint32_t GetDepthBits(float depth)
+	{
+		depth = std::max(depth, 0.0f);
+		uint32_t bits;
+		std::memcpy(&bits, &depth, sizeof(bits));
+		return bits;
+	}
+
+	uint64_t MakeSortKey(RenderObject* pRenderObject, float depth)
+	{
+		uint64_t pass = std::min<uint32_t>(pRenderObject->GetBlendMode(), BLENDMODE_BLEND);
+		uint64_t pipeline = pRenderObject->GetPipelineId() & ((1u << PipelineIdBits) - 1);
+		uint64_t material = pRenderObject->GetMaterialId() & ((1u << MaterialIdBits) - 1);
+		uint64_t depthBits = GetDepthBits(depth);
+		if (pass == BLENDMODE_BLEND)
+		{
+			// Correct blending needs the far objects first, state changes come second
+			return (pass << 62) | ((~depthBits & 0xFFFFFFFFull) << 30) | (pipeline << 16) | material;
+		}
+		return (pass << 62) | (pipeline << 48) | (material << 32) | depthBits;
+	}
+}
+
+DrawList::DrawList()
+{
+}
+
+DrawList::~DrawList()
+{
+}
+
+void DrawList::Clear()
+{
+	// Keeps the capacity, after the first frame building the list does not allocate
+	m_DrawItems.clear();
+}
+
+void DrawList::Add(RenderObject* pRenderObject)
+{
+	DrawItem item;
+	item.sortKey = 0;
+	item.pRenderObject = pRenderObject;
+	m_DrawItems.push_back(item);
+}
+
+void DrawList::Compact(const std::vector<uint8_t>& isKept)
+{
+	size_t keptCount = 0;
+	for (size_t i = 0; i < m_DrawItems.size(); i++)
+	{
+		if (isKept[i])
+		{
+			m_DrawItems[keptCount++] = m_DrawItems[i];
+		}
+	}
+	m_DrawItems.resize(keptCount);
+}
+
+void DrawList::Sort(const glm::mat4& viewMtx)
+{
+	size_t count = m_DrawItems.size();
+	for (DrawItem& item : m_DrawItems)
+	{
+		const BoundingBox& bounds = item.pRenderObject->GetWorldBounds();
+		glm::vec4 center = viewMtx * glm::vec4((bounds.min + bounds.max) * 0.5f, 1.0f);
+		// The view looks down -z
+		item.sortKey = MakeSortKey(item.pRenderObject, -center.z);
+	}
+
+	// LSD radix sort, 8 bits per pass. Stable, so equal keys keep the order they were gathered in.
+	// A pass whose digit is the same for every item changes nothing and is skipped, which is most of the upper ones
+	m_SortItems.resize(count);
+	DrawItem* pSrc = m_DrawItems.data();
+	DrawItem* pDst = m_SortItems.data();
+	for (uint32_t shift = 0; shift < 64; shift += 8)
+	{
+		size_t offsets[256] = {};
+		for (size_t i = 0; i < count; i++)
+		{
+			offsets[(pSrc[i].sortKey >> shift) & 0xFF]++;
+		}
+		if (count == 0 || offsets[(pSrc[0].sortKey >> shift) & 0xFF] == count)
+		{
+			continue;
+		}
+
+		size_t offset = 0;
+		for (size_t& bucketOffset : offsets)
+		{
+			size_t bucketCount = bucketOffset;
+			bucketOffset = offset;
+			offset += bucketCount;
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			pDst[offsets[(pSrc[i].sortKey >> shift) & 0xFF]++] = pSrc[i];
+		}
+		std::swap(pSrc, pDst);
+	}
+	if (pSrc != m_DrawItems.data())
+	{
+		m_DrawItems.swap(m_SortItems);
+	}
+}
+
+void DrawList::Record(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+	Record(commandBuffer, frameIndex, 0, GetRecordCount());
+}
+
+void DrawList::Record(VkCommandBuffer commandBuffer, uint32_t frameIndex, size_t begin, size_t end)
+{
+	// Chunks of one list may go to different secondary command buffers, bound state is only tracked within a call
+	DrawBindState bindState;
+	size_t drawCount = m_DrawItems.size();
+	for (size_t i = begin; i < end; i++)
+	{
+		if (m_IsDeferred)
+		{
+			m_DrawItems[i].pRenderObject->Draw(commandBuffer, frameIndex, &bindState, DRAW_PASS_GBUFFER);
+		}
+		else if (!m_IsDepthPrepass)
+		{
+			m_DrawItems[i].pRenderObject->Draw(commandBuffer, frameIndex, &bindState, DRAW_PASS_COLOR);
+		}
+		else if (i < drawCount)
+		{
+			m_DrawItems[i].pRenderObject->Draw(commandBuffer, frameIndex, &bindState, DRAW_PASS_DEPTH);
+		}
+		else
+		{
+			m_DrawItems[i - drawCount].pRenderObject->Draw(commandBuffer, frameIndex, &bindState, DRAW_PASS_COLOR_EQUAL);
+		}
+	}
+}
+
+void DrawList::RecordBlended(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+	// After Sort they are the tail, back to front, but an unsorted list may have them anywhere
+	DrawBindState bindState;
+	for (const DrawItem& item : m_DrawItems)
+	{
+		if (item.pRenderObject->GetBlendMode() == BLENDMODE_BLEND)
+		{
+			item.pRenderObject->Draw(commandBuffer, frameIndex, &bindState, DRAW_PASS_COLOR);
+		}
+	}
+}
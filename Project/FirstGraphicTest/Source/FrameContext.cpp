@@ -0,0 +1,119 @@
+#include "FrameContext.h"
+
+FrameContext::FrameContext()
+{
+}
+
+FrameContext::~FrameContext()
+{
+}
+
+void FrameContext::Init(VkDevice device, GpuTimeline* pTimeline, uint32_t frameCount, uint32_t imageCount)
+{
+	m_Device = device;
+	m_pTimeline = pTimeline;
+	m_FrameCount = frameCount;
+	m_FrameIndex = 0;
+
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	m_ImageAvailableSemaphores.resize(m_FrameCount);
+	m_FrameValues.assign(m_FrameCount, 0);
+	for (uint32_t i = 0; i < m_FrameCount; i++)
+	{
+		vkCreateSemaphore(m_Device, &semaphoreInfo, nullptr, &m_ImageAvailableSemaphores[i]);
+	}
+
+	m_RenderFinishedSemaphores.resize(imageCount);
+	m_ImageValues.assign(imageCount, 0);
+	for (uint32_t i = 0; i < imageCount; i++)
+	{
+		vkCreateSemaphore(m_Device, &semaphoreInfo, nullptr, &m_RenderFinishedSemaphores[i]);
+	}
+}
+
+void FrameContext::Finalize()
+{
+	for (uint32_t i = 0; i < m_FrameCount; i++)
+	{
+		vkDestroySemaphore(m_Device, m_ImageAvailableSemaphores[i], nullptr);
+	}
+	for (VkSemaphore semaphore : m_RenderFinishedSemaphores)
+	{
+		vkDestroySemaphore(m_Device, semaphore, nullptr);
+	}
+	m_ImageAvailableSemaphores.clear();
+	m_FrameValues.clear();
+	m_RenderFinishedSemaphores.clear();
+	m_ImageValues.clear();
+}
+
+uint32_t FrameContext::BeginFrame()
+{
+	m_pTimeline->Wait(m_FrameValues[m_FrameIndex]);
+	m_IsImageAcquired = false;
+	return m_FrameIndex;
+}
+
+VkResult FrameContext::AcquireImage(VkSwapchainKHR swapChain, uint32_t* pImageIndex)
+{
+	VkResult result = vkAcquireNextImageKHR(m_Device, swapChain, UINT64_MAX, m_ImageAvailableSemaphores[m_FrameIndex], VK_NULL_HANDLE, pImageIndex);
+	if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+	{
+		return result;
+	}
+
+	m_IsImageAcquired = true;
+	WaitForImage(*pImageIndex);
+	return result;
+}
+
+void FrameContext::UseImage(uint32_t imageIndex)
+{
+	m_IsImageAcquired = false;
+	WaitForImage(imageIndex);
+}
+
+void FrameContext::WaitForImage(uint32_t imageIndex)
+{
+	// With more images than frames the image may still be in use by a newer frame than the one just waited on
+	m_pTimeline->Wait(m_ImageValues[imageIndex]);
+	m_ImageIndex = imageIndex;
+}
+
+uint64_t FrameContext::Submit(VkCommandBuffer commandBuffer)
+{
+	if (m_IsImageAcquired)
+	{
+		m_pTimeline->AddWait(m_ImageAvailableSemaphores[m_FrameIndex], 0, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+		m_pTimeline->AddSignal(m_RenderFinishedSemaphores[m_ImageIndex]);
+	}
+
+	// Recorded only on submit, a frame abandoned after BeginFrame, e.g. on a failed acquire, keeps the slot's old value
+	uint64_t value = m_pTimeline->Submit(1, &commandBuffer);
+	m_FrameValues[m_FrameIndex] = value;
+	m_ImageValues[m_ImageIndex] = value;
+	return value;
+}
+
+VkResult FrameContext::Present(VkQueue queue, VkSwapchainKHR swapChain)
+{
+	VkPresentInfoKHR presentInfo = {};
+	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+
+	presentInfo.waitSemaphoreCount = 1;
+	presentInfo.pWaitSemaphores = &m_RenderFinishedSemaphores[m_ImageIndex];
+
+	presentInfo.swapchainCount = 1;
+	presentInfo.pSwapchains = &swapChain;
+	presentInfo.pImageIndices = &m_ImageIndex;
+	presentInfo.pResults = nullptr;
+
+	return vkQueuePresentKHR(queue, &presentInfo);
+}
+
+void FrameContext::EndFrame()
+{
+	m_FrameIndex = (m_FrameIndex + 1) % m_FrameCount;
+}
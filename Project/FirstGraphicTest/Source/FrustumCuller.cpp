@@ -0,0 +1,95 @@
+#include "FrustumCuller.h"
+#include "RenderObject.h"
+
+#include <xmmintrin.h>
+
+namespace
+{
+	const size_t SimdWidth = 4;
+}
+
+FrustumCuller::FrustumCuller()
+{
+}
+
+FrustumCuller::~FrustumCuller()
+{
+}
+
+void FrustumCuller::Cull(const glm::mat4& viewProjMtx, DrawList* pDrawList)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	size_t count = pDrawList->GetDrawCount();
+	size_t paddedCount = (count + SimdWidth - 1) / SimdWidth * SimdWidth;
+	m_MinX.resize(paddedCount);
+	m_MinY.resize(paddedCount);
+	m_MinZ.resize(paddedCount);
+	m_MaxX.resize(paddedCount);
+	m_MaxY.resize(paddedCount);
+	m_MaxZ.resize(paddedCount);
+	m_IsVisible.resize(paddedCount);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const BoundingBox& bounds = pDrawList->GetRenderObject(i)->GetWorldBounds();
+		m_MinX[i] = bounds.min.x;
+		m_MinY[i] = bounds.min.y;
+		m_MinZ[i] = bounds.min.z;
+		m_MaxX[i] = bounds.max.x;
+		m_MaxY[i] = bounds.max.y;
+		m_MaxZ[i] = bounds.max.z;
+	}
+	for (size_t i = count; i < paddedCount; i++)
+	{
+		m_MinX[i] = m_MinY[i] = m_MinZ[i] = 0.0f;
+		m_MaxX[i] = m_MaxY[i] = m_MaxZ[i] = 0.0f;
+	}
+
+	glm::vec4 planes[6];
+	ExtractFrustumPlanes(viewProjMtx, planes);
+	TestBounds(planes, paddedCount);
+
+	m_IsVisible.resize(count);
+	pDrawList->Compact(m_IsVisible);
+
+	auto endTime = std::chrono::high_resolution_clock::now();
+	m_Stats.testedCount = static_cast<uint32_t>(count);
+	m_Stats.culledCount = static_cast<uint32_t>(count - pDrawList->GetDrawCount());
+	m_Stats.cullTimeMs = std::chrono::duration<float, std::milli>(endTime - startTime).count();
+}
+
+void FrustumCuller::TestBounds(const glm::vec4* pPlanes, size_t count)
+{
+	for (size_t i = 0; i < count; i += SimdWidth)
+	{
+		__m128 minX = _mm_loadu_ps(&m_MinX[i]);
+		__m128 minY = _mm_loadu_ps(&m_MinY[i]);
+		__m128 minZ = _mm_loadu_ps(&m_MinZ[i]);
+		__m128 maxX = _mm_loadu_ps(&m_MaxX[i]);
+		__m128 maxY = _mm_loadu_ps(&m_MaxY[i]);
+		__m128 maxZ = _mm_loadu_ps(&m_MaxZ[i]);
+
+		__m128 isOutside = _mm_setzero_ps();
+		for (int plane = 0; plane < 6; plane++)
+		{
+			__m128 planeX = _mm_set1_ps(pPlanes[plane].x);
+			__m128 planeY = _mm_set1_ps(pPlanes[plane].y);
+			__m128 planeZ = _mm_set1_ps(pPlanes[plane].z);
+			__m128 planeW = _mm_set1_ps(pPlanes[plane].w);
+
+			// Distance of the corner furthest along the plane normal, picked per axis without branching
+			__m128 distance = _mm_max_ps(_mm_mul_ps(planeX, minX), _mm_mul_ps(planeX, maxX));
+			distance = _mm_add_ps(distance, _mm_max_ps(_mm_mul_ps(planeY, minY), _mm_mul_ps(planeY, maxY)));
+			distance = _mm_add_ps(distance, _mm_max_ps(_mm_mul_ps(planeZ, minZ), _mm_mul_ps(planeZ, maxZ)));
+			distance = _mm_add_ps(distance, planeW);
+			isOutside = _mm_or_ps(isOutside, _mm_cmplt_ps(distance, _mm_setzero_ps()));
+		}
+
+		int outsideMask = _mm_movemask_ps(isOutside);
+		for (size_t lane = 0; lane < SimdWidth; lane++)
+		{
+			m_IsVisible[i + lane] = (outsideMask & (1 << lane)) == 0 ? 1 : 0;
+		}
+	}
+}
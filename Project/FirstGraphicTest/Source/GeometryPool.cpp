@@ -0,0 +1,194 @@
+#include "GeometryPool.h"
+
+GeometryPool::GeometryPool()
+{
+}
+
+GeometryPool::~GeometryPool()
+{
+}
+
+void GeometryPool::Init(VkDevice device, MemoryAllocator* pAllocator, DeletionQueue* pDeletionQueue, VkDeviceSize blockSize)
+{
+	m_Device = device;
+	m_pAllocator = pAllocator;
+	m_pDeletionQueue = pDeletionQueue;
+	m_BlockSize = blockSize;
+
+	m_VertexHeap.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+	m_VertexHeap.granularity = sizeof(Vertex);
+	m_IndexHeap.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+	m_IndexHeap.granularity = 4;
+	m_DepthVertexHeap.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+	m_DepthVertexHeap.granularity = DepthVertexSize;
+}
+
+void GeometryPool::Finalize()
+{
+	// Deferred frees have run by now, the DeletionQueue is finalized first
+	DestroyHeap(m_VertexHeap);
+	DestroyHeap(m_IndexHeap);
+	DestroyHeap(m_DepthVertexHeap);
+}
+
+void GeometryPool::AllocateVertices(VkDeviceSize vertexCount, GeometryRange* pRange)
+{
+	Allocate(m_VertexHeap, vertexCount * sizeof(Vertex), pRange);
+}
+
+void GeometryPool::AllocateIndices(VkDeviceSize dataSize, GeometryRange* pRange)
+{
+	Allocate(m_IndexHeap, dataSize, pRange);
+}
+
+void GeometryPool::AllocateDepthVertices(VkDeviceSize vertexCount, GeometryRange* pRange)
+{
+	Allocate(m_DepthVertexHeap, vertexCount * DepthVertexSize, pRange);
+}
+
+void GeometryPool::FreeVertices(GeometryRange* pRange)
+{
+	Free(m_VertexHeap, pRange);
+}
+
+void GeometryPool::FreeIndices(GeometryRange* pRange)
+{
+	Free(m_IndexHeap, pRange);
+}
+
+void GeometryPool::FreeDepthVertices(GeometryRange* pRange)
+{
+	Free(m_DepthVertexHeap, pRange);
+}
+
+void GeometryPool::Allocate(Heap& heap, VkDeviceSize size, GeometryRange* pRange)
+{
+	// Empty geometry still gets a range, so every object has a block to bind
+	size = AlignUp(std::max<VkDeviceSize>(size, 1), heap.granularity);
+
+	uint32_t blockIndex = InvalidGeometryBlock;
+	std::map<VkDeviceSize, VkDeviceSize>::iterator found;
+	for (uint32_t i = 0; i < heap.blocks.size() && blockIndex == InvalidGeometryBlock; i++)
+	{
+		std::map<VkDeviceSize, VkDeviceSize>& freeRanges = heap.blocks[i].freeRanges;
+		for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+		{
+			if (it->second >= size)
+			{
+				blockIndex = i;
+				found = it;
+				break;
+			}
+		}
+	}
+
+	if (blockIndex == InvalidGeometryBlock)
+	{
+		Block block;
+		// Whole granules, so the free space at the end stays usable
+		block.size = std::max(AlignUp(m_BlockSize, heap.granularity), size);
+		CreateBuffer(
+			&block.buffer,
+			&block.memory,
+			block.size,
+			heap.usage,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			m_Device,
+			m_pAllocator);
+		block.freeRanges[0] = block.size;
+		heap.blocks.push_back(block);
+		blockIndex = static_cast<uint32_t>(heap.blocks.size() - 1);
+		found = heap.blocks.back().freeRanges.begin();
+	}
+
+	std::map<VkDeviceSize, VkDeviceSize>& freeRanges = heap.blocks[blockIndex].freeRanges;
+	VkDeviceSize offset = found->first;
+	VkDeviceSize remaining = found->second - size;
+	freeRanges.erase(found);
+	if (remaining > 0)
+	{
+		freeRanges[offset + size] = remaining;
+	}
+
+	pRange->block = blockIndex;
+	pRange->offset = offset;
+	pRange->size = size;
+	heap.usedBytes += size;
+	heap.rangeCount++;
+}
+
+void GeometryPool::Free(Heap& heap, GeometryRange* pRange)
+{
+	if (pRange->block == InvalidGeometryBlock)
+	{
+		return;
+	}
+
+	GeometryRange range = *pRange;
+	*pRange = GeometryRange();
+	Heap* pHeap = &heap;
+	m_pDeletionQueue->Defer([this, pHeap, range]()
+	{
+		Release(*pHeap, range);
+	});
+}
+
+void GeometryPool::Release(Heap& heap, const GeometryRange& range)
+{
+	std::map<VkDeviceSize, VkDeviceSize>& freeRanges = heap.blocks[range.block].freeRanges;
+	VkDeviceSize offset = range.offset;
+	VkDeviceSize size = range.size;
+
+	auto next = freeRanges.lower_bound(offset);
+	if (next != freeRanges.end() && offset + size == next->first)
+	{
+		size += next->second;
+		next = freeRanges.erase(next);
+	}
+	if (next != freeRanges.begin())
+	{
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == offset)
+		{
+			offset = previous->first;
+			size += previous->second;
+			freeRanges.erase(previous);
+		}
+	}
+	freeRanges[offset] = size;
+
+	heap.usedBytes -= range.size;
+	heap.rangeCount--;
+}
+
+void GeometryPool::DestroyHeap(Heap& heap)
+{
+	for (Block& block : heap.blocks)
+	{
+		vkDestroyBuffer(m_Device, block.buffer, nullptr);
+		m_pAllocator->Free(&block.memory);
+	}
+	heap.blocks.clear();
+	heap.usedBytes = 0;
+	heap.rangeCount = 0;
+}
+
+void GeometryPool::PrintStats()
+{
+	const Heap* heaps[] = { &m_VertexHeap, &m_IndexHeap, &m_DepthVertexHeap };
+	const char* names[] = { "vertex", "index", "depth vertex" };
+	for (size_t i = 0; i < 3; i++)
+	{
+		VkDeviceSize reservedBytes = 0;
+		for (const Block& block : heaps[i]->blocks)
+		{
+			reservedBytes += block.size;
+		}
+		printf("geometry pool %s: %u ranges, %llu of %llu bytes used in %zu blocks\n",
+			names[i],
+			heaps[i]->rangeCount,
+			static_cast<unsigned long long>(heaps[i]->usedBytes),
+			static_cast<unsigned long long>(reservedBytes),
+			heaps[i]->blocks.size());
+	}
+}
@@ -0,0 +1,727 @@
+#include "GpuScene.h"
+#include "RenderObject.h"
+#include "LightManager.h"
+
+#include <numeric>
+#include <tuple>
+
+namespace
+{
+	// local_size_x and the CULL_PHASE specialization of Shader/cull.comp
+	const uint32_t CullGroupSize = 64;
+	const uint32_t CullShaderFrustum = 0;
+	const uint32_t CullShaderEarly = 1;
+	const uint32_t CullShaderLate = 2;
+
+	struct BucketKey
+	{
+		// First, so the blended buckets come last
+		uint32_t blendMode;
+		uint32_t vertexAttributeFlags;
+		uint32_t textureAttributeFlags;
+		uint32_t cullMode;
+		uint32_t indexType;
+		uint32_t vertexBlock;
+		uint32_t indexBlock;
+
+		bool operator<(const BucketKey& other) const
+		{
+			return std::tie(blendMode, vertexAttributeFlags, textureAttributeFlags, cullMode, indexType, vertexBlock, indexBlock)
+				< std::tie(other.blendMode, other.vertexAttributeFlags, other.textureAttributeFlags, other.cullMode, other.indexType, other.vertexBlock, other.indexBlock);
+		}
+	};
+}
+
+GpuScene::GpuScene()
+{
+}
+
+GpuScene::~GpuScene()
+{
+}
+
+bool GpuScene::Init(GraphicSystem* pGraphicSystem, const std::vector<RenderObject*>& renderObjects, bool isOcclusionCulled)
+{
+	m_pGraphicSystem = pGraphicSystem;
+	m_Device = pGraphicSystem->GetDevice();
+	m_FrameCount = pGraphicSystem->GetFramesInFlight();
+	m_IsOcclusionCulled = isOcclusionCulled;
+
+	if (!pGraphicSystem->IsGpuDrivenSupported())
+	{
+		printf("### ERROR ### GpuScene : device lacks indirect count draws or descriptor indexing\n");
+		return false;
+	}
+	if (renderObjects.empty())
+	{
+		printf("### ERROR ### GpuScene : no objects\n");
+		return false;
+	}
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(pGraphicSystem->GetPhysicalDevice(), &properties);
+	m_StorageAlignment = std::max<VkDeviceSize>(properties.limits.minStorageBufferOffsetAlignment, 16);
+
+	ShaderModuleCache* pShaderModuleCache = pGraphicSystem->GetShaderModuleCache();
+	m_VertexShaderModule = pShaderModuleCache->Acquire("Shader/indirect_vs.spv");
+	m_FragmentShaderModule = pShaderModuleCache->Acquire("Shader/indirect_fs.spv");
+	m_CullShaderModule = pShaderModuleCache->Acquire("Shader/cull_cs.spv");
+	if (m_VertexShaderModule == VK_NULL_HANDLE || m_FragmentShaderModule == VK_NULL_HANDLE || m_CullShaderModule == VK_NULL_HANDLE)
+	{
+		printf("### ERROR ### GpuScene : indirect shaders are missing, run Shader/compile.bat\n");
+		Finalize();
+		return false;
+	}
+	if (!m_HiZBuffer.Init(pGraphicSystem))
+	{
+		Finalize();
+		return false;
+	}
+
+	CreateInstances(renderObjects);
+
+	uint32_t samplerCount = static_cast<uint32_t>(m_Textures.size() + m_CubeTextures.size());
+	if (m_Textures.empty() || m_CubeTextures.empty())
+	{
+		printf("### ERROR ### GpuScene : scene needs at least one 2D and one cube texture\n");
+		Finalize();
+		return false;
+	}
+	if (samplerCount > properties.limits.maxPerStageDescriptorSamplers || samplerCount > properties.limits.maxPerStageDescriptorSampledImages)
+	{
+		printf("### ERROR ### GpuScene : %u textures exceed the per stage descriptor limit\n", samplerCount);
+		Finalize();
+		return false;
+	}
+
+	CreateFrameRegions();
+	CreateDescriptors();
+	if (!CreatePipelines())
+	{
+		printf("### ERROR ### GpuScene : pipeline creation failed\n");
+		Finalize();
+		return false;
+	}
+
+	m_Stats.instanceCount = static_cast<uint32_t>(m_Instances.size());
+	m_Stats.bucketCount = static_cast<uint32_t>(m_Buckets.size());
+	m_Stats.textureCount = static_cast<uint32_t>(m_Textures.size());
+	m_Stats.cubeTextureCount = static_cast<uint32_t>(m_CubeTextures.size());
+	return true;
+}
+
+void GpuScene::Finalize()
+{
+	if (m_pGraphicSystem == nullptr)
+	{
+		return;
+	}
+
+	DeletionQueue* pDeletionQueue = m_pGraphicSystem->GetDeletionQueue();
+	VkBuffer* buffers[] = { &m_SceneBuffer, &m_DrawCommandBuffer, &m_DrawCountBuffer, &m_VisibilityBuffer };
+	MemoryAllocation* allocations[] = { &m_SceneBufferMemory, &m_DrawCommandBufferMemory, &m_DrawCountBufferMemory, &m_VisibilityBufferMemory };
+	for (size_t i = 0; i < 4; i++)
+	{
+		if (*buffers[i] != VK_NULL_HANDLE)
+		{
+			pDeletionQueue->DestroyBuffer(*buffers[i], allocations[i]);
+			*buffers[i] = VK_NULL_HANDLE;
+		}
+	}
+	if (m_DescriptorPool != VK_NULL_HANDLE)
+	{
+		pDeletionQueue->DestroyDescriptorPool(m_DescriptorPool);
+		m_DescriptorPool = VK_NULL_HANDLE;
+		m_DescriptorSet = VK_NULL_HANDLE;
+	}
+
+	m_HiZBuffer.Finalize();
+
+	ShaderModuleCache* pShaderModuleCache = m_pGraphicSystem->GetShaderModuleCache();
+	VkShaderModule* shaderModules[] = { &m_VertexShaderModule, &m_FragmentShaderModule, &m_CullShaderModule };
+	for (VkShaderModule* pShaderModule : shaderModules)
+	{
+		if (*pShaderModule != VK_NULL_HANDLE)
+		{
+			pShaderModuleCache->Release(*pShaderModule);
+			*pShaderModule = VK_NULL_HANDLE;
+		}
+	}
+
+	// Layouts and pipelines belong to the PipelineLibrary
+	m_DescriptorSetLayout = VK_NULL_HANDLE;
+	m_PipelineLayout = VK_NULL_HANDLE;
+	m_CullPipelineLayout = VK_NULL_HANDLE;
+	m_CullPipeline = VK_NULL_HANDLE;
+	m_LateCullPipeline = VK_NULL_HANDLE;
+
+	m_Instances.clear();
+	m_ObjectInstances.clear();
+	m_Buckets.clear();
+	m_OpaqueInstanceCount = 0;
+	m_OpaqueBucketCount = 0;
+	m_BlendedDraws.clear();
+	m_InstanceDirtyFrames.clear();
+	m_DirtyInstances.clear();
+	m_Textures.clear();
+	m_CubeTextures.clear();
+	m_TextureIndices.clear();
+	m_Stats = GpuSceneStats();
+	m_pGraphicSystem = nullptr;
+}
+
+void GpuScene::CreateInstances(const std::vector<RenderObject*>& renderObjects)
+{
+	uint32_t objectCount = static_cast<uint32_t>(renderObjects.size());
+
+	// Buckets are numbered in key order, sorting the instances by bucket then groups the commands of a bucket
+	std::map<BucketKey, uint32_t> bucketIndices;
+	std::vector<BucketKey> objectKeys(objectCount);
+	for (uint32_t object = 0; object < objectCount; object++)
+	{
+		RenderObject* pObject = renderObjects[object];
+		BucketKey& key = objectKeys[object];
+		// Mask only differs in the shader, it shares the opaque pipelines
+		key.blendMode = pObject->GetBlendMode() == BLENDMODE_BLEND ? BLENDMODE_BLEND : BLENDMODE_OPAQUE;
+		key.vertexAttributeFlags = pObject->GetVertexAttributeFlags();
+		key.textureAttributeFlags = pObject->GetTextureAttributeFlags();
+		// The IBL slot indexes the cube array, a 2D environment map cannot go there
+		Texture* pIblTexture = pObject->GetTexture(IBL_TEX);
+		if (pIblTexture == nullptr || pIblTexture->GetViewType() != VK_IMAGE_VIEW_TYPE_CUBE)
+		{
+			key.textureAttributeFlags &= ~static_cast<uint32_t>(IBL_TEX);
+		}
+		key.cullMode = pObject->IsDoubleSided() ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
+		key.indexType = pObject->GetIndexType();
+		key.vertexBlock = pObject->GetVertexRange().block;
+		key.indexBlock = pObject->GetIndexRange().block;
+		bucketIndices[key] = 0;
+	}
+
+	VkExtent2D extent = m_pGraphicSystem->GetSwapChainExtent();
+	GeometryPool* pGeometryPool = m_pGraphicSystem->GetGeometryPool();
+	ShaderModuleCache* pShaderModuleCache = m_pGraphicSystem->GetShaderModuleCache();
+	m_Buckets.resize(bucketIndices.size());
+	uint32_t bucketIndex = 0;
+	for (auto& entry : bucketIndices)
+	{
+		Bucket& bucket = m_Buckets[bucketIndex];
+		bucket.pipelineDesc = GraphicsPipelineDesc();
+		bucket.pipelineDesc.vertexShaderModule = m_VertexShaderModule;
+		bucket.pipelineDesc.fragmentShaderModule = m_FragmentShaderModule;
+		bucket.pipelineDesc.renderPass = m_pGraphicSystem->GetRenderPass();
+		bucket.pipelineDesc.vertexShaderHash = pShaderModuleCache->GetContentHash(m_VertexShaderModule);
+		bucket.pipelineDesc.fragmentShaderHash = pShaderModuleCache->GetContentHash(m_FragmentShaderModule);
+		bucket.pipelineDesc.vertexAttributeFlags = entry.first.vertexAttributeFlags;
+		bucket.pipelineDesc.textureAttributeFlags = entry.first.textureAttributeFlags;
+		bucket.pipelineDesc.cullMode = entry.first.cullMode;
+		bucket.pipelineDesc.isBlendEnabled = entry.first.blendMode == BLENDMODE_BLEND ? VK_TRUE : VK_FALSE;
+		bucket.pipelineDesc.isDepthWriteEnabled = entry.first.blendMode == BLENDMODE_BLEND ? VK_FALSE : VK_TRUE;
+		bucket.pipelineDesc.viewportWidth = extent.width;
+		bucket.pipelineDesc.viewportHeight = extent.height;
+		bucket.pipeline = VK_NULL_HANDLE;
+		bucket.indexType = static_cast<VkIndexType>(entry.first.indexType);
+		bucket.vertexBuffer = pGeometryPool->GetVertexBuffer(entry.first.vertexBlock);
+		bucket.indexBuffer = pGeometryPool->GetIndexBuffer(entry.first.indexBlock);
+		bucket.firstCommand = 0;
+		bucket.commandCount = 0;
+		if (entry.first.blendMode != BLENDMODE_BLEND)
+		{
+			m_OpaqueBucketCount++;
+		}
+		entry.second = bucketIndex++;
+	}
+
+	std::vector<uint32_t> objectBuckets(objectCount);
+	for (uint32_t object = 0; object < objectCount; object++)
+	{
+		objectBuckets[object] = bucketIndices[objectKeys[object]];
+	}
+	std::vector<uint32_t> order(objectCount);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&objectBuckets](uint32_t a, uint32_t b)
+	{
+		return objectBuckets[a] < objectBuckets[b];
+	});
+
+	static const TextureAttributeFlag slotFlags[GPU_TEXTURE_SLOT_COUNT] =
+	{
+		DIFFUSE_TEX, NORMAL_TEX, METALLICROUGHNESS_TEX, EMISSIVE_TEX, OCCLUSION_TEX, DFG_TEX, IBL_TEX
+	};
+
+	m_Instances.resize(objectCount);
+	m_ObjectInstances.resize(objectCount);
+	for (uint32_t instance = 0; instance < objectCount; instance++)
+	{
+		uint32_t object = order[instance];
+		RenderObject* pObject = renderObjects[object];
+		uint32_t objectBucket = objectBuckets[object];
+		m_ObjectInstances[object] = instance;
+
+		Bucket& bucket = m_Buckets[objectBucket];
+		if (bucket.commandCount == 0)
+		{
+			bucket.firstCommand = instance;
+		}
+		bucket.commandCount++;
+		if (objectBucket < m_OpaqueBucketCount)
+		{
+			m_OpaqueInstanceCount++;
+		}
+
+		const UniformData& material = pObject->GetUniformData();
+		GpuInstanceData& data = m_Instances[instance];
+		data = GpuInstanceData();
+		data.modelMtx = pObject->GetModelMatrix();
+		data.localBoundsMin = glm::vec4(pObject->GetLocalBounds().min, 1.0f);
+		data.localBoundsMax = glm::vec4(pObject->GetLocalBounds().max, 1.0f);
+		data.baseColorFactor = material.baseColorFactor;
+		data.metallicRoughness = material.metallicRoughness;
+		data.blendMode = material.blendMode;
+		data.emissiveFactor = material.emissiveFactor;
+		data.indexCount = static_cast<uint32_t>(pObject->GetIndexCount());
+		data.firstIndex = pObject->GetFirstIndex();
+		data.vertexOffset = pObject->GetVertexOffset();
+		data.bucket = objectBucket;
+		data.isVisible = 1;
+		for (uint32_t slot = 0; slot < GPU_TEXTURE_SLOT_COUNT; slot++)
+		{
+			data.textureIndices[slot] = AddTexture(pObject->GetTexture(slotFlags[slot]), slot == GPU_TEXTURE_SLOT_IBL);
+		}
+
+		m_Stats.vertexBytes += pObject->GetVertexCount() * sizeof(Vertex);
+		m_Stats.indexBytes += pObject->GetIndexCount() * GetIndexSize(pObject->GetIndexType());
+	}
+
+	for (GpuInstanceData& data : m_Instances)
+	{
+		data.firstCommand = m_Buckets[data.bucket].firstCommand;
+	}
+}
+
+uint32_t GpuScene::AddTexture(Texture* pTexture, bool isCube)
+{
+	// Unused slots point at the first texture of their array, the specialization constants keep them from being sampled
+	if (pTexture == nullptr || (pTexture->GetViewType() == VK_IMAGE_VIEW_TYPE_CUBE) != isCube)
+	{
+		return 0;
+	}
+
+	auto found = m_TextureIndices.find(pTexture->GetImageView());
+	if (found != m_TextureIndices.end())
+	{
+		return found->second;
+	}
+
+	std::vector<VkDescriptorImageInfo>& textures = isCube ? m_CubeTextures : m_Textures;
+	VkDescriptorImageInfo imageInfo = {};
+	imageInfo.sampler = pTexture->GetSampler();
+	imageInfo.imageView = pTexture->GetImageView();
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	uint32_t index = static_cast<uint32_t>(textures.size());
+	textures.push_back(imageInfo);
+	m_TextureIndices[imageInfo.imageView] = index;
+	return index;
+}
+
+void GpuScene::CreateFrameRegions()
+{
+	MemoryAllocator* pAllocator = m_pGraphicSystem->GetMemoryAllocator();
+	VkDeviceSize instanceCount = m_Instances.size();
+
+	m_SceneRegionSize = AlignUp(sizeof(GpuFrameData) + instanceCount * sizeof(GpuInstanceData), m_StorageAlignment);
+	CreateBuffer(&m_SceneBuffer, &m_SceneBufferMemory, m_SceneRegionSize * m_FrameCount,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_Device, pAllocator);
+	for (uint32_t frame = 0; frame < m_FrameCount; frame++)
+	{
+		uint8_t* pRegion = static_cast<uint8_t*>(m_SceneBufferMemory.pMappedData) + frame * m_SceneRegionSize;
+		memset(pRegion, 0, sizeof(GpuFrameData));
+		memcpy(pRegion + sizeof(GpuFrameData), m_Instances.data(), instanceCount * sizeof(GpuInstanceData));
+	}
+
+	m_DrawCommandRegionSize = AlignUp(2 * instanceCount * sizeof(VkDrawIndexedIndirectCommand), m_StorageAlignment);
+	CreateBuffer(&m_DrawCommandBuffer, &m_DrawCommandBufferMemory, m_DrawCommandRegionSize * m_FrameCount,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_Device, pAllocator);
+
+	m_DrawCountRegionSize = AlignUp((2 * m_Buckets.size() + 2) * sizeof(uint32_t), m_StorageAlignment);
+	CreateBuffer(&m_DrawCountBuffer, &m_DrawCountBufferMemory, m_DrawCountRegionSize * m_FrameCount,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_Device, pAllocator);
+	memset(m_DrawCountBufferMemory.pMappedData, 0, m_DrawCountRegionSize * m_FrameCount);
+
+	// Nothing counts as visible in the first frame, the early phase draws nothing and the late phase everything it does not cull
+	CreateBuffer(&m_VisibilityBuffer, &m_VisibilityBufferMemory, instanceCount * sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_Device, pAllocator);
+	memset(m_VisibilityBufferMemory.pMappedData, 0, instanceCount * sizeof(uint32_t));
+
+	m_InstanceDirtyFrames.assign(m_Instances.size(), 0);
+	m_DirtyInstances.clear();
+}
+
+void GpuScene::CreateDescriptors()
+{
+	std::vector<VkDescriptorSetLayoutBinding> bindings(7);
+	CreateDescriptorSetLayoutBinding(&bindings[0], 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT, m_Device);
+	CreateDescriptorSetLayoutBinding(&bindings[1], 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_SHADER_STAGE_COMPUTE_BIT, m_Device);
+	CreateDescriptorSetLayoutBinding(&bindings[2], 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_SHADER_STAGE_COMPUTE_BIT, m_Device);
+	CreateDescriptorSetLayoutBinding(&bindings[3], 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, m_Device);
+	CreateDescriptorSetLayoutBinding(&bindings[4], 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, m_Device);
+	CreateDescriptorSetLayoutBinding(&bindings[5], 5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, m_Device);
+	CreateDescriptorSetLayoutBinding(&bindings[6], 6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, m_Device);
+	bindings[3].descriptorCount = static_cast<uint32_t>(m_Textures.size());
+	bindings[4].descriptorCount = static_cast<uint32_t>(m_CubeTextures.size());
+	m_DescriptorSetLayout = m_pGraphicSystem->GetPipelineLibrary()->GetDescriptorSetLayout(bindings);
+
+	VkDescriptorPoolSize dynamicStoragePoolSize = {};
+	VkDescriptorPoolSize storagePoolSize = {};
+	VkDescriptorPoolSize samplerPoolSize = {};
+	CreateDescriptorPoolSize(&dynamicStoragePoolSize, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 3);
+	CreateDescriptorPoolSize(&storagePoolSize, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1);
+	CreateDescriptorPoolSize(&samplerPoolSize, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, bindings[3].descriptorCount + bindings[4].descriptorCount + 1);
+	std::vector<VkDescriptorPoolSize> poolSizes = { dynamicStoragePoolSize, storagePoolSize, samplerPoolSize };
+	CreateDescriptorPool(&m_DescriptorPool, m_Device, poolSizes, 1);
+
+	std::vector<VkDescriptorSetLayout> layouts = { m_DescriptorSetLayout };
+	std::vector<VkDescriptorSet> descriptorSets(1);
+	VkDescriptorSetAllocateInfo allocateInfo = {};
+	CreateDescriptorSet(descriptorSets, &allocateInfo, m_DescriptorPool, layouts, m_Device);
+	m_DescriptorSet = descriptorSets[0];
+
+	// Dynamic offsets select the frame region, the range covers one region
+	VkDescriptorBufferInfo bufferInfos[4] = {};
+	bufferInfos[0].buffer = m_SceneBuffer;
+	bufferInfos[0].range = m_SceneRegionSize;
+	bufferInfos[1].buffer = m_DrawCommandBuffer;
+	bufferInfos[1].range = m_DrawCommandRegionSize;
+	bufferInfos[2].buffer = m_DrawCountBuffer;
+	bufferInfos[2].range = m_DrawCountRegionSize;
+	bufferInfos[3].buffer = m_VisibilityBuffer;
+	bufferInfos[3].range = VK_WHOLE_SIZE;
+
+	VkDescriptorImageInfo hiZInfo = {};
+	hiZInfo.sampler = m_HiZBuffer.GetSampler();
+	hiZInfo.imageView = m_HiZBuffer.GetImageView();
+	hiZInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	VkWriteDescriptorSet writes[7] = {};
+	for (uint32_t binding = 0; binding < 7; binding++)
+	{
+		writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[binding].dstSet = m_DescriptorSet;
+		writes[binding].dstBinding = binding;
+		writes[binding].descriptorType = bindings[binding].descriptorType;
+		writes[binding].descriptorCount = bindings[binding].descriptorCount;
+	}
+	writes[0].pBufferInfo = &bufferInfos[0];
+	writes[1].pBufferInfo = &bufferInfos[1];
+	writes[2].pBufferInfo = &bufferInfos[2];
+	writes[3].pImageInfo = m_Textures.data();
+	writes[4].pImageInfo = m_CubeTextures.data();
+	writes[5].pImageInfo = &hiZInfo;
+	writes[6].pBufferInfo = &bufferInfos[3];
+	vkUpdateDescriptorSets(m_Device, 7, writes, 0, nullptr);
+}
+
+bool GpuScene::CreatePipelines()
+{
+	PipelineLibrary* pPipelineLibrary = m_pGraphicSystem->GetPipelineLibrary();
+	m_PipelineLayout = pPipelineLibrary->GetPipelineLayout({ LightManager::GetInstance().GetDescriptorSetLayout(), m_DescriptorSetLayout });
+	m_CullPipelineLayout = pPipelineLibrary->GetPipelineLayout({ m_DescriptorSetLayout });
+
+	ComputePipelineDesc cullDesc;
+	cullDesc.shaderModule = m_CullShaderModule;
+	cullDesc.pipelineLayout = m_CullPipelineLayout;
+	cullDesc.shaderHash = m_pGraphicSystem->GetShaderModuleCache()->GetContentHash(m_CullShaderModule);
+	cullDesc.specialization = m_IsOcclusionCulled ? CullShaderEarly : CullShaderFrustum;
+	m_CullPipeline = pPipelineLibrary->GetComputePipeline(cullDesc);
+	if (m_CullPipeline == VK_NULL_HANDLE)
+	{
+		return false;
+	}
+	if (m_IsOcclusionCulled)
+	{
+		cullDesc.specialization = CullShaderLate;
+		m_LateCullPipeline = pPipelineLibrary->GetComputePipeline(cullDesc);
+		if (m_LateCullPipeline == VK_NULL_HANDLE)
+		{
+			return false;
+		}
+	}
+
+	for (Bucket& bucket : m_Buckets)
+	{
+		bucket.pipelineDesc.pipelineLayout = m_PipelineLayout;
+		bucket.pipeline = pPipelineLibrary->GetGraphicsPipeline(bucket.pipelineDesc);
+		if (bucket.pipeline == VK_NULL_HANDLE)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void GpuScene::MarkInstanceDirty(uint32_t instance)
+{
+	if (m_InstanceDirtyFrames[instance] == 0)
+	{
+		m_DirtyInstances.push_back(instance);
+	}
+	m_InstanceDirtyFrames[instance] = m_FrameCount;
+}
+
+void GpuScene::SetObjectTransform(uint32_t object, const glm::mat4& modelMtx)
+{
+	uint32_t instance = m_ObjectInstances[object];
+	m_Instances[instance].modelMtx = modelMtx;
+	MarkInstanceDirty(instance);
+}
+
+void GpuScene::SetObjectVisible(uint32_t object, bool isVisible)
+{
+	uint32_t instance = m_ObjectInstances[object];
+	uint32_t value = isVisible ? 1 : 0;
+	if (m_Instances[instance].isVisible != value)
+	{
+		m_Instances[instance].isVisible = value;
+		MarkInstanceDirty(instance);
+	}
+}
+
+void GpuScene::Update(uint32_t frameIndex)
+{
+	// The slot's previous frame has completed, its counts are final
+	const uint32_t* pDrawCounts = reinterpret_cast<const uint32_t*>(static_cast<uint8_t*>(m_DrawCountBufferMemory.pMappedData) + frameIndex * m_DrawCountRegionSize);
+	size_t bucketCount = m_OpaqueBucketCount;
+	m_Stats.drawnCount = 0;
+	m_Stats.lateDrawnCount = 0;
+	for (size_t bucket = 0; bucket < bucketCount; bucket++)
+	{
+		m_Stats.drawnCount += pDrawCounts[bucket] + pDrawCounts[bucketCount + bucket];
+		m_Stats.lateDrawnCount += pDrawCounts[bucketCount + bucket];
+	}
+	m_Stats.frustumCulledCount = pDrawCounts[2 * bucketCount];
+	m_Stats.occlusionCulledCount = pDrawCounts[2 * bucketCount + 1];
+
+	uint8_t* pRegion = static_cast<uint8_t*>(m_SceneBufferMemory.pMappedData) + frameIndex * m_SceneRegionSize;
+
+	const Camera& camera = m_pGraphicSystem->GetCamera();
+	GpuFrameData frameData = {};
+	frameData.viewMtx = camera.viewMtx;
+	frameData.projMtx = camera.projMtx;
+	frameData.cameraPos = glm::vec4(camera.cameraPos, 1.0f);
+	ExtractFrustumPlanes(camera.projMtx * camera.viewMtx, frameData.frustumPlanes);
+	frameData.instanceCount = m_OpaqueInstanceCount;
+	frameData.bucketCount = static_cast<uint32_t>(bucketCount);
+	frameData.depthWidth = m_pGraphicSystem->GetSwapChainExtent().width;
+	frameData.depthHeight = m_pGraphicSystem->GetSwapChainExtent().height;
+	memcpy(pRegion, &frameData, sizeof(GpuFrameData));
+
+	GpuInstanceData* pInstances = reinterpret_cast<GpuInstanceData*>(pRegion + sizeof(GpuFrameData));
+	size_t keptCount = 0;
+	for (uint32_t instance : m_DirtyInstances)
+	{
+		pInstances[instance] = m_Instances[instance];
+		if (--m_InstanceDirtyFrames[instance] > 0)
+		{
+			m_DirtyInstances[keptCount++] = instance;
+		}
+	}
+	m_Stats.writtenInstanceCount = static_cast<uint32_t>(m_DirtyInstances.size());
+	m_DirtyInstances.resize(keptCount);
+
+	// Same frustum test as the cull shader, depth of the box center along the view direction
+	m_BlendedDraws.clear();
+	uint32_t blendedCulledCount = 0;
+	for (uint32_t instance = m_OpaqueInstanceCount; instance < m_Instances.size(); instance++)
+	{
+		const GpuInstanceData& data = m_Instances[instance];
+		if (data.isVisible == 0)
+		{
+			continue;
+		}
+		BoundingBox localBounds;
+		localBounds.min = glm::vec3(data.localBoundsMin);
+		localBounds.max = glm::vec3(data.localBoundsMax);
+		BoundingBox worldBounds = TransformBoundingBox(localBounds, data.modelMtx);
+		glm::vec3 center = (worldBounds.min + worldBounds.max) * 0.5f;
+		glm::vec3 extent = (worldBounds.max - worldBounds.min) * 0.5f;
+		bool isInsideFrustum = true;
+		for (int plane = 0; plane < 6 && isInsideFrustum; plane++)
+		{
+			glm::vec3 normal = glm::vec3(frameData.frustumPlanes[plane]);
+			isInsideFrustum = glm::dot(normal, center) + glm::dot(glm::abs(normal), extent) + frameData.frustumPlanes[plane].w >= 0.0f;
+		}
+		if (!isInsideFrustum)
+		{
+			blendedCulledCount++;
+			continue;
+		}
+		BlendedDraw draw;
+		draw.depth = -(camera.viewMtx * glm::vec4(center, 1.0f)).z;
+		draw.instance = instance;
+		m_BlendedDraws.push_back(draw);
+	}
+	std::sort(m_BlendedDraws.begin(), m_BlendedDraws.end(), [](const BlendedDraw& a, const BlendedDraw& b)
+	{
+		return a.depth > b.depth;
+	});
+	m_Stats.blendedDrawnCount = static_cast<uint32_t>(m_BlendedDraws.size());
+	m_Stats.drawnCount += m_Stats.blendedDrawnCount;
+	m_Stats.frustumCulledCount += blendedCulledCount;
+}
+
+void GpuScene::GetDynamicOffsets(uint32_t frameIndex, uint32_t* pOffsets)
+{
+	pOffsets[0] = static_cast<uint32_t>(frameIndex * m_SceneRegionSize);
+	pOffsets[1] = static_cast<uint32_t>(frameIndex * m_DrawCommandRegionSize);
+	pOffsets[2] = static_cast<uint32_t>(frameIndex * m_DrawCountRegionSize);
+}
+
+void GpuScene::RecordCull(VkCommandBuffer commandBuffer, uint32_t frameIndex, GpuCullPhase phase)
+{
+	VkPipeline pipeline = m_CullPipeline;
+	if (phase == GPU_CULL_PHASE_EARLY)
+	{
+		// Counts and counters of both phases start at zero
+		VkDeviceSize countOffset = frameIndex * m_DrawCountRegionSize;
+		VkDeviceSize countSize = (2 * m_OpaqueBucketCount + 2) * sizeof(uint32_t);
+		vkCmdFillBuffer(commandBuffer, m_DrawCountBuffer, countOffset, countSize, 0);
+
+		VkBufferMemoryBarrier clearBarrier = {};
+		clearBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		clearBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		clearBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		clearBarrier.buffer = m_DrawCountBuffer;
+		clearBarrier.offset = countOffset;
+		clearBarrier.size = countSize;
+
+		// The previous frame's late phase wrote the visibility flags
+		VkMemoryBarrier visibilityBarrier = {};
+		visibilityBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		visibilityBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		visibilityBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 1, &visibilityBarrier, 1, &clearBarrier, 0, nullptr);
+	}
+	else
+	{
+		m_HiZBuffer.RecordBuild(commandBuffer);
+		pipeline = m_LateCullPipeline;
+	}
+
+	uint32_t dynamicOffsets[3];
+	GetDynamicOffsets(frameIndex, dynamicOffsets);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_CullPipelineLayout, 0, 1, &m_DescriptorSet, 3, dynamicOffsets);
+	vkCmdDispatch(commandBuffer, (m_OpaqueInstanceCount + CullGroupSize - 1) / CullGroupSize, 1, 1);
+
+	// Commands and counts feed the indirect draws, the counts are read back by Update once the frame completed
+	VkMemoryBarrier cullBarrier = {};
+	cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &cullBarrier, 0, nullptr, 0, nullptr);
+}
+
+void GpuScene::RecordDraw(VkCommandBuffer commandBuffer, uint32_t frameIndex, GpuCullPhase phase)
+{
+	uint32_t dynamicOffsets[3];
+	GetDynamicOffsets(frameIndex, dynamicOffsets);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineLayout, 1, 1, &m_DescriptorSet, 3, dynamicOffsets);
+
+	VkDeviceSize commandOffset = frameIndex * m_DrawCommandRegionSize;
+	VkDeviceSize countOffset = frameIndex * m_DrawCountRegionSize;
+	if (phase == GPU_CULL_PHASE_LATE)
+	{
+		commandOffset += m_OpaqueInstanceCount * sizeof(VkDrawIndexedIndirectCommand);
+		countOffset += m_OpaqueBucketCount * sizeof(uint32_t);
+	}
+	VkPipeline boundPipeline = VK_NULL_HANDLE;
+	VkBuffer boundVertexBuffer = VK_NULL_HANDLE;
+	VkBuffer boundIndexBuffer = VK_NULL_HANDLE;
+	VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+	for (size_t i = 0; i < m_OpaqueBucketCount; i++)
+	{
+		const Bucket& bucket = m_Buckets[i];
+		if (bucket.pipeline != boundPipeline)
+		{
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, bucket.pipeline);
+			boundPipeline = bucket.pipeline;
+		}
+		if (bucket.vertexBuffer != boundVertexBuffer)
+		{
+			VkDeviceSize vertexOffset = 0;
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &bucket.vertexBuffer, &vertexOffset);
+			boundVertexBuffer = bucket.vertexBuffer;
+		}
+		if (bucket.indexBuffer != boundIndexBuffer || bucket.indexType != boundIndexType)
+		{
+			vkCmdBindIndexBuffer(commandBuffer, bucket.indexBuffer, 0, bucket.indexType);
+			boundIndexBuffer = bucket.indexBuffer;
+			boundIndexType = bucket.indexType;
+		}
+
+		vkCmdDrawIndexedIndirectCount(commandBuffer,
+			m_DrawCommandBuffer, commandOffset + bucket.firstCommand * sizeof(VkDrawIndexedIndirectCommand),
+			m_DrawCountBuffer, countOffset + i * sizeof(uint32_t),
+			bucket.commandCount, sizeof(VkDrawIndexedIndirectCommand));
+	}
+}
+
+void GpuScene::RecordBlended(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+	if (m_BlendedDraws.empty())
+	{
+		return;
+	}
+
+	uint32_t dynamicOffsets[3];
+	GetDynamicOffsets(frameIndex, dynamicOffsets);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineLayout, 1, 1, &m_DescriptorSet, 3, dynamicOffsets);
+
+	VkPipeline boundPipeline = VK_NULL_HANDLE;
+	VkBuffer boundVertexBuffer = VK_NULL_HANDLE;
+	VkBuffer boundIndexBuffer = VK_NULL_HANDLE;
+	VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+	for (const BlendedDraw& draw : m_BlendedDraws)
+	{
+		const GpuInstanceData& data = m_Instances[draw.instance];
+		const Bucket& bucket = m_Buckets[data.bucket];
+		if (bucket.pipeline != boundPipeline)
+		{
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, bucket.pipeline);
+			boundPipeline = bucket.pipeline;
+		}
+		if (bucket.vertexBuffer != boundVertexBuffer)
+		{
+			VkDeviceSize vertexOffset = 0;
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &bucket.vertexBuffer, &vertexOffset);
+			boundVertexBuffer = bucket.vertexBuffer;
+		}
+		if (bucket.indexBuffer != boundIndexBuffer || bucket.indexType != boundIndexType)
+		{
+			vkCmdBindIndexBuffer(commandBuffer, bucket.indexBuffer, 0, bucket.indexType);
+			boundIndexBuffer = bucket.indexBuffer;
+			boundIndexType = bucket.indexType;
+		}
+
+		// Same command the cull shader would have written, the instance index reaches the shaders as gl_InstanceIndex
+		vkCmdDrawIndexed(commandBuffer, data.indexCount, 1, data.firstIndex, data.vertexOffset, draw.instance);
+	}
+}
+
+void GpuScene::PrintStats()
+{
+	printf("GpuScene : %u instances in %u buckets, %u textures + %u cube textures, %.1f MB vertices, %.1f MB indices\n",
+		m_Stats.instanceCount, m_Stats.bucketCount, m_Stats.textureCount, m_Stats.cubeTextureCount,
+		m_Stats.vertexBytes / (1024.0f * 1024.0f), m_Stats.indexBytes / (1024.0f * 1024.0f));
+}
+
+void GpuScene::PrintCullStats()
+{
+	printf("GpuScene : %u of %u instances drawn (%u late, %u blended), %u outside the frustum, %u occluded\n",
+		m_Stats.drawnCount, m_Stats.instanceCount, m_Stats.lateDrawnCount, m_Stats.blendedDrawnCount, m_Stats.frustumCulledCount, m_Stats.occlusionCulledCount);
+}
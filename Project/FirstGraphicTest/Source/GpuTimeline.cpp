@@ -0,0 +1,146 @@
+#include "GpuTimeline.h"
+
+GpuTimeline::GpuTimeline()
+{
+}
+
+GpuTimeline::~GpuTimeline()
+{
+}
+
+void GpuTimeline::Init(VkDevice device, VkQueue queue)
+{
+	m_Device = device;
+	m_Queue = queue;
+	m_SubmittedValue = 0;
+	m_CompletedValue = 0;
+
+	VkSemaphoreTypeCreateInfo typeInfo = {};
+	typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	typeInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = &typeInfo;
+
+	VkResult result = vkCreateSemaphore(m_Device, &semaphoreInfo, nullptr, &m_Semaphore);
+	if (result != VK_SUCCESS)
+	{
+		printf("### ERROR ### GpuTimeline : vkCreateSemaphore failed (%d)\n", result);
+	}
+}
+
+void GpuTimeline::Finalize()
+{
+	Wait(m_SubmittedValue);
+	vkDestroySemaphore(m_Device, m_Semaphore, nullptr);
+	m_Semaphore = VK_NULL_HANDLE;
+}
+
+void GpuTimeline::AddWait(VkSemaphore semaphore, uint64_t value, VkPipelineStageFlags stageMask)
+{
+	m_WaitSemaphores.push_back(semaphore);
+	m_WaitValues.push_back(value);
+	m_WaitStages.push_back(stageMask);
+}
+
+void GpuTimeline::AddSignal(VkSemaphore binarySemaphore)
+{
+	m_SignalSemaphores.push_back(binarySemaphore);
+	m_SignalValues.push_back(0);
+}
+
+uint64_t GpuTimeline::Submit(uint32_t commandBufferCount, const VkCommandBuffer* pCommandBuffers)
+{
+	uint64_t value = m_SubmittedValue + 1;
+	m_SignalSemaphores.push_back(m_Semaphore);
+	m_SignalValues.push_back(value);
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(m_WaitValues.size());
+	timelineInfo.pWaitSemaphoreValues = m_WaitValues.data();
+	timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(m_SignalValues.size());
+	timelineInfo.pSignalSemaphoreValues = m_SignalValues.data();
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.waitSemaphoreCount = static_cast<uint32_t>(m_WaitSemaphores.size());
+	submitInfo.pWaitSemaphores = m_WaitSemaphores.data();
+	submitInfo.pWaitDstStageMask = m_WaitStages.data();
+	submitInfo.commandBufferCount = commandBufferCount;
+	submitInfo.pCommandBuffers = pCommandBuffers;
+	submitInfo.signalSemaphoreCount = static_cast<uint32_t>(m_SignalSemaphores.size());
+	submitInfo.pSignalSemaphores = m_SignalSemaphores.data();
+
+	VkResult result = vkQueueSubmit(m_Queue, 1, &submitInfo, VK_NULL_HANDLE);
+	if (result != VK_SUCCESS)
+	{
+		// Nothing will ever signal value, hand back the last one that was submitted so waits on it still return
+		printf("### ERROR ### GpuTimeline : vkQueueSubmit failed (%d)\n", result);
+		value = m_SubmittedValue;
+	}
+	else
+	{
+		m_SubmittedValue = value;
+	}
+
+	m_WaitSemaphores.clear();
+	m_WaitValues.clear();
+	m_WaitStages.clear();
+	m_SignalSemaphores.clear();
+	m_SignalValues.clear();
+	return value;
+}
+
+void GpuTimeline::EndSingleTimeCommands(VkCommandBuffer commandBuffer, VkCommandPool commandPool)
+{
+	vkEndCommandBuffer(commandBuffer);
+	Wait(Submit(1, &commandBuffer));
+	vkFreeCommandBuffers(m_Device, commandPool, 1, &commandBuffer);
+}
+
+void GpuTimeline::Wait(uint64_t value)
+{
+	if (value <= m_CompletedValue)
+	{
+		return;
+	}
+	if (value > m_SubmittedValue)
+	{
+		// Would block forever
+		printf("### ERROR ### GpuTimeline : waiting on %llu, only %llu was submitted\n",
+			static_cast<unsigned long long>(value), static_cast<unsigned long long>(m_SubmittedValue));
+		value = m_SubmittedValue;
+		if (value <= m_CompletedValue)
+		{
+			return;
+		}
+	}
+
+	VkSemaphoreWaitInfo waitInfo = {};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &m_Semaphore;
+	waitInfo.pValues = &value;
+	vkWaitSemaphores(m_Device, &waitInfo, UINT64_MAX);
+	GetCompletedValue();
+}
+
+bool GpuTimeline::IsComplete(uint64_t value)
+{
+	return value <= m_CompletedValue || value <= GetCompletedValue();
+}
+
+uint64_t GpuTimeline::GetCompletedValue()
+{
+	uint64_t value = 0;
+	vkGetSemaphoreCounterValue(m_Device, m_Semaphore, &value);
+	if (value > m_CompletedValue)
+	{
+		m_CompletedValue = value;
+	}
+	return m_CompletedValue;
+}
@@ -5,6 +5,10 @@ namespace
 	const int WIDTH = 1920;
 	const int HEIGHT = 1080;
 
+	// Offscreen targets used in place of the swapchain when running without a window
+	const uint32_t HeadlessImageCount = 3;
+	const VkFormat HeadlessColorFormat = VK_FORMAT_R8G8B8A8_SRGB;
+
 #ifdef NDEBUG
 	static const bool EnableValidationLayers = false;
 #else
@@ -16,10 +20,13 @@ namespace
 	};
 
 	static const std::vector<const char*> DeviceExtensions = {
-	   "VK_KHR_swapchain",
 	   "VK_EXT_index_type_uint8"
 	};
 
+	static const std::vector<const char*> SwapChainDeviceExtensions = {
+	   "VK_KHR_swapchain"
+	};
+
 	bool CheckValidationLayerSupport(const std::vector<const char*>& validationLayers)
 	{
 
@@ -48,7 +55,7 @@ namespace
 		return true;
 	}
 
-	bool CheckDeviceExtensionSupport(VkPhysicalDevice physicalDevice)
+	bool CheckDeviceExtensionSupport(VkPhysicalDevice physicalDevice, const std::vector<const char*>& deviceExtensions)
 	{
 		uint32_t extensionCount = 0;
 		vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
@@ -56,7 +63,7 @@ namespace
 		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
 		vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
 
-		std::set<std::string> requiredExtensions(DeviceExtensions.begin(), DeviceExtensions.end());
+		std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
 
 		for (const VkExtensionProperties& ext : availableExtensions)
 		{
@@ -70,6 +77,7 @@ namespace
 	{
 		std::optional<uint32_t> graphicsFamily;
 		std::optional<uint32_t> presentFamily;
+		std::optional<uint32_t> transferFamily;
 
 		bool hasValue()
 		{
@@ -90,29 +98,48 @@ namespace
 		int i = 0;
 		for (const VkQueueFamilyProperties& prop : queueFamilies)
 		{
-			if (prop.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+			if ((prop.queueFlags & VK_QUEUE_GRAPHICS_BIT) && !indices.graphicsFamily.has_value())
 			{
 				indices.graphicsFamily = i;
 			}
 
+			// A family without graphics is the DMA engine on discrete cards, prefer the one without compute as well
+			if ((prop.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(prop.queueFlags & VK_QUEUE_GRAPHICS_BIT))
+			{
+				if (!indices.transferFamily.has_value() || !(prop.queueFlags & VK_QUEUE_COMPUTE_BIT))
+				{
+					indices.transferFamily = i;
+				}
+			}
+
+			if (surface == VK_NULL_HANDLE)
+			{
+				// Headless: nothing is presented, the graphics queue stands in for the present queue
+				if (indices.graphicsFamily.has_value())
+				{
+					indices.presentFamily = indices.graphicsFamily;
+				}
+			}
+			else
 			{
 				VkBool32 presentSupport = false;
 
 				vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentSupport);
 
-				if (presentSupport)
+				if (presentSupport && !indices.presentFamily.has_value())
 				{
 					indices.presentFamily = i;
 				}
 			}
 
-			if (indices.hasValue())
-			{
-				break;
-			}
-
 			i++;
 		}
+
+		// Graphics queues can always transfer, uploads then simply share the graphics queue
+		if (!indices.transferFamily.has_value())
+		{
+			indices.transferFamily = indices.graphicsFamily;
+		}
 		return indices;
 	}
 
@@ -199,11 +226,23 @@ namespace
 		VkFormat* swapChainFormat,
 		VkExtent2D* m_SwapChainExtent,
 		VkSurfaceKHR* pVkSurface,
+		uint32_t* pGraphicsFamilyIndex,
+		uint32_t* pTransferFamilyIndex,
+		bool* pIsGpuDrivenSupported,
 		GLFWwindow* pWindow)
 	{
 		VkResult result = VK_SUCCESS;
 
-		auto CreateVkInstance = [](VkInstance* pVkInstance)
+		// pWindow == nullptr selects the headless path: no surface, no swapchain, no WSI extensions
+		const bool isHeadless = pWindow == nullptr;
+
+		std::vector<const char*> deviceExtensions = DeviceExtensions;
+		if (!isHeadless)
+		{
+			deviceExtensions.insert(deviceExtensions.end(), SwapChainDeviceExtensions.begin(), SwapChainDeviceExtensions.end());
+		}
+
+		auto CreateVkInstance = [isHeadless](VkInstance* pVkInstance)
 		{
 			VkApplicationInfo appInfo = {};
 			appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
@@ -218,8 +257,11 @@ namespace
 			createInfo.pApplicationInfo = &appInfo;
 
 			uint32_t glfwExtensionCount = 0;
-			const char** glfwExtensions;
-			glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+			const char** glfwExtensions = nullptr;
+			if (!isHeadless)
+			{
+				glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+			}
 
 			createInfo.enabledExtensionCount = glfwExtensionCount;
 			createInfo.ppEnabledExtensionNames = glfwExtensions;
@@ -240,8 +282,14 @@ namespace
 		};
 		result = CreateVkInstance(pVkInstance);
 
+		if (result != VK_SUCCESS)
+		{
+			return false;
+		}
 
+		if (!isHeadless)
 		{
+#ifdef _WIN32
 			VkWin32SurfaceCreateInfoKHR surfaceCreateinfo = {};
 			surfaceCreateinfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
 			surfaceCreateinfo.hwnd = glfwGetWin32Window(pWindow);
@@ -253,6 +301,7 @@ namespace
 			{
 				return false;
 			}
+#endif
 
 			result = glfwCreateWindowSurface(*pVkInstance, pWindow, nullptr, pVkSurface);
 
@@ -291,37 +340,73 @@ namespace
 
 		std::vector<VkPhysicalDevice> physicalDevices(deviceCount);
 		vkEnumeratePhysicalDevices(*pVkInstance, &deviceCount, physicalDevices.data());
-		*pVkPhysicalDevice = physicalDevices.data()[0];
-		const VkPhysicalDevice physicalDevice = *pVkPhysicalDevice;
 
-		VkPhysicalDeviceProperties physicalDeviceProperties;
-		vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
+		const VkSurfaceKHR surface = *pVkSurface;
+		QueueFamilyIndices indices;
+		SwapChainSupportDetails swapChainSupportDetails;
 
-		VkPhysicalDeviceFeatures physicalDeviceFeatures;
-		vkGetPhysicalDeviceFeatures(physicalDevice, &physicalDeviceFeatures);
+		// Take the first device that can run us; a headless machine may only expose a software ICD such as lavapipe
+		*pVkPhysicalDevice = VK_NULL_HANDLE;
+		for (VkPhysicalDevice candidate : physicalDevices)
+		{
+			VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+			vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+			VkPhysicalDeviceFeatures2 physicalDeviceFeatures2 = {};
+			physicalDeviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			physicalDeviceFeatures2.pNext = &vulkan12Features;
+			vkGetPhysicalDeviceFeatures2(candidate, &physicalDeviceFeatures2);
+			const VkPhysicalDeviceFeatures& physicalDeviceFeatures = physicalDeviceFeatures2.features;
 
-		const VkSurfaceKHR surface = *pVkSurface;
-		QueueFamilyIndices indices = FindQueueFamilies(physicalDevice, surface);
+			indices = FindQueueFamilies(candidate, surface);
 
-		bool isDeviceExtensionSupport = CheckDeviceExtensionSupport(physicalDevice);
-		bool swapChainAdequate = false;
+			bool isDeviceExtensionSupport = CheckDeviceExtensionSupport(candidate, deviceExtensions);
+			bool swapChainAdequate = isHeadless;
 
-		SwapChainSupportDetails swapChainSupportDetails = QuerySwapChainSupport(physicalDevice, surface);
+			if (!isHeadless && isDeviceExtensionSupport)
+			{
+				swapChainSupportDetails = QuerySwapChainSupport(candidate, surface);
+				swapChainAdequate = !swapChainSupportDetails.formats.empty() && !swapChainSupportDetails.presentModes.empty();
+			}
 
-		if (isDeviceExtensionSupport)
-		{
-			swapChainAdequate = !swapChainSupportDetails.formats.empty() && !swapChainSupportDetails.presentModes.empty();
+			if (indices.hasValue() && isDeviceExtensionSupport && swapChainAdequate && physicalDeviceFeatures.samplerAnisotropy && vulkan12Features.timelineSemaphore)
+			{
+				*pVkPhysicalDevice = candidate;
+				break;
+			}
 		}
 
-		if (!indices.hasValue() || !CheckDeviceExtensionSupport(physicalDevice) || !swapChainAdequate || !physicalDeviceFeatures.samplerAnisotropy)
+		if (*pVkPhysicalDevice == VK_NULL_HANDLE)
 		{
 			return false;
 		}
 
+		VkPhysicalDeviceProperties physicalDeviceProperties;
+		vkGetPhysicalDeviceProperties(*pVkPhysicalDevice, &physicalDeviceProperties);
+		std::cout << "physical device: " << physicalDeviceProperties.deviceName << std::endl;
+
+		// Optional, the GPU-driven path (GpuScene) is only offered when all of these are present
+		VkPhysicalDeviceVulkan12Features supportedVulkan12Features = {};
+		supportedVulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		VkPhysicalDeviceFeatures2 supportedFeatures2 = {};
+		supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supportedFeatures2.pNext = &supportedVulkan12Features;
+		vkGetPhysicalDeviceFeatures2(*pVkPhysicalDevice, &supportedFeatures2);
+		*pIsGpuDrivenSupported =
+			supportedFeatures2.features.multiDrawIndirect &&
+			supportedFeatures2.features.drawIndirectFirstInstance &&
+			supportedVulkan12Features.drawIndirectCount &&
+			supportedVulkan12Features.runtimeDescriptorArray &&
+			supportedVulkan12Features.shaderSampledImageArrayNonUniformIndexing;
+		std::cout << "gpu-driven rendering: " << (*pIsGpuDrivenSupported ? "supported" : "not supported") << std::endl;
+
+		*pGraphicsFamilyIndex = indices.graphicsFamily.value();
+		*pTransferFamilyIndex = indices.transferFamily.value();
+		std::cout << "graphics queue family: " << *pGraphicsFamilyIndex << " transfer queue family: " << *pTransferFamilyIndex << std::endl;
+
 
 		{
 			std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-			std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+			std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value(), indices.transferFamily.value() };
 
 			float queuePriority = 1.0f;
 
@@ -338,15 +423,30 @@ namespace
 
 			VkPhysicalDeviceFeatures physicalDeviceFeature = {};
 
+			// Every queue submission is tracked on a timeline semaphore, see GpuTimeline
+			VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+			vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+			vulkan12Features.timelineSemaphore = VK_TRUE;
+
+			if (*pIsGpuDrivenSupported)
+			{
+				physicalDeviceFeature.multiDrawIndirect = VK_TRUE;
+				physicalDeviceFeature.drawIndirectFirstInstance = VK_TRUE;
+				vulkan12Features.drawIndirectCount = VK_TRUE;
+				vulkan12Features.runtimeDescriptorArray = VK_TRUE;
+				vulkan12Features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+			}
+
 			VkDeviceCreateInfo deviceCreateInfo = {};
 			deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+			deviceCreateInfo.pNext = &vulkan12Features;
 
 			deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
 			deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 			deviceCreateInfo.pEnabledFeatures = &physicalDeviceFeature;
 
-			deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(DeviceExtensions.size());
-			deviceCreateInfo.ppEnabledExtensionNames = DeviceExtensions.data();
+			deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+			deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
 			if (EnableValidationLayers)
 			{
@@ -369,13 +469,17 @@ namespace
 		{
 			VkQueue graphicsQueue;
 			VkQueue presentQueue;
+			VkQueue transferQueue;
 			vkGetDeviceQueue(*pVkDevice, indices.graphicsFamily.value(), 0, &graphicsQueue);
 			vkGetDeviceQueue(*pVkDevice, indices.presentFamily.value(), 0, &presentQueue);
+			vkGetDeviceQueue(*pVkDevice, indices.transferFamily.value(), 0, &transferQueue);
 			m_Queues.push_back(graphicsQueue);
 			m_Queues.push_back(presentQueue);
+			m_Queues.push_back(transferQueue);
 		}
 
 		// CreateSwapChain
+		if (!isHeadless)
 		{
 			VkSurfaceFormatKHR surfaceFormat = ChooseSwapSurfaceFormat(swapChainSupportDetails.formats);
 			VkPresentModeKHR presentMode = ChooseSwapPresentMode(swapChainSupportDetails.presentModes);
@@ -429,26 +533,29 @@ namespace
 		return true;
 	}
 
-	bool CreateRenderPass(VkRenderPass* pRenderPass, VkDevice device, VkFormat colorFormat, VkFormat depthFormat)
+	// isColorLoad / isDepthLoad continue a frame begun by an earlier pass: the attachment is loaded in the layout that pass left it in.
+	// All variants are compatible, framebuffers and pipelines are shared
+	bool CreateRenderPass(VkRenderPass* pRenderPass, VkDevice device, VkFormat colorFormat, VkFormat depthFormat, VkImageLayout colorFinalLayout, bool isColorLoad, bool isDepthLoad)
 	{
 		VkAttachmentDescription colorAttachment = {};
 		colorAttachment.format = colorFormat;
 		colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		colorAttachment.loadOp = isColorLoad ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
 		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 		colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		colorAttachment.initialLayout = isColorLoad ? colorFinalLayout : VK_IMAGE_LAYOUT_UNDEFINED;
+		colorAttachment.finalLayout = colorFinalLayout;
 
+		// Stored, the Hi-Z pyramid is built from it between the two passes
 		VkAttachmentDescription depthAttachment = {};
 		depthAttachment.format = depthFormat;
 		depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.loadOp = isDepthLoad ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 		depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		depthAttachment.initialLayout = isDepthLoad ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
 		depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
 		VkAttachmentReference colorAttachmentRef = {};
@@ -477,10 +584,11 @@ namespace
 		VkSubpassDependency dependency = {};
 		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
 		dependency.dstSubpass = 0;
-		dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependency.srcAccessMask = 0;
-		dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		// The depth image is shared by all frames in flight, the previous frame's depth writes have to finish first
+		dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+		dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
 		renderPassCreateInfo.dependencyCount = 1;
 		renderPassCreateInfo.pDependencies = &dependency;
@@ -494,6 +602,82 @@ namespace
 		return true;
 	}
 
+	// One subpass writing every GBufferAttachment and depth. The G-buffer is only sampled afterwards, by the tiled lighting compute pass,
+	// depth stays in the attachment layout and is handed over by an explicit barrier like for the Hi-Z build
+	bool CreateGBufferRenderPass(VkRenderPass* pRenderPass, VkDevice device, VkFormat depthFormat)
+	{
+		std::vector<VkAttachmentDescription> attachments(GBUFFER_ATTACHMENT_COUNT + 1);
+		std::vector<VkAttachmentReference> colorAttachmentRefs(GBUFFER_ATTACHMENT_COUNT);
+		for (uint32_t i = 0; i < GBUFFER_ATTACHMENT_COUNT; i++)
+		{
+			attachments[i] = {};
+			attachments[i].format = GBufferFormats[i];
+			attachments[i].samples = VK_SAMPLE_COUNT_1_BIT;
+			attachments[i].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+			attachments[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			attachments[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			attachments[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachments[i].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			attachments[i].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+			colorAttachmentRefs[i].attachment = i;
+			colorAttachmentRefs[i].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		}
+
+		VkAttachmentDescription& depthAttachment = attachments[GBUFFER_ATTACHMENT_COUNT];
+		depthAttachment = {};
+		depthAttachment.format = depthFormat;
+		depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkAttachmentReference depthAttachmentRef = {};
+		depthAttachmentRef.attachment = GBUFFER_ATTACHMENT_COUNT;
+		depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkSubpassDescription subpass = {};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = static_cast<uint32_t>(colorAttachmentRefs.size());
+		subpass.pColorAttachments = colorAttachmentRefs.data();
+		subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+		VkSubpassDependency dependencies[2] = {};
+		// The G-buffer and depth are shared by all frames in flight, the previous frame's lighting reads and depth tests have to finish first
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = 0;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[1].srcSubpass = 0;
+		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		VkRenderPassCreateInfo renderPassCreateInfo = {};
+		renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		renderPassCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		renderPassCreateInfo.pAttachments = attachments.data();
+		renderPassCreateInfo.subpassCount = 1;
+		renderPassCreateInfo.pSubpasses = &subpass;
+		renderPassCreateInfo.dependencyCount = 2;
+		renderPassCreateInfo.pDependencies = dependencies;
+
+		VkResult result = vkCreateRenderPass(device, &renderPassCreateInfo, nullptr, pRenderPass);
+		if (result != VK_SUCCESS)
+		{
+			return false;
+		}
+
+		return true;
+	}
+
 
 }
 
@@ -507,26 +691,61 @@ GraphicSystem::~GraphicSystem()
 }
 void GraphicSystem::Finalize()
 {
+	// Pending entries may still free command buffers of the pools below
+	m_DeletionQueue.Finalize();
 	vkDestroyRenderPass(m_Device, m_RenderPass, nullptr);
+	vkDestroyRenderPass(m_Device, m_LoadRenderPass, nullptr);
+	vkDestroyRenderPass(m_Device, m_CompositeRenderPass, nullptr);
+	vkDestroyRenderPass(m_Device, m_GBufferRenderPass, nullptr);
 	vkDestroyCommandPool(m_Device, m_CommandPool, nullptr);
+	vkDestroyCommandPool(m_Device, m_TransferCommandPool, nullptr);
 	vkDestroyImageView(m_Device, m_DepthImageView, nullptr);
 	vkDestroyImage(m_Device, m_DepthImage, nullptr);
-	vkFreeMemory(m_Device, m_DepthImageMemory, nullptr);
+	m_MemoryAllocator.Free(&m_DepthImageMemory);
 
 	for (VkImageView swapChainView : m_SwapChainImageViews)
 	{
 		vkDestroyImageView(m_Device, swapChainView, nullptr);
 	}
 
-	vkDestroySwapchainKHR(m_Device, m_SwapChain, nullptr);
+	if (m_IsHeadless)
+	{
+		for (uint32_t i = 0; i < m_SwapChainCount; i++)
+		{
+			vkDestroyImage(m_Device, m_SwapChainImages[i], nullptr);
+			m_MemoryAllocator.Free(&m_OffscreenImageMemories[i]);
+		}
+	}
+	else
+	{
+		vkDestroySwapchainKHR(m_Device, m_SwapChain, nullptr);
+	}
+	m_GeometryPool.Finalize();
+	m_UniformArena.Finalize();
+	m_PipelineLibrary.Finalize();
+	m_ShaderModuleCache.Finalize();
+	m_PipelineCache.Finalize();
+	m_StagingRing.Finalize();
+	m_TransferTimeline.Finalize();
+	m_GraphicsTimeline.Finalize();
+	m_MemoryAllocator.Finalize();
 	vkDestroyDevice(m_Device, nullptr);
 }
 
-void GraphicSystem::InitGraphicsSystem(GLFWwindow* pWindow)
+void GraphicSystem::InitGraphicsSystem(GLFWwindow* pWindow, const GraphicSystemConfig& config)
 {
 	glfwGetFramebufferSize(pWindow, &m_ScreenWidth, &m_ScreenHeight);
 
-	InitVulkan(&m_Instance, &m_PhysicalDevice, &m_Device, m_Queues, &m_SwapChain, &m_SwapChainFormat, &m_SwapChainExtent, &m_Surface, pWindow);
+	InitVulkan(&m_Instance, &m_PhysicalDevice, &m_Device, m_Queues, &m_SwapChain, &m_SwapChainFormat, &m_SwapChainExtent, &m_Surface, &m_GraphicsQueueFamilyIndex, &m_TransferQueueFamilyIndex, &m_IsGpuDrivenSupported, pWindow);
+	m_MemoryAllocator.Init(m_Device, m_PhysicalDevice);
+	m_GraphicsTimeline.Init(m_Device, m_Queues[0]);
+	m_TransferTimeline.Init(m_Device, m_Queues[2]);
+	m_DeletionQueue.Init(m_Device, &m_MemoryAllocator, &m_GraphicsTimeline);
+	m_GeometryPool.Init(m_Device, &m_MemoryAllocator, &m_DeletionQueue, config.geometryBlockSize);
+	m_StagingRing.Init(m_Device, &m_MemoryAllocator, &m_TransferTimeline, config.stagingRingSize);
+	m_PipelineCache.Init(m_Device, m_PhysicalDevice, config.pipelineCachePath);
+	m_PipelineLibrary.Init(m_Device, &m_PipelineCache);
+	m_ShaderModuleCache.Init(m_Device);
 
 	// SwapChain
 	vkGetSwapchainImagesKHR(m_Device, m_SwapChain, &m_SwapChainCount, nullptr);
@@ -538,12 +757,72 @@ void GraphicSystem::InitGraphicsSystem(GLFWwindow* pWindow)
 		CreateImageView(&m_SwapChainImageViews[i], m_SwapChainImages[i], VK_IMAGE_VIEW_TYPE_2D, m_Device, 1, 1, m_SwapChainFormat, VK_IMAGE_ASPECT_COLOR_BIT);
 	}
 
+	InitRenderTargets(VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+	m_FramesInFlight = std::max(1u, config.framesInFlight);
+	m_UniformArena.Init(m_Device, m_PhysicalDevice, &m_MemoryAllocator, m_FramesInFlight, config.uniformArenaFrameSize);
+}
+
+void GraphicSystem::InitHeadlessGraphicsSystem(int width, int height, const GraphicSystemConfig& config)
+{
+	m_IsHeadless = true;
+	m_ScreenWidth = width;
+	m_ScreenHeight = height;
+
+	if (!InitVulkan(&m_Instance, &m_PhysicalDevice, &m_Device, m_Queues, &m_SwapChain, &m_SwapChainFormat, &m_SwapChainExtent, &m_Surface, &m_GraphicsQueueFamilyIndex, &m_TransferQueueFamilyIndex, &m_IsGpuDrivenSupported, nullptr))
+	{
+		throw std::runtime_error("No Vulkan device usable for headless rendering");
+	}
+	m_MemoryAllocator.Init(m_Device, m_PhysicalDevice);
+	m_GraphicsTimeline.Init(m_Device, m_Queues[0]);
+	m_TransferTimeline.Init(m_Device, m_Queues[2]);
+	m_DeletionQueue.Init(m_Device, &m_MemoryAllocator, &m_GraphicsTimeline);
+	m_GeometryPool.Init(m_Device, &m_MemoryAllocator, &m_DeletionQueue, config.geometryBlockSize);
+	m_StagingRing.Init(m_Device, &m_MemoryAllocator, &m_TransferTimeline, config.stagingRingSize);
+	m_PipelineCache.Init(m_Device, m_PhysicalDevice, config.pipelineCachePath);
+	m_PipelineLibrary.Init(m_Device, &m_PipelineCache);
+	m_ShaderModuleCache.Init(m_Device);
+
+	m_SwapChainFormat = HeadlessColorFormat;
+	m_SwapChainExtent.width = static_cast<uint32_t>(width);
+	m_SwapChainExtent.height = static_cast<uint32_t>(height);
+
+	// Offscreen color images take the place of the swapchain images, same count/format/extent contract
+	m_SwapChainCount = HeadlessImageCount;
+	m_SwapChainImages.resize(m_SwapChainCount);
+	m_SwapChainImageViews.resize(m_SwapChainCount);
+	m_OffscreenImageMemories.resize(m_SwapChainCount);
+	for (uint32_t i = 0; i < m_SwapChainCount; i++)
+	{
+		CreateImage(
+			&m_SwapChainImages[i],
+			&m_OffscreenImageMemories[i],
+			m_Device,
+			&m_MemoryAllocator,
+			m_SwapChainExtent.width,
+			m_SwapChainExtent.height,
+			1,
+			1,
+			VK_IMAGE_TYPE_2D,
+			m_SwapChainFormat,
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		CreateImageView(&m_SwapChainImageViews[i], m_SwapChainImages[i], VK_IMAGE_VIEW_TYPE_2D, m_Device, 1, 1, m_SwapChainFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+	}
+
+	InitRenderTargets(VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+	m_FramesInFlight = std::max(1u, config.framesInFlight);
+	m_UniformArena.Init(m_Device, m_PhysicalDevice, &m_MemoryAllocator, m_FramesInFlight, config.uniformArenaFrameSize);
+}
+
+void GraphicSystem::InitRenderTargets(VkImageLayout colorFinalLayout)
+{
 	//Depth
 	CreateImage(
 		&m_DepthImage, 
 		&m_DepthImageMemory, 
 		m_Device, 
-		m_PhysicalDevice, 
+		&m_MemoryAllocator, 
 		m_SwapChainExtent.width, 
 		m_SwapChainExtent.height,
 		1,
@@ -551,11 +830,14 @@ void GraphicSystem::InitGraphicsSystem(GLFWwindow* pWindow)
 		VK_IMAGE_TYPE_2D,
 		VK_FORMAT_D32_SFLOAT, 
 		VK_IMAGE_TILING_OPTIMAL, 
-		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 	CreateImageView(&m_DepthImageView, m_DepthImage, VK_IMAGE_VIEW_TYPE_2D, m_Device, 1, 1, VK_FORMAT_D32_SFLOAT, VK_IMAGE_ASPECT_DEPTH_BIT);
 
-	CreateRenderPass(&m_RenderPass, m_Device, m_SwapChainFormat, VK_FORMAT_D32_SFLOAT);
+	CreateRenderPass(&m_RenderPass, m_Device, m_SwapChainFormat, VK_FORMAT_D32_SFLOAT, colorFinalLayout, false, false);
+	CreateRenderPass(&m_LoadRenderPass, m_Device, m_SwapChainFormat, VK_FORMAT_D32_SFLOAT, colorFinalLayout, true, true);
+	CreateRenderPass(&m_CompositeRenderPass, m_Device, m_SwapChainFormat, VK_FORMAT_D32_SFLOAT, colorFinalLayout, false, true);
+	CreateGBufferRenderPass(&m_GBufferRenderPass, m_Device, VK_FORMAT_D32_SFLOAT);
 
 	m_SwapChainFrameBuffers.resize(m_SwapChainImageViews.size());
 	for (size_t i = 0; i < m_SwapChainImageViews.size(); i++)
@@ -571,12 +853,14 @@ void GraphicSystem::InitGraphicsSystem(GLFWwindow* pWindow)
 		createInfo.layers = 1;
 		vkCreateFramebuffer(m_Device, &createInfo, nullptr, &m_SwapChainFrameBuffers[i]);
 	}
-	QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(m_PhysicalDevice, m_Surface);
 	VkCommandPoolCreateInfo cmdPoolCreateInfo = {};
 	cmdPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	cmdPoolCreateInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+	cmdPoolCreateInfo.queueFamilyIndex = m_GraphicsQueueFamilyIndex;
 	cmdPoolCreateInfo.flags = 0;
 
 
 	vkCreateCommandPool(m_Device, &cmdPoolCreateInfo, nullptr, &m_CommandPool);
-}
+
+	cmdPoolCreateInfo.queueFamilyIndex = m_TransferQueueFamilyIndex;
+	vkCreateCommandPool(m_Device, &cmdPoolCreateInfo, nullptr, &m_TransferCommandPool);
+}
\ No newline at end of file
@@ -0,0 +1,265 @@
+#include "HiZBuffer.h"
+
+namespace
+{
+	// local_size of Shader/hiz.comp
+	const uint32_t BuildGroupSize = 8;
+
+	bool CreateLevelView(VkImageView* pImageView, VkImage image, uint32_t baseLevel, uint32_t levelCount, VkDevice device)
+	{
+		VkImageViewCreateInfo viewInfo = {};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = VK_FORMAT_R32_SFLOAT;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		viewInfo.subresourceRange.baseMipLevel = baseLevel;
+		viewInfo.subresourceRange.levelCount = levelCount;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		return vkCreateImageView(device, &viewInfo, nullptr, pImageView) == VK_SUCCESS;
+	}
+
+	uint32_t GetLevelSize(uint32_t size, uint32_t level)
+	{
+		for (uint32_t i = 0; i < level; i++)
+		{
+			size = (size + 1) / 2;
+		}
+		return size;
+	}
+}
+
+HiZBuffer::HiZBuffer()
+{
+}
+
+HiZBuffer::~HiZBuffer()
+{
+}
+
+bool HiZBuffer::Init(GraphicSystem* pGraphicSystem)
+{
+	m_pGraphicSystem = pGraphicSystem;
+	m_Device = pGraphicSystem->GetDevice();
+
+	m_ShaderModule = pGraphicSystem->GetShaderModuleCache()->Acquire("Shader/hiz_cs.spv");
+	if (m_ShaderModule == VK_NULL_HANDLE)
+	{
+		printf("### ERROR ### HiZBuffer : Shader/hiz_cs.spv is missing, run Shader/compile.bat\n");
+		return false;
+	}
+
+	VkExtent2D depthExtent = pGraphicSystem->GetSwapChainExtent();
+	m_Extent.width = (depthExtent.width + 1) / 2;
+	m_Extent.height = (depthExtent.height + 1) / 2;
+	m_LevelCount = 1;
+	while (GetLevelSize(m_Extent.width, m_LevelCount - 1) > 1 || GetLevelSize(m_Extent.height, m_LevelCount - 1) > 1)
+	{
+		m_LevelCount++;
+	}
+
+	CreateImage(
+		&m_Image,
+		&m_ImageMemory,
+		m_Device,
+		pGraphicSystem->GetMemoryAllocator(),
+		m_Extent.width,
+		m_Extent.height,
+		1,
+		m_LevelCount,
+		VK_IMAGE_TYPE_2D,
+		VK_FORMAT_R32_SFLOAT,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	CreateLevelView(&m_ImageView, m_Image, 0, m_LevelCount, m_Device);
+	m_LevelViews.resize(m_LevelCount);
+	for (uint32_t level = 0; level < m_LevelCount; level++)
+	{
+		CreateLevelView(&m_LevelViews[level], m_Image, level, 1, m_Device);
+	}
+
+	// Only texelFetch reads through it
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.maxAnisotropy = 1;
+	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+	samplerInfo.minLod = 0;
+	samplerInfo.maxLod = static_cast<float>(m_LevelCount);
+	vkCreateSampler(m_Device, &samplerInfo, nullptr, &m_Sampler);
+
+	std::vector<VkDescriptorSetLayoutBinding> bindings(2);
+	CreateDescriptorSetLayoutBinding(&bindings[0], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, m_Device);
+	CreateDescriptorSetLayoutBinding(&bindings[1], 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, m_Device);
+	PipelineLibrary* pPipelineLibrary = pGraphicSystem->GetPipelineLibrary();
+	m_DescriptorSetLayout = pPipelineLibrary->GetDescriptorSetLayout(bindings);
+
+	VkDescriptorPoolSize samplerPoolSize = {};
+	VkDescriptorPoolSize storagePoolSize = {};
+	CreateDescriptorPoolSize(&samplerPoolSize, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, m_LevelCount);
+	CreateDescriptorPoolSize(&storagePoolSize, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, m_LevelCount);
+	std::vector<VkDescriptorPoolSize> poolSizes = { samplerPoolSize, storagePoolSize };
+	CreateDescriptorPool(&m_DescriptorPool, m_Device, poolSizes, m_LevelCount);
+
+	std::vector<VkDescriptorSetLayout> layouts(m_LevelCount, m_DescriptorSetLayout);
+	m_DescriptorSets.resize(m_LevelCount);
+	VkDescriptorSetAllocateInfo allocateInfo = {};
+	CreateDescriptorSet(m_DescriptorSets, &allocateInfo, m_DescriptorPool, layouts, m_Device);
+
+	for (uint32_t level = 0; level < m_LevelCount; level++)
+	{
+		VkDescriptorImageInfo srcInfo = {};
+		srcInfo.sampler = m_Sampler;
+		srcInfo.imageView = level == 0 ? pGraphicSystem->GetDepthImageView() : m_LevelViews[level - 1];
+		srcInfo.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+		VkDescriptorImageInfo dstInfo = {};
+		dstInfo.imageView = m_LevelViews[level];
+		dstInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkWriteDescriptorSet writes[2] = {};
+		writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[0].dstSet = m_DescriptorSets[level];
+		writes[0].dstBinding = 0;
+		writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writes[0].descriptorCount = 1;
+		writes[0].pImageInfo = &srcInfo;
+		writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[1].dstSet = m_DescriptorSets[level];
+		writes[1].dstBinding = 1;
+		writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		writes[1].descriptorCount = 1;
+		writes[1].pImageInfo = &dstInfo;
+		vkUpdateDescriptorSets(m_Device, 2, writes, 0, nullptr);
+	}
+
+	m_PipelineLayout = pPipelineLibrary->GetPipelineLayout({ m_DescriptorSetLayout });
+
+	ComputePipelineDesc pipelineDesc;
+	pipelineDesc.shaderModule = m_ShaderModule;
+	pipelineDesc.pipelineLayout = m_PipelineLayout;
+	pipelineDesc.shaderHash = pGraphicSystem->GetShaderModuleCache()->GetContentHash(m_ShaderModule);
+	m_Pipeline = pPipelineLibrary->GetComputePipeline(pipelineDesc);
+	if (m_Pipeline == VK_NULL_HANDLE)
+	{
+		printf("### ERROR ### HiZBuffer : pipeline creation failed\n");
+		Finalize();
+		return false;
+	}
+
+	return true;
+}
+
+void HiZBuffer::Finalize()
+{
+	if (m_pGraphicSystem == nullptr)
+	{
+		return;
+	}
+
+	DeletionQueue* pDeletionQueue = m_pGraphicSystem->GetDeletionQueue();
+	if (m_DescriptorPool != VK_NULL_HANDLE)
+	{
+		pDeletionQueue->DestroyDescriptorPool(m_DescriptorPool);
+		m_DescriptorPool = VK_NULL_HANDLE;
+	}
+	m_DescriptorSets.clear();
+	if (m_Sampler != VK_NULL_HANDLE)
+	{
+		pDeletionQueue->DestroySampler(m_Sampler);
+		m_Sampler = VK_NULL_HANDLE;
+	}
+	for (VkImageView levelView : m_LevelViews)
+	{
+		pDeletionQueue->DestroyImageView(levelView);
+	}
+	m_LevelViews.clear();
+	if (m_ImageView != VK_NULL_HANDLE)
+	{
+		pDeletionQueue->DestroyImageView(m_ImageView);
+		m_ImageView = VK_NULL_HANDLE;
+	}
+	if (m_Image != VK_NULL_HANDLE)
+	{
+		pDeletionQueue->DestroyImage(m_Image, &m_ImageMemory);
+		m_Image = VK_NULL_HANDLE;
+	}
+	if (m_ShaderModule != VK_NULL_HANDLE)
+	{
+		m_pGraphicSystem->GetShaderModuleCache()->Release(m_ShaderModule);
+		m_ShaderModule = VK_NULL_HANDLE;
+	}
+
+	// Layouts and the pipeline belong to the PipelineLibrary
+	m_DescriptorSetLayout = VK_NULL_HANDLE;
+	m_PipelineLayout = VK_NULL_HANDLE;
+	m_Pipeline = VK_NULL_HANDLE;
+	m_LevelCount = 0;
+	m_pGraphicSystem = nullptr;
+}
+
+void HiZBuffer::RecordBuild(VkCommandBuffer commandBuffer)
+{
+	// The depth written by the pass becomes readable. The previous contents of the pyramid are discarded,
+	// the last reads of them were compute shaders earlier on this queue
+	VkImageMemoryBarrier barriers[2] = {};
+	barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].image = m_pGraphicSystem->GetDepthImage();
+	barriers[0].subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+	barriers[1].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[1].srcAccessMask = 0;
+	barriers[1].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[1].image = m_Image;
+	barriers[1].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, m_LevelCount, 0, 1 };
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, nullptr, 0, nullptr, 2, barriers);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_Pipeline);
+	for (uint32_t level = 0; level < m_LevelCount; level++)
+	{
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_PipelineLayout, 0, 1, &m_DescriptorSets[level], 0, nullptr);
+		uint32_t width = GetLevelSize(m_Extent.width, level);
+		uint32_t height = GetLevelSize(m_Extent.height, level);
+		vkCmdDispatch(commandBuffer, (width + BuildGroupSize - 1) / BuildGroupSize, (height + BuildGroupSize - 1) / BuildGroupSize, 1);
+
+		// Read by the next level and by the occlusion test
+		VkImageMemoryBarrier levelBarrier = {};
+		levelBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		levelBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		levelBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		levelBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		levelBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		levelBarrier.image = m_Image;
+		levelBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &levelBarrier);
+	}
+
+	VkImageMemoryBarrier depthBarrier = barriers[0];
+	depthBarrier.srcAccessMask = 0;
+	depthBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	depthBarrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		0, 0, nullptr, 0, nullptr, 1, &depthBarrier);
+}
@@ -1,5 +1,9 @@
 #include "LightManager.h"
 #include "Light.h"
+#include "GraphicSystem.h"
+#include "SceneBvh.h"
+
+#include <chrono>
 
 void LightManager::Finalize()
 {
@@ -9,6 +13,18 @@ void LightManager::Finalize()
 		pLight = nullptr;
 	}
 	lightList.clear();
+
+	if (m_DescriptorPool != VK_NULL_HANDLE)
+	{
+		vkDestroyDescriptorPool(m_Device, m_DescriptorPool, nullptr);
+		m_DescriptorPool = VK_NULL_HANDLE;
+		m_DescriptorSets.clear();
+	}
+	if (m_LightBuffer != VK_NULL_HANDLE)
+	{
+		m_pGraphicSystem->GetDeletionQueue()->DestroyBuffer(m_LightBuffer, &m_LightBufferMemory);
+		m_LightBuffer = VK_NULL_HANDLE;
+	}
 }
 
 Light* LightManager::CreateNewLight()
@@ -37,4 +53,272 @@ int LightManager::GetLightCount()
 	int lightCount = static_cast<int>(lightList.size());
 
 	return lightCount;
-}
\ No newline at end of file
+}
+
+void LightManager::InitUniform(GraphicSystem* pGraphicSystem)
+{
+	m_pGraphicSystem = pGraphicSystem;
+	m_Device = pGraphicSystem->GetDevice();
+	m_pUniformArena = pGraphicSystem->GetUniformArena();
+	m_pUniformArena->AllocateSlot(sizeof(LightClusterUniform), &m_UniformSlot);
+
+	uint32_t frameCount = m_pUniformArena->GetFrameCount();
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(pGraphicSystem->GetPhysicalDevice(), &properties);
+	VkDeviceSize storageAlignment = std::max<VkDeviceSize>(properties.limits.minStorageBufferOffsetAlignment, 16);
+
+	// Frame region: lights | cluster ranges | light indices
+	VkDeviceSize lightBytes = MaxLightCount * sizeof(LightInfo);
+	VkDeviceSize clusterBytes = LightClusterCount * sizeof(glm::uvec2);
+	VkDeviceSize indexBytes = MaxLightIndexCount * sizeof(uint32_t);
+	m_ClusterOffset = AlignUp(lightBytes, storageAlignment);
+	m_IndexOffset = m_ClusterOffset + AlignUp(clusterBytes, storageAlignment);
+	m_LightRegionSize = AlignUp(m_IndexOffset + indexBytes, storageAlignment);
+	CreateBuffer(&m_LightBuffer, &m_LightBufferMemory, m_LightRegionSize * frameCount,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		m_Device, pGraphicSystem->GetMemoryAllocator());
+	memset(m_LightBufferMemory.pMappedData, 0, m_LightRegionSize * frameCount);
+
+	m_ClusterRanges.resize(LightClusterCount);
+	m_ClusterFill.resize(LightClusterCount);
+	m_LightIndices.resize(MaxLightIndexCount);
+
+	std::vector<VkDescriptorSetLayoutBinding> bindings(4);
+	CreateDescriptorSetLayoutBinding(&bindings[0], 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT, m_Device);
+	for (uint32_t binding = 1; binding < 4; binding++)
+	{
+		CreateDescriptorSetLayoutBinding(&bindings[binding], binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT, m_Device);
+	}
+	m_DescriptorSetLayout = pGraphicSystem->GetPipelineLibrary()->GetDescriptorSetLayout(bindings);
+	m_PipelineLayout = pGraphicSystem->GetPipelineLibrary()->GetPipelineLayout({ m_DescriptorSetLayout });
+
+	VkDescriptorPoolSize uniformPoolSize = {};
+	CreateDescriptorPoolSize(&uniformPoolSize, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, frameCount);
+	VkDescriptorPoolSize storagePoolSize = {};
+	CreateDescriptorPoolSize(&storagePoolSize, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 * frameCount);
+	std::vector<VkDescriptorPoolSize> poolSizes = { uniformPoolSize, storagePoolSize };
+	CreateDescriptorPool(&m_DescriptorPool, m_Device, poolSizes, frameCount);
+
+	std::vector<VkDescriptorSetLayout> layouts(frameCount, m_DescriptorSetLayout);
+	m_DescriptorSets.resize(frameCount);
+	VkDescriptorSetAllocateInfo allocateInfo = {};
+	CreateDescriptorSet(m_DescriptorSets, &allocateInfo, m_DescriptorPool, layouts, m_Device);
+
+	// Each frame's set points straight at that frame's copy, no dynamic offset needed
+	for (uint32_t i = 0; i < frameCount; i++)
+	{
+		VkDescriptorBufferInfo bufferInfos[4];
+		bufferInfos[0] = m_pUniformArena->GetDescriptorBufferInfo(m_UniformSlot);
+		bufferInfos[0].offset = m_pUniformArena->GetDynamicOffset(m_UniformSlot, i);
+		VkDeviceSize regionOffset = i * m_LightRegionSize;
+		bufferInfos[1] = { m_LightBuffer, regionOffset, lightBytes };
+		bufferInfos[2] = { m_LightBuffer, regionOffset + m_ClusterOffset, clusterBytes };
+		bufferInfos[3] = { m_LightBuffer, regionOffset + m_IndexOffset, indexBytes };
+
+		VkWriteDescriptorSet descriptorWrites[4] = {};
+		for (uint32_t binding = 0; binding < 4; binding++)
+		{
+			descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrites[binding].dstSet = m_DescriptorSets[i];
+			descriptorWrites[binding].dstBinding = binding;
+			descriptorWrites[binding].dstArrayElement = 0;
+			descriptorWrites[binding].descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			descriptorWrites[binding].descriptorCount = 1;
+			descriptorWrites[binding].pBufferInfo = &bufferInfos[binding];
+		}
+		vkUpdateDescriptorSets(m_Device, 4, descriptorWrites, 0, nullptr);
+	}
+}
+
+void LightManager::FillLightInfo(Light* pLight, LightInfo* pInfo)
+{
+	pInfo->lightColor = pLight->GetLightColorIntensity();
+	pInfo->LightDir = glm::vec4(pLight->GetLightDir(), 1.0f);
+	pInfo->LightPos = glm::vec4(pLight->GetLightPos(), 1.0f);
+	pInfo->lightInfo.x = pLight->GetLightRange();
+	pInfo->lightInfo.y = pLight->GetInnerConeAngleCos();
+	pInfo->lightInfo.z = pLight->GetOuterConeAngleCos();
+	pInfo->lightInfo.w = pLight->GetLightType();
+}
+
+bool LightManager::ComputeClusterBounds(Light* pLight, const Camera& camera, LightClusterBounds* pBounds)
+{
+	// Spot lights are bounded by their range sphere as well
+	glm::vec3 viewPos = glm::vec3(camera.viewMtx * glm::vec4(pLight->GetLightPos(), 1.0f));
+	float radius = pLight->GetLightRange();
+
+	// View space looks down -z
+	float minDepth = std::max(-viewPos.z - radius, camera.nearPlane);
+	float maxDepth = std::min(-viewPos.z + radius, camera.farPlane);
+	if (minDepth > maxDepth)
+	{
+		return false;
+	}
+
+	// x / depth is monotonic in depth, so the sphere's view space box projects between its sides taken at both depths.
+	// Assumes a symmetric projection like glm::perspective builds, the sign of projMtx[1][1] already matches gl_FragCoord
+	const uint32_t counts[2] = { LightClusterCountX, LightClusterCountY };
+	for (int axis = 0; axis < 2; axis++)
+	{
+		float scale = camera.projMtx[axis][axis];
+		float side0 = (viewPos[axis] - radius) * scale;
+		float side1 = (viewPos[axis] + radius) * scale;
+		float minNdc = std::min(std::min(side0 / minDepth, side0 / maxDepth), std::min(side1 / minDepth, side1 / maxDepth));
+		float maxNdc = std::max(std::max(side0 / minDepth, side0 / maxDepth), std::max(side1 / minDepth, side1 / maxDepth));
+		if (minNdc > 1.0f || maxNdc < -1.0f)
+		{
+			return false;
+		}
+		float count = static_cast<float>(counts[axis]);
+		pBounds->minCluster[axis] = static_cast<uint32_t>(glm::clamp((minNdc * 0.5f + 0.5f) * count, 0.0f, count - 1.0f));
+		pBounds->maxCluster[axis] = static_cast<uint32_t>(glm::clamp((maxNdc * 0.5f + 0.5f) * count, 0.0f, count - 1.0f));
+	}
+
+	float maxSlice = static_cast<float>(LightClusterCountZ - 1);
+	pBounds->minCluster.z = static_cast<uint32_t>(glm::clamp(std::log(minDepth) * m_ClusterData.clusterScale.z + m_ClusterData.clusterScale.w, 0.0f, maxSlice));
+	pBounds->maxCluster.z = static_cast<uint32_t>(glm::clamp(std::log(maxDepth) * m_ClusterData.clusterScale.z + m_ClusterData.clusterScale.w, 0.0f, maxSlice));
+	return true;
+}
+
+void LightManager::UpdateUniform(uint32_t frameIndex)
+{
+	auto assignStartTime = std::chrono::high_resolution_clock::now();
+
+	const Camera& camera = m_pGraphicSystem->GetCamera();
+	VkExtent2D extent = m_pGraphicSystem->GetSwapChainExtent();
+	// Slice = log(depth) * scale + bias, slice 0 starts at the near plane and the last one ends at the far plane
+	float logDepthRange = std::log(camera.farPlane / camera.nearPlane);
+	m_ClusterData.viewMtx = camera.viewMtx;
+	m_ClusterData.clusterScale.x = extent.width / static_cast<float>(LightClusterCountX);
+	m_ClusterData.clusterScale.y = extent.height / static_cast<float>(LightClusterCountY);
+	float sliceCount = static_cast<float>(LightClusterCountZ);
+	m_ClusterData.clusterScale.z = sliceCount / logDepthRange;
+	m_ClusterData.clusterScale.w = -sliceCount * std::log(camera.nearPlane) / logDepthRange;
+
+	uint8_t* pRegion = static_cast<uint8_t*>(m_LightBufferMemory.pMappedData) + frameIndex * m_LightRegionSize;
+	LightInfo* pLightInfos = reinterpret_cast<LightInfo*>(pRegion);
+	m_Stats = LightClusterStats();
+
+	// Global lights go first, the shader loops over them for every fragment before the cluster's list
+	uint32_t lightCount = 0;
+	uint32_t maxLightCount = static_cast<uint32_t>(MaxLightCount);
+	for (Light* pLight : lightList)
+	{
+		bool isGlobal = pLight->GetLightType() == DIRECTIONAL_LIGHT || pLight->GetLightRange() <= 0.0f;
+		if (isGlobal && lightCount < maxLightCount)
+		{
+			FillLightInfo(pLight, &pLightInfos[lightCount++]);
+		}
+	}
+	m_ClusterData.clusterGrid.w = lightCount;
+	m_Stats.globalLightCount = lightCount;
+
+	m_ClusterBounds.clear();
+	for (Light* pLight : lightList)
+	{
+		bool isGlobal = pLight->GetLightType() == DIRECTIONAL_LIGHT || pLight->GetLightRange() <= 0.0f;
+		if (isGlobal || lightCount >= maxLightCount)
+		{
+			continue;
+		}
+		LightClusterBounds bounds;
+		if (!ComputeClusterBounds(pLight, camera, &bounds))
+		{
+			m_Stats.culledLightCount++;
+			continue;
+		}
+		if (m_pSceneBvh != nullptr && m_pSceneBvh->GetPrimitiveCount() > 0)
+		{
+			// A light that reaches no object shades nothing, keep it out of the clusters
+			m_LitObjects.clear();
+			m_pSceneBvh->QuerySphere(pLight->GetLightPos(), pLight->GetLightRange(), &m_LitObjects);
+			if (m_LitObjects.empty())
+			{
+				m_Stats.unlitLightCount++;
+				continue;
+			}
+			m_Stats.litObjectCount += static_cast<uint32_t>(m_LitObjects.size());
+		}
+		bounds.light = lightCount;
+		FillLightInfo(pLight, &pLightInfos[lightCount++]);
+		m_ClusterBounds.push_back(bounds);
+	}
+	m_ClusterData.lightCount.x = lightCount;
+	m_Stats.lightCount = lightCount;
+
+	// Count, prefix sum, then scatter the light indices so every cluster's list is contiguous
+	std::fill(m_ClusterRanges.begin(), m_ClusterRanges.end(), glm::uvec2(0));
+	for (const LightClusterBounds& bounds : m_ClusterBounds)
+	{
+		for (uint32_t z = bounds.minCluster.z; z <= bounds.maxCluster.z; z++)
+		{
+			for (uint32_t y = bounds.minCluster.y; y <= bounds.maxCluster.y; y++)
+			{
+				uint32_t cluster = (z * LightClusterCountY + y) * LightClusterCountX;
+				for (uint32_t x = bounds.minCluster.x; x <= bounds.maxCluster.x; x++)
+				{
+					m_ClusterRanges[cluster + x].y++;
+				}
+			}
+		}
+	}
+	uint32_t indexCount = 0;
+	for (glm::uvec2& range : m_ClusterRanges)
+	{
+		uint32_t count = std::min(range.y, MaxLightIndexCount - indexCount);
+		m_Stats.droppedIndexCount += range.y - count;
+		m_Stats.maxClusterLightCount = std::max(m_Stats.maxClusterLightCount, range.y);
+		range = glm::uvec2(indexCount, count);
+		indexCount += count;
+	}
+	m_Stats.indexCount = indexCount;
+
+	std::fill(m_ClusterFill.begin(), m_ClusterFill.end(), 0);
+	for (const LightClusterBounds& bounds : m_ClusterBounds)
+	{
+		for (uint32_t z = bounds.minCluster.z; z <= bounds.maxCluster.z; z++)
+		{
+			for (uint32_t y = bounds.minCluster.y; y <= bounds.maxCluster.y; y++)
+			{
+				uint32_t cluster = (z * LightClusterCountY + y) * LightClusterCountX;
+				for (uint32_t x = bounds.minCluster.x; x <= bounds.maxCluster.x; x++)
+				{
+					const glm::uvec2& range = m_ClusterRanges[cluster + x];
+					uint32_t& fill = m_ClusterFill[cluster + x];
+					if (fill < range.y)
+					{
+						m_LightIndices[range.x + fill] = bounds.light;
+						fill++;
+					}
+				}
+			}
+		}
+	}
+
+	memcpy(pRegion + m_ClusterOffset, m_ClusterRanges.data(), LightClusterCount * sizeof(glm::uvec2));
+	memcpy(pRegion + m_IndexOffset, m_LightIndices.data(), indexCount * sizeof(uint32_t));
+	m_pUniformArena->Write(m_UniformSlot, frameIndex, &m_ClusterData, sizeof(LightClusterUniform));
+
+	auto assignEndTime = std::chrono::high_resolution_clock::now();
+	m_Stats.assignTimeMs = std::chrono::duration<float, std::milli>(assignEndTime - assignStartTime).count();
+}
+
+void LightManager::Bind(VkCommandBuffer commandBuffer, uint32_t frameIndex, VkPipelineBindPoint bindPoint)
+{
+	vkCmdBindDescriptorSets(commandBuffer, bindPoint, m_PipelineLayout, 0, 1, &m_DescriptorSets[frameIndex], 0, nullptr);
+}
+
+void LightManager::PrintStats()
+{
+	printf("light clusters: %u lights (%u global, %u culled, %u unlit, %u lit objects), %u indices, max %u per cluster, %u dropped, %.3f ms\n",
+		m_Stats.lightCount,
+		m_Stats.globalLightCount,
+		m_Stats.culledLightCount,
+		m_Stats.unlitLightCount,
+		m_Stats.litObjectCount,
+		m_Stats.indexCount,
+		m_Stats.maxClusterLightCount,
+		m_Stats.droppedIndexCount,
+		m_Stats.assignTimeMs);
+}
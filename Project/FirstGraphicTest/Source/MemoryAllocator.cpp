@@ -0,0 +1,412 @@
+#include "MemoryAllocator.h"
+
+namespace
+{
+	const VkDeviceSize DeviceLocalBlockSize = 64 * 1024 * 1024;
+	const VkDeviceSize HostVisibleBlockSize = 16 * 1024 * 1024;
+
+	uint32_t FindMemoryTypeIndex(const VkPhysicalDeviceMemoryProperties& memProps, uint32_t typeFilter, VkMemoryPropertyFlags properties)
+	{
+		for (uint32_t i = 0; i < memProps.memoryTypeCount; i++)
+		{
+			if (typeFilter & (1 << i) && (memProps.memoryTypes[i].propertyFlags & properties) == properties)
+			{
+				return i;
+			}
+		}
+		return UINT32_MAX;
+	}
+}
+
+MemoryAllocator::MemoryAllocator()
+{
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+}
+
+void MemoryAllocator::Init(VkDevice device, VkPhysicalDevice physicalDevice)
+{
+	m_Device = device;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &m_MemoryProperties);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	m_BufferImageGranularity = std::max<VkDeviceSize>(1, properties.limits.bufferImageGranularity);
+
+	m_DedicatedStats.resize(m_MemoryProperties.memoryTypeCount);
+}
+
+void MemoryAllocator::Finalize()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	for (MemoryBlock* pBlock : m_Blocks)
+	{
+		if (pBlock->allocationCount != 0)
+		{
+			printf("### WARNING ### memory block of type %u destroyed with %u live allocations\n", pBlock->memoryTypeIndex, pBlock->allocationCount);
+		}
+		DestroyBlock(pBlock);
+	}
+	m_Blocks.clear();
+}
+
+VkDeviceSize MemoryAllocator::GetBlockSize(uint32_t memoryTypeIndex)
+{
+	const VkMemoryType& memoryType = m_MemoryProperties.memoryTypes[memoryTypeIndex];
+	VkDeviceSize blockSize = (memoryType.propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) ? DeviceLocalBlockSize : HostVisibleBlockSize;
+
+	// Small heaps (integrated or BAR memory) should not be eaten by a handful of blocks
+	VkDeviceSize heapSize = m_MemoryProperties.memoryHeaps[memoryType.heapIndex].size;
+	return std::min(blockSize, std::max<VkDeviceSize>(heapSize / 8, 1024 * 1024));
+}
+
+MemoryBlock* MemoryAllocator::CreateBlock(uint32_t memoryTypeIndex, VkDeviceSize size, MemoryResourceType resourceType, MemoryAllocationStrategy strategy)
+{
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkResult result = vkAllocateMemory(m_Device, &allocInfo, nullptr, &memory);
+	if (result != VK_SUCCESS)
+	{
+		return nullptr;
+	}
+
+	MemoryBlock* pBlock = new MemoryBlock();
+	pBlock->memory = memory;
+	pBlock->size = size;
+	pBlock->memoryTypeIndex = memoryTypeIndex;
+	pBlock->resourceType = resourceType;
+	pBlock->strategy = strategy;
+	pBlock->freeRanges.push_back({ 0, size });
+
+	if (m_MemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		vkMapMemory(m_Device, memory, 0, VK_WHOLE_SIZE, 0, &pBlock->pMappedData);
+	}
+
+	return pBlock;
+}
+
+void MemoryAllocator::DestroyBlock(MemoryBlock* pBlock)
+{
+	if (pBlock->pMappedData != nullptr)
+	{
+		vkUnmapMemory(m_Device, pBlock->memory);
+	}
+	vkFreeMemory(m_Device, pBlock->memory, nullptr);
+	delete(pBlock);
+}
+
+bool MemoryAllocator::AllocateFromBlock(MemoryBlock* pBlock, VkDeviceSize size, VkDeviceSize alignment, MemoryAllocation* pAllocation)
+{
+	VkDeviceSize blockOffset = 0;
+	VkDeviceSize alignedOffset = 0;
+
+	if (pBlock->strategy == MEMORY_STRATEGY_LINEAR)
+	{
+		alignedOffset = AlignUp(pBlock->linearOffset, alignment);
+		if (alignedOffset + size > pBlock->size)
+		{
+			return false;
+		}
+		blockOffset = pBlock->linearOffset;
+		pBlock->linearOffset = alignedOffset + size;
+	}
+	else
+	{
+		// Best fit: the smallest free range that still holds the aligned allocation
+		size_t bestIndex = SIZE_MAX;
+		VkDeviceSize bestSize = UINT64_MAX;
+		for (size_t i = 0; i < pBlock->freeRanges.size(); i++)
+		{
+			const MemoryBlock::Range& range = pBlock->freeRanges[i];
+			VkDeviceSize offset = AlignUp(range.offset, alignment);
+			if (offset + size <= range.offset + range.size && range.size < bestSize)
+			{
+				bestIndex = i;
+				bestSize = range.size;
+			}
+		}
+		if (bestIndex == SIZE_MAX)
+		{
+			return false;
+		}
+
+		MemoryBlock::Range& range = pBlock->freeRanges[bestIndex];
+		blockOffset = range.offset;
+		alignedOffset = AlignUp(range.offset, alignment);
+
+		VkDeviceSize end = alignedOffset + size;
+		VkDeviceSize rangeEnd = range.offset + range.size;
+		if (end == rangeEnd)
+		{
+			pBlock->freeRanges.erase(pBlock->freeRanges.begin() + bestIndex);
+		}
+		else
+		{
+			range.offset = end;
+			range.size = rangeEnd - end;
+		}
+	}
+
+	pBlock->allocationCount++;
+	pBlock->usedBytes += size;
+	pBlock->alignmentWasteBytes += alignedOffset - blockOffset;
+
+	pAllocation->memory = pBlock->memory;
+	pAllocation->offset = alignedOffset;
+	pAllocation->size = size;
+	pAllocation->memoryTypeIndex = pBlock->memoryTypeIndex;
+	pAllocation->pMappedData = pBlock->pMappedData != nullptr ? static_cast<uint8_t*>(pBlock->pMappedData) + alignedOffset : nullptr;
+	pAllocation->pBlock = pBlock;
+	pAllocation->blockOffset = blockOffset;
+	pAllocation->blockSize = alignedOffset + size - blockOffset;
+	return true;
+}
+
+bool MemoryAllocator::Allocate(
+	MemoryAllocation* pAllocation,
+	const VkMemoryRequirements& requirements,
+	VkMemoryPropertyFlags propertyFlags,
+	MemoryResourceType resourceType,
+	MemoryAllocationStrategy strategy)
+{
+	uint32_t memoryTypeIndex = FindMemoryTypeIndex(m_MemoryProperties, requirements.memoryTypeBits, propertyFlags);
+	if (memoryTypeIndex == UINT32_MAX)
+	{
+		printf("### ERROR ### no memory type for property flags 0x%x\n", propertyFlags);
+		return false;
+	}
+
+	// Linear and optimal resources only share a block when the device does not care about
+	// bufferImageGranularity, which keeps the allocator from ever having to pad between neighbours
+	if (m_BufferImageGranularity <= 1)
+	{
+		resourceType = MEMORY_RESOURCE_LINEAR;
+	}
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	VkDeviceSize blockSize = GetBlockSize(memoryTypeIndex);
+	if (requirements.size > blockSize / 2)
+	{
+		// Large resources get their own allocation instead of wasting most of a block
+		VkMemoryAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = requirements.size;
+		allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+		*pAllocation = {};
+		VkResult result = vkAllocateMemory(m_Device, &allocInfo, nullptr, &pAllocation->memory);
+		if (result != VK_SUCCESS)
+		{
+			return false;
+		}
+		pAllocation->offset = 0;
+		pAllocation->size = requirements.size;
+		pAllocation->memoryTypeIndex = memoryTypeIndex;
+		if (m_MemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		{
+			vkMapMemory(m_Device, pAllocation->memory, 0, VK_WHOLE_SIZE, 0, &pAllocation->pMappedData);
+		}
+
+		m_DedicatedStats[memoryTypeIndex].count++;
+		m_DedicatedStats[memoryTypeIndex].bytes += requirements.size;
+		return true;
+	}
+
+	for (MemoryBlock* pBlock : m_Blocks)
+	{
+		if (pBlock->memoryTypeIndex == memoryTypeIndex &&
+			pBlock->resourceType == resourceType &&
+			pBlock->strategy == strategy &&
+			AllocateFromBlock(pBlock, requirements.size, requirements.alignment, pAllocation))
+		{
+			return true;
+		}
+	}
+
+	MemoryBlock* pBlock = CreateBlock(memoryTypeIndex, blockSize, resourceType, strategy);
+	if (pBlock == nullptr)
+	{
+		printf("### ERROR ### vkAllocateMemory failed for a %llu byte block of type %u\n", static_cast<unsigned long long>(blockSize), memoryTypeIndex);
+		return false;
+	}
+	m_Blocks.push_back(pBlock);
+
+	return AllocateFromBlock(pBlock, requirements.size, requirements.alignment, pAllocation);
+}
+
+void MemoryAllocator::Free(MemoryAllocation* pAllocation)
+{
+	if (pAllocation->memory == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	MemoryBlock* pBlock = pAllocation->pBlock;
+	if (pBlock == nullptr)
+	{
+		if (pAllocation->pMappedData != nullptr)
+		{
+			vkUnmapMemory(m_Device, pAllocation->memory);
+		}
+		vkFreeMemory(m_Device, pAllocation->memory, nullptr);
+		m_DedicatedStats[pAllocation->memoryTypeIndex].count--;
+		m_DedicatedStats[pAllocation->memoryTypeIndex].bytes -= pAllocation->size;
+		*pAllocation = {};
+		return;
+	}
+
+	pBlock->allocationCount--;
+	pBlock->usedBytes -= pAllocation->size;
+	pBlock->alignmentWasteBytes -= pAllocation->offset - pAllocation->blockOffset;
+
+	if (pBlock->strategy == MEMORY_STRATEGY_LINEAR)
+	{
+		if (pBlock->allocationCount == 0)
+		{
+			pBlock->linearOffset = 0;
+		}
+	}
+	else
+	{
+		// Insert the range back in offset order and merge it with its neighbours
+		MemoryBlock::Range freed = { pAllocation->blockOffset, pAllocation->blockSize };
+		std::vector<MemoryBlock::Range>& ranges = pBlock->freeRanges;
+		auto iter = std::lower_bound(ranges.begin(), ranges.end(), freed.offset,
+			[](const MemoryBlock::Range& range, VkDeviceSize offset) { return range.offset < offset; });
+		iter = ranges.insert(iter, freed);
+
+		auto next = iter + 1;
+		if (next != ranges.end() && iter->offset + iter->size == next->offset)
+		{
+			iter->size += next->size;
+			ranges.erase(next);
+		}
+		if (iter != ranges.begin())
+		{
+			auto prev = iter - 1;
+			if (prev->offset + prev->size == iter->offset)
+			{
+				prev->size += iter->size;
+				ranges.erase(iter);
+			}
+		}
+	}
+
+	// Give empty blocks back to the driver, but keep one per pool around to absorb churn
+	if (pBlock->allocationCount == 0)
+	{
+		for (MemoryBlock* pOther : m_Blocks)
+		{
+			if (pOther != pBlock &&
+				pOther->memoryTypeIndex == pBlock->memoryTypeIndex &&
+				pOther->resourceType == pBlock->resourceType &&
+				pOther->strategy == pBlock->strategy)
+			{
+				m_Blocks.erase(std::find(m_Blocks.begin(), m_Blocks.end(), pBlock));
+				DestroyBlock(pBlock);
+				break;
+			}
+		}
+	}
+
+	*pAllocation = {};
+}
+
+MemoryAllocatorStats MemoryAllocator::GetStats(uint32_t memoryTypeIndex)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	MemoryAllocatorStats stats;
+	for (MemoryBlock* pBlock : m_Blocks)
+	{
+		if (pBlock->memoryTypeIndex != memoryTypeIndex)
+		{
+			continue;
+		}
+		stats.blockCount++;
+		stats.allocationCount += pBlock->allocationCount;
+		stats.reservedBytes += pBlock->size;
+		stats.usedBytes += pBlock->usedBytes;
+		stats.alignmentWasteBytes += pBlock->alignmentWasteBytes;
+
+		if (pBlock->strategy == MEMORY_STRATEGY_LINEAR)
+		{
+			VkDeviceSize tail = pBlock->size - pBlock->linearOffset;
+			stats.freeBytes += tail;
+			stats.largestFreeRange = std::max(stats.largestFreeRange, tail);
+			stats.freeRangeCount += tail > 0 ? 1 : 0;
+		}
+		else
+		{
+			for (const MemoryBlock::Range& range : pBlock->freeRanges)
+			{
+				stats.freeBytes += range.size;
+				stats.largestFreeRange = std::max(stats.largestFreeRange, range.size);
+				stats.freeRangeCount++;
+			}
+		}
+	}
+
+	const DedicatedStats& dedicated = m_DedicatedStats[memoryTypeIndex];
+	stats.dedicatedAllocationCount = dedicated.count;
+	stats.allocationCount += dedicated.count;
+	stats.reservedBytes += dedicated.bytes;
+	stats.usedBytes += dedicated.bytes;
+	return stats;
+}
+
+MemoryAllocatorStats MemoryAllocator::GetTotalStats()
+{
+	MemoryAllocatorStats total;
+	for (uint32_t i = 0; i < m_MemoryProperties.memoryTypeCount; i++)
+	{
+		total.Add(GetStats(i));
+	}
+	return total;
+}
+
+void MemoryAllocator::PrintStats()
+{
+	auto ToMB = [](VkDeviceSize bytes) { return bytes / (1024.0 * 1024.0); };
+
+	printf("memory allocator stats:\n");
+	for (uint32_t i = 0; i < m_MemoryProperties.memoryTypeCount; i++)
+	{
+		MemoryAllocatorStats stats = GetStats(i);
+		if (stats.reservedBytes == 0)
+		{
+			continue;
+		}
+		printf("  type %2u flags 0x%02x : %u blocks + %u dedicated, %u allocations, reserved %.2f MB, used %.2f MB, padding %.2f MB, free %.2f MB in %u ranges (largest %.2f MB, fragmentation %.2f)\n",
+			i,
+			m_MemoryProperties.memoryTypes[i].propertyFlags,
+			stats.blockCount,
+			stats.dedicatedAllocationCount,
+			stats.allocationCount,
+			ToMB(stats.reservedBytes),
+			ToMB(stats.usedBytes),
+			ToMB(stats.alignmentWasteBytes),
+			ToMB(stats.freeBytes),
+			stats.freeRangeCount,
+			ToMB(stats.largestFreeRange),
+			stats.GetFragmentation());
+	}
+
+	MemoryAllocatorStats total = GetTotalStats();
+	printf("  total : %u vkAllocateMemory calls for %u allocations, reserved %.2f MB, used %.2f MB, wasted %.2f MB\n",
+		total.blockCount + total.dedicatedAllocationCount,
+		total.allocationCount,
+		ToMB(total.reservedBytes),
+		ToMB(total.usedBytes),
+		ToMB(total.reservedBytes - total.usedBytes));
+}
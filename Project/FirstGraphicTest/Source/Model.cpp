@@ -1,6 +1,5 @@
 #include "Model.h"
 
-#include "FileReader.h"
 #include "GltfLoader.h"
 #include "TextureManager.h"
 #include "Light.h"
@@ -12,7 +11,7 @@ namespace
 	TextureData* pNullTextureData;
 	TextureData* pDfgTextureData;
 	TextureData* pIBLTextureData;
-	void CreateObject(Mesh& mesh, const fx::gltf::Document& model, int meshIndex, GraphicSystem* pGraphicSystem, std::vector<TextureData*>& textureDatas)
+	void CreateObject(Mesh& mesh, const fx::gltf::Document& model, int meshIndex, GraphicSystem* pGraphicSystem, UploadBatch* pUploadBatch, std::vector<TextureData*>& textureDatas)
 	{
 		for (std::size_t i = 0; i < model.meshes[meshIndex].primitives.size(); i++)
 		{
@@ -29,6 +28,7 @@ namespace
 			}
 			RenderObject* pObject = new RenderObject();
 			pObject->SetGraphicSystem(pGraphicSystem);
+			pObject->SetUploadBatch(pUploadBatch);
 			//pObject->Init(pGraphicSystem);
 			std::vector<Vertex> vertexs;
 
@@ -253,7 +253,15 @@ Model::Model()
 	m_Scale = glm::vec3(1.0f);
 	m_Rotate = glm::quat();
 	m_WorldTransform = glm::mat4(1.0);
-
+	m_pShaderModuleCache = nullptr;
+	m_IsVisible = true;
+	m_IsTransformChanged = true;
+	m_VsShaderModule = VK_NULL_HANDLE;
+	m_FsShaderModule = VK_NULL_HANDLE;
+	m_DepthVsShaderModule = VK_NULL_HANDLE;
+	m_DepthMaskVsShaderModule = VK_NULL_HANDLE;
+	m_DepthFsShaderModule = VK_NULL_HANDLE;
+	m_GBufferFsShaderModule = VK_NULL_HANDLE;
 }
 
 
@@ -263,8 +271,15 @@ Model::~Model()
 
 void Model::Finalize()
 {
-	vkDestroyShaderModule(m_Device, m_VsShaderModule, nullptr);
-	vkDestroyShaderModule(m_Device, m_FsShaderModule, nullptr);
+	if (m_pShaderModuleCache != nullptr)
+	{
+		m_pShaderModuleCache->Release(m_VsShaderModule);
+		m_pShaderModuleCache->Release(m_FsShaderModule);
+		m_pShaderModuleCache->Release(m_DepthVsShaderModule);
+		m_pShaderModuleCache->Release(m_DepthMaskVsShaderModule);
+		m_pShaderModuleCache->Release(m_DepthFsShaderModule);
+		m_pShaderModuleCache->Release(m_GBufferFsShaderModule);
+	}
 
 	for (Mesh mesh : meshes)
 	{
@@ -279,13 +294,13 @@ void Model::Finalize()
 void Model::CreateModel(std::string textureName, const void* pVertexData, size_t vertexCount, const void* pIndexData, size_t indexCount, GraphicSystem* pGraphicSystem)
 {
 	m_Device = pGraphicSystem->GetDevice();
-	std::vector<char> vsCode;
-	std::vector<char> fsCode;
-	LoadFile(vsCode, "Shader/vs.spv");
-	LoadFile(fsCode, "Shader/fs.spv");
-
-	CreateShaderModule(&m_VsShaderModule, m_Device, vsCode);
-	CreateShaderModule(&m_FsShaderModule, m_Device, fsCode);
+	m_pShaderModuleCache = pGraphicSystem->GetShaderModuleCache();
+	m_VsShaderModule = m_pShaderModuleCache->Acquire("Shader/vs.spv");
+	m_FsShaderModule = m_pShaderModuleCache->Acquire("Shader/fs.spv");
+	m_DepthVsShaderModule = m_pShaderModuleCache->Acquire("Shader/depth_vs.spv");
+	m_DepthMaskVsShaderModule = m_pShaderModuleCache->Acquire("Shader/depth_mask_vs.spv");
+	m_DepthFsShaderModule = m_pShaderModuleCache->Acquire("Shader/depth_fs.spv");
+	m_GBufferFsShaderModule = m_pShaderModuleCache->Acquire("Shader/gbuffer_fs.spv");
 
 	{
 		TextureManager::GetInstance().LoadTexture(&pNullTextureData, "Texture/white.png");
@@ -293,10 +308,14 @@ void Model::CreateModel(std::string textureName, const void* pVertexData, size_t
 		TextureManager::GetInstance().LoadTexture(&pIBLTextureData, "Texture/IBLTestSpecularHDR.dds");
 	}
 
+	UploadBatch uploadBatch;
+	uploadBatch.Begin(pGraphicSystem);
+
 	meshes.resize(1);
 	RenderObject* pObj = new RenderObject();
 	meshes[0].push_back(pObj);
 	pObj->SetGraphicSystem(pGraphicSystem);
+	pObj->SetUploadBatch(&uploadBatch);
 	pObj->SetGeometry(
 		pVertexData, vertexCount,
 		pIndexData, indexCount, sizeof(uint16_t),
@@ -313,18 +332,22 @@ void Model::CreateModel(std::string textureName, const void* pVertexData, size_t
 
 	pObj->SetVertexShaderModule(m_VsShaderModule);
 	pObj->SetFragmentShaderModule(m_FsShaderModule);
+	pObj->SetDepthShaderModules(m_DepthVsShaderModule, m_DepthMaskVsShaderModule, m_DepthFsShaderModule);
+	pObj->SetGBufferShaderModule(m_GBufferFsShaderModule);
 	pObj->Init();
+
+	uploadBatch.End();
 }
 void Model::CreateModel(std::string fileName, std::string textureRoot, GraphicSystem* pGraphicSystem)
 {
 	m_Device = pGraphicSystem->GetDevice();
-	std::vector<char> vsCode;
-	std::vector<char> fsCode;
-	LoadFile(vsCode, "Shader/vs.spv");
-	LoadFile(fsCode, "Shader/fs.spv");
-
-	CreateShaderModule(&m_VsShaderModule, m_Device, vsCode);
-	CreateShaderModule(&m_FsShaderModule, m_Device, fsCode);
+	m_pShaderModuleCache = pGraphicSystem->GetShaderModuleCache();
+	m_VsShaderModule = m_pShaderModuleCache->Acquire("Shader/vs.spv");
+	m_FsShaderModule = m_pShaderModuleCache->Acquire("Shader/fs.spv");
+	m_DepthVsShaderModule = m_pShaderModuleCache->Acquire("Shader/depth_vs.spv");
+	m_DepthMaskVsShaderModule = m_pShaderModuleCache->Acquire("Shader/depth_mask_vs.spv");
+	m_DepthFsShaderModule = m_pShaderModuleCache->Acquire("Shader/depth_fs.spv");
+	m_GBufferFsShaderModule = m_pShaderModuleCache->Acquire("Shader/gbuffer_fs.spv");
 
 	{
 		TextureManager::GetInstance().LoadTexture(&pNullTextureData, "Texture/white.png");
@@ -388,9 +411,12 @@ void Model::CreateModel(std::string fileName, std::string textureRoot, GraphicSy
 			pThreadObjects[i]->join();
 		}
 
+		// Every staging copy of the model goes out in as few submits as possible, the graphics queue waits on them once below
+		UploadBatch uploadBatch;
+		uploadBatch.Begin(pGraphicSystem);
 		for (uint32_t i = 0; i < model.meshes.size(); i++)
 		{
-			CreateObject(meshes[i], model, i, pGraphicSystem, textureDatas);
+			CreateObject(meshes[i], model, i, pGraphicSystem, &uploadBatch, textureDatas);
 		}
 		std::vector<Node> graphNodes(model.nodes.size());
 		for (const uint32_t sceneNode : model.scenes[0].nodes)
@@ -417,9 +443,12 @@ void Model::CreateModel(std::string fileName, std::string textureRoot, GraphicSy
 			{
 				pObj->SetVertexShaderModule(m_VsShaderModule);
 				pObj->SetFragmentShaderModule(m_FsShaderModule);
+				pObj->SetDepthShaderModules(m_DepthVsShaderModule, m_DepthMaskVsShaderModule, m_DepthFsShaderModule);
+				pObj->SetGBufferShaderModule(m_GBufferFsShaderModule);
 				pObj->Init();
 			}
 		}
+		uploadBatch.End();
 
 		for (int i = 0; i < JobCount; i++)
 		{
@@ -429,17 +458,29 @@ void Model::CreateModel(std::string fileName, std::string textureRoot, GraphicSy
 	}
 
 }
-void Model::Draw(VkCommandBuffer commandBuffer, uint32_t index)
+void Model::GatherDrawItems(DrawList* pDrawList)
 {
-	for (Mesh mesh : meshes)
+	if (!m_IsVisible)
+	{
+		return;
+	}
+	for (Mesh& mesh : meshes)
 	{
 		for (RenderObject* pObj : mesh)
 		{
-			pObj->Draw(commandBuffer, index);
+			pDrawList->Add(pObj);
 		}
 	}
 }
 
+void Model::GetRenderObjects(std::vector<RenderObject*>* pRenderObjects)
+{
+	for (Mesh& mesh : meshes)
+	{
+		pRenderObjects->insert(pRenderObjects->end(), mesh.begin(), mesh.end());
+	}
+}
+
 void Model::Update(uint32_t index)
 {
 	m_WorldTransform = glm::translate(glm::mat4(1.0f), m_Translate);// DirectX::XMMatrixTranslationFromVector(DirectX::XMLoadFloat3(&local)) *;
@@ -459,4 +500,5 @@ void Model::Update(uint32_t index)
 			pObj->Update(index);
 		}
 	}
+	m_IsTransformChanged = false;
 }
\ No newline at end of file
@@ -0,0 +1,164 @@
+#include "ParallelRecorder.h"
+
+namespace
+{
+	// Below this a chunk costs more in thread handoff and vkCmdExecuteCommands than it saves
+	const size_t MinDrawsPerChunk = 32;
+}
+
+ParallelRecorder::ParallelRecorder()
+{
+}
+
+ParallelRecorder::~ParallelRecorder()
+{
+}
+
+void ParallelRecorder::Init(VkDevice device, uint32_t queueFamilyIndex, uint32_t frameCount, uint32_t threadCount)
+{
+	m_Device = device;
+	m_ThreadCount = std::max(1u, threadCount);
+
+	m_CommandPools.resize(frameCount * m_ThreadCount);
+	m_CommandBuffers.resize(frameCount * m_ThreadCount);
+	for (size_t i = 0; i < m_CommandPools.size(); i++)
+	{
+		VkCommandPoolCreateInfo cmdPoolCreateInfo = {};
+		cmdPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		cmdPoolCreateInfo.queueFamilyIndex = queueFamilyIndex;
+		cmdPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		vkCreateCommandPool(m_Device, &cmdPoolCreateInfo, nullptr, &m_CommandPools[i]);
+
+		VkCommandBufferAllocateInfo allocCmdBufInfo = {};
+		allocCmdBufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocCmdBufInfo.commandPool = m_CommandPools[i];
+		allocCmdBufInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocCmdBufInfo.commandBufferCount = 1;
+		vkAllocateCommandBuffers(m_Device, &allocCmdBufInfo, &m_CommandBuffers[i]);
+	}
+
+	m_IsExiting = false;
+	for (uint32_t i = 0; i < m_ThreadCount; i++)
+	{
+		m_Threads.push_back(std::thread(&ParallelRecorder::WorkerMain, this, i));
+	}
+}
+
+void ParallelRecorder::Finalize()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_IsExiting = true;
+	}
+	m_StartCondition.notify_all();
+	for (std::thread& thread : m_Threads)
+	{
+		thread.join();
+	}
+	m_Threads.clear();
+
+	for (VkCommandPool commandPool : m_CommandPools)
+	{
+		vkDestroyCommandPool(m_Device, commandPool, nullptr);
+	}
+	m_CommandPools.clear();
+	m_CommandBuffers.clear();
+}
+
+void ParallelRecorder::Record(
+	VkCommandBuffer primaryCommandBuffer,
+	uint32_t frameIndex,
+	VkRenderPass renderPass,
+	VkFramebuffer framebuffer,
+	DrawList* pDrawList,
+	const std::function<void(VkCommandBuffer)>& beginCommands)
+{
+	size_t drawCount = pDrawList->GetRecordCount();
+	uint32_t chunkCount = static_cast<uint32_t>(std::min<size_t>(m_ThreadCount, (drawCount + MinDrawsPerChunk - 1) / MinDrawsPerChunk));
+	chunkCount = std::max(1u, chunkCount);
+
+	for (uint32_t i = 0; i < m_ThreadCount; i++)
+	{
+		vkResetCommandPool(m_Device, m_CommandPools[frameIndex * m_ThreadCount + i], 0);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_FrameIndex = frameIndex;
+		m_RenderPass = renderPass;
+		m_Framebuffer = framebuffer;
+		m_pDrawList = pDrawList;
+		m_pBeginCommands = &beginCommands;
+		m_ChunkCount = chunkCount;
+		m_ChunkSize = (drawCount + chunkCount - 1) / chunkCount;
+		m_PendingCount = chunkCount;
+		m_Generation++;
+	}
+	m_StartCondition.notify_all();
+
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_DoneCondition.wait(lock, [this] { return m_PendingCount == 0; });
+	}
+
+	vkCmdExecuteCommands(primaryCommandBuffer, chunkCount, &m_CommandBuffers[frameIndex * m_ThreadCount]);
+}
+
+void ParallelRecorder::WorkerMain(uint32_t threadIndex)
+{
+	uint64_t seenGeneration = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_StartCondition.wait(lock, [&] { return m_IsExiting || m_Generation != seenGeneration; });
+			if (m_IsExiting)
+			{
+				return;
+			}
+			seenGeneration = m_Generation;
+			if (threadIndex >= m_ChunkCount)
+			{
+				continue;
+			}
+		}
+
+		RecordChunk(threadIndex);
+
+		bool isLast = false;
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_PendingCount--;
+			isLast = m_PendingCount == 0;
+		}
+		if (isLast)
+		{
+			m_DoneCondition.notify_one();
+		}
+	}
+}
+
+void ParallelRecorder::RecordChunk(uint32_t threadIndex)
+{
+	VkCommandBuffer commandBuffer = m_CommandBuffers[m_FrameIndex * m_ThreadCount + threadIndex];
+
+	VkCommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = m_RenderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = m_Framebuffer;
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	beginInfo.pInheritanceInfo = &inheritanceInfo;
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	(*m_pBeginCommands)(commandBuffer);
+
+	size_t begin = threadIndex * m_ChunkSize;
+	size_t end = std::min(begin + m_ChunkSize, m_pDrawList->GetRecordCount());
+	m_pDrawList->Record(commandBuffer, m_FrameIndex, begin, end);
+
+	vkEndCommandBuffer(commandBuffer);
+}
@@ -0,0 +1,171 @@
+#include "PipelineCache.h"
+#include "FileReader.h"
+
+namespace
+{
+	const uint32_t PipelineCacheMagic = 0x48434c50; // "PLCH"
+	const uint32_t PipelineCacheFileVersion = 1;
+}
+
+PipelineCache::PipelineCache()
+{
+}
+
+PipelineCache::~PipelineCache()
+{
+}
+
+void PipelineCache::Init(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& path)
+{
+	m_Device = device;
+	m_Path = path;
+	vkGetPhysicalDeviceProperties(physicalDevice, &m_DeviceProperties);
+
+	std::vector<char> cacheData;
+	m_Stats.isLoadedFromDisk = !m_Path.empty() && Load(cacheData);
+	m_Stats.loadedBytes = cacheData.size();
+
+	VkPipelineCacheCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	createInfo.initialDataSize = cacheData.size();
+	createInfo.pInitialData = cacheData.empty() ? nullptr : cacheData.data();
+
+	VkResult result = vkCreatePipelineCache(m_Device, &createInfo, nullptr, &m_PipelineCache);
+	if (result != VK_SUCCESS && !cacheData.empty())
+	{
+		// The driver refused the blob after all, start cold rather than without a cache
+		printf("pipeline cache: driver rejected %s, starting empty\n", m_Path.c_str());
+		createInfo.initialDataSize = 0;
+		createInfo.pInitialData = nullptr;
+		m_Stats.isLoadedFromDisk = false;
+		m_Stats.loadedBytes = 0;
+		vkCreatePipelineCache(m_Device, &createInfo, nullptr, &m_PipelineCache);
+	}
+}
+
+void PipelineCache::Finalize()
+{
+	if (!m_Path.empty())
+	{
+		Save();
+	}
+	vkDestroyPipelineCache(m_Device, m_PipelineCache, nullptr);
+	m_PipelineCache = VK_NULL_HANDLE;
+}
+
+bool PipelineCache::Load(std::vector<char>& cacheData)
+{
+	std::vector<char> fileData;
+	if (!LoadFile(fileData, m_Path) || fileData.size() < sizeof(PipelineCacheFileHeader))
+	{
+		return false;
+	}
+
+	PipelineCacheFileHeader header;
+	std::memcpy(&header, fileData.data(), sizeof(header));
+
+	bool isValid =
+		header.magic == PipelineCacheMagic &&
+		header.version == PipelineCacheFileVersion &&
+		header.dataSize == fileData.size() - sizeof(header) &&
+		header.vendorID == m_DeviceProperties.vendorID &&
+		header.deviceID == m_DeviceProperties.deviceID &&
+		header.driverVersion == m_DeviceProperties.driverVersion &&
+		std::memcmp(header.pipelineCacheUUID, m_DeviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+	if (!isValid)
+	{
+		printf("pipeline cache: %s was written by another device or driver, ignoring it\n", m_Path.c_str());
+		return false;
+	}
+
+	cacheData.assign(fileData.begin() + sizeof(header), fileData.end());
+	return true;
+}
+
+void PipelineCache::Save()
+{
+	size_t dataSize = 0;
+	vkGetPipelineCacheData(m_Device, m_PipelineCache, &dataSize, nullptr);
+	std::vector<char> cacheData(dataSize);
+	if (dataSize == 0 || vkGetPipelineCacheData(m_Device, m_PipelineCache, &dataSize, cacheData.data()) != VK_SUCCESS)
+	{
+		return;
+	}
+
+	PipelineCacheFileHeader header = {};
+	header.magic = PipelineCacheMagic;
+	header.version = PipelineCacheFileVersion;
+	header.dataSize = static_cast<uint32_t>(dataSize);
+	header.vendorID = m_DeviceProperties.vendorID;
+	header.deviceID = m_DeviceProperties.deviceID;
+	header.driverVersion = m_DeviceProperties.driverVersion;
+	std::memcpy(header.pipelineCacheUUID, m_DeviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+
+	// Write next to the target and swap it in, a crash mid-write must not leave a truncated cache behind
+	std::string tempPath = m_Path + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+		{
+			return;
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(cacheData.data(), dataSize);
+		if (!file.good())
+		{
+			return;
+		}
+	}
+	std::remove(m_Path.c_str());
+	std::rename(tempPath.c_str(), m_Path.c_str());
+}
+
+VkResult PipelineCache::CreateGraphicsPipeline(const VkGraphicsPipelineCreateInfo* pCreateInfo, VkPipeline* pPipeline)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+	VkResult result = vkCreateGraphicsPipelines(m_Device, m_PipelineCache, 1, pCreateInfo, nullptr, pPipeline);
+	auto endTime = std::chrono::high_resolution_clock::now();
+
+	double createMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+	{
+		std::lock_guard<std::mutex> lock(m_StatsMutex);
+		m_Stats.pipelineCount++;
+		m_Stats.totalCreateMs += createMs;
+		m_Stats.maxCreateMs = std::max(m_Stats.maxCreateMs, createMs);
+	}
+	return result;
+}
+
+VkResult PipelineCache::CreateComputePipeline(const VkComputePipelineCreateInfo* pCreateInfo, VkPipeline* pPipeline)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+	VkResult result = vkCreateComputePipelines(m_Device, m_PipelineCache, 1, pCreateInfo, nullptr, pPipeline);
+	auto endTime = std::chrono::high_resolution_clock::now();
+
+	double createMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+	{
+		std::lock_guard<std::mutex> lock(m_StatsMutex);
+		m_Stats.pipelineCount++;
+		m_Stats.totalCreateMs += createMs;
+		m_Stats.maxCreateMs = std::max(m_Stats.maxCreateMs, createMs);
+	}
+	return result;
+}
+
+PipelineCacheStats PipelineCache::GetStats()
+{
+	std::lock_guard<std::mutex> lock(m_StatsMutex);
+	return m_Stats;
+}
+
+void PipelineCache::PrintStats()
+{
+	PipelineCacheStats stats = GetStats();
+	printf("pipeline cache: %s (%zu bytes), %u pipelines created in %.2f ms (avg %.3f ms, max %.3f ms)\n",
+		stats.isLoadedFromDisk ? "warm" : "cold",
+		stats.loadedBytes,
+		stats.pipelineCount,
+		stats.totalCreateMs,
+		stats.pipelineCount > 0 ? stats.totalCreateMs / stats.pipelineCount : 0.0,
+		stats.maxCreateMs);
+}
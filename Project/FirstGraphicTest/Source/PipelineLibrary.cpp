@@ -0,0 +1,349 @@
+#include "PipelineLibrary.h"
+
+namespace
+{
+	uint64_t HashBindings(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+	{
+		uint64_t hash = HashBytes(nullptr, 0);
+		for (const VkDescriptorSetLayoutBinding& binding : bindings)
+		{
+			hash = HashBytes(&binding.binding, sizeof(binding.binding), hash);
+			hash = HashBytes(&binding.descriptorType, sizeof(binding.descriptorType), hash);
+			hash = HashBytes(&binding.descriptorCount, sizeof(binding.descriptorCount), hash);
+			hash = HashBytes(&binding.stageFlags, sizeof(binding.stageFlags), hash);
+		}
+		return hash;
+	}
+
+	bool IsSameBindings(const std::vector<VkDescriptorSetLayoutBinding>& a, const std::vector<VkDescriptorSetLayoutBinding>& b)
+	{
+		if (a.size() != b.size())
+		{
+			return false;
+		}
+		for (size_t i = 0; i < a.size(); i++)
+		{
+			if (a[i].binding != b[i].binding ||
+				a[i].descriptorType != b[i].descriptorType ||
+				a[i].descriptorCount != b[i].descriptorCount ||
+				a[i].stageFlags != b[i].stageFlags)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+PipelineLibrary::PipelineLibrary()
+{
+}
+
+PipelineLibrary::~PipelineLibrary()
+{
+}
+
+void PipelineLibrary::Init(VkDevice device, PipelineCache* pPipelineCache)
+{
+	m_Device = device;
+	m_pPipelineCache = pPipelineCache;
+}
+
+void PipelineLibrary::Finalize()
+{
+	for (auto& bucket : m_Pipelines)
+	{
+		for (PipelineEntry& entry : bucket.second)
+		{
+			vkDestroyPipeline(m_Device, entry.pipeline, nullptr);
+		}
+	}
+	for (auto& bucket : m_ComputePipelines)
+	{
+		for (ComputePipelineEntry& entry : bucket.second)
+		{
+			vkDestroyPipeline(m_Device, entry.pipeline, nullptr);
+		}
+	}
+	for (auto& bucket : m_PipelineLayouts)
+	{
+		for (PipelineLayoutEntry& entry : bucket.second)
+		{
+			vkDestroyPipelineLayout(m_Device, entry.layout, nullptr);
+		}
+	}
+	for (auto& bucket : m_DescriptorSetLayouts)
+	{
+		for (DescriptorSetLayoutEntry& entry : bucket.second)
+		{
+			vkDestroyDescriptorSetLayout(m_Device, entry.layout, nullptr);
+		}
+	}
+	m_Pipelines.clear();
+	m_ComputePipelines.clear();
+	m_PipelineLayouts.clear();
+	m_DescriptorSetLayouts.clear();
+}
+
+VkDescriptorSetLayout PipelineLibrary::GetDescriptorSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+{
+	// Binding order does not change the layout, textures are added in whatever order the material lists them
+	std::vector<VkDescriptorSetLayoutBinding> sortedBindings = bindings;
+	std::sort(sortedBindings.begin(), sortedBindings.end(),
+		[](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) { return a.binding < b.binding; });
+
+	std::vector<DescriptorSetLayoutEntry>& bucket = m_DescriptorSetLayouts[HashBindings(sortedBindings)];
+	for (DescriptorSetLayoutEntry& entry : bucket)
+	{
+		if (IsSameBindings(entry.bindings, sortedBindings))
+		{
+			return entry.layout;
+		}
+	}
+	if (!bucket.empty())
+	{
+		m_Stats.hashCollisionCount++;
+	}
+
+	DescriptorSetLayoutEntry entry;
+	entry.bindings = sortedBindings;
+	entry.layout = VK_NULL_HANDLE;
+	CreateDescriptorSetLayout(&entry.layout, sortedBindings, m_Device);
+	bucket.push_back(entry);
+	m_Stats.descriptorSetLayoutCount++;
+	return entry.layout;
+}
+
+VkPipelineLayout PipelineLibrary::GetPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts)
+{
+	std::vector<PipelineLayoutEntry>& bucket = m_PipelineLayouts[HashBytes(setLayouts.data(), setLayouts.size() * sizeof(VkDescriptorSetLayout))];
+	for (PipelineLayoutEntry& entry : bucket)
+	{
+		if (entry.setLayouts == setLayouts)
+		{
+			return entry.layout;
+		}
+	}
+	if (!bucket.empty())
+	{
+		m_Stats.hashCollisionCount++;
+	}
+
+	VkPipelineLayoutCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	createInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+	createInfo.pSetLayouts = setLayouts.data();
+	createInfo.pushConstantRangeCount = 0;
+	createInfo.pPushConstantRanges = nullptr;
+
+	PipelineLayoutEntry entry;
+	entry.setLayouts = setLayouts;
+	entry.layout = VK_NULL_HANDLE;
+	vkCreatePipelineLayout(m_Device, &createInfo, nullptr, &entry.layout);
+	bucket.push_back(entry);
+	m_Stats.pipelineLayoutCount++;
+	return entry.layout;
+}
+
+VkPipeline PipelineLibrary::GetGraphicsPipeline(const GraphicsPipelineDesc& desc, uint32_t* pPipelineId)
+{
+	m_Stats.pipelineRequestCount++;
+
+	std::vector<PipelineEntry>& bucket = m_Pipelines[HashBytes(&desc, sizeof(desc))];
+	for (PipelineEntry& entry : bucket)
+	{
+		if (std::memcmp(&entry.desc, &desc, sizeof(desc)) == 0)
+		{
+			if (pPipelineId != nullptr)
+			{
+				*pPipelineId = entry.id;
+			}
+			return entry.pipeline;
+		}
+	}
+	if (!bucket.empty())
+	{
+		m_Stats.hashCollisionCount++;
+	}
+
+	PipelineEntry entry;
+	entry.desc = desc;
+	entry.pipeline = CreateGraphicsPipeline(desc);
+	entry.id = m_Stats.pipelineCount;
+	bucket.push_back(entry);
+	m_Stats.pipelineCount++;
+	if (pPipelineId != nullptr)
+	{
+		*pPipelineId = entry.id;
+	}
+	return entry.pipeline;
+}
+
+VkPipeline PipelineLibrary::GetComputePipeline(const ComputePipelineDesc& desc)
+{
+	m_Stats.pipelineRequestCount++;
+
+	std::vector<ComputePipelineEntry>& bucket = m_ComputePipelines[HashBytes(&desc, sizeof(desc))];
+	for (ComputePipelineEntry& entry : bucket)
+	{
+		if (std::memcmp(&entry.desc, &desc, sizeof(desc)) == 0)
+		{
+			return entry.pipeline;
+		}
+	}
+	if (!bucket.empty())
+	{
+		m_Stats.hashCollisionCount++;
+	}
+
+	ComputePipelineEntry entry;
+	entry.desc = desc;
+	entry.pipeline = CreateComputePipeline(desc);
+	bucket.push_back(entry);
+	m_Stats.pipelineCount++;
+	return entry.pipeline;
+}
+
+VkPipeline PipelineLibrary::CreateGraphicsPipeline(const GraphicsPipelineDesc& desc)
+{
+	VkPipelineShaderStageCreateInfo shaderStages[2];
+
+	VkSpecializationMapEntry mapEntries[2];
+	mapEntries[0].constantID = 0;
+	mapEntries[0].offset = 0;
+	mapEntries[0].size = sizeof(uint32_t);
+	mapEntries[1].constantID = 1;
+	mapEntries[1].offset = sizeof(uint32_t);
+	mapEntries[1].size = sizeof(uint32_t);
+
+	uint32_t pData[] = { desc.vertexAttributeFlags, desc.textureAttributeFlags };
+
+	VkSpecializationInfo specializationInfo = {};
+	specializationInfo.mapEntryCount = 2;
+	specializationInfo.pMapEntries = mapEntries;
+	specializationInfo.dataSize = sizeof(pData);
+	specializationInfo.pData = pData;
+
+	CreateShaderStage(&shaderStages[0], desc.vertexShaderModule, VK_SHADER_STAGE_VERTEX_BIT, &specializationInfo);
+	CreateShaderStage(&shaderStages[1], desc.fragmentShaderModule, VK_SHADER_STAGE_FRAGMENT_BIT, &specializationInfo);
+
+	std::vector<VkVertexInputBindingDescription> bindingDescriptions = { Vertex::GetBindingDescription(0) };
+	std::vector<VkVertexInputAttributeDescription> attributeDescriptions = Vertex::GetAttributeDescription(0);
+	if (desc.vertexLayout != VERTEX_LAYOUT_FULL)
+	{
+		bool isUvRead = desc.vertexLayout == VERTEX_LAYOUT_DEPTH_MASKED;
+		bindingDescriptions = DepthVertex::GetBindingDescriptions(isUvRead);
+		attributeDescriptions = DepthVertex::GetAttributeDescriptions(isUvRead);
+	}
+	VkPipelineVertexInputStateCreateInfo vertexInputState = {};
+	CreateVertexInputState(&vertexInputState, &bindingDescriptions, &attributeDescriptions);
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = {};
+	CreateInputAssemblyState(&inputAssemblyState);
+
+	VkViewport viewport = {};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = static_cast<float>(desc.viewportWidth);
+	viewport.height = static_cast<float>(desc.viewportHeight);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+
+	VkRect2D scissor = {};
+	scissor.offset = { 0,0 };
+	scissor.extent = { desc.viewportWidth, desc.viewportHeight };
+	VkPipelineViewportStateCreateInfo viewportState = {};
+	CreateViewportState(&viewportState, &viewport, &scissor);
+
+	VkPipelineRasterizationStateCreateInfo rasterizationState = {};
+	CreateRasterizationState(&rasterizationState);
+	rasterizationState.cullMode = desc.cullMode;
+	rasterizationState.frontFace = static_cast<VkFrontFace>(desc.frontFace);
+
+	VkPipelineMultisampleStateCreateInfo multisampleState = {};
+	CreateMultisampleState(&multisampleState);
+
+	VkPipelineDepthStencilStateCreateInfo depthStencilState = {};
+	CreateDepthStencilState(&depthStencilState);
+	depthStencilState.depthTestEnable = desc.isDepthTestEnabled;
+	depthStencilState.depthWriteEnable = desc.isDepthWriteEnabled;
+	depthStencilState.depthCompareOp = static_cast<VkCompareOp>(desc.depthCompareOp);
+
+	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+	CreateColorBlendAttachmentState(&colorBlendAttachment);
+	colorBlendAttachment.blendEnable = desc.isBlendEnabled;
+	colorBlendAttachment.colorWriteMask = desc.colorWriteMask;
+	std::vector<VkPipelineColorBlendAttachmentState> colorBlendAttachments(desc.colorAttachmentCount, colorBlendAttachment);
+
+	VkPipelineColorBlendStateCreateInfo colorBlendState = {};
+	CreateColorBlendState(&colorBlendState, colorBlendAttachments.data());
+	colorBlendState.attachmentCount = desc.colorAttachmentCount;
+
+	VkGraphicsPipelineCreateInfo pipelinCreateInfo = {};
+	pipelinCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelinCreateInfo.stageCount = desc.fragmentShaderModule != VK_NULL_HANDLE ? 2 : 1;
+	pipelinCreateInfo.pStages = shaderStages;
+	pipelinCreateInfo.pVertexInputState = &vertexInputState;
+	pipelinCreateInfo.pInputAssemblyState = &inputAssemblyState;
+	pipelinCreateInfo.pViewportState = &viewportState;
+	pipelinCreateInfo.pRasterizationState = &rasterizationState;
+	pipelinCreateInfo.pMultisampleState = &multisampleState;
+	pipelinCreateInfo.pDepthStencilState = &depthStencilState;
+	pipelinCreateInfo.pTessellationState = nullptr;
+	pipelinCreateInfo.pColorBlendState = &colorBlendState;
+	pipelinCreateInfo.pDynamicState = nullptr;
+
+	pipelinCreateInfo.layout = desc.pipelineLayout;
+	pipelinCreateInfo.renderPass = desc.renderPass;
+	pipelinCreateInfo.subpass = desc.subpass;
+
+	pipelinCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelinCreateInfo.basePipelineIndex = -1;
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkResult result = m_pPipelineCache->CreateGraphicsPipeline(&pipelinCreateInfo, &pipeline);
+	if (result != VK_SUCCESS)
+	{
+		printf("### ERROR ### PipelineLibrary : vkCreateGraphicsPipelines failed (%d)\n", result);
+	}
+	return pipeline;
+}
+
+VkPipeline PipelineLibrary::CreateComputePipeline(const ComputePipelineDesc& desc)
+{
+	VkSpecializationMapEntry mapEntry;
+	mapEntry.constantID = 0;
+	mapEntry.offset = 0;
+	mapEntry.size = sizeof(uint32_t);
+
+	VkSpecializationInfo specializationInfo = {};
+	specializationInfo.mapEntryCount = 1;
+	specializationInfo.pMapEntries = &mapEntry;
+	specializationInfo.dataSize = sizeof(uint32_t);
+	specializationInfo.pData = &desc.specialization;
+
+	VkComputePipelineCreateInfo pipelineCreateInfo = {};
+	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	CreateShaderStage(&pipelineCreateInfo.stage, desc.shaderModule, VK_SHADER_STAGE_COMPUTE_BIT, &specializationInfo);
+	pipelineCreateInfo.layout = desc.pipelineLayout;
+	pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelineCreateInfo.basePipelineIndex = -1;
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkResult result = m_pPipelineCache->CreateComputePipeline(&pipelineCreateInfo, &pipeline);
+	if (result != VK_SUCCESS)
+	{
+		printf("### ERROR ### PipelineLibrary : vkCreateComputePipelines failed (%d)\n", result);
+	}
+	return pipeline;
+}
+
+void PipelineLibrary::PrintStats()
+{
+	printf("pipeline library: %u requests -> %u pipelines, %u pipeline layouts, %u descriptor set layouts, %u hash collisions\n",
+		m_Stats.pipelineRequestCount,
+		m_Stats.pipelineCount,
+		m_Stats.pipelineLayoutCount,
+		m_Stats.descriptorSetLayoutCount,
+		m_Stats.hashCollisionCount);
+}
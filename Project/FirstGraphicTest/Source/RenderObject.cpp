@@ -8,6 +8,18 @@ RenderObject::RenderObject()
 	m_WorldMtx = glm::mat4(1);
 
 	m_IsDoubleSided = false;
+	m_pUploadBatch = nullptr;
+	m_PipelineId = 0;
+	m_MaterialId = 0;
+	m_DepthVertexShaderModule = VK_NULL_HANDLE;
+	m_DepthMaskVertexShaderModule = VK_NULL_HANDLE;
+	m_DepthFragmentShaderModule = VK_NULL_HANDLE;
+	m_DepthPipeline = VK_NULL_HANDLE;
+	m_EqualPipeline = VK_NULL_HANDLE;
+	m_GBufferFragmentShaderModule = VK_NULL_HANDLE;
+	m_GBufferPipeline = VK_NULL_HANDLE;
+	m_VertexAttributeFlags = 0;
+	m_TextureAttributeFlags = 0;
 }
 
 
@@ -22,10 +34,13 @@ void RenderObject::SetGraphicSystem(GraphicSystem* pGraphicSystem)
 	m_PhysicalDevice = pGraphicSystem->GetPhysicalDevice();
 }
 
+void RenderObject::SetUploadBatch(UploadBatch* pUploadBatch)
+{
+	m_pUploadBatch = pUploadBatch;
+}
+
 void RenderObject::Finalize()
 {
-	m_UniformBufferDescriptor.Finalize();
-	m_LightInfosDescriptor.Finalize();
 	m_VertexBuffer.Finalize();
 	for (TextureDescriptor* pTexDescriptor : m_TextureDescriptors)
 	{
@@ -35,27 +50,20 @@ void RenderObject::Finalize()
 		}
 	}
 
-	vkDestroyDescriptorPool(m_Device, m_DescriptorPool, nullptr);
-
-	vkDestroyDescriptorSetLayout(m_Device, m_DescriptorSetLayout, nullptr);
-	vkDestroyPipelineLayout(m_Device, m_PipelineLayout, nullptr);
-	vkDestroyPipeline(m_Device, m_Pipeline, nullptr);
+	// Layouts and pipeline belong to the PipelineLibrary, other objects may share them
+	m_pGraphicSystem->GetDeletionQueue()->DestroyDescriptorPool(m_DescriptorPool);
 }
 
 void RenderObject::Init()
 {
-	uint32_t swapChainCount = m_pGraphicSystem->GetSwapChainCount();
 	VkExtent2D extent = m_pGraphicSystem->GetSwapChainExtent();
 	VkRenderPass renderPass = m_pGraphicSystem->GetRenderPass();
 
 	m_UniformBufferDescriptor.Init(m_pGraphicSystem, 0, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
 
-	m_LightInfosDescriptor.Init(m_pGraphicSystem, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
-
 	std::vector<VkDescriptorSetLayoutBinding> bindings = 
 	{ 
-		m_UniformBufferDescriptor.uniformBinding,
-		m_LightInfosDescriptor.uniformBinding
+		m_UniformBufferDescriptor.uniformBinding
 	};
 
 	for (TextureDescriptor* pTexDescriptor : m_TextureDescriptors)
@@ -63,21 +71,24 @@ void RenderObject::Init()
 		bindings.push_back(pTexDescriptor->textureBinding);
 	}
 
-	CreateDescriptorSetLayout(&m_DescriptorSetLayout, bindings, m_Device);
+	PipelineLibrary* pPipelineLibrary = m_pGraphicSystem->GetPipelineLibrary();
+	m_DescriptorSetLayout = pPipelineLibrary->GetDescriptorSetLayout(bindings);
 
-	std::vector<VkDescriptorSetLayout> layouts(swapChainCount, m_DescriptorSetLayout);
+	// Set 1 only holds per-object data. Textures never change and the uniform slot picks its frame through the dynamic offset,
+	// so a single set serves every frame
+	std::vector<VkDescriptorSetLayout> layouts(1, m_DescriptorSetLayout);
 
 	VkDescriptorPoolSize uniformDescriptorPoolSize = {};
 	VkDescriptorPoolSize samplerDescriptorPoolSize = {};
-	CreateDescriptorPoolSize(&uniformDescriptorPoolSize, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, swapChainCount);
-	CreateDescriptorPoolSize(&samplerDescriptorPoolSize, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, swapChainCount);
+	CreateDescriptorPoolSize(&uniformDescriptorPoolSize, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1);
+	CreateDescriptorPoolSize(&samplerDescriptorPoolSize, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, std::max(1u, static_cast<uint32_t>(m_TextureDescriptors.size())));
 
 	std::vector<VkDescriptorPoolSize> poolSizes = { uniformDescriptorPoolSize , samplerDescriptorPoolSize };
 
 	m_DescriptorPool = {};
-	CreateDescriptorPool(&m_DescriptorPool, m_Device, poolSizes, swapChainCount);
+	CreateDescriptorPool(&m_DescriptorPool, m_Device, poolSizes, 1);
 
-	m_DescriptorSets.resize(swapChainCount);
+	m_DescriptorSets.resize(1);
 	m_DescriptorSetAlocateInfo = {};
 	m_DescriptorSetAlocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	m_DescriptorSetAlocateInfo.descriptorPool = m_DescriptorPool;
@@ -86,102 +97,71 @@ void RenderObject::Init()
 
 	VkResult result = vkAllocateDescriptorSets(m_Device, &m_DescriptorSetAlocateInfo, m_DescriptorSets.data());
 
-	m_UniformBufferDescriptor.uniformBuffer.CreateUniformBuffer(m_Device, m_PhysicalDevice, nullptr, sizeof(UniformData), swapChainCount, 0, m_DescriptorSets);
-
-	m_LightInfosDescriptor.uniformBuffer.CreateUniformBuffer(m_Device, m_PhysicalDevice, nullptr, sizeof(LightInfosUniform), swapChainCount, 1, m_DescriptorSets);
+	UniformArena* pUniformArena = m_pGraphicSystem->GetUniformArena();
+	pUniformArena->AllocateSlot(sizeof(UniformData), &m_UniformBufferDescriptor.slot);
+	m_UniformBufferDescriptor.Bind(m_Device, m_DescriptorSets, pUniformArena);
 
 	//-----------------------------------------------------------------------
 
-	CreatePipelineLayout(&m_PipelineLayout, m_Device, &m_DescriptorSetLayout);
+	m_PipelineLayout = pPipelineLibrary->GetPipelineLayout({ LightManager::GetInstance().GetDescriptorSetLayout(), m_DescriptorSetLayout });
 
 	//-----------------------------------------------------------------------
 
-	VkPipelineShaderStageCreateInfo shaderStages[2]; 
-
-	specializationMapEntry.constantID = 0;
-	specializationMapEntry.offset = 0;
-	specializationMapEntry.size = sizeof(uint32_t);
-
-	specializationMapEntry2.constantID = 1;
-	specializationMapEntry2.offset = sizeof(uint32_t);
-	specializationMapEntry2.size = sizeof(uint32_t);
-	VkSpecializationMapEntry mapEntries[] = { specializationMapEntry ,specializationMapEntry2 };
-
-	uint32_t pData[] = { m_VertexAttributeFlags ,m_TextureAttributeFlags };
-
-	specializationInfo.mapEntryCount = 2;
-	specializationInfo.pMapEntries = mapEntries;
-	specializationInfo.dataSize = sizeof(uint32_t) + sizeof(uint32_t);
-	specializationInfo.pData = pData;
-
-	CreateShaderStage(&shaderStages[0], m_VertexShaderModule, VK_SHADER_STAGE_VERTEX_BIT, &specializationInfo);
-	CreateShaderStage(&shaderStages[1], m_FragmentShaderModule, VK_SHADER_STAGE_FRAGMENT_BIT, &specializationInfo);
-
-	auto bindingDescription = Vertex::GetBindingDescription(0);
-	auto attributeDescriptions = Vertex::GetAttributeDescription(0);
-	VkPipelineVertexInputStateCreateInfo vertexInputState = {};
-	CreateVertexInputState(&vertexInputState, &bindingDescription, &attributeDescriptions);
-
-	VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = {};
-	CreateInputAssemblyState(&inputAssemblyState);
-
-	VkViewport viewport = {};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = static_cast<float>(extent.width);
-	viewport.height = static_cast<float>(extent.height);
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
+	GraphicsPipelineDesc pipelineDesc;
+	pipelineDesc.vertexShaderModule = m_VertexShaderModule;
+	pipelineDesc.fragmentShaderModule = m_FragmentShaderModule;
+	pipelineDesc.pipelineLayout = m_PipelineLayout;
+	pipelineDesc.renderPass = renderPass;
+	pipelineDesc.vertexShaderHash = m_pGraphicSystem->GetShaderModuleCache()->GetContentHash(m_VertexShaderModule);
+	pipelineDesc.fragmentShaderHash = m_pGraphicSystem->GetShaderModuleCache()->GetContentHash(m_FragmentShaderModule);
+	pipelineDesc.vertexAttributeFlags = m_VertexAttributeFlags;
+	pipelineDesc.textureAttributeFlags = m_TextureAttributeFlags;
+	pipelineDesc.cullMode = m_IsDoubleSided ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
+	// Blended surfaces are drawn after everything opaque and must not hide each other
+	bool isBlended = GetBlendMode() == BLENDMODE_BLEND;
+	pipelineDesc.isBlendEnabled = isBlended ? VK_TRUE : VK_FALSE;
+	pipelineDesc.isDepthWriteEnabled = isBlended ? VK_FALSE : VK_TRUE;
+	pipelineDesc.viewportWidth = extent.width;
+	pipelineDesc.viewportHeight = extent.height;
+
+	m_Pipeline = pPipelineLibrary->GetGraphicsPipeline(pipelineDesc, &m_PipelineId);
+
+	// Opaque surfaces write depth without a fragment stage, masked ones run the alpha test and nothing else
+	bool isMasked = GetBlendMode() == BLENDMODE_MASK;
+	VkShaderModule depthVertexShaderModule = isMasked ? m_DepthMaskVertexShaderModule : m_DepthVertexShaderModule;
+	if (!isBlended && depthVertexShaderModule != VK_NULL_HANDLE && (!isMasked || m_DepthFragmentShaderModule != VK_NULL_HANDLE))
+	{
+		GraphicsPipelineDesc depthDesc = pipelineDesc;
+		depthDesc.vertexShaderModule = depthVertexShaderModule;
+		depthDesc.fragmentShaderModule = isMasked ? m_DepthFragmentShaderModule : VK_NULL_HANDLE;
+		depthDesc.vertexShaderHash = m_pGraphicSystem->GetShaderModuleCache()->GetContentHash(depthDesc.vertexShaderModule);
+		depthDesc.fragmentShaderHash = isMasked ? m_pGraphicSystem->GetShaderModuleCache()->GetContentHash(depthDesc.fragmentShaderModule) : 0;
+		depthDesc.colorWriteMask = 0;
+		depthDesc.vertexLayout = isMasked ? VERTEX_LAYOUT_DEPTH_MASKED : VERTEX_LAYOUT_DEPTH;
+		m_DepthPipeline = pPipelineLibrary->GetGraphicsPipeline(depthDesc);
+
+		GraphicsPipelineDesc equalDesc = pipelineDesc;
+		equalDesc.isDepthWriteEnabled = VK_FALSE;
+		equalDesc.depthCompareOp = VK_COMPARE_OP_EQUAL;
+		m_EqualPipeline = pPipelineLibrary->GetGraphicsPipeline(equalDesc);
+	}
 
-	VkRect2D scissor = {};
-	scissor.offset = { 0,0 };
-	scissor.extent = extent;
-	VkPipelineViewportStateCreateInfo viewportState = {};
-	CreateViewportState(&viewportState, &viewport, &scissor);
+	if (!isBlended && m_GBufferFragmentShaderModule != VK_NULL_HANDLE)
+	{
+		GraphicsPipelineDesc gbufferDesc = pipelineDesc;
+		gbufferDesc.fragmentShaderModule = m_GBufferFragmentShaderModule;
+		gbufferDesc.fragmentShaderHash = m_pGraphicSystem->GetShaderModuleCache()->GetContentHash(m_GBufferFragmentShaderModule);
+		gbufferDesc.renderPass = m_pGraphicSystem->GetGBufferRenderPass();
+		gbufferDesc.colorAttachmentCount = GBUFFER_ATTACHMENT_COUNT;
+		m_GBufferPipeline = pPipelineLibrary->GetGraphicsPipeline(gbufferDesc);
+	}
 
-	VkPipelineRasterizationStateCreateInfo rasterizationState = {};
-	CreateRasterizationState(&rasterizationState);
-	if (m_IsDoubleSided)
+	uint64_t materialHash = HashBytes(&m_TextureAttributeFlags, sizeof(m_TextureAttributeFlags));
+	for (TextureDescriptor* pTexDescriptor : m_TextureDescriptors)
 	{
-		rasterizationState.cullMode = VK_CULL_MODE_NONE;
+		materialHash = HashBytes(&pTexDescriptor->pSourceData, sizeof(pTexDescriptor->pSourceData), materialHash);
 	}
-	
-	VkPipelineMultisampleStateCreateInfo multisampleState = {};
-	CreateMultisampleState(&multisampleState);
-
-	VkPipelineDepthStencilStateCreateInfo depthStencilState = {};
-	CreateDepthStencilState(&depthStencilState);
-
-	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
-	CreateColorBlendAttachmentState(&colorBlendAttachment);
-
-	VkPipelineColorBlendStateCreateInfo colorBlendState = {};
-	CreateColorBlendState(&colorBlendState, &colorBlendAttachment);
-
-	VkPipelineDynamicStateCreateInfo dynamicState = {};
-	CreateDynamicState(&dynamicState);
-	VkGraphicsPipelineCreateInfo pipelinCreateInfo = {};
-	pipelinCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipelinCreateInfo.stageCount = 2;
-	pipelinCreateInfo.pStages = shaderStages;
-	pipelinCreateInfo.pVertexInputState = &vertexInputState;
-	pipelinCreateInfo.pInputAssemblyState = &inputAssemblyState;
-	pipelinCreateInfo.pViewportState = &viewportState;
-	pipelinCreateInfo.pRasterizationState = &rasterizationState;
-	pipelinCreateInfo.pMultisampleState = &multisampleState;
-	pipelinCreateInfo.pDepthStencilState = &depthStencilState;
-	pipelinCreateInfo.pTessellationState = nullptr;
-	pipelinCreateInfo.pColorBlendState = &colorBlendState;
-	pipelinCreateInfo.pDynamicState = nullptr;// &dynamicState;
-
-	pipelinCreateInfo.layout = m_PipelineLayout;
-	pipelinCreateInfo.renderPass = renderPass;
-	pipelinCreateInfo.subpass = 0;
-
-	pipelinCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
-	pipelinCreateInfo.basePipelineIndex = -1;
-
-	result = vkCreateGraphicsPipelines(m_Device, VK_NULL_HANDLE, 1, &pipelinCreateInfo, nullptr, &m_Pipeline);
+	m_MaterialId = static_cast<uint32_t>(materialHash ^ (materialHash >> 32));
 
 	//--------------------------------------------------------
 
@@ -196,6 +176,18 @@ void RenderObject::SetGeometry(const void* pVertexData, size_t vertexCount, cons
 	m_VertexCount = vertexCount;
 	m_IndexCount = indexCount;
 
+	const Vertex* pVertices = static_cast<const Vertex*>(pVertexData);
+	if (vertexCount > 0)
+	{
+		m_LocalBounds.min = pVertices[0].pos;
+		m_LocalBounds.max = pVertices[0].pos;
+	}
+	for (size_t i = 1; i < vertexCount; i++)
+	{
+		m_LocalBounds.min = glm::min(m_LocalBounds.min, pVertices[i].pos);
+		m_LocalBounds.max = glm::max(m_LocalBounds.max, pVertices[i].pos);
+	}
+
 	VkIndexType indexType = VK_INDEX_TYPE_UINT16;
 	switch (indexStride)
 	{
@@ -212,21 +204,21 @@ void RenderObject::SetGeometry(const void* pVertexData, size_t vertexCount, cons
 		break;
 	}
 
-	m_VertexBuffer.CreateVertexBuffer(m_pGraphicSystem, pVertexData, m_VertexCount * sizeof(Vertex));
-	m_VertexBuffer.CreateIndexBuffer(m_pGraphicSystem, pIndexData, m_IndexCount * indexStride, indexType);
+	m_VertexBuffer.CreateVertexBuffer(m_pGraphicSystem, m_pUploadBatch, pVertexData, m_VertexCount * sizeof(Vertex));
+	m_VertexBuffer.CreateIndexBuffer(m_pGraphicSystem, m_pUploadBatch, pIndexData, m_IndexCount * indexStride, indexType);
 	m_VertexAttributeFlags = vertexAttributeFlag;
 }
 
 void RenderObject::SetDiffuseTexture(int width, int height, int mipLevels, void* pTexData, size_t texDataSize, uint32_t textureAttributeFlags)
 {
-	m_DiffuseTextureDescriptor.Init(m_pGraphicSystem, width, height, 1, mipLevels, 32, VK_FORMAT_R8G8B8A8_SRGB, pTexData, texDataSize, TextureBindingOffset + 0);
+	m_DiffuseTextureDescriptor.Init(m_pGraphicSystem, m_pUploadBatch, width, height, 1, mipLevels, 32, VK_FORMAT_R8G8B8A8_SRGB, pTexData, texDataSize, TextureBindingOffset + 0);
 	m_TextureDescriptors.push_back(&m_DiffuseTextureDescriptor);
 	m_TextureAttributeFlags |= textureAttributeFlags;
 }
 
 void RenderObject::SetDiffuseTexture(TextureData* textureData, uint32_t textureAttributeFlags)
 {
-	m_DiffuseTextureDescriptor.Init(m_pGraphicSystem,
+	m_DiffuseTextureDescriptor.Init(m_pGraphicSystem, m_pUploadBatch,
 		textureData->width,
 		textureData->height,
 		textureData->faceCount,
@@ -242,14 +234,14 @@ void RenderObject::SetDiffuseTexture(TextureData* textureData, uint32_t textureA
 
 void RenderObject::SetNormalTexture(int width, int height, int mipLevels, void* pTexData, size_t texDataSize, uint32_t textureAttributeFlags)
 {
-	m_NormalTextureDescriptor.Init(m_pGraphicSystem, width, height, 1, mipLevels, 32, VK_FORMAT_R8G8B8A8_UNORM, pTexData, texDataSize, TextureBindingOffset + 1);
+	m_NormalTextureDescriptor.Init(m_pGraphicSystem, m_pUploadBatch, width, height, 1, mipLevels, 32, VK_FORMAT_R8G8B8A8_UNORM, pTexData, texDataSize, TextureBindingOffset + 1);
 	m_TextureDescriptors.push_back(&m_NormalTextureDescriptor);
 	m_TextureAttributeFlags |= textureAttributeFlags;
 }
 
 void RenderObject::SetNormalTexture(TextureData* textureData, uint32_t textureAttributeFlags)
 {
-	m_NormalTextureDescriptor.Init(m_pGraphicSystem,
+	m_NormalTextureDescriptor.Init(m_pGraphicSystem, m_pUploadBatch,
 		textureData->width,
 		textureData->height,
 		textureData->faceCount,
@@ -265,7 +257,7 @@ void RenderObject::SetNormalTexture(TextureData* textureData, uint32_t textureAt
 
 void RenderObject::SetMetallicRoughnessTexture(int width, int height, int mipLevels, void* pTexData, size_t texDataSize, uint32_t textureAttributeFlags)
 {
-	m_MetallicRoughnessTextureDescriptor.Init(m_pGraphicSystem, width, height, 1, mipLevels, 32, VK_FORMAT_R8G8B8A8_UNORM, pTexData, texDataSize, TextureBindingOffset + 2);
+	m_MetallicRoughnessTextureDescriptor.Init(m_pGraphicSystem, m_pUploadBatch, width, height, 1, mipLevels, 32, VK_FORMAT_R8G8B8A8_UNORM, pTexData, texDataSize, TextureBindingOffset + 2);
 	m_TextureDescriptors.push_back(&m_MetallicRoughnessTextureDescriptor);
 	m_TextureAttributeFlags |= textureAttributeFlags;
 }
@@ -274,6 +266,7 @@ void RenderObject::SetMetallicRoughnessTexture(TextureData* textureData, uint32_
 {
 	m_MetallicRoughnessTextureDescriptor.Init(
 		m_pGraphicSystem,
+		m_pUploadBatch,
 		textureData->width,
 		textureData->height,
 		textureData->faceCount,
@@ -289,7 +282,7 @@ void RenderObject::SetMetallicRoughnessTexture(TextureData* textureData, uint32_
 
 void RenderObject::SetEmissiveTexture(int width, int height, int mipLevels, void* pTexData, size_t texDataSize, uint32_t textureAttributeFlags)
 {
-	m_EmissiveTextureDescriptor.Init(m_pGraphicSystem, width, height, 1, mipLevels, 32, VK_FORMAT_R8G8B8A8_UNORM, pTexData, texDataSize, TextureBindingOffset + 3);
+	m_EmissiveTextureDescriptor.Init(m_pGraphicSystem, m_pUploadBatch, width, height, 1, mipLevels, 32, VK_FORMAT_R8G8B8A8_UNORM, pTexData, texDataSize, TextureBindingOffset + 3);
 	m_TextureDescriptors.push_back(&m_EmissiveTextureDescriptor);
 	m_TextureAttributeFlags |= textureAttributeFlags;
 }
@@ -298,6 +291,7 @@ void RenderObject::SetEmissiveTexture(TextureData* textureData, uint32_t texture
 {
 	m_EmissiveTextureDescriptor.Init(
 		m_pGraphicSystem,
+		m_pUploadBatch,
 		textureData->width,
 		textureData->height,
 		textureData->faceCount,
@@ -313,7 +307,7 @@ void RenderObject::SetEmissiveTexture(TextureData* textureData, uint32_t texture
 
 void RenderObject::SetOcclusionTexture(int width, int height, int mipLevels, void* pTexData, size_t texDataSize, uint32_t textureAttributeFlags)
 {
-	m_OcclusionTextureDescriptor.Init(m_pGraphicSystem, width, height, 1, mipLevels, 32, VK_FORMAT_R8G8B8A8_UNORM, pTexData, texDataSize, TextureBindingOffset + 4);
+	m_OcclusionTextureDescriptor.Init(m_pGraphicSystem, m_pUploadBatch, width, height, 1, mipLevels, 32, VK_FORMAT_R8G8B8A8_UNORM, pTexData, texDataSize, TextureBindingOffset + 4);
 	m_TextureDescriptors.push_back(&m_OcclusionTextureDescriptor);
 	m_TextureAttributeFlags |= textureAttributeFlags;
 }
@@ -328,6 +322,7 @@ void RenderObject::SetOcclusionTexture(TextureData* textureData, uint32_t textur
 
 	m_OcclusionTextureDescriptor.Init(
 		m_pGraphicSystem,
+		m_pUploadBatch,
 		textureData->width,
 		textureData->height,
 		textureData->faceCount,
@@ -343,14 +338,14 @@ void RenderObject::SetOcclusionTexture(TextureData* textureData, uint32_t textur
 
 void RenderObject::SetDfgTexture(int width, int height, int mipLevels, void* pTexData, size_t texDataSize, uint32_t textureAttributeFlags)
 {
-	m_DfgTextureDescriptor.Init(m_pGraphicSystem, width, height, 1, mipLevels, 32, VK_FORMAT_R8G8B8A8_UNORM, pTexData, texDataSize, TextureBindingOffset + 7);
+	m_DfgTextureDescriptor.Init(m_pGraphicSystem, m_pUploadBatch, width, height, 1, mipLevels, 32, VK_FORMAT_R8G8B8A8_UNORM, pTexData, texDataSize, TextureBindingOffset + 7);
 	m_TextureDescriptors.push_back(&m_DfgTextureDescriptor);
 	m_TextureAttributeFlags |= textureAttributeFlags;
 }
 
 void RenderObject::SetDfgTexture(TextureData* textureData, uint32_t textureAttributeFlags)
 {
-	m_DfgTextureDescriptor.Init(m_pGraphicSystem,
+	m_DfgTextureDescriptor.Init(m_pGraphicSystem, m_pUploadBatch,
 		textureData->width,
 		textureData->height,
 		textureData->faceCount,
@@ -366,14 +361,14 @@ void RenderObject::SetDfgTexture(TextureData* textureData, uint32_t textureAttri
 
 void RenderObject::SetIBLTexture(int width, int height, int mipLevels, void* pTexData, size_t texDataSize, uint32_t textureAttributeFlags)
 {
-	m_IBLTextureDescriptor.Init(m_pGraphicSystem, width, height, 1, mipLevels, 32, VK_FORMAT_R8G8B8A8_UNORM, pTexData, texDataSize, TextureBindingOffset + 8);
+	m_IBLTextureDescriptor.Init(m_pGraphicSystem, m_pUploadBatch, width, height, 1, mipLevels, 32, VK_FORMAT_R8G8B8A8_UNORM, pTexData, texDataSize, TextureBindingOffset + 8);
 	m_TextureDescriptors.push_back(&m_IBLTextureDescriptor);
 	m_TextureAttributeFlags |= textureAttributeFlags;
 }
 
 void RenderObject::SetIBLTexture(TextureData* textureData, uint32_t textureAttributeFlags)
 {
-	m_IBLTextureDescriptor.Init(m_pGraphicSystem,
+	m_IBLTextureDescriptor.Init(m_pGraphicSystem, m_pUploadBatch,
 		textureData->width,
 		textureData->height,
 		textureData->faceCount,
@@ -396,39 +391,126 @@ void RenderObject::SetFragmentShaderModule(VkShaderModule shaderModule)
 {
 	m_FragmentShaderModule = shaderModule;
 }
+void RenderObject::SetDepthShaderModules(VkShaderModule vertexShaderModule, VkShaderModule maskVertexShaderModule, VkShaderModule maskFragmentShaderModule)
+{
+	m_DepthVertexShaderModule = vertexShaderModule;
+	m_DepthMaskVertexShaderModule = maskVertexShaderModule;
+	m_DepthFragmentShaderModule = maskFragmentShaderModule;
+}
+void RenderObject::SetGBufferShaderModule(VkShaderModule fragmentShaderModule)
+{
+	m_GBufferFragmentShaderModule = fragmentShaderModule;
+}
+
+Texture* RenderObject::GetTexture(TextureAttributeFlag slot)
+{
+	TextureDescriptor* pTexDescriptor = nullptr;
+	switch (slot)
+	{
+	case DIFFUSE_TEX:
+		pTexDescriptor = &m_DiffuseTextureDescriptor;
+		break;
+	case NORMAL_TEX:
+		pTexDescriptor = &m_NormalTextureDescriptor;
+		break;
+	case METALLICROUGHNESS_TEX:
+		pTexDescriptor = &m_MetallicRoughnessTextureDescriptor;
+		break;
+	case EMISSIVE_TEX:
+		pTexDescriptor = &m_EmissiveTextureDescriptor;
+		break;
+	case OCCLUSION_TEX:
+		pTexDescriptor = &m_OcclusionTextureDescriptor;
+		break;
+	case DFG_TEX:
+		pTexDescriptor = &m_DfgTextureDescriptor;
+		break;
+	case IBL_TEX:
+		pTexDescriptor = &m_IBLTextureDescriptor;
+		break;
+	default:
+		break;
+	}
+	if (pTexDescriptor == nullptr || !pTexDescriptor->isInitialized)
+	{
+		return nullptr;
+	}
+	return &pTexDescriptor->texture;
+}
 
 void RenderObject::Update(uint32_t index)
 {
 	m_UniformData.modelMtx = m_WorldMtx * m_ModelMtx;
+	m_WorldBounds = TransformBoundingBox(m_LocalBounds, m_UniformData.modelMtx);
 	m_UniformData.viewMtx = m_pGraphicSystem->GetCamera().viewMtx;
 	m_UniformData.projMtx = m_pGraphicSystem->GetCamera().projMtx;
 
 	m_UniformData.cameraPos = glm::vec4(m_pGraphicSystem->GetCamera().cameraPos, 1.0);
 
-	m_UniformBufferDescriptor.uniformBuffer.UpdateUniformBuffer(m_Device, &m_UniformData, sizeof(UniformData), index);
-
+	m_pGraphicSystem->GetUniformArena()->Write(m_UniformBufferDescriptor.slot, index, &m_UniformData, sizeof(UniformData));
+}
+void RenderObject::Draw(VkCommandBuffer commandBuffer, uint32_t index, DrawBindState* pBindState, DrawPass pass)
+{
+	VkPipeline pipeline = m_Pipeline;
+	if (pass == DRAW_PASS_DEPTH)
+	{
+		if (m_DepthPipeline == VK_NULL_HANDLE)
+		{
+			return;
+		}
+		pipeline = m_DepthPipeline;
+	}
+	else if (pass == DRAW_PASS_COLOR_EQUAL && m_EqualPipeline != VK_NULL_HANDLE)
+	{
+		pipeline = m_EqualPipeline;
+	}
+	else if (pass == DRAW_PASS_GBUFFER)
+	{
+		if (m_GBufferPipeline == VK_NULL_HANDLE)
+		{
+			return;
+		}
+		pipeline = m_GBufferPipeline;
+	}
 
-	m_LightInfosData.lightCount.x = static_cast<float>(LightManager::GetInstance().GetLightCount());
-	for (int i = 0; i < m_LightInfosData.lightCount.x; i++)
+	if (pBindState->pipeline != pipeline)
 	{
-		Light* pLight = LightManager::GetInstance().GetLight(i);
-		LightInfo& info = m_LightInfosData.lightInfos[i];
-		info.lightColor = pLight->GetLightColorIntensity();
-		info.LightDir = glm::vec4(pLight->GetLightDir(), 1.0f);
-		info.LightPos = glm::vec4(pLight->GetLightPos(), 1.0f);
-		info.lightInfo.x = pLight->GetLightRange();
-		info.lightInfo.y = pLight->GetInnerConeAngleCos();
-		info.lightInfo.z = pLight->GetOuterConeAngleCos();
-		info.lightInfo.w = pLight->GetLightType();
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+		pBindState->pipeline = pipeline;
 	}
-	m_LightInfosDescriptor.uniformBuffer.UpdateUniformBuffer(m_Device, &m_LightInfosData, sizeof(LightInfosUniform), index);
-}
-void RenderObject::Draw(VkCommandBuffer commandBuffer, uint32_t index)
-{
-	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_Pipeline);
-	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineLayout, 0, 1, &m_DescriptorSets[index], 0, nullptr);
-	VkDeviceSize offsets[] = { 0 };
-	vkCmdBindVertexBuffers(commandBuffer, 0, 1, m_VertexBuffer.GetVertexBuffer(), offsets);
-	vkCmdBindIndexBuffer(commandBuffer, *m_VertexBuffer.GetIndexBuffer(), 0, m_VertexBuffer.GetIndexType());
-	vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(m_IndexCount), 1, 0, 0, 0);
+	// Set 0 (lights) is bound once per frame by LightManager. Set 1 is per object, its uniform slot differs every draw
+	uint32_t dynamicOffset = m_pGraphicSystem->GetUniformArena()->GetDynamicOffset(m_UniformBufferDescriptor.slot, index);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineLayout, 1, 1, &m_DescriptorSets[0], 1, &dynamicOffset);
+	int32_t vertexOffset = m_VertexBuffer.GetVertexOffset();
+	if (pass == DRAW_PASS_DEPTH)
+	{
+		// Both streams of the depth block, the uv one is only read by masked materials
+		VkBuffer depthVertexBuffer = m_VertexBuffer.GetDepthVertexBuffer();
+		if (pBindState->vertexBuffer != depthVertexBuffer)
+		{
+			VkBuffer buffers[] = { depthVertexBuffer, depthVertexBuffer };
+			VkDeviceSize offsets[] = { 0, m_VertexBuffer.GetDepthUvStreamOffset() };
+			vkCmdBindVertexBuffers(commandBuffer, 0, 2, buffers, offsets);
+			pBindState->vertexBuffer = depthVertexBuffer;
+		}
+		vertexOffset = m_VertexBuffer.GetDepthVertexOffset();
+	}
+	else
+	{
+		VkBuffer vertexBuffer = m_VertexBuffer.GetVertexBuffer();
+		if (pBindState->vertexBuffer != vertexBuffer)
+		{
+			VkDeviceSize offsets[] = { 0 };
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, offsets);
+			pBindState->vertexBuffer = vertexBuffer;
+		}
+	}
+	VkBuffer indexBuffer = m_VertexBuffer.GetIndexBuffer();
+	if (pBindState->indexBuffer != indexBuffer || pBindState->indexType != m_VertexBuffer.GetIndexType())
+	{
+		vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, m_VertexBuffer.GetIndexType());
+		pBindState->indexBuffer = indexBuffer;
+		pBindState->indexType = m_VertexBuffer.GetIndexType();
+	}
+	vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(m_IndexCount), 1, m_VertexBuffer.GetFirstIndex(), vertexOffset, 0);
 }
\ No newline at end of file
@@ -0,0 +1,577 @@
+#include "SceneBvh.h"
+
+#include <cfloat>
+#include <functional>
+#include <thread>
+
+namespace
+{
+	const uint32_t InvalidIndex = 0xFFFFFFFF;
+	const uint32_t BinCount = 16;
+	const uint32_t MaxLeafSize = 4;
+	// SAH cost of visiting a node relative to testing one primitive box
+	const float TraversalCost = 1.0f;
+	// Smaller subtrees are not worth a thread of their own, neither is refitting a scene smaller than this
+	const uint32_t ParallelThreshold = 4096;
+
+	BoundingBox EmptyBox()
+	{
+		BoundingBox box;
+		box.min = glm::vec3(FLT_MAX);
+		box.max = glm::vec3(-FLT_MAX);
+		return box;
+	}
+
+	void Grow(BoundingBox* pBox, const BoundingBox& other)
+	{
+		pBox->min = glm::min(pBox->min, other.min);
+		pBox->max = glm::max(pBox->max, other.max);
+	}
+
+	float SurfaceArea(const BoundingBox& box)
+	{
+		glm::vec3 extent = glm::max(box.max - box.min, glm::vec3(0.0f));
+		return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+	}
+
+	bool IsOutside(const BoundingBox& box, const glm::vec4& plane)
+	{
+		float distance = std::max(plane.x * box.min.x, plane.x * box.max.x)
+			+ std::max(plane.y * box.min.y, plane.y * box.max.y)
+			+ std::max(plane.z * box.min.z, plane.z * box.max.z)
+			+ plane.w;
+		return distance < 0.0f;
+	}
+
+	bool IsInside(const BoundingBox& box, const glm::vec4& plane)
+	{
+		float distance = std::min(plane.x * box.min.x, plane.x * box.max.x)
+			+ std::min(plane.y * box.min.y, plane.y * box.max.y)
+			+ std::min(plane.z * box.min.z, plane.z * box.max.z)
+			+ plane.w;
+		return distance >= 0.0f;
+	}
+
+	// Entry distance of the ray into the box, FLT_MAX on a miss
+	float IntersectRay(const BoundingBox& box, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance)
+	{
+		glm::vec3 t0 = (box.min - origin) * inverseDirection;
+		glm::vec3 t1 = (box.max - origin) * inverseDirection;
+		glm::vec3 tNear = glm::min(t0, t1);
+		glm::vec3 tFar = glm::max(t0, t1);
+		float entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+		float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+		return entry <= exit ? entry : FLT_MAX;
+	}
+
+	bool IsTouchingSphere(const BoundingBox& box, const glm::vec3& center, float radius)
+	{
+		glm::vec3 closest = glm::clamp(center, box.min, box.max);
+		glm::vec3 offset = closest - center;
+		return glm::dot(offset, offset) <= radius * radius;
+	}
+}
+
+SceneBvh::SceneBvh()
+	: m_NodeCount(0)
+	, m_MaxDepth(0)
+{
+}
+
+SceneBvh::~SceneBvh()
+{
+}
+
+void SceneBvh::Init(uint32_t threadCount)
+{
+	m_ThreadCount = std::max(1u, threadCount);
+	m_MaxParallelDepth = 0;
+	while ((1u << m_MaxParallelDepth) < m_ThreadCount)
+	{
+		m_MaxParallelDepth++;
+	}
+}
+
+void SceneBvh::Finalize()
+{
+	m_Nodes.clear();
+	m_PrimitiveBounds.clear();
+	m_PrimitiveIndices.clear();
+	m_PrimitiveLeaves.clear();
+	m_DirtyLeaves.clear();
+	m_IsNodeDirty.clear();
+}
+
+void SceneBvh::Build(const std::vector<BoundingBox>& primitiveBounds)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	uint32_t primitiveCount = static_cast<uint32_t>(primitiveBounds.size());
+	m_PrimitiveBounds = primitiveBounds;
+	m_PrimitiveIndices.resize(primitiveCount);
+	m_PrimitiveLeaves.assign(primitiveCount, InvalidIndex);
+	std::vector<glm::vec3> centroids(primitiveCount);
+	for (uint32_t i = 0; i < primitiveCount; i++)
+	{
+		m_PrimitiveIndices[i] = i;
+		centroids[i] = (primitiveBounds[i].min + primitiveBounds[i].max) * 0.5f;
+	}
+
+	// A binary tree with at least one primitive per leaf never has more than 2n - 1 nodes
+	m_Nodes.resize(std::max(1u, 2 * primitiveCount));
+	m_Nodes[0].parent = InvalidIndex;
+	m_NodeCount = 1;
+	m_MaxDepth = 0;
+	BuildNode(0, 0, primitiveCount, 0, centroids);
+	m_Nodes.resize(m_NodeCount);
+
+	m_DirtyLeaves.clear();
+	m_IsNodeDirty.assign(m_Nodes.size(), 0);
+
+	auto endTime = std::chrono::high_resolution_clock::now();
+	m_Stats.primitiveCount = primitiveCount;
+	m_Stats.nodeCount = static_cast<uint32_t>(m_Nodes.size());
+	m_Stats.leafCount = 0;
+	for (const Node& node : m_Nodes)
+	{
+		m_Stats.leafCount += node.primitiveCount > 0 ? 1 : 0;
+	}
+	m_Stats.maxDepth = m_MaxDepth;
+	m_Stats.buildTimeMs = std::chrono::duration<float, std::milli>(endTime - startTime).count();
+}
+
+void SceneBvh::BuildNode(uint32_t nodeIndex, uint32_t begin, uint32_t end, uint32_t depth, const std::vector<glm::vec3>& centroids)
+{
+	// m_Nodes is sized up front, references stay valid while other threads take their children
+	Node& node = m_Nodes[nodeIndex];
+
+	uint32_t previousMaxDepth = m_MaxDepth;
+	while (depth > previousMaxDepth && !m_MaxDepth.compare_exchange_weak(previousMaxDepth, depth))
+	{
+	}
+
+	BoundingBox centroidBounds = EmptyBox();
+	node.bounds = EmptyBox();
+	for (uint32_t i = begin; i < end; i++)
+	{
+		uint32_t primitive = m_PrimitiveIndices[i];
+		Grow(&node.bounds, m_PrimitiveBounds[primitive]);
+		centroidBounds.min = glm::min(centroidBounds.min, centroids[primitive]);
+		centroidBounds.max = glm::max(centroidBounds.max, centroids[primitive]);
+	}
+
+	uint32_t count = end - begin;
+	if (count <= 1)
+	{
+		MakeLeaf(nodeIndex, begin, end);
+		return;
+	}
+
+	// Binned SAH over all three axes
+	glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+	int bestAxis = -1;
+	uint32_t bestSplit = 0;
+	float bestCost = FLT_MAX;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (extent[axis] <= 0.0f)
+		{
+			continue;
+		}
+
+		BoundingBox binBounds[BinCount];
+		uint32_t binCounts[BinCount] = {};
+		for (uint32_t bin = 0; bin < BinCount; bin++)
+		{
+			binBounds[bin] = EmptyBox();
+		}
+		float scale = BinCount / extent[axis];
+		for (uint32_t i = begin; i < end; i++)
+		{
+			uint32_t primitive = m_PrimitiveIndices[i];
+			uint32_t bin = std::min(BinCount - 1, static_cast<uint32_t>((centroids[primitive][axis] - centroidBounds.min[axis]) * scale));
+			Grow(&binBounds[bin], m_PrimitiveBounds[primitive]);
+			binCounts[bin]++;
+		}
+
+		// rightArea[i] / rightCount[i] cover bins [i, BinCount)
+		float rightArea[BinCount];
+		uint32_t rightCount[BinCount];
+		BoundingBox accumulated = EmptyBox();
+		uint32_t accumulatedCount = 0;
+		for (uint32_t bin = BinCount - 1; bin > 0; bin--)
+		{
+			Grow(&accumulated, binBounds[bin]);
+			accumulatedCount += binCounts[bin];
+			rightArea[bin] = SurfaceArea(accumulated);
+			rightCount[bin] = accumulatedCount;
+		}
+
+		accumulated = EmptyBox();
+		accumulatedCount = 0;
+		for (uint32_t split = 1; split < BinCount; split++)
+		{
+			Grow(&accumulated, binBounds[split - 1]);
+			accumulatedCount += binCounts[split - 1];
+			if (accumulatedCount == 0 || rightCount[split] == 0)
+			{
+				continue;
+			}
+			float cost = SurfaceArea(accumulated) * accumulatedCount + rightArea[split] * rightCount[split];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = split;
+			}
+		}
+	}
+
+	uint32_t middle = begin + count / 2;
+	if (bestAxis >= 0)
+	{
+		float nodeArea = SurfaceArea(node.bounds);
+		if (count <= MaxLeafSize && TraversalCost * nodeArea + bestCost >= nodeArea * count)
+		{
+			MakeLeaf(nodeIndex, begin, end);
+			return;
+		}
+
+		float axisMin = centroidBounds.min[bestAxis];
+		float scale = BinCount / extent[bestAxis];
+		uint32_t* pMiddle = std::partition(m_PrimitiveIndices.data() + begin, m_PrimitiveIndices.data() + end,
+			[&](uint32_t primitive)
+			{
+				uint32_t bin = std::min(BinCount - 1, static_cast<uint32_t>((centroids[primitive][bestAxis] - axisMin) * scale));
+				return bin < bestSplit;
+			});
+		middle = static_cast<uint32_t>(pMiddle - m_PrimitiveIndices.data());
+	}
+	else if (count <= MaxLeafSize)
+	{
+		// Every centroid in the same spot, no split can separate them
+		MakeLeaf(nodeIndex, begin, end);
+		return;
+	}
+
+	uint32_t children = m_NodeCount.fetch_add(2);
+	node.first = children;
+	node.primitiveCount = 0;
+	m_Nodes[children].parent = nodeIndex;
+	m_Nodes[children + 1].parent = nodeIndex;
+
+	if (depth < m_MaxParallelDepth && count >= ParallelThreshold)
+	{
+		std::thread worker(&SceneBvh::BuildNode, this, children, begin, middle, depth + 1, std::cref(centroids));
+		BuildNode(children + 1, middle, end, depth + 1, centroids);
+		worker.join();
+	}
+	else
+	{
+		BuildNode(children, begin, middle, depth + 1, centroids);
+		BuildNode(children + 1, middle, end, depth + 1, centroids);
+	}
+}
+
+void SceneBvh::MakeLeaf(uint32_t nodeIndex, uint32_t begin, uint32_t end)
+{
+	Node& node = m_Nodes[nodeIndex];
+	node.first = begin;
+	node.primitiveCount = end - begin;
+	for (uint32_t i = begin; i < end; i++)
+	{
+		m_PrimitiveLeaves[m_PrimitiveIndices[i]] = nodeIndex;
+	}
+}
+
+void SceneBvh::SetPrimitiveBounds(uint32_t primitive, const BoundingBox& bounds)
+{
+	m_PrimitiveBounds[primitive] = bounds;
+	uint32_t leaf = m_PrimitiveLeaves[primitive];
+	if (!m_IsNodeDirty[leaf])
+	{
+		m_IsNodeDirty[leaf] = 1;
+		m_DirtyLeaves.push_back(leaf);
+	}
+}
+
+void SceneBvh::Refit()
+{
+	if (m_DirtyLeaves.empty())
+	{
+		return;
+	}
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	if (m_DirtyLeaves.size() * 4 > m_Stats.leafCount)
+	{
+		// Most of the tree moved, one bottom up pass over everything is cheaper than walking every path
+		bool isParallel = m_PrimitiveBounds.size() >= ParallelThreshold;
+		RefitNode(0, isParallel ? m_MaxParallelDepth : 0);
+		for (uint32_t leaf : m_DirtyLeaves)
+		{
+			m_IsNodeDirty[leaf] = 0;
+		}
+	}
+	else
+	{
+		std::vector<uint32_t>& dirtyNodes = m_DirtyLeaves;
+		for (size_t i = 0; i < dirtyNodes.size(); i++)
+		{
+			uint32_t parent = m_Nodes[dirtyNodes[i]].parent;
+			if (parent != InvalidIndex && !m_IsNodeDirty[parent])
+			{
+				m_IsNodeDirty[parent] = 1;
+				dirtyNodes.push_back(parent);
+			}
+		}
+		// Children are always allocated after their parent, descending indices visit every child before its parent
+		std::sort(dirtyNodes.begin(), dirtyNodes.end(), std::greater<uint32_t>());
+		for (uint32_t nodeIndex : dirtyNodes)
+		{
+			UpdateNodeBounds(nodeIndex);
+			m_IsNodeDirty[nodeIndex] = 0;
+		}
+	}
+	m_DirtyLeaves.clear();
+
+	auto endTime = std::chrono::high_resolution_clock::now();
+	m_Stats.refitTimeMs = std::chrono::duration<float, std::milli>(endTime - startTime).count();
+}
+
+void SceneBvh::RefitNode(uint32_t nodeIndex, uint32_t parallelDepth)
+{
+	const Node& node = m_Nodes[nodeIndex];
+	if (node.primitiveCount == 0)
+	{
+		if (parallelDepth > 0)
+		{
+			std::thread worker(&SceneBvh::RefitNode, this, node.first, parallelDepth - 1);
+			RefitNode(node.first + 1, parallelDepth - 1);
+			worker.join();
+		}
+		else
+		{
+			RefitNode(node.first, 0);
+			RefitNode(node.first + 1, 0);
+		}
+	}
+	UpdateNodeBounds(nodeIndex);
+}
+
+void SceneBvh::UpdateNodeBounds(uint32_t nodeIndex)
+{
+	Node& node = m_Nodes[nodeIndex];
+	node.bounds = EmptyBox();
+	if (node.primitiveCount == 0)
+	{
+		Grow(&node.bounds, m_Nodes[node.first].bounds);
+		Grow(&node.bounds, m_Nodes[node.first + 1].bounds);
+		return;
+	}
+	for (uint32_t i = node.first; i < node.first + node.primitiveCount; i++)
+	{
+		Grow(&node.bounds, m_PrimitiveBounds[m_PrimitiveIndices[i]]);
+	}
+}
+
+void SceneBvh::CullFrustum(const glm::mat4& viewProjMtx, std::vector<uint32_t>* pPrimitives)
+{
+	m_Stats.visitedNodeCount = 0;
+	if (m_PrimitiveBounds.empty())
+	{
+		return;
+	}
+
+	glm::vec4 planes[6];
+	ExtractFrustumPlanes(viewProjMtx, planes);
+
+	// Pairs of node index and the mask of planes the node's parent was not completely inside of
+	const uint32_t AllPlanes = (1 << 6) - 1;
+	m_TraversalStack.clear();
+	m_TraversalStack.push_back(0);
+	m_TraversalStack.push_back(AllPlanes);
+	while (!m_TraversalStack.empty())
+	{
+		uint32_t planeMask = m_TraversalStack.back();
+		m_TraversalStack.pop_back();
+		uint32_t nodeIndex = m_TraversalStack.back();
+		m_TraversalStack.pop_back();
+		const Node& node = m_Nodes[nodeIndex];
+		m_Stats.visitedNodeCount++;
+
+		bool isOutside = false;
+		for (uint32_t plane = 0; plane < 6 && !isOutside; plane++)
+		{
+			if ((planeMask & (1 << plane)) == 0)
+			{
+				continue;
+			}
+			isOutside = IsOutside(node.bounds, planes[plane]);
+			if (IsInside(node.bounds, planes[plane]))
+			{
+				planeMask &= ~(1 << plane);
+			}
+		}
+		if (isOutside)
+		{
+			continue;
+		}
+
+		if (planeMask == 0)
+		{
+			AppendSubtree(nodeIndex, pPrimitives);
+		}
+		else if (node.primitiveCount > 0)
+		{
+			for (uint32_t i = node.first; i < node.first + node.primitiveCount; i++)
+			{
+				uint32_t primitive = m_PrimitiveIndices[i];
+				bool isPrimitiveOutside = false;
+				for (uint32_t plane = 0; plane < 6 && !isPrimitiveOutside; plane++)
+				{
+					isPrimitiveOutside = (planeMask & (1 << plane)) != 0 && IsOutside(m_PrimitiveBounds[primitive], planes[plane]);
+				}
+				if (!isPrimitiveOutside)
+				{
+					pPrimitives->push_back(primitive);
+				}
+			}
+		}
+		else
+		{
+			m_TraversalStack.push_back(node.first);
+			m_TraversalStack.push_back(planeMask);
+			m_TraversalStack.push_back(node.first + 1);
+			m_TraversalStack.push_back(planeMask);
+		}
+	}
+}
+
+void SceneBvh::AppendSubtree(uint32_t nodeIndex, std::vector<uint32_t>* pPrimitives)
+{
+	const Node& node = m_Nodes[nodeIndex];
+	if (node.primitiveCount == 0)
+	{
+		AppendSubtree(node.first, pPrimitives);
+		AppendSubtree(node.first + 1, pPrimitives);
+		return;
+	}
+	pPrimitives->insert(pPrimitives->end(), m_PrimitiveIndices.begin() + node.first, m_PrimitiveIndices.begin() + node.first + node.primitiveCount);
+}
+
+bool SceneBvh::RayCast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, uint32_t* pPrimitive, float* pDistance)
+{
+	m_Stats.visitedNodeCount = 0;
+	if (m_PrimitiveBounds.empty())
+	{
+		return false;
+	}
+
+	// Division by a zero component gives an infinity, which the slab test handles
+	glm::vec3 inverseDirection = 1.0f / direction;
+	float closest = maxDistance;
+	uint32_t closestPrimitive = InvalidIndex;
+
+	m_TraversalStack.clear();
+	if (IntersectRay(m_Nodes[0].bounds, origin, inverseDirection, closest) != FLT_MAX)
+	{
+		m_TraversalStack.push_back(0);
+	}
+	while (!m_TraversalStack.empty())
+	{
+		const Node& node = m_Nodes[m_TraversalStack.back()];
+		m_TraversalStack.pop_back();
+		m_Stats.visitedNodeCount++;
+
+		if (node.primitiveCount > 0)
+		{
+			for (uint32_t i = node.first; i < node.first + node.primitiveCount; i++)
+			{
+				uint32_t primitive = m_PrimitiveIndices[i];
+				float distance = IntersectRay(m_PrimitiveBounds[primitive], origin, inverseDirection, closest);
+				if (distance != FLT_MAX && (distance < closest || closestPrimitive == InvalidIndex))
+				{
+					closest = distance;
+					closestPrimitive = primitive;
+				}
+			}
+			continue;
+		}
+
+		// Nearer child on top of the stack, so it can shrink closest before the farther one is tested
+		float nearDistance = IntersectRay(m_Nodes[node.first].bounds, origin, inverseDirection, closest);
+		float farDistance = IntersectRay(m_Nodes[node.first + 1].bounds, origin, inverseDirection, closest);
+		uint32_t nearChild = node.first;
+		uint32_t farChild = node.first + 1;
+		if (farDistance < nearDistance)
+		{
+			std::swap(nearDistance, farDistance);
+			std::swap(nearChild, farChild);
+		}
+		if (farDistance != FLT_MAX)
+		{
+			m_TraversalStack.push_back(farChild);
+		}
+		if (nearDistance != FLT_MAX)
+		{
+			m_TraversalStack.push_back(nearChild);
+		}
+	}
+
+	if (closestPrimitive == InvalidIndex)
+	{
+		return false;
+	}
+	*pPrimitive = closestPrimitive;
+	*pDistance = closest;
+	return true;
+}
+
+void SceneBvh::QuerySphere(const glm::vec3& center, float radius, std::vector<uint32_t>* pPrimitives)
+{
+	m_Stats.visitedNodeCount = 0;
+	if (m_PrimitiveBounds.empty())
+	{
+		return;
+	}
+
+	m_TraversalStack.clear();
+	m_TraversalStack.push_back(0);
+	while (!m_TraversalStack.empty())
+	{
+		const Node& node = m_Nodes[m_TraversalStack.back()];
+		m_TraversalStack.pop_back();
+		m_Stats.visitedNodeCount++;
+
+		if (!IsTouchingSphere(node.bounds, center, radius))
+		{
+			continue;
+		}
+		if (node.primitiveCount == 0)
+		{
+			m_TraversalStack.push_back(node.first);
+			m_TraversalStack.push_back(node.first + 1);
+			continue;
+		}
+		for (uint32_t i = node.first; i < node.first + node.primitiveCount; i++)
+		{
+			uint32_t primitive = m_PrimitiveIndices[i];
+			if (IsTouchingSphere(m_PrimitiveBounds[primitive], center, radius))
+			{
+				pPrimitives->push_back(primitive);
+			}
+		}
+	}
+}
+
+void SceneBvh::PrintStats()
+{
+	printf("scene bvh: %u primitives, %u nodes, %u leaves, depth %u, build %.2f ms, last refit %.3f ms\n",
+		m_Stats.primitiveCount,
+		m_Stats.nodeCount,
+		m_Stats.leafCount,
+		m_Stats.maxDepth,
+		m_Stats.buildTimeMs,
+		m_Stats.refitTimeMs);
+}
@@ -0,0 +1,135 @@
+#include "ShaderModuleCache.h"
+#include "FileReader.h"
+
+namespace
+{
+	const uint32_t SpirvMagic = 0x07230203;
+}
+
+ShaderModuleCache::ShaderModuleCache()
+{
+}
+
+ShaderModuleCache::~ShaderModuleCache()
+{
+}
+
+void ShaderModuleCache::Init(VkDevice device)
+{
+	m_Device = device;
+}
+
+void ShaderModuleCache::Finalize()
+{
+	for (auto& pair : m_Entries)
+	{
+		printf("### WARNING ### ShaderModuleCache : %s still has %u references at shutdown\n", pair.second.path.c_str(), pair.second.refCount);
+		vkDestroyShaderModule(m_Device, pair.second.shaderModule, nullptr);
+	}
+	m_Entries.clear();
+	m_Modules.clear();
+}
+
+VkShaderModule ShaderModuleCache::Acquire(const std::string& path)
+{
+	m_Stats.acquireCount++;
+
+	std::vector<char> code;
+	if (!LoadFile(code, path))
+	{
+		printf("### ERROR ### ShaderModuleCache : failed to open %s\n", path.c_str());
+		return VK_NULL_HANDLE;
+	}
+
+	uint64_t contentHash = HashBytes(code.data(), code.size());
+	auto found = m_Modules.find(std::make_pair(path, contentHash));
+	if (found != m_Modules.end())
+	{
+		m_Entries[found->second].refCount++;
+		return found->second;
+	}
+
+	if (!Validate(code, path))
+	{
+		m_Stats.validationFailureCount++;
+		return VK_NULL_HANDLE;
+	}
+
+	VkShaderModule shaderModule = VK_NULL_HANDLE;
+	if (!CreateShaderModule(&shaderModule, m_Device, code))
+	{
+		printf("### ERROR ### ShaderModuleCache : vkCreateShaderModule failed for %s\n", path.c_str());
+		return VK_NULL_HANDLE;
+	}
+
+	Entry entry;
+	entry.path = path;
+	entry.contentHash = contentHash;
+	entry.shaderModule = shaderModule;
+	entry.refCount = 1;
+	m_Entries[shaderModule] = entry;
+	m_Modules[std::make_pair(path, contentHash)] = shaderModule;
+
+	m_Stats.moduleCreateCount++;
+	m_Stats.liveModuleCount++;
+	return shaderModule;
+}
+
+void ShaderModuleCache::Release(VkShaderModule shaderModule)
+{
+	auto found = m_Entries.find(shaderModule);
+	if (found == m_Entries.end())
+	{
+		return;
+	}
+
+	Entry& entry = found->second;
+	entry.refCount--;
+	if (entry.refCount > 0)
+	{
+		return;
+	}
+
+	vkDestroyShaderModule(m_Device, entry.shaderModule, nullptr);
+	m_Modules.erase(std::make_pair(entry.path, entry.contentHash));
+	m_Entries.erase(found);
+	m_Stats.liveModuleCount--;
+}
+
+uint64_t ShaderModuleCache::GetContentHash(VkShaderModule shaderModule)
+{
+	auto found = m_Entries.find(shaderModule);
+	if (found == m_Entries.end())
+	{
+		return 0;
+	}
+	return found->second.contentHash;
+}
+
+bool ShaderModuleCache::Validate(const std::vector<char>& code, const std::string& path)
+{
+	// vkCreateShaderModule requires a whole number of words, and a wrong file fed to the driver may just crash it
+	if (code.size() < sizeof(uint32_t) * 5 || code.size() % sizeof(uint32_t) != 0)
+	{
+		printf("### ERROR ### ShaderModuleCache : %s has invalid size %zu\n", path.c_str(), code.size());
+		return false;
+	}
+
+	uint32_t magic;
+	std::memcpy(&magic, code.data(), sizeof(magic));
+	if (magic != SpirvMagic)
+	{
+		printf("### ERROR ### ShaderModuleCache : %s is not SPIR-V (magic 0x%08x)\n", path.c_str(), magic);
+		return false;
+	}
+	return true;
+}
+
+void ShaderModuleCache::PrintStats()
+{
+	printf("shader modules: %u acquires -> %u modules created, %u alive, %u rejected\n",
+		m_Stats.acquireCount,
+		m_Stats.moduleCreateCount,
+		m_Stats.liveModuleCount,
+		m_Stats.validationFailureCount);
+}
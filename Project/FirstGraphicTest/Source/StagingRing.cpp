@@ -0,0 +1,123 @@
+#include "StagingRing.h"
+
+StagingRing::StagingRing()
+{
+}
+
+StagingRing::~StagingRing()
+{
+}
+
+void StagingRing::Init(VkDevice device, MemoryAllocator* pAllocator, GpuTimeline* pTimeline, VkDeviceSize size)
+{
+	m_Device = device;
+	m_pAllocator = pAllocator;
+	m_pTimeline = pTimeline;
+	m_Size = size;
+
+	CreateBuffer(
+		&m_Buffer,
+		&m_Memory,
+		m_Size,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		m_Device,
+		m_pAllocator);
+}
+
+void StagingRing::Finalize()
+{
+	while (WaitForOldest())
+	{
+	}
+	vkDestroyBuffer(m_Device, m_Buffer, nullptr);
+	m_Buffer = VK_NULL_HANDLE;
+	m_pAllocator->Free(&m_Memory);
+}
+
+bool StagingRing::Allocate(VkDeviceSize size, VkDeviceSize alignment, StagingRegion* pRegion)
+{
+	if (size >= m_Size)
+	{
+		return false;
+	}
+
+	// Recycle whatever the GPU is already done with before deciding to block
+	while (!m_InFlight.empty() && m_pTimeline->IsComplete(m_InFlight.front().timelineValue))
+	{
+		Retire(m_InFlight.front());
+		m_InFlight.pop_front();
+	}
+
+	for (;;)
+	{
+		if (m_Head == m_Tail && m_InFlight.empty())
+		{
+			m_Head = 0;
+			m_Tail = 0;
+			m_OpenStart = 0;
+		}
+
+		VkDeviceSize offset = AlignUp(m_Head, alignment);
+		bool isFound = false;
+		if (m_Head >= m_Tail)
+		{
+			if (offset + size <= m_Size)
+			{
+				isFound = true;
+			}
+			else if (size < m_Tail)
+			{
+				// The rest of the buffer is skipped and comes back when the tail passes it
+				offset = 0;
+				isFound = true;
+			}
+		}
+		else if (offset + size < m_Tail)
+		{
+			isFound = true;
+		}
+
+		if (isFound)
+		{
+			m_Head = offset + size;
+			pRegion->buffer = m_Buffer;
+			pRegion->offset = offset;
+			pRegion->pMappedData = static_cast<uint8_t*>(m_Memory.pMappedData) + offset;
+			return true;
+		}
+
+		if (!WaitForOldest())
+		{
+			return false;
+		}
+	}
+}
+
+void StagingRing::Submit(uint64_t timelineValue)
+{
+	Submission submission;
+	submission.timelineValue = timelineValue;
+	submission.end = m_Head;
+	m_InFlight.push_back(submission);
+
+	m_OpenStart = m_Head;
+}
+
+bool StagingRing::WaitForOldest()
+{
+	if (m_InFlight.empty())
+	{
+		return false;
+	}
+
+	m_pTimeline->Wait(m_InFlight.front().timelineValue);
+	Retire(m_InFlight.front());
+	m_InFlight.pop_front();
+	return true;
+}
+
+void StagingRing::Retire(const Submission& submission)
+{
+	m_Tail = submission.end;
+}
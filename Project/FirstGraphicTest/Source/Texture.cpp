@@ -13,14 +13,14 @@ Texture::~Texture()
 
 void Texture::Finalize()
 {
-	vkDestroySampler(m_Device, m_Sampler, nullptr);
-	vkDestroyImageView(m_Device, m_TextureImageView, nullptr);
-	vkDestroyImage(m_Device, m_TextureImage, nullptr);
-	vkFreeMemory(m_Device, m_TextureImageMemory, nullptr);
+	m_pDeletionQueue->DestroySampler(m_Sampler);
+	m_pDeletionQueue->DestroyImageView(m_TextureImageView);
+	m_pDeletionQueue->DestroyImage(m_TextureImage, &m_TextureImageMemory);
 }
 
 void Texture::Init(
 	GraphicSystem* pGraphicSystem,
+	UploadBatch* pUploadBatch,
 	int width, 
 	int height,
 	int layers,
@@ -32,30 +32,15 @@ void Texture::Init(
 	size_t texDataSize)
 {
 	m_Device = pGraphicSystem->GetDevice();
+	m_pMemoryAllocator = pGraphicSystem->GetMemoryAllocator();
+	m_pDeletionQueue = pGraphicSystem->GetDeletionQueue();
 	VkDevice device = pGraphicSystem->GetDevice();
-	VkPhysicalDevice physicalDevice = pGraphicSystem->GetPhysicalDevice();
-
-	VkBuffer localBuffer;
-	VkDeviceMemory localBufferMemory;
-	CreateBuffer(
-		&localBuffer,
-		&localBufferMemory,
-		texDataSize,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		device,
-		physicalDevice);
-
-	void* tempData;
-	VkResult result = vkMapMemory(device, localBufferMemory, 0, texDataSize, 0, &tempData);
-	std::memcpy(tempData, pTexData, texDataSize);
-	vkUnmapMemory(device, localBufferMemory);
 
 	// Image
 	CreateImage(
 		&m_TextureImage, 
 		&m_TextureImageMemory, 
-		device, physicalDevice, 
+		device, m_pMemoryAllocator, 
 		width, height, 
 		layers,
 		mipLevels,
@@ -64,15 +49,6 @@ void Texture::Init(
 		VK_IMAGE_TILING_OPTIMAL, 
 		VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, 
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	
-	TransitionImageLayout(
-		m_TextureImage, 
-		format,
-		layers,
-		mipLevels,
-		VK_IMAGE_LAYOUT_UNDEFINED, 
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		device, pGraphicSystem->GetCommandPool(), pGraphicSystem->GetQueues()[0]);
 
 	uint32_t bitDepth = 32;
 	if (format == VK_FORMAT_R8G8B8A8_UNORM)
@@ -87,19 +63,12 @@ void Texture::Init(
 	{
 		bitDepth = 128;
 	}
-	CopyBufferToImage(localBuffer, m_TextureImage, width, height, layers, mipLevels, bitDepth, device, pGraphicSystem->GetCommandPool(), pGraphicSystem->GetQueues()[0]);
-	
-	TransitionImageLayout(
-		m_TextureImage,
-		format,
-		layers,
-		mipLevels,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-		device, pGraphicSystem->GetCommandPool(), pGraphicSystem->GetQueues()[0]);
+	// Leaves the image in SHADER_READ_ONLY_OPTIMAL once the batch has been submitted
+	pUploadBatch->UploadImage(m_TextureImage, pTexData, texDataSize, width, height, layers, mipLevels, bitDepth);
 
 
 	// ImageView
+	m_ViewType = viewType;
 	CreateImageView(&m_TextureImageView, m_TextureImage, viewType, device, layers, mipLevels, format, VK_IMAGE_ASPECT_COLOR_BIT);
 
 	// Sampler
@@ -120,10 +89,6 @@ void Texture::Init(
 	samplerInfo.minLod = 0;
 
 	vkCreateSampler(device, &samplerInfo, nullptr, &m_Sampler);
-
-
-	vkDestroyBuffer(device, localBuffer, nullptr);
-	vkFreeMemory(device, localBufferMemory, nullptr);
 }
 
 void Texture::Bind(std::vector<VkDescriptorSet>& descriptorSets, uint32_t binding)
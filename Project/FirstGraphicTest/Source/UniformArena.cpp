@@ -0,0 +1,69 @@
+#include "UniformArena.h"
+
+UniformArena::UniformArena()
+{
+}
+
+UniformArena::~UniformArena()
+{
+}
+
+void UniformArena::Init(VkDevice device, VkPhysicalDevice physicalDevice, MemoryAllocator* pAllocator, uint32_t frameCount, VkDeviceSize frameSize)
+{
+	m_Device = device;
+	m_pAllocator = pAllocator;
+	m_FrameCount = frameCount;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	m_Alignment = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 16);
+
+	// Every region has to start on an aligned offset too, otherwise only frame 0 would be bindable
+	m_FrameSize = AlignUp(frameSize, m_Alignment);
+
+	CreateBuffer(
+		&m_Buffer,
+		&m_Memory,
+		m_FrameSize * m_FrameCount,
+		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		m_Device,
+		m_pAllocator);
+}
+
+void UniformArena::Finalize()
+{
+	vkDestroyBuffer(m_Device, m_Buffer, nullptr);
+	m_Buffer = VK_NULL_HANDLE;
+	m_pAllocator->Free(&m_Memory);
+	m_Head = 0;
+	m_SlotCount = 0;
+}
+
+bool UniformArena::AllocateSlot(VkDeviceSize size, UniformSlot* pSlot)
+{
+	VkDeviceSize offset = AlignUp(m_Head, m_Alignment);
+	if (offset + size > m_FrameSize)
+	{
+		printf("### ERROR ### UniformArena : out of space (%llu of %llu bytes per frame used)\n",
+			static_cast<unsigned long long>(m_Head),
+			static_cast<unsigned long long>(m_FrameSize));
+		return false;
+	}
+
+	m_Head = offset + size;
+	m_SlotCount++;
+	pSlot->offset = offset;
+	pSlot->size = size;
+	return true;
+}
+
+void UniformArena::PrintStats()
+{
+	printf("uniform arena: %u slots, %llu of %llu bytes per frame used, %u frames, %llu byte alignment\n",
+		m_SlotCount,
+		static_cast<unsigned long long>(m_Head),
+		static_cast<unsigned long long>(m_FrameSize),
+		m_FrameCount,
+		static_cast<unsigned long long>(m_Alignment));
+}
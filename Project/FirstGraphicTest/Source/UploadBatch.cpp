@@ -0,0 +1,342 @@
+#include "UploadBatch.h"
+#include "GraphicSystem.h"
+
+namespace
+{
+	// Covers the 4 byte rule for buffer copies and the texel size of every format we upload
+	const VkDeviceSize StagingAlignment = 16;
+
+	// Uploaded buffers are only ever read as vertex/index data, images only by the fragment shader
+	const VkPipelineStageFlags ConsumerStages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+}
+
+UploadBatch::UploadBatch()
+{
+}
+
+UploadBatch::~UploadBatch()
+{
+}
+
+void UploadBatch::Begin(GraphicSystem* pGraphicSystem)
+{
+	m_pGraphicSystem = pGraphicSystem;
+	m_Device = pGraphicSystem->GetDevice();
+	m_pMemoryAllocator = pGraphicSystem->GetMemoryAllocator();
+	m_pStagingRing = pGraphicSystem->GetStagingRing();
+	m_pTransferTimeline = pGraphicSystem->GetTransferTimeline();
+	m_pGraphicsTimeline = pGraphicSystem->GetGraphicsTimeline();
+	m_SubmitCount = 0;
+}
+
+void UploadBatch::End()
+{
+	Submit();
+
+	if (m_Submissions.empty())
+	{
+		return;
+	}
+
+	// Graphics side of the batch: the acquire halves of the ownership transfers, or nothing at all when both queues
+	// share a family. It waits on the GPU for the last copy, reaching the value of which implies every earlier
+	// submission of the transfer queue has completed. Frames are submitted behind it on the graphics queue, so they
+	// see the uploads without the CPU waiting for anything here
+	VkCommandBuffer acquireCommandBuffer = VK_NULL_HANDLE;
+	if (!m_AcquireBufferBarriers.empty() || !m_AcquireImageBarriers.empty())
+	{
+		acquireCommandBuffer = BeginSingleTimeCommands(m_Device, m_pGraphicSystem->GetCommandPool());
+		vkCmdPipelineBarrier(
+			acquireCommandBuffer,
+			ConsumerStages, ConsumerStages,
+			0,
+			0, nullptr,
+			static_cast<uint32_t>(m_AcquireBufferBarriers.size()), m_AcquireBufferBarriers.data(),
+			static_cast<uint32_t>(m_AcquireImageBarriers.size()), m_AcquireImageBarriers.data());
+		vkEndCommandBuffer(acquireCommandBuffer);
+
+		m_AcquireBufferBarriers.clear();
+		m_AcquireImageBarriers.clear();
+	}
+
+	m_pGraphicsTimeline->AddWait(m_pTransferTimeline->GetSemaphore(), m_pTransferTimeline->GetSubmittedValue(), ConsumerStages);
+	m_pGraphicsTimeline->Submit(acquireCommandBuffer != VK_NULL_HANDLE ? 1 : 0, &acquireCommandBuffer);
+
+	// Keyed on the graphics submission above, which only completes after the copies. Retired by DeletionQueue::Collect
+	DeletionQueue* pDeletionQueue = m_pGraphicSystem->GetDeletionQueue();
+	VkDevice device = m_Device;
+	if (acquireCommandBuffer != VK_NULL_HANDLE)
+	{
+		VkCommandPool commandPool = m_pGraphicSystem->GetCommandPool();
+		pDeletionQueue->Defer([device, commandPool, acquireCommandBuffer]()
+		{
+			vkFreeCommandBuffers(device, commandPool, 1, &acquireCommandBuffer);
+		});
+	}
+	for (Submission& submission : m_Submissions)
+	{
+		VkCommandPool commandPool = m_pGraphicSystem->GetTransferCommandPool();
+		VkCommandBuffer commandBuffer = submission.commandBuffer;
+		pDeletionQueue->Defer([device, commandPool, commandBuffer]()
+		{
+			vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+		});
+		for (StagingBuffer& staging : submission.dedicatedStagingBuffers)
+		{
+			pDeletionQueue->DestroyBuffer(staging.buffer, &staging.memory);
+		}
+	}
+	m_Submissions.clear();
+}
+
+void UploadBatch::Stage(const void* pData, size_t dataSize, VkBuffer* pBuffer, VkDeviceSize* pOffset)
+{
+	if (dataSize < m_pStagingRing->GetSize())
+	{
+		StagingRegion region;
+		bool isAllocated = m_pStagingRing->Allocate(dataSize, StagingAlignment, &region);
+		if (!isAllocated)
+		{
+			// Only our own unsubmitted copies are in the way, send them off and wait for room
+			Submit();
+			isAllocated = m_pStagingRing->Allocate(dataSize, StagingAlignment, &region);
+		}
+		if (isAllocated)
+		{
+			std::memcpy(region.pMappedData, pData, dataSize);
+			*pBuffer = region.buffer;
+			*pOffset = region.offset;
+			return;
+		}
+	}
+
+	StagingBuffer staging;
+	CreateBuffer(
+		&staging.buffer,
+		&staging.memory,
+		dataSize,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		m_Device,
+		m_pMemoryAllocator,
+		MEMORY_STRATEGY_LINEAR);
+
+	std::memcpy(staging.memory.pMappedData, pData, dataSize);
+
+	m_DedicatedStagingBuffers.push_back(staging);
+	*pBuffer = staging.buffer;
+	*pOffset = 0;
+}
+
+void UploadBatch::UploadBuffer(VkBuffer dstBuffer, const void* pData, size_t dataSize, VkDeviceSize dstOffset)
+{
+	BufferCopy copy;
+	copy.region = {};
+	Stage(pData, dataSize, &copy.srcBuffer, &copy.region.srcOffset);
+	copy.dstBuffer = dstBuffer;
+	copy.region.dstOffset = dstOffset;
+	copy.region.size = dataSize;
+	m_BufferCopies.push_back(copy);
+}
+
+void UploadBatch::UploadImage(
+	VkImage dstImage,
+	const void* pData,
+	size_t dataSize,
+	uint32_t width,
+	uint32_t height,
+	uint32_t layers,
+	uint32_t mipLevels,
+	uint32_t bitDepth)
+{
+	ImageCopy copy;
+	VkDeviceSize offset = 0;
+	Stage(pData, dataSize, &copy.srcBuffer, &offset);
+	copy.dstImage = dstImage;
+
+	for (uint32_t face = 0; face < layers; face++)
+	{
+		for (uint32_t level = 0; level < mipLevels; level++)
+		{
+			VkBufferImageCopy region = {};
+			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.imageSubresource.mipLevel = level;
+			region.imageSubresource.baseArrayLayer = face;
+			region.imageSubresource.layerCount = 1;
+			region.imageExtent.width = width >> level;
+			region.imageExtent.height = height >> level;
+			region.imageExtent.depth = 1;
+			region.bufferOffset = offset;
+			region.imageOffset = { 0,0,0 };
+			copy.regions.push_back(region);
+
+			// Increase offset into staging buffer for next level / face
+			offset += (width >> level) * (height >> level) * (bitDepth / 8);
+		}
+	}
+	m_ImageCopies.push_back(copy);
+
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = dstImage;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = mipLevels;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = layers;
+
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	m_PreCopyBarriers.push_back(barrier);
+
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	m_PostCopyBarriers.push_back(barrier);
+}
+
+void UploadBatch::Submit()
+{
+	if (m_BufferCopies.empty() && m_ImageCopies.empty())
+	{
+		return;
+	}
+
+	const bool isOwnershipTransfer = m_pGraphicSystem->HasDedicatedTransferQueue();
+	const uint32_t transferFamilyIndex = m_pGraphicSystem->GetTransferQueueFamilyIndex();
+	const uint32_t graphicsFamilyIndex = m_pGraphicSystem->GetGraphicsQueueFamilyIndex();
+
+	Submission submission;
+	submission.commandBuffer = BeginSingleTimeCommands(m_Device, m_pGraphicSystem->GetTransferCommandPool());
+
+	if (!m_PreCopyBarriers.empty())
+	{
+		vkCmdPipelineBarrier(
+			submission.commandBuffer,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0,
+			0, nullptr,
+			0, nullptr,
+			static_cast<uint32_t>(m_PreCopyBarriers.size()), m_PreCopyBarriers.data());
+	}
+
+	std::vector<VkBufferMemoryBarrier> bufferBarriers(m_BufferCopies.size());
+	for (size_t i = 0; i < m_BufferCopies.size(); i++)
+	{
+		const BufferCopy& copy = m_BufferCopies[i];
+		vkCmdCopyBuffer(submission.commandBuffer, copy.srcBuffer, copy.dstBuffer, 1, &copy.region);
+
+		bufferBarriers[i] = {};
+		bufferBarriers[i].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		bufferBarriers[i].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarriers[i].dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+		bufferBarriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarriers[i].buffer = copy.dstBuffer;
+		bufferBarriers[i].offset = copy.region.dstOffset;
+		bufferBarriers[i].size = copy.region.size;
+	}
+	for (const ImageCopy& copy : m_ImageCopies)
+	{
+		vkCmdCopyBufferToImage(
+			submission.commandBuffer,
+			copy.srcBuffer,
+			copy.dstImage,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			static_cast<uint32_t>(copy.regions.size()),
+			copy.regions.data());
+	}
+
+	if (!isOwnershipTransfer)
+	{
+		vkCmdPipelineBarrier(
+			submission.commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, ConsumerStages,
+			0,
+			0, nullptr,
+			static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+			static_cast<uint32_t>(m_PostCopyBarriers.size()), m_PostCopyBarriers.data());
+	}
+	else
+	{
+		// Release to the graphics family. The acquire half repeats the barriers with the access masks swapped,
+		// the image layout transition is executed once between the two
+		for (VkBufferMemoryBarrier& barrier : bufferBarriers)
+		{
+			barrier.srcQueueFamilyIndex = transferFamilyIndex;
+			barrier.dstQueueFamilyIndex = graphicsFamilyIndex;
+		}
+		for (VkImageMemoryBarrier& barrier : m_PostCopyBarriers)
+		{
+			barrier.srcQueueFamilyIndex = transferFamilyIndex;
+			barrier.dstQueueFamilyIndex = graphicsFamilyIndex;
+		}
+		std::vector<VkBufferMemoryBarrier> releaseBufferBarriers = bufferBarriers;
+		std::vector<VkImageMemoryBarrier> releaseImageBarriers = m_PostCopyBarriers;
+		for (VkBufferMemoryBarrier& barrier : releaseBufferBarriers)
+		{
+			barrier.dstAccessMask = 0;
+		}
+		for (VkImageMemoryBarrier& barrier : releaseImageBarriers)
+		{
+			barrier.dstAccessMask = 0;
+		}
+		vkCmdPipelineBarrier(
+			submission.commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			0,
+			0, nullptr,
+			static_cast<uint32_t>(releaseBufferBarriers.size()), releaseBufferBarriers.data(),
+			static_cast<uint32_t>(releaseImageBarriers.size()), releaseImageBarriers.data());
+
+		for (VkBufferMemoryBarrier& barrier : bufferBarriers)
+		{
+			barrier.srcAccessMask = 0;
+		}
+		for (VkImageMemoryBarrier& barrier : m_PostCopyBarriers)
+		{
+			barrier.srcAccessMask = 0;
+		}
+		m_AcquireBufferBarriers.insert(m_AcquireBufferBarriers.end(), bufferBarriers.begin(), bufferBarriers.end());
+		m_AcquireImageBarriers.insert(m_AcquireImageBarriers.end(), m_PostCopyBarriers.begin(), m_PostCopyBarriers.end());
+	}
+
+	vkEndCommandBuffer(submission.commandBuffer);
+
+	submission.timelineValue = m_pTransferTimeline->Submit(1, &submission.commandBuffer);
+	m_SubmitCount++;
+
+	// The ring recycles this submission's regions once the transfer timeline reaches its value
+	m_pStagingRing->Submit(submission.timelineValue);
+	submission.dedicatedStagingBuffers.swap(m_DedicatedStagingBuffers);
+	m_Submissions.push_back(std::move(submission));
+
+	m_BufferCopies.clear();
+	m_ImageCopies.clear();
+	m_PreCopyBarriers.clear();
+	m_PostCopyBarriers.clear();
+
+	// Drop command buffers and oversized staging buffers the GPU is already done with
+	while (!m_Submissions.empty() && m_pTransferTimeline->IsComplete(m_Submissions.front().timelineValue))
+	{
+		Retire(m_Submissions.front());
+		m_Submissions.erase(m_Submissions.begin());
+	}
+}
+
+void UploadBatch::Retire(Submission& submission)
+{
+	vkFreeCommandBuffers(m_Device, m_pGraphicSystem->GetTransferCommandPool(), 1, &submission.commandBuffer);
+
+	for (StagingBuffer& staging : submission.dedicatedStagingBuffers)
+	{
+		vkDestroyBuffer(m_Device, staging.buffer, nullptr);
+		m_pMemoryAllocator->Free(&staging.memory);
+	}
+	submission.dedicatedStagingBuffers.clear();
+}
@@ -3,6 +3,7 @@
 VertexBuffer::VertexBuffer()
 {
 	m_IndexType = VK_INDEX_TYPE_UINT16;
+	m_pGeometryPool = nullptr;
 }
 
 
@@ -12,87 +13,49 @@ VertexBuffer::~VertexBuffer()
 
 void VertexBuffer::Finalize()
 {
-	vkDestroyBuffer(m_Device, m_VertexBuffer, nullptr);
-	m_VertexBuffer = VK_NULL_HANDLE;
-	vkFreeMemory(m_Device, m_VertexBufferMemory, nullptr);
-	vkDestroyBuffer(m_Device, m_IndexBuffer, nullptr);
-	m_IndexBuffer = VK_NULL_HANDLE;
-	vkFreeMemory(m_Device, m_IndexBufferMemory, nullptr);
+	if (m_pGeometryPool == nullptr)
+	{
+		return;
+	}
+	m_pGeometryPool->FreeVertices(&m_VertexRange);
+	m_pGeometryPool->FreeIndices(&m_IndexRange);
+	m_pGeometryPool->FreeDepthVertices(&m_DepthVertexRange);
 }
 
-void VertexBuffer::CreateVertexBuffer(GraphicSystem* pGraphicSystem, const void* pData, size_t dataSize)
+void VertexBuffer::CreateVertexBuffer(GraphicSystem* pGraphicSystem, UploadBatch* pUploadBatch, const void* pData, size_t dataSize)
 {
-	m_Device = pGraphicSystem->GetDevice();
-	VkDevice device = pGraphicSystem->GetDevice();
-	VkPhysicalDevice physicalDevice = pGraphicSystem->GetPhysicalDevice();
-
-	VkBuffer localBuffer;
-	VkDeviceMemory localBufferMemory;
-	CreateBuffer(
-		&localBuffer,
-		&localBufferMemory,
-		dataSize,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		device,
-		physicalDevice);
-
-	void* tempData;
-	VkResult result = vkMapMemory(device, localBufferMemory, 0, dataSize, 0, &tempData);
-	std::memcpy(tempData, pData, dataSize);
-	vkUnmapMemory(device, localBufferMemory);
-
-	CreateBuffer(
-		&m_VertexBuffer,
-		&m_VertexBufferMemory,
-		dataSize,
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		device,
-		physicalDevice);
-
-	CopyBuffer(localBuffer, m_VertexBuffer, dataSize, device, pGraphicSystem->GetCommandPool(), pGraphicSystem->GetQueues()[0]);
-
-	vkDestroyBuffer(device, localBuffer, nullptr);
-	vkFreeMemory(device, localBufferMemory, nullptr);
-
+	m_pGeometryPool = pGraphicSystem->GetGeometryPool();
+
+	size_t vertexCount = dataSize / sizeof(Vertex);
+	m_pGeometryPool->AllocateVertices(vertexCount, &m_VertexRange);
+	m_pGeometryPool->AllocateDepthVertices(vertexCount, &m_DepthVertexRange);
+	if (dataSize > 0)
+	{
+		pUploadBatch->UploadBuffer(GetVertexBuffer(), pData, dataSize, m_VertexRange.offset);
+
+		const Vertex* pVertices = static_cast<const Vertex*>(pData);
+		std::vector<glm::vec3> positions(vertexCount);
+		std::vector<glm::vec2> uvs(vertexCount);
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			positions[i] = pVertices[i].pos;
+			uvs[i] = pVertices[i].uv;
+		}
+		// Staged right away, the vectors may go before the batch ends
+		pUploadBatch->UploadBuffer(GetDepthVertexBuffer(), positions.data(), vertexCount * sizeof(glm::vec3), m_pGeometryPool->GetDepthPositionOffset(m_DepthVertexRange));
+		pUploadBatch->UploadBuffer(GetDepthVertexBuffer(), uvs.data(), vertexCount * sizeof(glm::vec2), m_pGeometryPool->GetDepthUvOffset(m_DepthVertexRange));
+	}
 }
 
-void VertexBuffer::CreateIndexBuffer(GraphicSystem* pGraphicSystem, const void* pData, size_t dataSize, VkIndexType indexType)
+void VertexBuffer::CreateIndexBuffer(GraphicSystem* pGraphicSystem, UploadBatch* pUploadBatch, const void* pData, size_t dataSize, VkIndexType indexType)
 {
-	m_Device = pGraphicSystem->GetDevice();
-	VkDevice device = pGraphicSystem->GetDevice();
-	VkPhysicalDevice physicalDevice = pGraphicSystem->GetPhysicalDevice();
+	m_pGeometryPool = pGraphicSystem->GetGeometryPool();
 
 	m_IndexType = indexType;
 
-	VkBuffer localBuffer;
-	VkDeviceMemory localBufferMemory;
-	CreateBuffer(
-		&localBuffer,
-		&localBufferMemory,
-		dataSize,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		device,
-		physicalDevice);
-
-	void* tempData;
-	VkResult result = vkMapMemory(device, localBufferMemory, 0, dataSize, 0, &tempData);
-	std::memcpy(tempData, pData, dataSize);
-	vkUnmapMemory(device, localBufferMemory);
-
-	CreateBuffer(
-		&m_IndexBuffer,
-		&m_IndexBufferMemory,
-		dataSize,
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		device,
-		physicalDevice);
-
-	CopyBuffer(localBuffer, m_IndexBuffer, dataSize, device, pGraphicSystem->GetCommandPool(), pGraphicSystem->GetQueues()[0]);
-
-	vkDestroyBuffer(device, localBuffer, nullptr);
-	vkFreeMemory(device, localBufferMemory, nullptr);
-}
\ No newline at end of file
+	m_pGeometryPool->AllocateIndices(dataSize, &m_IndexRange);
+	if (dataSize > 0)
+	{
+		pUploadBatch->UploadBuffer(GetIndexBuffer(), pData, dataSize, m_IndexRange.offset);
+	}
+}
@@ -5,6 +5,12 @@
 
 #include "RenderObject.h"
 #include "CommandBuffer.h"
+#include "ParallelRecorder.h"
+#include "FrameContext.h"
+#include "FrustumCuller.h"
+#include "SceneBvh.h"
+#include "GpuScene.h"
+#include "DeferredRenderer.h"
 
 
 
@@ -13,6 +19,7 @@
 
 #include <thread>
 #include <functional>
+#include <random>
 
 #include "Model.h"
 #include "Light.h"
@@ -51,6 +58,8 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 }
 
 bool g_MouseButtonDown = false;
+// Right click, consumed by the frame loop
+bool g_PickRequested = false;
 
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 {
@@ -65,6 +74,10 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 			g_MouseButtonDown = false;
 		}
 	}
+	if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_PRESS)
+	{
+		g_PickRequested = true;
+	}
 }
 
 double g_LastMouseX = 0;
@@ -169,12 +182,324 @@ void DestroyWindow(GLFWwindow* pWindow)
 	glfwTerminate();
 }
 
-int main() {
-	GLFWwindow* pWindow = nullptr;
-	InitWindow(&pWindow, 1920,1080); 
+enum CullMode
+{
+	CULL_MODE_NONE = 0,
+	CULL_MODE_LINEAR = 1,	// FrustumCuller over the gathered draw list
+	CULL_MODE_BVH = 2,		// SceneBvh query, the draw list is built from its result
+};
+
+struct LaunchOptions
+{
+	bool isHeadless = false;
+	uint32_t headlessFrameCount = 500;
+	int width = 1920;
+	int height = 1080;
+	// 0 records inline into the primary on the main thread
+	uint32_t recordThreadCount = std::min(8u, std::max(1u, std::thread::hardware_concurrency()));
+	bool isRecordingBenchmark = false;
+	CullMode cullMode = CULL_MODE_BVH;
+	bool isBvhBenchmark = false;
+	// Right click prints the object under the cursor
+	bool isPickDebug = false;
+	// Compute culling and indirect draws, falls back to the per-object path when GpuScene::Init fails
+	bool isGpuDriven = false;
+	// Two phase Hi-Z occlusion culling on the GPU-driven path
+	bool isOcclusionCulled = true;
+	// Orders the per-object draws by pass, pipeline, material and depth, off keeps the gather order
+	bool isDrawSorted = true;
+	// Lays down opaque depth first and shades with an EQUAL depth test, P toggles it in the window
+	bool isDepthPrepass = false;
+	// Headless frames are run once without and once with the depth pre-pass
+	bool isPrepassBenchmark = false;
+	// Tiled deferred shading of the per-object path, G toggles it in the window. Replaces the depth pre-pass while on
+	bool isDeferred = false;
+	// Headless frames are run once forward and once deferred
+	bool isDeferredBenchmark = false;
+	// Random point lights added on top of the scene's, to load the clustered lighting
+	uint32_t extraLightCount = 0;
+	GraphicSystemConfig graphicConfig;
+};
+
+LaunchOptions ParseLaunchOptions(int argc, char** argv)
+{
+	LaunchOptions options;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--headless")
+		{
+			options.isHeadless = true;
+		}
+		else if (arg == "--frames" && i + 1 < argc)
+		{
+			options.headlessFrameCount = static_cast<uint32_t>(std::max(1, atoi(argv[++i])));
+		}
+		else if (arg == "--size" && i + 2 < argc)
+		{
+			options.width = std::max(1, atoi(argv[++i]));
+			options.height = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--no-pipeline-cache")
+		{
+			options.graphicConfig.pipelineCachePath.clear();
+		}
+		else if (arg == "--staging-mb" && i + 1 < argc)
+		{
+			options.graphicConfig.stagingRingSize = static_cast<VkDeviceSize>(std::max(1, atoi(argv[++i]))) * 1024 * 1024;
+		}
+		else if (arg == "--record-threads" && i + 1 < argc)
+		{
+			options.recordThreadCount = static_cast<uint32_t>(std::max(0, atoi(argv[++i])));
+		}
+		else if (arg == "--frames-in-flight" && i + 1 < argc)
+		{
+			options.graphicConfig.framesInFlight = static_cast<uint32_t>(std::min(4, std::max(1, atoi(argv[++i]))));
+		}
+		else if (arg == "--bench-recording")
+		{
+			options.isRecordingBenchmark = true;
+		}
+		else if (arg == "--no-cull")
+		{
+			options.cullMode = CULL_MODE_NONE;
+		}
+		else if (arg == "--cull-linear")
+		{
+			options.cullMode = CULL_MODE_LINEAR;
+		}
+		else if (arg == "--bench-bvh")
+		{
+			options.isBvhBenchmark = true;
+		}
+		else if (arg == "--debug-pick")
+		{
+			options.isPickDebug = true;
+		}
+		else if (arg == "--gpu-driven")
+		{
+			options.isGpuDriven = true;
+		}
+		else if (arg == "--no-occlusion")
+		{
+			options.isOcclusionCulled = false;
+		}
+		else if (arg == "--no-sort")
+		{
+			options.isDrawSorted = false;
+		}
+		else if (arg == "--depth-prepass")
+		{
+			options.isDepthPrepass = true;
+		}
+		else if (arg == "--bench-prepass")
+		{
+			options.isPrepassBenchmark = true;
+		}
+		else if (arg == "--deferred")
+		{
+			options.isDeferred = true;
+		}
+		else if (arg == "--bench-deferred")
+		{
+			options.isDeferredBenchmark = true;
+		}
+		else if (arg == "--lights" && i + 1 < argc)
+		{
+			options.extraLightCount = static_cast<uint32_t>(std::max(0, atoi(argv[++i])));
+		}
+	}
+	return options;
+}
+
+struct CullReport
+{
+	uint32_t frameCount = 0;
+	uint64_t testedCount = 0;
+	uint64_t culledCount = 0;
+	double cullTimeMs = 0.0;
 
+	void Add(const FrustumCullStats& stats)
+	{
+		frameCount++;
+		testedCount += stats.testedCount;
+		culledCount += stats.culledCount;
+		cullTimeMs += stats.cullTimeMs;
+	}
+	void Print()
+	{
+		if (frameCount == 0)
+		{
+			return;
+		}
+		printf("frustum culling: %.1f of %.1f draws culled, %.3f ms per frame\n",
+			static_cast<double>(culledCount) / frameCount,
+			static_cast<double>(testedCount) / frameCount,
+			cullTimeMs / frameCount);
+	}
+};
+
+void PrintFrameTimes(std::vector<float>& frameTimes)
+{
+	if (frameTimes.empty())
+	{
+		return;
+	}
+	std::sort(frameTimes.begin(), frameTimes.end());
+	float total = 0.0f;
+	for (float t : frameTimes)
+	{
+		total += t;
+	}
+	size_t count = frameTimes.size();
+	printf("frames: %zu\n", count);
+	printf("frame time (ms) avg: %.3f min: %.3f median: %.3f p95: %.3f max: %.3f\n",
+		total / count,
+		frameTimes.front(),
+		frameTimes[count / 2],
+		frameTimes[std::min(count - 1, count * 95 / 100)],
+		frameTimes.back());
+}
+
+// Casts the ray under the cursor into the scene BVH, which only the BVH cull mode keeps built
+void PickObject(SceneBvh& sceneBvh, const Camera& camera, VkExtent2D extent, const std::vector<uint32_t>& sceneObjectModels)
+{
+	if (sceneBvh.GetPrimitiveCount() == 0)
+	{
+		printf("picking needs the scene bvh, which only bvh culling builds\n");
+		return;
+	}
+
+	// The ray ends where the cursor meets the far plane
+	glm::vec4 ndc(
+		static_cast<float>(g_MouseX) / extent.width * 2.0f - 1.0f,
+		static_cast<float>(g_MouseY) / extent.height * 2.0f - 1.0f,
+		1.0f,
+		1.0f);
+	glm::vec4 farPoint = glm::inverse(camera.projMtx * camera.viewMtx) * ndc;
+	glm::vec3 toFarPoint = glm::vec3(farPoint) / farPoint.w - camera.cameraPos;
+	float maxDistance = glm::length(toFarPoint);
+
+	uint32_t object = 0;
+	float distance = 0.0f;
+	if (sceneBvh.RayCast(camera.cameraPos, toFarPoint / maxDistance, maxDistance, &object, &distance))
+	{
+		printf("picked object %u of model %u at %.2f, %u nodes visited\n", object, sceneObjectModels[object], distance, sceneBvh.GetStats().visitedNodeCount);
+	}
+	else
+	{
+		printf("picked nothing, %u nodes visited\n", sceneBvh.GetStats().visitedNodeCount);
+	}
+}
+
+// Synthetic scenes of random boxes at constant density, no GPU involved
+void RunBvhBenchmark()
+{
+	uint32_t maxThreadCount = std::max(1u, std::thread::hardware_concurrency());
+	std::mt19937 random(1234);
+	for (uint32_t objectCount : { 10000u, 100000u, 1000000u })
+	{
+		float sceneExtent = 10.0f * std::cbrt(static_cast<float>(objectCount));
+		std::uniform_real_distribution<float> position(-sceneExtent, sceneExtent);
+		std::uniform_real_distribution<float> halfSize(0.5f, 2.0f);
+		std::uniform_real_distribution<float> move(-1.0f, 1.0f);
+		std::vector<BoundingBox> bounds(objectCount);
+		for (BoundingBox& box : bounds)
+		{
+			glm::vec3 center(position(random), position(random), position(random));
+			glm::vec3 extent(halfSize(random), halfSize(random), halfSize(random));
+			box.min = center - extent;
+			box.max = center + extent;
+		}
+
+		glm::mat4 projMtx = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, sceneExtent);
+		glm::mat4 viewProjMtx = projMtx * glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+		for (uint32_t threadCount : { 1u, maxThreadCount })
+		{
+			SceneBvh bvh;
+			bvh.Init(threadCount);
+			bvh.Build(bounds);
+			float buildMs = bvh.GetStats().buildTimeMs;
+
+			for (uint32_t i = 0; i < objectCount; i++)
+			{
+				glm::vec3 offset(move(random), move(random), move(random));
+				bvh.SetPrimitiveBounds(i, { bounds[i].min + offset, bounds[i].max + offset });
+			}
+			bvh.Refit();
+			float fullRefitMs = bvh.GetStats().refitTimeMs;
+
+			for (uint32_t i = 0; i < objectCount; i += 100)
+			{
+				glm::vec3 offset(move(random), move(random), move(random));
+				bvh.SetPrimitiveBounds(i, { bounds[i].min + offset, bounds[i].max + offset });
+			}
+			bvh.Refit();
+			float partialRefitMs = bvh.GetStats().refitTimeMs;
+
+			std::vector<uint32_t> visible;
+			auto cullStartTime = std::chrono::high_resolution_clock::now();
+			bvh.CullFrustum(viewProjMtx, &visible);
+			auto cullEndTime = std::chrono::high_resolution_clock::now();
+
+			printf("bvh %u objects, %u threads: build %.2f ms, full refit %.3f ms, 1%% refit %.3f ms, cull %.3f ms (%zu visible, %u nodes visited)\n",
+				objectCount,
+				threadCount,
+				buildMs,
+				fullRefitMs,
+				partialRefitMs,
+				std::chrono::duration<float, std::milli>(cullEndTime - cullStartTime).count(),
+				visible.size(),
+				bvh.GetStats().visitedNodeCount);
+			bvh.Finalize();
+		}
+
+		// Reference: every box against every plane
+		glm::vec4 planes[6];
+		ExtractFrustumPlanes(viewProjMtx, planes);
+		size_t visibleCount = 0;
+		auto linearStartTime = std::chrono::high_resolution_clock::now();
+		for (const BoundingBox& box : bounds)
+		{
+			bool isOutside = false;
+			for (int plane = 0; plane < 6 && !isOutside; plane++)
+			{
+				glm::vec3 corner(
+					planes[plane].x > 0.0f ? box.max.x : box.min.x,
+					planes[plane].y > 0.0f ? box.max.y : box.min.y,
+					planes[plane].z > 0.0f ? box.max.z : box.min.z);
+				isOutside = glm::dot(glm::vec3(planes[plane]), corner) + planes[plane].w < 0.0f;
+			}
+			visibleCount += isOutside ? 0 : 1;
+		}
+		auto linearEndTime = std::chrono::high_resolution_clock::now();
+		printf("linear %u objects: cull %.3f ms (%zu visible)\n",
+			objectCount,
+			std::chrono::duration<float, std::milli>(linearEndTime - linearStartTime).count(),
+			visibleCount);
+	}
+}
+
+int main(int argc, char** argv) {
+	LaunchOptions options = ParseLaunchOptions(argc, argv);
+	if (options.isBvhBenchmark)
+	{
+		RunBvhBenchmark();
+		return 0;
+	}
+
+	GLFWwindow* pWindow = nullptr;
 	GraphicSystem graphicSystem;
-	graphicSystem.InitGraphicsSystem(pWindow);
+	if (options.isHeadless)
+	{
+		graphicSystem.InitHeadlessGraphicsSystem(options.width, options.height, options.graphicConfig);
+	}
+	else
+	{
+		InitWindow(&pWindow, options.width, options.height);
+		graphicSystem.InitGraphicsSystem(pWindow, options.graphicConfig);
+	}
 	VkDevice device = graphicSystem.GetDevice();
 
 
@@ -182,14 +507,16 @@ int main() {
 	uint32_t swapChainCount = graphicSystem.GetSwapChainCount();
 	VkExtent2D swapChainExtent = graphicSystem.GetSwapChainExtent();
 	VkRenderPass renderPass = graphicSystem.GetRenderPass();
-	VkCommandPool commandPool = graphicSystem.GetCommandPool();
 
 	std::vector<VkQueue>& queues = graphicSystem.GetQueues();
 	VkSwapchainKHR swapChain = graphicSystem.GetSwapChain();
 	std::vector<VkFramebuffer>& swapChainFrameBuffers = graphicSystem.GetSwapChainFrameBuffers();
 
 	CommandBuffer commandBuffer;
-	commandBuffer.Init(device, swapChainCount, commandPool);
+	uint32_t framesInFlight = graphicSystem.GetFramesInFlight();
+	commandBuffer.Init(device, framesInFlight, graphicSystem.GetGraphicsQueueFamilyIndex());
+
+	LightManager::GetInstance().InitUniform(&graphicSystem);
 
 	//===========================================================================================================================
 	glm::mat4 lightMtx;
@@ -235,6 +562,23 @@ int main() {
 	pLight3->SetInnerConeAngle(glm::radians(30.0f));
 
 
+	// Spread over the inside of Sponza
+	std::mt19937 lightRandom(5678);
+	std::uniform_real_distribution<float> lightX(-12.0f, 12.0f);
+	std::uniform_real_distribution<float> lightY(0.5f, 10.0f);
+	std::uniform_real_distribution<float> lightZ(-5.0f, 5.0f);
+	std::uniform_real_distribution<float> lightRange(1.0f, 3.0f);
+	std::uniform_real_distribution<float> lightColor(0.2f, 1.0f);
+	for (uint32_t i = 0; i < options.extraLightCount; i++)
+	{
+		Light* pLight = LightManager::GetInstance().CreateNewLight();
+		pLight->SetLightType(POINT_LIGHT);
+		pLight->SetLightLocalTransform(glm::translate(glm::mat4(1.0f), glm::vec3(lightX(lightRandom), lightY(lightRandom), lightZ(lightRandom))));
+		pLight->SetLightRange(lightRange(lightRandom));
+		pLight->SetLightColor(lightColor(lightRandom), lightColor(lightRandom), lightColor(lightRandom));
+		pLight->SetLightIntensity(5);
+	}
+
 	float x1 = pLight1->GetLightDir().x;
 	float y1 = pLight1->GetLightDir().y;
 	float z1 = pLight1->GetLightDir().z;
@@ -244,6 +588,8 @@ int main() {
 	float z3 = pLight3->GetLightDir().z;
 
 	//===========================================================================================================================
+	auto sceneLoadStartTime = std::chrono::high_resolution_clock::now();
+
 	Model sponza;
 	sponza.CreateModel("Models/Sponza/glTF/Sponza.gltf", "Models/Sponza/glTF", &graphicSystem);
 	Model normalTangentTest;
@@ -333,6 +679,32 @@ int main() {
 	testModel2.SetTranslate(glm::vec3(2, 1, -1));
 	testModel2.SetScale(glm::vec3(1, 1, 1));
 
+	std::vector<Model*> models =
+	{
+		&sponza,
+		&normalTangentTest,
+		&normalTangentMirrorTest,
+		&test,
+		&alphaBlendModeTest,
+		&boomBoxWithAxes,
+		&boomBox,
+		&testModel1,
+		&testModel2,
+		&kko,
+		&lightTest,
+		&damagedHelmet,
+		&cube
+	};
+
+	auto sceneLoadEndTime = std::chrono::high_resolution_clock::now();
+	printf("scene load: %.2f ms\n", std::chrono::duration<double, std::milli>(sceneLoadEndTime - sceneLoadStartTime).count());
+	graphicSystem.GetMemoryAllocator()->PrintStats();
+	graphicSystem.GetPipelineCache()->PrintStats();
+	graphicSystem.GetPipelineLibrary()->PrintStats();
+	graphicSystem.GetShaderModuleCache()->PrintStats();
+	graphicSystem.GetUniformArena()->PrintStats();
+	graphicSystem.GetGeometryPool()->PrintStats();
+
 	g_CameraPos = glm::vec3(1, 1, 0);
 	g_CameraLookAt = glm::vec3(0, 1, 0);
 	g_CameraUp = glm::vec3(0, 1, 0);
@@ -344,17 +716,32 @@ int main() {
 	graphicSystem.GetCamera().cameraUp = g_CameraUp;
 
 	graphicSystem.GetCamera().viewMtx = glm::lookAt(graphicSystem.GetCamera().cameraPos, graphicSystem.GetCamera().cameraLookAt, graphicSystem.GetCamera().cameraUp);
-	graphicSystem.GetCamera().projMtx = glm::perspective(glm::radians(45.0f), graphicSystem.GetSwapChainAspect(), 0.1f, 10000.0f);
+	graphicSystem.GetCamera().nearPlane = 0.1f;
+	graphicSystem.GetCamera().farPlane = 10000.0f;
+	graphicSystem.GetCamera().projMtx = glm::perspective(glm::radians(45.0f), graphicSystem.GetSwapChainAspect(),
+		graphicSystem.GetCamera().nearPlane, graphicSystem.GetCamera().farPlane);
 	graphicSystem.GetCamera().projMtx[1][1] *= -1;
 
-	for (uint32_t i = 0; i < swapChainCount; i++)
+	FrameContext frameContext;
+	frameContext.Init(device, graphicSystem.GetGraphicsTimeline(), framesInFlight, swapChainCount);
+
+	auto BindFrameResources = [](VkCommandBuffer cmdBuf, uint32_t frameIndex)
 	{
-		commandBuffer.Begin(i);
+		LightManager::GetInstance().Bind(cmdBuf, frameIndex);
+	};
 
+	ParallelRecorder parallelRecorder;
+	if (options.recordThreadCount > 0)
+	{
+		parallelRecorder.Init(device, graphicSystem.GetGraphicsQueueFamilyIndex(), framesInFlight, options.recordThreadCount);
+	}
+
+	auto BeginRenderPass = [&](VkCommandBuffer cmdBuf, uint32_t imageIndex, VkSubpassContents contents, VkRenderPass pass)
+	{
 		VkRenderPassBeginInfo renderPassBeginInfo = {};
 		renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassBeginInfo.renderPass = renderPass;
-		renderPassBeginInfo.framebuffer = swapChainFrameBuffers[i];
+		renderPassBeginInfo.renderPass = pass;
+		renderPassBeginInfo.framebuffer = swapChainFrameBuffers[imageIndex];
 		renderPassBeginInfo.renderArea.offset = { 0,0 };
 		renderPassBeginInfo.renderArea.extent = swapChainExtent;
 
@@ -364,182 +751,520 @@ int main() {
 		renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearColors.size());
 		renderPassBeginInfo.pClearValues = clearColors.data();
 
+		vkCmdBeginRenderPass(cmdBuf, &renderPassBeginInfo, contents);
+	};
 
-		VkCommandBuffer cmdBuf = commandBuffer.GetCommandBuffer(i);
-		vkCmdBeginRenderPass(cmdBuf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-		
-		sponza.Draw(cmdBuf, i);
-		normalTangentTest.Draw(cmdBuf, i);
-		normalTangentMirrorTest.Draw(cmdBuf, i);
-		test.Draw(cmdBuf, i); 
-		alphaBlendModeTest.Draw(cmdBuf, i);
-		boomBoxWithAxes.Draw(cmdBuf, i);
-		boomBox.Draw(cmdBuf, i);
-
-		testModel1.Draw(cmdBuf, i);
-		testModel2.Draw(cmdBuf, i);
-
-		kko.Draw(cmdBuf, i); 
-		
-		lightTest.Draw(cmdBuf, i);
+	DeferredRenderer deferredRenderer;
+	bool isDeferredAvailable = deferredRenderer.Init(&graphicSystem);
+	if (!isDeferredAvailable && (options.isDeferred || options.isDeferredBenchmark))
+	{
+		printf("deferred path unavailable, shading forward\n");
+	}
 
-		damagedHelmet.Draw(cmdBuf, i);
+	DrawList drawList;
+	drawList.SetDepthPrepass(options.isDepthPrepass);
+	drawList.SetDeferred(options.isDeferred && isDeferredAvailable);
+	auto RecordDrawList = [&](uint32_t frameIndex, uint32_t imageIndex, DrawList* pDrawList, ParallelRecorder* pRecorder)
+	{
+		commandBuffer.Reset(frameIndex);
+		commandBuffer.Begin(frameIndex);
 
-		cube.Draw(cmdBuf, i);
+		VkCommandBuffer cmdBuf = commandBuffer.GetCommandBuffer(frameIndex);
+		if (pDrawList->IsDeferred())
+		{
+			// G-buffer, tiled lighting in compute, then the lit image and the blended objects onto the swapchain
+			if (pRecorder != nullptr)
+			{
+				deferredRenderer.BeginGBufferPass(cmdBuf, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+				pRecorder->Record(cmdBuf, frameIndex, graphicSystem.GetGBufferRenderPass(), deferredRenderer.GetGBufferFramebuffer(), pDrawList,
+					[frameIndex, &BindFrameResources](VkCommandBuffer secondary) { BindFrameResources(secondary, frameIndex); });
+			}
+			else
+			{
+				deferredRenderer.BeginGBufferPass(cmdBuf, VK_SUBPASS_CONTENTS_INLINE);
+				BindFrameResources(cmdBuf, frameIndex);
+				pDrawList->Record(cmdBuf, frameIndex);
+			}
+			vkCmdEndRenderPass(cmdBuf);
+
+			deferredRenderer.RecordLighting(cmdBuf, frameIndex);
+
+			// Few blended draws, recorded inline since the recorder's secondaries are already spent on the G-buffer pass
+			BeginRenderPass(cmdBuf, imageIndex, VK_SUBPASS_CONTENTS_INLINE, graphicSystem.GetCompositeRenderPass());
+			deferredRenderer.RecordComposite(cmdBuf);
+			BindFrameResources(cmdBuf, frameIndex);
+			pDrawList->RecordBlended(cmdBuf, frameIndex);
+			vkCmdEndRenderPass(cmdBuf);
+
+			commandBuffer.End(frameIndex);
+			return;
+		}
+		if (pRecorder != nullptr)
+		{
+			BeginRenderPass(cmdBuf, imageIndex, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS, renderPass);
+			pRecorder->Record(cmdBuf, frameIndex, renderPass, swapChainFrameBuffers[imageIndex], pDrawList,
+				[frameIndex, &BindFrameResources](VkCommandBuffer secondary) { BindFrameResources(secondary, frameIndex); });
+		}
+		else
+		{
+			BeginRenderPass(cmdBuf, imageIndex, VK_SUBPASS_CONTENTS_INLINE, renderPass);
+			BindFrameResources(cmdBuf, frameIndex);
+			pDrawList->Record(cmdBuf, frameIndex);
+		}
 
 		vkCmdEndRenderPass(cmdBuf);
 
-		commandBuffer.End(i);
-	}
-
-	std::vector<VkSemaphore> imageAvailableSemaphores, renderFinishedSemaphores;
-	std::vector<VkFence> imageFences;
-	imageAvailableSemaphores.resize(swapChainCount);
-	renderFinishedSemaphores.resize(swapChainCount);
-	imageFences.resize(swapChainCount);
+		commandBuffer.End(frameIndex);
+	};
 
-	for (uint32_t i = 0; i < swapChainCount; i++)
+	GpuScene gpuScene;
+	auto RecordGpuScene = [&](uint32_t frameIndex, uint32_t imageIndex)
 	{
-		VkSemaphoreCreateInfo semaphoreInfo = {};
-		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-		vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]);
-		vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]);
+		commandBuffer.Reset(frameIndex);
+		commandBuffer.Begin(frameIndex);
 
-		VkFenceCreateInfo fenceInfo = {};
-		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-		fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-		vkCreateFence(device, &fenceInfo, nullptr, &imageFences[i]);
-		vkResetFences(device, 1, &imageFences[i]);
-	}
-	uint64_t currentFrame = 0;
-	auto startTime = std::chrono::high_resolution_clock::now();
-	auto lastTime = startTime;
-	while (!glfwWindowShouldClose(pWindow))
-	{
-		auto currentTime = std::chrono::high_resolution_clock::now();
-		float dTime = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - lastTime).count();
+		VkCommandBuffer cmdBuf = commandBuffer.GetCommandBuffer(frameIndex);
+		gpuScene.RecordCull(cmdBuf, frameIndex, GPU_CULL_PHASE_EARLY);
 
-		glfwPollEvents();
-		UpdateInpute(dTime);
+		BeginRenderPass(cmdBuf, imageIndex, VK_SUBPASS_CONTENTS_INLINE, renderPass);
+		BindFrameResources(cmdBuf, frameIndex);
+		gpuScene.RecordDraw(cmdBuf, frameIndex, GPU_CULL_PHASE_EARLY);
+		if (!gpuScene.IsOcclusionCulled())
+		{
+			gpuScene.RecordBlended(cmdBuf, frameIndex);
+		}
+		vkCmdEndRenderPass(cmdBuf);
 
-		uint32_t imageIndex = 0;
-		vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame % swapChainCount], VK_NULL_HANDLE, &imageIndex);
+		if (gpuScene.IsOcclusionCulled())
+		{
+			gpuScene.RecordCull(cmdBuf, frameIndex, GPU_CULL_PHASE_LATE);
+
+			BeginRenderPass(cmdBuf, imageIndex, VK_SUBPASS_CONTENTS_INLINE, graphicSystem.GetLoadRenderPass());
+			BindFrameResources(cmdBuf, frameIndex);
+			gpuScene.RecordDraw(cmdBuf, frameIndex, GPU_CULL_PHASE_LATE);
+			// Over the opaque draws of both phases
+			gpuScene.RecordBlended(cmdBuf, frameIndex);
+			vkCmdEndRenderPass(cmdBuf);
+		}
 
-		VkSubmitInfo submitInfo = {};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		commandBuffer.End(frameIndex);
+	};
 
-		VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame % swapChainCount] };
-		VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-		submitInfo.waitSemaphoreCount = 1;
-		submitInfo.pWaitSemaphores = waitSemaphores;
-		submitInfo.pWaitDstStageMask = waitStages;
-		submitInfo.commandBufferCount = 1;
+	FrustumCuller frustumCuller;
+	CullReport cullReport;
 
-		VkCommandBuffer commandBuffers[] = { commandBuffer.GetCommandBuffer(imageIndex) };
-		submitInfo.pCommandBuffers = commandBuffers;
+	// Every RenderObject of the scene in BVH primitive order, objects of one model are contiguous
+	std::vector<RenderObject*> sceneObjects;
+	std::vector<uint32_t> sceneObjectModels;
+	std::vector<uint32_t> sceneModelBegin;
+	for (size_t i = 0; i < models.size(); i++)
+	{
+		sceneModelBegin.push_back(static_cast<uint32_t>(sceneObjects.size()));
+		models[i]->GetRenderObjects(&sceneObjects);
+		sceneObjectModels.resize(sceneObjects.size(), static_cast<uint32_t>(i));
+	}
+	sceneModelBegin.push_back(static_cast<uint32_t>(sceneObjects.size()));
 
-		VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame % swapChainCount] };
-		submitInfo.signalSemaphoreCount = 1;
-		submitInfo.pSignalSemaphores = signalSemaphores;
+	SceneBvh sceneBvh;
+	sceneBvh.Init(std::max(1u, std::thread::hardware_concurrency()));
+	std::vector<uint32_t> visibleObjects;
+	if (options.cullMode == CULL_MODE_BVH)
+	{
+		// Built and refit by UpdateFrame before the lights are gathered
+		LightManager::GetInstance().SetSceneBvh(&sceneBvh);
+	}
 
+	bool isGpuDriven = false;
+	std::vector<uint8_t> sceneModelVisible(models.size(), 1);
+	if (options.isGpuDriven)
+	{
+		// Nothing is in flight yet, the world transforms have to be current before the instances are written
+		for (Model* pModel : models)
+		{
+			pModel->Update(0);
+		}
+		isGpuDriven = gpuScene.Init(&graphicSystem, sceneObjects, options.isOcclusionCulled);
+		if (isGpuDriven)
 		{
-			graphicSystem.GetCamera().cameraPos = g_CameraPos;
-			graphicSystem.GetCamera().cameraLookAt = g_CameraLookAt;
-			graphicSystem.GetCamera().cameraUp = g_CameraUp;
-			graphicSystem.GetCamera().viewMtx = glm::lookAt(g_CameraPos, g_CameraLookAt, g_CameraUp);
-			
-			normalTangentTest.Update(imageIndex);
+			gpuScene.PrintStats();
+		}
+		else
+		{
+			printf("GPU driven path unavailable, drawing per object\n");
+		}
+	}
 
-			normalTangentMirrorTest.Update(imageIndex);
+	// Only called between FrameContext::BeginFrame and Submit, the frame slot's uniforms and command buffers are free to rewrite
+	auto UpdateFrame = [&](uint32_t frameIndex, uint32_t imageIndex)
+	{
+		graphicSystem.GetCamera().cameraPos = g_CameraPos;
+		graphicSystem.GetCamera().cameraLookAt = g_CameraLookAt;
+		graphicSystem.GetCamera().cameraUp = g_CameraUp;
+		graphicSystem.GetCamera().viewMtx = glm::lookAt(g_CameraPos, g_CameraLookAt, g_CameraUp);
+
+		const Camera& camera = graphicSystem.GetCamera();
+		drawList.Clear();
+		if (isGpuDriven)
+		{
+			for (size_t i = 0; i < models.size(); i++)
+			{
+				if (models[i]->IsTransformChanged())
+				{
+					models[i]->Update(frameIndex);
+					for (uint32_t object = sceneModelBegin[i]; object < sceneModelBegin[i + 1]; object++)
+					{
+						gpuScene.SetObjectTransform(object, sceneObjects[object]->GetModelMatrix());
+					}
+				}
+				uint8_t isVisible = models[i]->IsVisible() ? 1 : 0;
+				if (isVisible != sceneModelVisible[i])
+				{
+					sceneModelVisible[i] = isVisible;
+					for (uint32_t object = sceneModelBegin[i]; object < sceneModelBegin[i + 1]; object++)
+					{
+						gpuScene.SetObjectVisible(object, isVisible != 0);
+					}
+				}
+			}
+			gpuScene.Update(frameIndex);
+			LightManager::GetInstance().UpdateUniform(frameIndex);
+
+			// Counts of the frame that last used this slot, culling itself runs on the GPU
+			FrustumCullStats stats;
+			stats.testedCount = gpuScene.GetStats().instanceCount;
+			stats.culledCount = stats.testedCount - std::min(stats.testedCount, gpuScene.GetStats().drawnCount);
+			stats.cullTimeMs = 0.0f;
+			cullReport.Add(stats);
+
+			RecordGpuScene(frameIndex, imageIndex);
+			return;
+		}
+		if (options.cullMode == CULL_MODE_BVH)
+		{
+			for (size_t i = 0; i < models.size(); i++)
+			{
+				bool isMoved = models[i]->IsTransformChanged();
+				models[i]->Update(frameIndex);
+				if (isMoved && sceneBvh.GetPrimitiveCount() == sceneObjects.size())
+				{
+					for (uint32_t object = sceneModelBegin[i]; object < sceneModelBegin[i + 1]; object++)
+					{
+						sceneBvh.SetPrimitiveBounds(object, sceneObjects[object]->GetWorldBounds());
+					}
+				}
+			}
+
+			auto cullStartTime = std::chrono::high_resolution_clock::now();
+			if (sceneBvh.GetPrimitiveCount() != sceneObjects.size())
+			{
+				// World bounds are known once every object went through Update
+				std::vector<BoundingBox> bounds(sceneObjects.size());
+				for (size_t object = 0; object < sceneObjects.size(); object++)
+				{
+					bounds[object] = sceneObjects[object]->GetWorldBounds();
+				}
+				sceneBvh.Build(bounds);
+				sceneBvh.PrintStats();
+			}
+			sceneBvh.Refit();
+
+			visibleObjects.clear();
+			sceneBvh.CullFrustum(camera.projMtx * camera.viewMtx, &visibleObjects);
+			for (uint32_t object : visibleObjects)
+			{
+				if (models[sceneObjectModels[object]]->IsVisible())
+				{
+					drawList.Add(sceneObjects[object]);
+				}
+			}
+			auto cullEndTime = std::chrono::high_resolution_clock::now();
+
+			FrustumCullStats stats;
+			stats.testedCount = static_cast<uint32_t>(sceneObjects.size());
+			stats.culledCount = stats.testedCount - static_cast<uint32_t>(visibleObjects.size());
+			stats.cullTimeMs = std::chrono::duration<float, std::milli>(cullEndTime - cullStartTime).count();
+			cullReport.Add(stats);
+		}
+		else
+		{
+			for (Model* pModel : models)
+			{
+				pModel->Update(frameIndex);
+				pModel->GatherDrawItems(&drawList);
+			}
+			if (options.cullMode == CULL_MODE_LINEAR)
+			{
+				frustumCuller.Cull(camera.projMtx * camera.viewMtx, &drawList);
+				cullReport.Add(frustumCuller.GetStats());
+			}
+		}
+		if (options.isDrawSorted)
+		{
+			drawList.Sort(camera.viewMtx);
+		}
+		LightManager::GetInstance().UpdateUniform(frameIndex);
+		if (drawList.IsDeferred())
+		{
+			deferredRenderer.Update(frameIndex);
+		}
 
-			alphaBlendModeTest.Update(imageIndex);
+		RecordDrawList(frameIndex, imageIndex, &drawList, options.recordThreadCount > 0 ? &parallelRecorder : nullptr);
+	};
 
-			sponza.Update(imageIndex);
+	// Records the scene repeated to a large draw count with an increasing number of threads. Nothing is submitted,
+	// only CPU recording time is measured
+	if (options.isRecordingBenchmark)
+	{
+		UpdateFrame(0, 0);
 
-			boomBoxWithAxes.Update(imageIndex);
+		const size_t TargetDrawCount = 20000;
+		const int IterationCount = 20;
+		if (isGpuDriven)
+		{
+			auto gpuStartTime = std::chrono::high_resolution_clock::now();
+			for (int i = 0; i < IterationCount; i++)
+			{
+				RecordGpuScene(0, 0);
+			}
+			auto gpuEndTime = std::chrono::high_resolution_clock::now();
+			printf("recording %u instances gpu driven: %.3f ms\n", gpuScene.GetStats().instanceCount,
+				std::chrono::duration<double, std::milli>(gpuEndTime - gpuStartTime).count() / IterationCount);
+		}
 
-			boomBox.Update(imageIndex);
+		DrawList benchmarkList;
+		benchmarkList.SetDepthPrepass(options.isDepthPrepass);
+		benchmarkList.SetDeferred(drawList.IsDeferred());
+		while (benchmarkList.GetDrawCount() < TargetDrawCount && drawList.GetDrawCount() > 0)
+		{
+			for (Model* pModel : models)
+			{
+				pModel->GatherDrawItems(&benchmarkList);
+			}
+		}
+		if (options.isDrawSorted)
+		{
+			auto sortStartTime = std::chrono::high_resolution_clock::now();
+			for (int i = 0; i < IterationCount; i++)
+			{
+				benchmarkList.Sort(graphicSystem.GetCamera().viewMtx);
+			}
+			auto sortEndTime = std::chrono::high_resolution_clock::now();
+			printf("sorting %zu draws: %.3f ms\n", benchmarkList.GetDrawCount(),
+				std::chrono::duration<double, std::milli>(sortEndTime - sortStartTime).count() / IterationCount);
+		}
 
-			test.Update(imageIndex);
+		std::vector<uint32_t> threadCounts = { 0 };
+		uint32_t maxThreadCount = std::max(1u, std::thread::hardware_concurrency());
+		for (uint32_t threadCount = 1; threadCount <= maxThreadCount; threadCount *= 2)
+		{
+			threadCounts.push_back(threadCount);
+		}
 
-			kko.Update(imageIndex);
+		double inlineMs = 0.0;
+		for (uint32_t threadCount : threadCounts)
+		{
+			ParallelRecorder benchmarkRecorder;
+			ParallelRecorder* pRecorder = nullptr;
+			if (threadCount > 0)
+			{
+				benchmarkRecorder.Init(device, graphicSystem.GetGraphicsQueueFamilyIndex(), framesInFlight, threadCount);
+				pRecorder = &benchmarkRecorder;
+			}
+
+			// The first pass grows the pools, keep it out of the measurement
+			RecordDrawList(0, 0, &benchmarkList, pRecorder);
+
+			auto benchStartTime = std::chrono::high_resolution_clock::now();
+			for (int i = 0; i < IterationCount; i++)
+			{
+				RecordDrawList(0, 0, &benchmarkList, pRecorder);
+			}
+			auto benchEndTime = std::chrono::high_resolution_clock::now();
+			double averageMs = std::chrono::duration<double, std::milli>(benchEndTime - benchStartTime).count() / IterationCount;
+			if (threadCount == 0)
+			{
+				inlineMs = averageMs;
+			}
+
+			printf("recording %zu draws, %s%u threads: %.3f ms (x%.2f vs inline)\n",
+				benchmarkList.GetDrawCount(),
+				threadCount == 0 ? "inline, " : "",
+				threadCount,
+				averageMs,
+				inlineMs / averageMs);
+
+			if (pRecorder != nullptr)
+			{
+				benchmarkRecorder.Finalize();
+			}
+		}
+		cullReport = CullReport();
+	}
 
-			damagedHelmet.Update(imageIndex);
+	auto startTime = std::chrono::high_resolution_clock::now();
+	auto lastTime = startTime;
 
-			cube.Update(imageIndex);
-			
-			lightTest.Update(imageIndex);
-			testModel1.Update(imageIndex);
-			testModel2.Update(imageIndex);
+	// Headless: fixed camera, no acquire/present. Frames overlap like in the windowed loop, so a frame time is the interval
+	// between two frames leaving the CPU once the pipeline of frames in flight is full
+	if (options.isHeadless)
+	{
+		std::vector<bool> prepassModes = { options.isDepthPrepass };
+		if (options.isPrepassBenchmark)
+		{
+			prepassModes = { false, true };
 		}
+		std::vector<bool> deferredModes = { drawList.IsDeferred() };
+		if (options.isDeferredBenchmark && isDeferredAvailable)
+		{
+			deferredModes = { false, true };
+		}
+		std::vector<std::pair<bool, bool>> renderModes;
+		for (bool isDeferred : deferredModes)
+		{
+			// The deferred path ignores the pre-pass, once is enough
+			for (size_t i = 0; i < (isDeferred ? 1 : prepassModes.size()); i++)
+			{
+				renderModes.push_back({ isDeferred, prepassModes[i] });
+			}
+		}
+		for (const std::pair<bool, bool>& renderMode : renderModes)
+		{
+			drawList.SetDeferred(renderMode.first);
+			drawList.SetDepthPrepass(renderMode.second);
+			if (renderMode.first && options.isDeferredBenchmark)
+			{
+				printf("deferred\n");
+			}
+			else if (options.isPrepassBenchmark || options.isDeferredBenchmark)
+			{
+				printf("forward, depth pre-pass %s\n", renderMode.second ? "on" : "off");
+			}
+			std::vector<float> frameTimes;
+			frameTimes.reserve(options.headlessFrameCount);
+			auto frameStartTime = std::chrono::high_resolution_clock::now();
+			for (uint32_t frame = 0; frame < options.headlessFrameCount; frame++)
+			{
+				uint32_t frameIndex = frameContext.BeginFrame();
+				graphicSystem.GetDeletionQueue()->Collect();
+				uint32_t imageIndex = frame % swapChainCount;
+				frameContext.UseImage(imageIndex);
+
+				UpdateFrame(frameIndex, imageIndex);
+
+				frameContext.Submit(commandBuffer.GetCommandBuffer(frameIndex));
+				frameContext.EndFrame();
+
+				auto frameEndTime = std::chrono::high_resolution_clock::now();
+				frameTimes.push_back(std::chrono::duration<float, std::chrono::milliseconds::period>(frameEndTime - frameStartTime).count());
+				frameStartTime = frameEndTime;
+			}
+			graphicSystem.GetGraphicsTimeline()->Wait(graphicSystem.GetGraphicsTimeline()->GetSubmittedValue());
+			PrintFrameTimes(frameTimes);
+		}
+		cullReport.Print();
+		LightManager::GetInstance().PrintStats();
+		if (isGpuDriven)
+		{
+			gpuScene.PrintCullStats();
+		}
+	}
 
-		vkQueueSubmit(queues[0], 1, &submitInfo, imageFences[currentFrame % swapChainCount]);
+	auto cullReportTime = std::chrono::high_resolution_clock::now();
+	bool isPrepassKeyDown = false;
+	bool isDeferredKeyDown = false;
 
-		if (currentFrame > 0)
+	while (!options.isHeadless && !glfwWindowShouldClose(pWindow))
+	{
+		auto currentTime = std::chrono::high_resolution_clock::now();
+		float dTime = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - lastTime).count();
+
+		glfwPollEvents();
+		UpdateInpute(dTime);
+		if (keyMap[GLFW_KEY_P] && !isPrepassKeyDown)
+		{
+			drawList.SetDepthPrepass(!drawList.IsDepthPrepass());
+			printf("depth pre-pass %s\n", drawList.IsDepthPrepass() ? "on" : "off");
+		}
+		isPrepassKeyDown = keyMap[GLFW_KEY_P];
+		if (keyMap[GLFW_KEY_G] && !isDeferredKeyDown && isDeferredAvailable)
 		{
-			vkWaitForFences(device, 1, &imageFences[(currentFrame - 1) % swapChainCount], VK_TRUE, UINT64_MAX);
-			vkResetFences(device, 1, &imageFences[(currentFrame - 1) % swapChainCount]);
+			drawList.SetDeferred(!drawList.IsDeferred());
+			printf("%s shading\n", drawList.IsDeferred() ? "deferred" : "forward");
+		}
+		isDeferredKeyDown = keyMap[GLFW_KEY_G];
+		if (g_PickRequested)
+		{
+			g_PickRequested = false;
+			if (options.isPickDebug)
+			{
+				PickObject(sceneBvh, graphicSystem.GetCamera(), graphicSystem.GetSwapChainExtent(), sceneObjectModels);
+			}
 		}
 
-		VkPresentInfoKHR presentInfo = {};
-		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+		uint32_t frameIndex = frameContext.BeginFrame();
+		graphicSystem.GetDeletionQueue()->Collect();
+		uint32_t imageIndex = 0;
+		VkResult result = frameContext.AcquireImage(swapChain, &imageIndex);
+		if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+		{
+			lastTime = currentTime;
+			continue;
+		}
 
-		presentInfo.waitSemaphoreCount = 1;
-		presentInfo.pWaitSemaphores = signalSemaphores;
+		UpdateFrame(frameIndex, imageIndex);
 
-		VkSwapchainKHR swapChains[] = { swapChain };
-		presentInfo.swapchainCount = 1;
-		presentInfo.pSwapchains = swapChains;
-		presentInfo.pImageIndices = &imageIndex;
-		presentInfo.pResults = nullptr;
+		frameContext.Submit(commandBuffer.GetCommandBuffer(frameIndex));
+		frameContext.Present(queues[1], swapChain);
+		frameContext.EndFrame();
 
-		vkQueuePresentKHR(queues[1], &presentInfo);
+		if (std::chrono::duration<float>(currentTime - cullReportTime).count() >= 1.0f)
+		{
+			cullReport.Print();
+			cullReport = CullReport();
+			LightManager::GetInstance().PrintStats();
+			if (isGpuDriven)
+			{
+				gpuScene.PrintCullStats();
+			}
+			cullReportTime = currentTime;
+		}
 
-		currentFrame++;
 		lastTime = currentTime;
 	}
 
 	vkDeviceWaitIdle(device);
 
 
-	sponza.Finalize();
-	normalTangentTest.Finalize();
-	normalTangentMirrorTest.Finalize(); 
-	alphaBlendModeTest.Finalize();
-	boomBoxWithAxes.Finalize();
-	boomBox.Finalize();
-	test.Finalize();
-	kko.Finalize();
-	damagedHelmet.Finalize();
-	cube.Finalize();
-	lightTest.Finalize();
-	testModel1.Finalize();
-	testModel2.Finalize();
-
-	commandBuffer.Finalize();
-
-	for (VkSemaphore semaphore : imageAvailableSemaphores)
+	for (Model* pModel : models)
 	{
-		vkDestroySemaphore(device, semaphore, nullptr);
+		pModel->Finalize();
 	}
-	for (VkSemaphore semaphore : renderFinishedSemaphores)
-	{
-		vkDestroySemaphore(device, semaphore, nullptr);
-	}
-	for (VkFence fence : imageFences)
+
+	commandBuffer.Finalize();
+	if (options.recordThreadCount > 0)
 	{
-		vkDestroyFence(device, fence, nullptr);
+		parallelRecorder.Finalize();
 	}
 
+	frameContext.Finalize();
+	LightManager::GetInstance().SetSceneBvh(nullptr);
+	sceneBvh.Finalize();
+	gpuScene.Finalize();
+	deferredRenderer.Finalize();
+
 	for (VkFramebuffer framebuffer : swapChainFrameBuffers)
 	{
 		vkDestroyFramebuffer(device, framebuffer, nullptr);
 	}
 
+	LightManager::GetInstance().Finalize();
 	graphicSystem.Finalize();
 	TextureManager::GetInstance().Finalize();
 
-	DestroyWindow(pWindow);
+	if (!options.isHeadless)
+	{
+		DestroyWindow(pWindow);
+	}
 
 	return 0;
 }
\ No newline at end of file
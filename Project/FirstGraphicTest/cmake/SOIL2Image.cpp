@@ -0,0 +1,15 @@
+// SOIL2's image loading entry points without SOIL2.c, which also holds the OpenGL texture upload path.
+// stb_image here carries SOIL2's DDS, PVR and PKM extensions, so DDS cube maps and mip chains load as before.
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "SOIL2.h"
+
+unsigned char* SOIL_load_image_full(const char* filename, int* width, int* height, int* channels, int* faces, int* mipmaps, int* bit_depth, int force_channels)
+{
+	return stbi_load_full(filename, width, height, channels, faces, mipmaps, bit_depth, force_channels);
+}
+
+void SOIL_free_image_data(unsigned char* img_data)
+{
+	stbi_image_free(img_data);
+}